@@ -8,6 +8,9 @@ using namespace std;
 #define STB_IMAGE_IMPLEMENTATION
 #include <Buffer.hpp>
 #include <FrameBuffer.hpp>
+#include <GpuProfiler.hpp>
+#include <RenderGraph.hpp>
+#include <RenderTargetPool.hpp>
 #include <Texture.hpp>
 #include <debug.hpp>
 #include <glm/glm.hpp>
@@ -115,33 +118,13 @@ int main() {
     // uncomment this call to draw in wireframe polygons.
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-    int width = window.getSize().x;
-    int height = window.getSize().y;
-
-    FrameBuffer fbo(width, height);
-
-    Texture fboTexture(vec2(width, height),
-                       Texture::RGB,
-                       Texture::RGB,
-                       GL_FLOAT,
-                       0,
-                       Texture::Linear,
-                       Texture::Linear,
-                       Texture::Clamp,
-                       false);
-
-    fbo.attach(&fboTexture, GL_COLOR_ATTACHMENT0);
-
-    RenderBuffer rbo(width, height, GL_DEPTH24_STENCIL8);
-    fbo.attach(&rbo, GL_DEPTH_STENCIL_ATTACHMENT);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        cerr << "FBO is not complete!" << endl;
-        return 1;
-    }
-    FrameBuffer::getDefault().bind();
+    // Scene targets live for one frame and follow the window size
+    RenderTargetPool pool;
+    RenderGraph graph;
+    GpuProfiler profiler;
 
     sf::Clock clock;
+    sf::Clock statsClock;
 
     while (window.isOpen()) {
         sf::Event event;
@@ -150,6 +133,8 @@ int main() {
                 case sf::Event::KeyPressed:
                     if (event.key.code == sf::Keyboard::Escape)
                         window.close();
+                    else if (event.key.code == sf::Keyboard::G)
+                        graph.dump(cout);
                     break;
                 case sf::Event::Resized: {
                     sf::FloatRect visibleArea(0, 0, event.size.width,
@@ -165,20 +150,65 @@ int main() {
             }
         }
 
-        fbo.bind();
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        shader.bind();
-        texture.bind();
-        array.drawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
-
-        FrameBuffer::getDefault().bind();
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        screenShader.bind();
-        sst.setValue(clock.getElapsedTime().asSeconds());
-        fboTexture.bind();
-        quad.draw();
+        pool.beginFrame();
+        uvec2 size(window.getSize().x, window.getSize().y);
+
+        graph.clear();
+        RenderGraph::Handle screen =
+            graph.importFrameBuffer("screen", &FrameBuffer::getDefault());
+        RenderGraph::Handle sceneColor;
+
+        graph.addPass(
+            "scene",
+            [&](RenderGraph::Builder & builder) {
+                // 4 bytes per pixel with HDR range, a quarter of RGBA32F
+                // bandwidth
+                sceneColor = builder.create("sceneColor",
+                                            {size, Texture::R11G11B10F});
+                builder.create("sceneDepth",
+                               {size, Texture::Depth24Stencil8, 0, true},
+                               GL_DEPTH_STENCIL_ATTACHMENT);
+            },
+            [&](RenderGraph::Context &) {
+                auto zone = profiler.zone("scene");
+                glClear(GL_COLOR_BUFFER_BIT);
+
+                shader.bind();
+                texture.bind();
+                array.drawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
+            });
+
+        graph.addPass(
+            "post",
+            [&](RenderGraph::Builder & builder) {
+                builder.read(sceneColor);
+                builder.write(screen);
+            },
+            [&](RenderGraph::Context & context) {
+                auto zone = profiler.zone("post");
+                glClear(GL_COLOR_BUFFER_BIT);
+
+                screenShader.bind();
+                sst.setValue(clock.getElapsedTime().asSeconds());
+                context.getTexture(sceneColor).bind();
+                quad.draw();
+            });
+
+        profiler.beginFrame();
+        graph.execute(pool);
+        profiler.endFrame();
+
+        if (statsClock.getElapsedTime().asSeconds() >= 1) {
+            auto & stats = pool.getFrameStats();
+            string title = "Post Processing - "
+                           + to_string(stats.peakBytes / 1024)
+                           + " KiB peak transient";
+            for (auto & zone : profiler.getStats())
+                title += ", " + zone.name + " "
+                         + to_string(int(zone.average * 1000)) + " us";
+            window.setTitle(title);
+            statsClock.restart();
+        }
 
         window.display();
     }
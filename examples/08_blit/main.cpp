@@ -1,3 +1,5 @@
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 using namespace std;
 
@@ -8,7 +10,10 @@ using namespace std;
 #define STB_IMAGE_IMPLEMENTATION
 #include <Buffer.hpp>
 #include <FrameBuffer.hpp>
+#include <GpuProfiler.hpp>
+#include <Profiler.hpp>
 #include <Texture.hpp>
+#include <Trace.hpp>
 #include <debug.hpp>
 
 static const char * vertexShaderSource = R"(
@@ -89,13 +94,20 @@ int main() {
 
     FrameBuffer::getDefault().resize(width, height);
 
+    // Allocate in 256 pixel steps so dragging the window edge only moves
+    // the viewport instead of reallocating on every resize event
     FrameBuffer fbo(width, height);
+    fbo.setBucketSize(256);
 
-    RenderBuffer rbo(width, height, GL_DEPTH24_STENCIL8);
+    RenderBuffer rbo(fbo.getAllocatedWidth(),
+                     fbo.getAllocatedHeight(),
+                     GL_DEPTH24_STENCIL8);
 
     fbo.attach(&rbo, GL_DEPTH_STENCIL_ATTACHMENT);
 
-    RenderBuffer rbo2(width, height, GL_RGB8);
+    RenderBuffer rbo2(fbo.getAllocatedWidth(),
+                      fbo.getAllocatedHeight(),
+                      GL_RGB8);
     fbo.attach(&rbo2, GL_COLOR_ATTACHMENT0);
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
@@ -104,13 +116,49 @@ int main() {
     }
     FrameBuffer::getDefault().bind();
 
+    // P prints GPU zone timings, T starts and stops a trace written to
+    // trace.json
+    GpuProfiler profiler;
+    ChromeTrace trace;
+    // The CPU zones, added on the collector thread of CpuProfiler
+    ChromeTrace cpuTrace;
+    bool tracing = false;
+
     while (window.isOpen()) {
         sf::Event event;
         while (window.pollEvent(event)) {
             switch (event.type) {
                 case sf::Event::KeyPressed:
-                    if (event.key.code == sf::Keyboard::Escape)
+                    if (event.key.code == sf::Keyboard::Escape) {
                         window.close();
+                    }
+                    else if (event.key.code == sf::Keyboard::P) {
+                        cout << left << setw(12) << "zone" << right << setw(10)
+                             << "avg ms" << setw(10) << "p50" << setw(10)
+                             << "p95" << setw(10) << "p99" << endl;
+                        for (auto & zone : profiler.getStats())
+                            cout << left << setw(12)
+                                 << string(zone.depth * 2, ' ') + zone.name
+                                 << right << fixed << setprecision(3)
+                                 << setw(10) << zone.average << setw(10)
+                                 << zone.p50 << setw(10) << zone.p95
+                                 << setw(10) << zone.p99 << endl;
+                    }
+                    else if (event.key.code == sf::Keyboard::T) {
+                        tracing = !tracing;
+                        profiler.setTrace(tracing ? &trace : nullptr);
+                        CpuProfiler::get().setTrace(tracing ? &cpuTrace
+                                                            : nullptr);
+                        if (!tracing) {
+                            // Both profilers let go of their traces above
+                            trace.merge(cpuTrace);
+                            ofstream out("trace.json");
+                            trace.write(out);
+                            trace.clear();
+                            cpuTrace.clear();
+                            cout << "Wrote trace.json" << endl;
+                        }
+                    }
                     break;
                 case sf::Event::Resized: {
                     sf::FloatRect visibleArea(0, 0, event.size.width,
@@ -129,17 +177,32 @@ int main() {
             }
         }
 
-        fbo.bind();
-        glClear(GL_COLOR_BUFFER_BIT);
+        profiler.beginFrame();
+        profiler.begin("frame");
+
+        fbo.trim();
+        {
+            auto zone = profiler.zone("scene");
+            fbo.bind();
+            fbo.viewport();
+            glClear(GL_COLOR_BUFFER_BIT);
 
-        shader.bind();
-        texture.bind();
-        array.drawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
+            shader.bind();
+            texture.bind();
+            array.drawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
+        }
 
-        FrameBuffer::getDefault().bind();
-        glClear(GL_COLOR_BUFFER_BIT);
+        {
+            auto zone = profiler.zone("blit");
+            FrameBuffer::getDefault().bind();
+            FrameBuffer::getDefault().viewport();
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            FrameBuffer::getDefault().blit(fbo);
+        }
 
-        FrameBuffer::getDefault().blit(fbo);
+        profiler.end();
+        profiler.endFrame();
 
         window.display();
     }
@@ -1,3 +1,4 @@
+#include <iomanip>
 #include <iostream>
 using namespace std;
 
@@ -7,6 +8,8 @@ using namespace std;
 #include <Shader.hpp>
 #define STB_IMAGE_IMPLEMENTATION
 #include <Buffer.hpp>
+#include <Capture.hpp>
+#include <Profiler.hpp>
 #include <Texture.hpp>
 #include <Transform.hpp>
 #include <debug.hpp>
@@ -35,6 +38,21 @@ void main() {
     FragColor = texture(gTexture, FragTex);
 })";
 
+/// Print CPU frame times and zones, needs -DENABLE_PROFILER=ON.
+static void printProfile() {
+    CpuProfiler & profiler = CpuProfiler::get();
+    profiler.flush();
+
+    CpuProfiler::FrameStats frame = profiler.getFrameStats();
+    cout << fixed << setprecision(3) << "frames " << frame.frames << ", p50 "
+         << frame.p50 << " ms, p95 " << frame.p95 << " ms, p99 " << frame.p99
+         << " ms, max " << frame.max << " ms" << endl;
+
+    for (auto & zone : profiler.getZoneStats())
+        cout << "  " << left << setw(36) << zone.name << right << setw(10)
+             << zone.average << setw(10) << zone.p99 << " ms" << endl;
+}
+
 int main() {
     const sf::ContextSettings settings(24, 1, 8, 3, 0);
     sf::RenderWindow window(sf::VideoMode(800, 600),
@@ -54,6 +72,7 @@ int main() {
     }
 
     initDebug();
+    GL_CAPTURE_START(window.getSize().x, window.getSize().y);
 
     Shader shader(vertexShaderSource, fragmentShaderSource);
     Texture texture = Texture::fromPath("../../../examples/res/uv.png");
@@ -90,40 +109,60 @@ int main() {
     // uncomment this call to draw in wireframe polygons.
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    PROFILE_THREAD("main");
+
     while (window.isOpen()) {
-        sf::Event event;
-        while (window.pollEvent(event)) {
-            switch (event.type) {
-                case sf::Event::KeyPressed:
-                    if (event.key.code == sf::Keyboard::Escape)
+        {
+            PROFILE_ZONE("pollEvent");
+            sf::Event event;
+            while (window.pollEvent(event)) {
+                switch (event.type) {
+                    case sf::Event::KeyPressed:
+                        if (event.key.code == sf::Keyboard::Escape)
+                            window.close();
+                        else if (event.key.code == sf::Keyboard::P)
+                            printProfile();
+                        break;
+                    case sf::Event::Resized: {
+                        sf::FloatRect visibleArea(0, 0, event.size.width,
+                                                  event.size.height);
+                        window.setView(sf::View(visibleArea));
+                        GL_CAPTURE(Viewport, 0, 0, event.size.width,
+                                   event.size.height);
+                        glViewport(0, 0, event.size.width, event.size.height);
+                    } break;
+                    case sf::Event::Closed:
                         window.close();
-                    break;
-                case sf::Event::Resized: {
-                    sf::FloatRect visibleArea(0, 0, event.size.width,
-                                              event.size.height);
-                    window.setView(sf::View(visibleArea));
-                    glViewport(0, 0, event.size.width, event.size.height);
-                } break;
-                case sf::Event::Closed:
-                    window.close();
-                    break;
-                default:
-                    break;
+                        break;
+                    default:
+                        break;
+                }
             }
         }
 
-        model.rotateEuler({0, 0, 0.01});
+        glm::mat4 matrix;
+        {
+            PROFILE_ZONE("transform");
+            model.rotateEuler({0, 0, 0.01});
+            matrix = model.toMatrix();
+        }
 
+        GL_CAPTURE(Clear, GL_COLOR_BUFFER_BIT);
         glClear(GL_COLOR_BUFFER_BIT);
 
         shader.bind();
-        mvp.setMat4(model.toMatrix());
+        mvp.setMat4(matrix);
 
         texture.bind();
         // array.drawArrays(GL_TRIANGLES, 0, 3);
         array.drawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
 
-        window.display();
+        GL_CAPTURE_FRAME();
+        {
+            PROFILE_ZONE("display");
+            window.display();
+        }
+        PROFILE_FRAME();
     }
 
     window.close();
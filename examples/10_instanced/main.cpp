@@ -1,4 +1,6 @@
+#include <cmath>
 #include <iostream>
+#include <sstream>
 using namespace std;
 
 #include <GL/glew.h>
@@ -6,10 +8,18 @@ using namespace std;
 #include <SFML/Graphics.hpp>
 #include <Shader.hpp>
 #define STB_IMAGE_IMPLEMENTATION
+#include <Bounds.hpp>
+#include <BoundsBuffer.hpp>
 #include <Buffer.hpp>
+#include <Capture.hpp>
+#include <Frustum.hpp>
+#include <GLStatsOverlay.hpp>
+#include <JobSystem.hpp>
+#include <Profiler.hpp>
 #include <Texture.hpp>
 #include <debug.hpp>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 using namespace glm;
 
 static const char * vertexShaderSource = R"(
@@ -19,10 +29,10 @@ layout (location = 1) in vec2 aTex;
 layout (location = 2) in vec2 aOffset;
 out vec3 FragPos;
 out vec2 FragTex;
+uniform mat4 viewProjection;
 void main() {
     vec4 pos = vec4(aPos + vec3(aOffset, 0.0), 1.0);
-    pos /= 10.0;
-    gl_Position = pos;
+    gl_Position = viewProjection * pos;
     FragPos = pos.xyz;
     FragTex = aTex;
 })";
@@ -56,6 +66,7 @@ int main() {
     }
 
     initDebug();
+    GL_CAPTURE_START(window.getSize().x, window.getSize().y);
 
     Shader shader(vertexShaderSource, fragmentShaderSource);
     Texture texture = Texture::fromPath("../../../examples/res/uv.png");
@@ -76,15 +87,19 @@ int main() {
         0, 1, 2, // First Triangle
     };
 
-    vec2 translations[100];
-    int index = 0;
-    float offset = 0.1f;
-    for (int y = -10; y < 10; y += 2) {
-        for (int x = -10; x < 10; x += 2) {
-            vec2 translation;
-            translation.x = (float)x / 10.0f + offset;
-            translation.y = (float)y / 10.0f + offset;
-            translations[index++] = translation;
+    // A grid of 200x200 instances, far larger than the view, each with the
+    // bounds of the triangle moved to its offset
+    const int columns = 200;
+    vector<vec2> translations;
+    BoundsBuffer bounds;
+    AABB triangleBounds = AABB::fromPoints(vertices, 3);
+    for (int y = 0; y < columns; y++) {
+        for (int x = 0; x < columns; x++) {
+            vec2 translation((x - columns / 2) * 0.2f + 0.1f,
+                             (y - columns / 2) * 0.2f + 0.1f);
+            translations.push_back(translation);
+            bounds.add(triangleBounds.transformed(
+                translate(mat4(1), vec3(translation, 0))));
         }
     }
 
@@ -96,44 +111,110 @@ int main() {
     array.bind();
     array.bufferData(0, sizeof(vertices), vertices);
     array.bufferData(1, sizeof(texCoords), texCoords);
-    array.bufferData(2, sizeof(translations), translations);
+    array.bufferData(2, translations.size() * sizeof(vec2), nullptr,
+                     GL_STREAM_DRAW);
     array.bufferElements(sizeof(indices), indices);
     array.unbind();
 
     // uncomment this call to draw in wireframe polygons.
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    // O toggles the GL stats overlay, needs -DENABLE_GL_STATS=ON
+    GLStatsOverlay overlay;
+    bool showOverlay = true;
+
+    // Each frame the instances outside the view are culled and only the
+    // offsets of the visible ones uploaded
+    JobSystem jobs;
+    vector<uint32_t> visible;
+    vector<vec2> visibleTranslations(translations.size());
+    Shader::Uniform viewProjection = shader.uniform("viewProjection");
+    sf::Clock clock;
+    sf::Clock titleClock;
+
+    PROFILE_THREAD("main");
+
     while (window.isOpen()) {
-        sf::Event event;
-        while (window.pollEvent(event)) {
-            switch (event.type) {
-                case sf::Event::KeyPressed:
-                    if (event.key.code == sf::Keyboard::Escape)
+        {
+            PROFILE_ZONE("pollEvent");
+            sf::Event event;
+            while (window.pollEvent(event)) {
+                switch (event.type) {
+                    case sf::Event::KeyPressed:
+                        if (event.key.code == sf::Keyboard::Escape)
+                            window.close();
+                        else if (event.key.code == sf::Keyboard::O)
+                            showOverlay = !showOverlay;
+                        break;
+                    case sf::Event::Resized: {
+                        sf::FloatRect visibleArea(0, 0, event.size.width,
+                                                  event.size.height);
+                        window.setView(sf::View(visibleArea));
+                        GL_CAPTURE(Viewport, 0, 0, event.size.width,
+                                   event.size.height);
+                        glViewport(0, 0, event.size.width, event.size.height);
+                    } break;
+                    case sf::Event::Closed:
                         window.close();
-                    break;
-                case sf::Event::Resized: {
-                    sf::FloatRect visibleArea(0, 0, event.size.width,
-                                              event.size.height);
-                    window.setView(sf::View(visibleArea));
-                    glViewport(0, 0, event.size.width, event.size.height);
-                } break;
-                case sf::Event::Closed:
-                    window.close();
-                    break;
-                default:
-                    break;
+                        break;
+                    default:
+                        break;
+                }
             }
         }
 
+        GL_CAPTURE(Clear, GL_COLOR_BUFFER_BIT);
         glClear(GL_COLOR_BUFFER_BIT);
 
+        // Pan over the grid and zoom in and out
+        float t = clock.getElapsedTime().asSeconds();
+        vec2 center(sin(t * 0.3f) * 15, cos(t * 0.2f) * 15);
+        float aspect = float(window.getSize().x) / window.getSize().y;
+        vec2 extent(1, 1);
+        extent *= 2 + 6 * (0.5f + 0.5f * sin(t * 0.5f));
+        extent.x *= aspect;
+        mat4 matrix = ortho(center.x - extent.x, center.x + extent.x,
+                            center.y - extent.y, center.y + extent.y, -1.0f,
+                            1.0f);
+
+        BoundsBuffer::Stats culling;
+        {
+            PROFILE_ZONE("cull");
+            culling = bounds.cull(Frustum::fromMatrix(matrix), visible, jobs);
+            BoundsBuffer::gather(visible.data(), visible.size(),
+                                 translations.data(),
+                                 visibleTranslations.data());
+        }
+
         shader.bind();
+        viewProjection.setMat4(matrix);
 
         texture.bind();
-        // array.drawArraysInstanced(GL_TRIANGLES, 0, 3, 100);
-        array.drawElementsInstanced(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0, 100);
+        if (culling.visible > 0) {
+            array.bufferSubData(2, 0, culling.visible * sizeof(vec2),
+                                visibleTranslations.data());
+            array.drawElementsInstanced(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0,
+                                        GLsizei(culling.visible));
+        }
+
+        GLFrameStats stats = GLStats::get().endFrame();
+        if (showOverlay)
+            overlay.draw(stats, window.getSize().x, window.getSize().y);
 
-        window.display();
+        if (titleClock.getElapsedTime().asSeconds() >= 0.5f) {
+            ostringstream title;
+            title << "Instanced - " << culling.visible << " visible, "
+                  << culling.culled() << " culled";
+            window.setTitle(title.str());
+            titleClock.restart();
+        }
+
+        GL_CAPTURE_FRAME();
+        {
+            PROFILE_ZONE("display");
+            window.display();
+        }
+        PROFILE_FRAME();
     }
 
     window.close();
@@ -0,0 +1,186 @@
+#include <iomanip>
+#include <iostream>
+using namespace std;
+
+#include <GL/glew.h>
+
+#include <SFML/Graphics.hpp>
+#include <Shader.hpp>
+#define STB_IMAGE_IMPLEMENTATION
+#include <Buffer.hpp>
+#include <FrameBuffer.hpp>
+#include <Texture.hpp>
+#include <glm/glm.hpp>
+using namespace glm;
+
+static const char * fillVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+out vec2 FragPos;
+void main() {
+    gl_Position = vec4(aPos, 1.0);
+    FragPos = aPos.xy;
+})";
+
+static const char * fillFragmentShaderSource = R"(
+#version 330 core
+in vec2 FragPos;
+out vec4 FragColor;
+uniform float t;
+void main() {
+    FragColor = vec4(FragPos * 0.5 + 0.5, fract(t), 1.0);
+    gl_FragDepth = fract(t + FragPos.x * 0.25);
+})";
+
+static const char * readVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+out vec2 FragTex;
+void main() {
+    gl_Position = vec4(aPos, 1.0);
+    FragTex = aTex;
+})";
+
+static const char * readFragmentShaderSource = R"(
+#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+void main() {
+    FragColor = texture(gTexture, FragTex);
+})";
+
+struct FormatInfo {
+    const char * name;
+    Texture::Format format;
+    bool depth;
+};
+
+static const FormatInfo formats[] = {
+    {"RGBA8", Texture::RGBA8, false},
+    {"SRGB8_ALPHA8", Texture::SRGB8A8, false},
+    {"RGB10_A2", Texture::RGB10A2, false},
+    {"R11F_G11F_B10F", Texture::R11G11B10F, false},
+    {"RGBA16F", Texture::RGBA16F, false},
+    {"RGBA32F", Texture::RGBA32F, false},
+    {"DEPTH_COMPONENT24", Texture::Depth24, true},
+    {"DEPTH_COMPONENT32F", Texture::Depth32F, true},
+    {"DEPTH24_STENCIL8", Texture::Depth24Stencil8, true},
+};
+
+static const int iterations = 200;
+
+/// Run draw iterations times and return the GPU time in milliseconds.
+template <typename F>
+static double timeGpu(GLuint query, F draw) {
+    draw(); // warm up
+    glFinish();
+
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    for (int i = 0; i < iterations; i++)
+        draw();
+    glEndQuery(GL_TIME_ELAPSED);
+
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+    return ns / 1.0e6;
+}
+
+int main() {
+    const sf::ContextSettings settings(24, 1, 0, 4, 6);
+    sf::RenderWindow window(sf::VideoMode(1280, 720),
+                            "Format Bench",
+                            sf::Style::Default,
+                            settings);
+    window.setVerticalSyncEnabled(false);
+    window.setActive();
+
+    // glewExperimental = true;
+    GLenum err = glewInit();
+    if (err != GLEW_OK) {
+        cerr << "glewInit failed: " << glewGetErrorString(err);
+        return 1;
+    }
+
+    Shader fillShader(fillVertexShaderSource, fillFragmentShaderSource);
+    Shader::Uniform fillT = fillShader.uniform("t");
+    Shader readShader(readVertexShaderSource, readFragmentShaderSource);
+
+    Quad quad;
+
+    int width = window.getSize().x;
+    int height = window.getSize().y;
+    uvec2 size(width, height);
+
+    GLuint query;
+    glGenQueries(1, &query);
+
+    cout << "Target " << width << "x" << height << ", " << iterations
+         << " passes per measurement" << endl;
+    cout << left << setw(20) << "format" << right << setw(8) << "bytes"
+         << setw(12) << "fill GB/s" << setw(12) << "read GB/s" << endl;
+
+    for (auto & info : formats) {
+        cout << left << setw(20) << info.name << right;
+
+        if (!Texture::isRenderable(info.format)) {
+            cout << "  not renderable" << endl;
+            continue;
+        }
+
+        Texture target = Texture::renderTarget(size, info.format, 0,
+                                               Texture::Nearest);
+        FrameBuffer fbo(width, height);
+        if (info.depth) {
+            GLenum attachment = info.format == Texture::Depth24Stencil8
+                                    ? GL_DEPTH_STENCIL_ATTACHMENT
+                                    : GL_DEPTH_ATTACHMENT;
+            fbo.attach(&target, attachment);
+            glDrawBuffer(GL_NONE);
+        }
+        else {
+            fbo.attach(&target, GL_COLOR_ATTACHMENT0);
+        }
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            cout << "  incomplete" << endl;
+            continue;
+        }
+
+        double bytes = double(Texture::storageBytes(info.format, size))
+                       * iterations;
+
+        // Fill: write every pixel of the target
+        glViewport(0, 0, width, height);
+        if (info.depth) {
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(GL_ALWAYS);
+        }
+        fillShader.bind();
+        float t = 0;
+        double fillMs = timeGpu(query, [&]() {
+            fillT.setValue(t += 0.01f);
+            quad.draw();
+        });
+        glDisable(GL_DEPTH_TEST);
+
+        // Read: sample every pixel of the target into the window
+        FrameBuffer::getDefault().bind();
+        readShader.bind();
+        target.bind();
+        double readMs = timeGpu(query, [&]() { quad.draw(); });
+
+        cout << setw(8) << Texture::storageBytes(info.format, uvec2(1))
+             << fixed << setprecision(2) << setw(12)
+             << bytes / (fillMs * 1.0e6) << setw(12)
+             << bytes / (readMs * 1.0e6) << endl;
+
+        window.display();
+    }
+
+    glDeleteQueries(1, &query);
+    window.close();
+
+    return 0;
+}
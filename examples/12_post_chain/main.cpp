@@ -0,0 +1,176 @@
+#include <iostream>
+using namespace std;
+
+#include <GL/glew.h>
+
+#include <SFML/Graphics.hpp>
+#include <Shader.hpp>
+#define STB_IMAGE_IMPLEMENTATION
+#include <Buffer.hpp>
+#include <FrameBuffer.hpp>
+#include <PostChain.hpp>
+#include <RenderTargetPool.hpp>
+#include <Texture.hpp>
+#include <debug.hpp>
+#include <glm/glm.hpp>
+using namespace glm;
+
+static const char * vertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+out vec2 FragTex;
+void main() {
+    gl_Position = vec4(aPos, 1.0);
+    FragTex = aTex;
+})";
+
+// Brighter than 1 so bloom has something to pick up
+static const char * fragmentShaderSource = R"(
+#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+void main() {
+    FragColor = texture(gTexture, FragTex) * 3.0;
+})";
+
+int main() {
+    const sf::ContextSettings settings(24, 1, 0, 4, 6, sf::ContextSettings::Debug);
+    sf::RenderWindow window(sf::VideoMode(800, 600),
+                            "Post Chain",
+                            sf::Style::Default,
+                            settings);
+    window.setVerticalSyncEnabled(true);
+    window.setFramerateLimit(60);
+    window.setActive();
+    window.setKeyRepeatEnabled(false);
+
+    // glewExperimental = true;
+    GLenum err = glewInit();
+    if (err != GLEW_OK) {
+        cerr << "glewInit failed: " << glewGetErrorString(err);
+        return 1;
+    }
+
+    initDebug();
+
+    Shader shader(vertexShaderSource, fragmentShaderSource);
+    Texture texture = Texture::fromPath("../../../examples/res/uv.png");
+
+    const float vertices[] = {
+        -0.5f, -0.5f, 0.0f, // Bottom Left
+        0.5f,  -0.5f, 0.0f, // Bottom Right
+        0.0f,  0.5f,  0.0f // Top Center
+    };
+
+    const float texCoords[] = {
+        0.0f, 0.0f, // Bottom Left
+        1.0f, 0.0f, // Bottom Right
+        0.5f, 1.0f, // Top Center
+    };
+
+    const unsigned int indices[] = {
+        0, 1, 2, // First Triangle
+    };
+
+    Attribute a0 {0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0};
+    Attribute a1 {1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0};
+
+    BufferArray array(vector<vector<Attribute>> {{a0}, {a1}});
+    array.bind();
+    array.bufferData(0, sizeof(vertices), vertices);
+    array.bufferData(1, sizeof(texCoords), texCoords);
+    array.bufferElements(sizeof(indices), indices);
+    array.unbind();
+
+    RenderTargetPool pool;
+    PostChain chain;
+
+    // Keys 1-5 toggle the effects
+    bool enabled[5] = {true, true, false, true, false};
+    const char * names[5] = {"bloom", "distortion", "blur", "tonemap",
+                             "grayscale"};
+    bool rebuild = true;
+
+    FrameBuffer & screen = FrameBuffer::getDefault();
+    screen.resize(window.getSize().x, window.getSize().y);
+
+    sf::Clock clock;
+
+    while (window.isOpen()) {
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            switch (event.type) {
+                case sf::Event::KeyPressed:
+                    if (event.key.code == sf::Keyboard::Escape) {
+                        window.close();
+                    }
+                    else if (event.key.code >= sf::Keyboard::Num1
+                             && event.key.code <= sf::Keyboard::Num5) {
+                        int i = event.key.code - sf::Keyboard::Num1;
+                        enabled[i] = !enabled[i];
+                        rebuild = true;
+                    }
+                    break;
+                case sf::Event::Resized: {
+                    sf::FloatRect visibleArea(0, 0, event.size.width,
+                                              event.size.height);
+                    window.setView(sf::View(visibleArea));
+                    screen.resize(event.size.width, event.size.height);
+                } break;
+                case sf::Event::Closed:
+                    window.close();
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        if (rebuild) {
+            chain.clear();
+            if (enabled[0])
+                chain.bloom(1.0f, 0.6f);
+            if (enabled[1])
+                chain.distortion(0.02f, 8.0f);
+            if (enabled[2])
+                chain.blur(0.5f);
+            if (enabled[3])
+                chain.tonemap(1.0f);
+            if (enabled[4])
+                chain.grayscale();
+            chain.compile();
+
+            string title = "Post Chain -";
+            for (int i = 0; i < 5; i++) {
+                if (enabled[i])
+                    title += string(" ") + names[i];
+            }
+            window.setTitle(title + " (" + to_string(chain.getStageCount())
+                            + " passes)");
+            rebuild = false;
+        }
+
+        pool.beginFrame();
+        uvec2 size(window.getSize().x, window.getSize().y);
+
+        Texture * scene = pool.acquireTexture(size, Texture::RGBA16F);
+        FrameBuffer * sceneBuffer = pool.getFrameBuffer({{scene}});
+        sceneBuffer->bind();
+        sceneBuffer->viewport();
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        shader.bind();
+        texture.bind();
+        array.drawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
+
+        chain.apply(*scene, screen, pool, clock.getElapsedTime().asSeconds());
+        pool.release(scene);
+
+        window.display();
+    }
+
+    window.close();
+
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+using namespace std;
+
+#include <GL/glew.h>
+
+#include <SFML/Graphics.hpp>
+#include <Shader.hpp>
+#define STB_IMAGE_IMPLEMENTATION
+#include <Buffer.hpp>
+#include <DynamicResolution.hpp>
+#include <FrameBuffer.hpp>
+#include <Query.hpp>
+#include <Texture.hpp>
+#include <debug.hpp>
+#include <glm/glm.hpp>
+using namespace glm;
+
+static const char * vertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+out vec2 FragPos;
+void main() {
+    gl_Position = vec4(aPos, 1.0);
+    FragPos = aPos.xy;
+})";
+
+// A fractal with an adjustable iteration count as a stand in for a heavy
+// scene
+static const char * fragmentShaderSource = R"(
+#version 330 core
+in vec2 FragPos;
+out vec4 FragColor;
+uniform float t;
+uniform int iterations;
+void main() {
+    vec2 c = vec2(-0.8 + 0.1 * sin(t * 0.3), 0.156);
+    vec2 z = FragPos * vec2(1.6, 1.0);
+    int i = 0;
+    for (; i < iterations && dot(z, z) < 4.0; i++)
+        z = vec2(z.x * z.x - z.y * z.y, 2.0 * z.x * z.y) + c;
+    float v = float(i) / float(iterations);
+    FragColor = vec4(v, v * v, sqrt(v), 1.0);
+})";
+
+int main() {
+    const sf::ContextSettings settings(24, 1, 0, 4, 6, sf::ContextSettings::Debug);
+    sf::RenderWindow window(sf::VideoMode(1280, 720),
+                            "Dynamic Resolution",
+                            sf::Style::Default,
+                            settings);
+    // Uncapped so the GPU time is not hidden behind vsync
+    window.setVerticalSyncEnabled(false);
+    window.setActive();
+    window.setKeyRepeatEnabled(false);
+
+    // glewExperimental = true;
+    GLenum err = glewInit();
+    if (err != GLEW_OK) {
+        cerr << "glewInit failed: " << glewGetErrorString(err);
+        return 1;
+    }
+
+    initDebug();
+
+    Shader shader(vertexShaderSource, fragmentShaderSource);
+    Shader::Uniform st = shader.uniform("t");
+    Shader::Uniform sIterations = shader.uniform("iterations");
+
+    Quad quad;
+    Upscaler upscaler;
+
+    int width = window.getSize().x;
+    int height = window.getSize().y;
+
+    FrameBuffer & screen = FrameBuffer::getDefault();
+    screen.resize(width, height);
+
+    // Allocated for the full window, scale changes only move the viewport
+    FrameBuffer fbo(width, height);
+    fbo.setBucketSize(256);
+    Texture color = Texture::renderTarget(
+        uvec2(fbo.getAllocatedWidth(), fbo.getAllocatedHeight()),
+        Texture::RGBA8);
+    fbo.attach(&color, GL_COLOR_ATTACHMENT0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        cerr << "FBO is not complete!" << endl;
+        return 1;
+    }
+
+    GpuTimer timer;
+    DynamicResolution resolution(8.0);
+
+    // Up and Down change the load, S toggles the sharpening upscale
+    int iterations = 256;
+    bool sharpen = true;
+
+    sf::Clock clock;
+    sf::Clock titleClock;
+
+    while (window.isOpen()) {
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            switch (event.type) {
+                case sf::Event::KeyPressed:
+                    if (event.key.code == sf::Keyboard::Escape)
+                        window.close();
+                    else if (event.key.code == sf::Keyboard::Up)
+                        iterations *= 2;
+                    else if (event.key.code == sf::Keyboard::Down)
+                        iterations = std::max(iterations / 2, 16);
+                    else if (event.key.code == sf::Keyboard::S)
+                        sharpen = !sharpen;
+                    break;
+                case sf::Event::Resized: {
+                    sf::FloatRect visibleArea(0, 0, event.size.width,
+                                              event.size.height);
+                    window.setView(sf::View(visibleArea));
+                    width = event.size.width;
+                    height = event.size.height;
+                    screen.resize(width, height);
+                    // Grow the allocation to the full window once
+                    fbo.resize(width, height);
+                } break;
+                case sf::Event::Closed:
+                    window.close();
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        double gpuMs;
+        if (timer.poll(gpuMs))
+            resolution.update(gpuMs);
+
+        ivec2 size = resolution.getSize(width, height);
+        fbo.resize(size.x, size.y);
+
+        timer.begin();
+
+        fbo.bind();
+        fbo.viewport();
+        shader.bind();
+        st.setValue(clock.getElapsedTime().asSeconds());
+        sIterations.setValue(iterations);
+        quad.draw();
+
+        if (sharpen) {
+            upscaler.draw(fbo, color, screen);
+        }
+        else {
+            screen.bind();
+            screen.viewport();
+            screen.blit(fbo, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        }
+
+        timer.end();
+
+        if (titleClock.getElapsedTime().asSeconds() >= 0.5f) {
+            ostringstream title;
+            title << "Dynamic Resolution - " << size.x << "x" << size.y << " ("
+                  << int(resolution.getScale() * 100) << "%), " << fixed
+                  << setprecision(2) << resolution.getFrameTime() << " ms GPU, "
+                  << iterations << " iterations"
+                  << (sharpen ? ", sharpened" : ", bilinear");
+            window.setTitle(title.str());
+            titleClock.restart();
+        }
+
+        window.display();
+    }
+
+    window.close();
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <deque>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+
+#include <SFML/Graphics.hpp>
+#include <Shader.hpp>
+#define STB_IMAGE_IMPLEMENTATION
+#include <Atlas.hpp>
+#include <Buffer.hpp>
+#include <Texture.hpp>
+#include <debug.hpp>
+#include <glm/glm.hpp>
+using namespace glm;
+
+static const char * vertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTex;
+out vec2 FragTex;
+void main() {
+    gl_Position = vec4(aPos, 0.0, 1.0);
+    FragTex = aTex;
+})";
+
+static const char * fragmentShaderSource = R"(
+#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+void main() {
+    FragColor = texture(gTexture, FragTex);
+    if (FragColor.a < 0.5)
+        discard;
+})";
+
+/// A checkerboard or a disc of random size and colors.
+static vector<unsigned char> randomSprite(mt19937 & random, uvec2 & size) {
+    uniform_int_distribution<int> side(8, 64), channel(40, 255);
+    size = uvec2(side(random), side(random));
+    unsigned char a[4] = {(unsigned char)channel(random),
+                          (unsigned char)channel(random),
+                          (unsigned char)channel(random), 255};
+    unsigned char b[4] = {(unsigned char)(255 - a[0]),
+                          (unsigned char)(255 - a[1]),
+                          (unsigned char)(255 - a[2]), 255};
+    bool disc = random() % 2;
+
+    vector<unsigned char> pixels(size.x * size.y * 4);
+    for (unsigned y = 0; y < size.y; y++) {
+        for (unsigned x = 0; x < size.x; x++) {
+            const unsigned char * color = ((x / 4 + y / 4) % 2) ? a : b;
+            unsigned char * dst = &pixels[(y * size.x + x) * 4];
+            for (int c = 0; c < 4; c++)
+                dst[c] = color[c];
+            if (disc) {
+                vec2 p = (vec2(x, y) + 0.5f) / vec2(size) * 2.0f - 1.0f;
+                dst[3] = dot(p, p) <= 1 ? 255 : 0;
+            }
+        }
+    }
+    return pixels;
+}
+
+int main() {
+    const sf::ContextSettings settings(24, 1, 0, 3, 3, sf::ContextSettings::Debug);
+    sf::RenderWindow window(sf::VideoMode(1280, 720),
+                            "Atlas",
+                            sf::Style::Default,
+                            settings);
+    window.setVerticalSyncEnabled(true);
+    window.setFramerateLimit(60);
+    window.setActive();
+    window.setKeyRepeatEnabled(false);
+
+    // glewExperimental = true;
+    GLenum err = glewInit();
+    if (err != GLEW_OK) {
+        cerr << "glewInit failed: " << glewGetErrorString(err);
+        return 1;
+    }
+
+    initDebug();
+
+    Shader shader(vertexShaderSource, fragmentShaderSource);
+
+    // The whole atlas on the left, each packed image on its own quad on
+    // the right, drawn with one texture bind
+    TextureAtlas atlas(uvec2(1024, 1024));
+    atlas.insertPath("../../../examples/res/uv.png");
+    Quad atlasQuad(-0.95f, -0.9f, 1.0f, 1.8f);
+    deque<Quad> sprites;
+    vector<string> names;
+    mt19937 random(1);
+
+    // Space packs another batch of sprites, the mip chain is rebuilt once
+    // for the batch rather than once per sprite
+    auto addSprites = [&](int count) {
+        for (int i = 0; i < count; i++) {
+            uvec2 size;
+            vector<unsigned char> pixels = randomSprite(random, size);
+            string name = "sprite" + to_string(names.size());
+            try {
+                atlas.insert(name, pixels.data(), size, 4);
+            }
+            catch (const TextureAtlas::AtlasException &) {
+                break;
+            }
+            names.push_back(name);
+        }
+        atlas.generateMipmaps();
+
+        const int columns = 12;
+        float cell = 0.85f / columns;
+        sprites.clear();
+        for (size_t i = 0; i < names.size(); i++) {
+            const TextureAtlas::Region & region = atlas.get(names[i]);
+            vec2 size = vec2(region.size) / 64.0f * cell * 0.9f;
+            vec2 pos(0.1f + (i % columns) * cell,
+                     0.9f - cell * 16.0f / 9.0f * (i / columns + 1));
+            sprites.emplace_back(pos.x, pos.y, size.x, size.y * 16 / 9);
+            sprites.back().setTexRect(region.uvMin, region.uvMax);
+        }
+
+        ostringstream title;
+        title << "Atlas - " << atlas.getRegions().size() << " images";
+        window.setTitle(title.str());
+    };
+    addSprites(48);
+
+    while (window.isOpen()) {
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            switch (event.type) {
+                case sf::Event::KeyPressed:
+                    if (event.key.code == sf::Keyboard::Escape)
+                        window.close();
+                    else if (event.key.code == sf::Keyboard::Space)
+                        addSprites(12);
+                    break;
+                case sf::Event::Resized: {
+                    sf::FloatRect visibleArea(0, 0, event.size.width,
+                                              event.size.height);
+                    window.setView(sf::View(visibleArea));
+                    glViewport(0, 0, event.size.width, event.size.height);
+                } break;
+                case sf::Event::Closed:
+                    window.close();
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        glClearColor(0.1f, 0.1f, 0.1f, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        shader.bind();
+        atlas.getTexture().bind();
+        atlasQuad.draw();
+        for (auto & sprite : sprites)
+            sprite.draw();
+
+        window.display();
+    }
+
+    window.close();
+
+    return 0;
+}
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+// REMEMBER TO DEVINE STB_IMAGE_IMPLEMENTATION in main.cpp
+#include <stb_image.h>
+
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Texture.hpp"
+
+/**
+ * Skyline bottom-left rectangle packer.
+ *
+ * The skyline is the list of horizontal segments forming the top edge of
+ * everything packed so far. Each insert picks the spot where the new
+ * rectangle ends up lowest, so earlier placements never move.
+ */
+class AtlasPacker {
+    struct Segment {
+        int x, y, width;
+    };
+
+    glm::ivec2 size;
+    std::vector<Segment> skyline;
+
+public:
+    AtlasPacker(const glm::uvec2 & size)
+        : size(size), skyline {{0, 0, static_cast<int>(size.x)}} {}
+
+    const glm::ivec2 & getSize() const {
+        return size;
+    }
+
+    void clear() {
+        skyline.assign(1, Segment {0, 0, size.x});
+    }
+
+    /**
+     * Find a position for a rectangle and reserve it.
+     *
+     * @param rect the rectangle dimensions in pixels
+     * @param pos set to the bottom left corner of the placed rectangle
+     *
+     * @return false if the rectangle does not fit
+     */
+    bool insert(const glm::uvec2 & rect, glm::uvec2 & pos) {
+        int w = rect.x, h = rect.y;
+        size_t best = skyline.size();
+        int bestY = 0, bestTop = 0, bestWidth = 0;
+
+        for (size_t i = 0; i < skyline.size(); i++) {
+            int y;
+            if (!fits(i, w, h, y))
+                continue;
+
+            int top = y + h;
+            if (best == skyline.size() || top < bestTop
+                || (top == bestTop && skyline[i].width < bestWidth)) {
+                best = i;
+                bestY = y;
+                bestTop = top;
+                bestWidth = skyline[i].width;
+            }
+        }
+
+        if (best == skyline.size())
+            return false;
+
+        pos = glm::uvec2(skyline[best].x, bestY);
+        addLevel(best, skyline[best].x, bestY, w, h);
+        return true;
+    }
+
+private:
+    bool fits(size_t index, int w, int h, int & y) const {
+        if (skyline[index].x + w > size.x)
+            return false;
+
+        y = skyline[index].y;
+        int remaining = w;
+        for (size_t i = index; remaining > 0; i++) {
+            y = std::max(y, skyline[i].y);
+            if (y + h > size.y)
+                return false;
+            remaining -= skyline[i].width;
+        }
+        return true;
+    }
+
+    void addLevel(size_t index, int x, int y, int w, int h) {
+        skyline.insert(skyline.begin() + index, Segment {x, y + h, w});
+
+        // Trim the segments now covered by the new one
+        for (size_t i = index + 1; i < skyline.size();) {
+            const Segment & prev = skyline[i - 1];
+            int overlap = prev.x + prev.width - skyline[i].x;
+            if (overlap <= 0)
+                break;
+
+            skyline[i].x += overlap;
+            skyline[i].width -= overlap;
+            if (skyline[i].width > 0)
+                break;
+            skyline.erase(skyline.begin() + i);
+        }
+
+        // Merge neighbours at the same height
+        for (size_t i = 0; i + 1 < skyline.size();) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+            }
+            else {
+                i++;
+            }
+        }
+    }
+};
+
+/**
+ * Many small images packed into a single RGBA Texture, so everything
+ * drawn from the atlas shares one bind. Inserted images only reach the
+ * mip levels once generateMipmaps() is called.
+ */
+class TextureAtlas {
+public:
+    /// Placement of an image inside the atlas.
+    struct Region {
+        glm::uvec2 pos;
+        glm::uvec2 size;
+        glm::vec2 uvMin;
+        glm::vec2 uvMax;
+
+        /// Map a texture coordinate of the source image into the atlas.
+        glm::vec2 remap(const glm::vec2 & uv) const {
+            return uvMin + uv * (uvMax - uvMin);
+        }
+    };
+
+    struct Image {
+        std::string name;
+        const unsigned char * data;
+        glm::uvec2 size;
+        size_t nrComponents;
+    };
+
+private:
+    AtlasPacker packer;
+    unsigned padding;
+    unsigned alignment;
+    std::vector<unsigned char> pixels;
+    Texture texture;
+    std::unordered_map<std::string, Region> regions;
+    // Regions uploaded since the mip chain was last generated
+    bool dirty;
+
+public:
+    /**
+     * Create an empty atlas.
+     *
+     * Each image is surrounded by padding pixels copied from its edges and
+     * placed on an alignment boundary, so filtering and the first mip
+     * levels don't bleed neighbouring images in.
+     *
+     * @param size the atlas dimensions in pixels
+     * @param padding the border around each image in pixels
+     * @param alignment the placement granularity in pixels
+     * @param mipmaps should mipmaps be generated
+     */
+    TextureAtlas(const glm::uvec2 & size,
+                 unsigned padding = 2,
+                 unsigned alignment = 4,
+                 bool mipmaps = true)
+        : packer(size),
+          padding(padding),
+          alignment(std::max(alignment, 1u)),
+          pixels(size.x * size.y * 4, 0),
+          texture(pixels.data(),
+                  size,
+                  4,
+                  Texture::Linear,
+                  mipmaps ? Texture::LinearMmLinear : Texture::Linear,
+                  Texture::Clamp,
+                  mipmaps),
+          dirty(false) {}
+
+    const Texture & getTexture() const {
+        return texture;
+    }
+
+    const std::unordered_map<std::string, Region> & getRegions() const {
+        return regions;
+    }
+
+    bool contains(const std::string & name) const {
+        return regions.count(name) > 0;
+    }
+
+    /**
+     * Get the region of a packed image.
+     *
+     * @throws AtlasException if no image has that name
+     */
+    const Region & get(const std::string & name) const {
+        auto it = regions.find(name);
+        if (it == regions.end())
+            throw AtlasException("No region named " + name);
+        return it->second;
+    }
+
+    /**
+     * Pack an image into the atlas and upload only its region. Existing
+     * regions never move, so UVs handed out earlier stay valid. Call
+     * generateMipmaps() once after a batch of inserts, before drawing.
+     *
+     * Gray images are expanded to opaque gray RGBA.
+     *
+     * @param name the lookup name of the image
+     * @param data the pixel data
+     * @param size the image dimensions in pixels
+     * @param nrComponents the number of components for each pixel
+     *
+     * @throws AtlasException if the name is taken or the atlas is full
+     * @throws Texture::TextureLoadException for unsupported nrComponents
+     */
+    const Region & insert(const std::string & name,
+                          const unsigned char * data,
+                          const glm::uvec2 & size,
+                          size_t nrComponents) {
+        glm::uvec2 pos, padded;
+        const Region & region =
+            place(name, data, size, nrComponents, pos, padded);
+
+        unsigned width = texture.getSize().x;
+        texture.loadSubImage(&pixels[(pos.y * width + pos.x) * 4], pos, padded,
+                             4, width);
+        dirty = true;
+        return region;
+    }
+
+    /// Rebuild the mip chain if images were inserted since the last call.
+    void generateMipmaps() {
+        if (dirty) {
+            texture.generateMipmaps();
+            dirty = false;
+        }
+    }
+
+    /**
+     * Load an image from a file and insert it using the path as name.
+     *
+     * @throws Texture::TextureLoadException if the file can't be loaded
+     * @throws AtlasException if the atlas is full
+     */
+    const Region & insertPath(const std::string & path) {
+        int x, y, n;
+        std::unique_ptr<unsigned char, void (*)(void *)> data(
+            stbi_load(path.c_str(), &x, &y, &n, 0), stbi_image_free);
+        if (!data)
+            throw Texture::TextureLoadException("Failed to load image from file");
+        return insert(path, data.get(), glm::uvec2(x, y), n);
+    }
+
+    /**
+     * Remap an array of texture coordinates from the source image into the
+     * atlas in place.
+     *
+     * @param name the packed image the coordinates refer to
+     * @param uvs interleaved u, v pairs
+     * @param count the number of pairs
+     */
+    void remapUVs(const std::string & name, float * uvs, size_t count) const {
+        const Region & region = get(name);
+        for (size_t i = 0; i < count; i++) {
+            glm::vec2 uv = region.remap(glm::vec2(uvs[i * 2], uvs[i * 2 + 1]));
+            uvs[i * 2] = uv.x;
+            uvs[i * 2 + 1] = uv.y;
+        }
+    }
+
+    /**
+     * Build an atlas from a known set of images. Images are packed tallest
+     * first, which wastes less space than inserting in arbitrary order, and
+     * the texture is uploaded once at the end.
+     *
+     * @throws AtlasException if the images don't fit
+     */
+    static TextureAtlas build(std::vector<Image> images,
+                              const glm::uvec2 & size,
+                              unsigned padding = 2,
+                              unsigned alignment = 4,
+                              bool mipmaps = true) {
+        std::sort(images.begin(), images.end(),
+                  [](const Image & a, const Image & b) {
+                      if (a.size.y != b.size.y)
+                          return a.size.y > b.size.y;
+                      return a.size.x > b.size.x;
+                  });
+
+        TextureAtlas atlas(size, padding, alignment, mipmaps);
+        for (auto & image : images) {
+            glm::uvec2 pos, padded;
+            atlas.place(image.name, image.data, image.size,
+                        image.nrComponents, pos, padded);
+        }
+        atlas.texture.loadSubImage(atlas.pixels.data(), glm::uvec2(0, 0),
+                                   size, 4);
+        atlas.texture.generateMipmaps();
+        return atlas;
+    }
+
+    /**
+     * Build an atlas from image files, using each path as region name.
+     *
+     * @throws Texture::TextureLoadException if a file can't be loaded
+     * @throws AtlasException if the images don't fit
+     */
+    static TextureAtlas fromPaths(const std::vector<std::string> & paths,
+                                  const glm::uvec2 & size,
+                                  unsigned padding = 2,
+                                  unsigned alignment = 4,
+                                  bool mipmaps = true) {
+        std::vector<std::unique_ptr<unsigned char, void (*)(void *)>> data;
+        std::vector<Image> images;
+        for (auto & path : paths) {
+            int x, y, n;
+            data.emplace_back(stbi_load(path.c_str(), &x, &y, &n, 0),
+                              stbi_image_free);
+            if (!data.back())
+                throw Texture::TextureLoadException(
+                    "Failed to load image from file");
+            images.push_back(
+                Image {path, data.back().get(), glm::uvec2(x, y), size_t(n)});
+        }
+        return build(std::move(images), size, padding, alignment, mipmaps);
+    }
+
+    class AtlasException : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+private:
+    unsigned alignUp(unsigned value) const {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    const Region & place(const std::string & name,
+                         const unsigned char * data,
+                         const glm::uvec2 & size,
+                         size_t nrComponents,
+                         glm::uvec2 & pos,
+                         glm::uvec2 & padded) {
+        if (nrComponents != 1 && nrComponents != 3 && nrComponents != 4)
+            throw Texture::TextureLoadException(
+                "Unsupported number of components");
+        if (size.x == 0 || size.y == 0)
+            throw AtlasException("Empty image " + name);
+        if (regions.count(name))
+            throw AtlasException("Region already exists " + name);
+
+        padded = glm::uvec2(alignUp(size.x + 2 * padding),
+                            alignUp(size.y + 2 * padding));
+        if (!packer.insert(padded, pos))
+            throw AtlasException("Atlas is full");
+
+        // Copy the image, extruding its edge pixels into the padding
+        unsigned width = texture.getSize().x;
+        for (unsigned y = 0; y < padded.y; y++) {
+            int sy = std::min(std::max(int(y) - int(padding), 0),
+                              int(size.y) - 1);
+            unsigned char * row = &pixels[((pos.y + y) * width + pos.x) * 4];
+            for (unsigned x = 0; x < padded.x; x++) {
+                int sx = std::min(std::max(int(x) - int(padding), 0),
+                                  int(size.x) - 1);
+                const unsigned char * src =
+                    data + (size_t(sy) * size.x + sx) * nrComponents;
+                unsigned char * dst = row + x * 4;
+                if (nrComponents == 1) {
+                    dst[0] = dst[1] = dst[2] = src[0];
+                    dst[3] = 255;
+                }
+                else {
+                    dst[0] = src[0];
+                    dst[1] = src[1];
+                    dst[2] = src[2];
+                    dst[3] = nrComponents == 4 ? src[3] : 255;
+                }
+            }
+        }
+
+        glm::vec2 atlasSize(texture.getSize());
+        glm::uvec2 inner = pos + glm::uvec2(padding);
+
+        Region region;
+        region.pos = inner;
+        region.size = size;
+        region.uvMin = glm::vec2(inner) / atlasSize;
+        region.uvMax = glm::vec2(inner + size) / atlasSize;
+        return regions.emplace(name, region).first->second;
+    }
+};
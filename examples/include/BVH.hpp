@@ -0,0 +1,852 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Bounds.hpp"
+#include "Frustum.hpp"
+#include "JobSystem.hpp"
+#include "Profiler.hpp"
+
+/**
+ * A bounding volume hierarchy over the world bounds of many moving objects,
+ * for frustum, box and ray queries.
+ *
+ * The nodes are one flat array of 32 bytes each, the two children of a
+ * node side by side so a query tests both from one cache line. Leaves keep
+ * copies of the bounds of their objects in leaf order, so a query reads
+ * those in sequence too.
+ *
+ * update() marks an object moved and refit() grows and shrinks the nodes
+ * above the moved objects only. The shape of the tree stays, so it gets
+ * worse as objects move apart: rebuild() builds a new one with the surface
+ * area heuristic, and startRebuild() does that on a JobSystem worker from a
+ * copy of the bounds, swapped in by finishRebuild(). maintain() does all of
+ * that once a frame. Objects inserted after a build wait in a list that
+ * queries test one by one, until the next. An object inserted with the id
+ * of a removed one takes over its leaf, refit at once.
+ */
+class BVH {
+public:
+    static constexpr uint32_t none = ~uint32_t(0);
+
+    /// A node, a leaf if count is not 0.
+    struct Node {
+        AABB bounds;
+        /// The left child, the right one is first + 1, or of a leaf the
+        /// first of its objects in getObjects()
+        uint32_t first = 0;
+        uint32_t count = 0;
+
+        bool leaf() const {
+            return count > 0;
+        }
+    };
+
+    /// The closest object a ray enters, at origin + distance * direction.
+    struct Hit {
+        uint32_t object = none;
+        float distance = std::numeric_limits<float>::infinity();
+    };
+
+private:
+    struct Tree {
+        std::vector<Node> nodes;
+        std::vector<uint32_t> parents;
+        /// The objects of the leaves, and their bounds as of the last refit
+        std::vector<uint32_t> objects;
+        std::vector<AABB> boxes;
+        /// The leaf of each object that was in the build, or none
+        std::vector<uint32_t> leaves;
+    };
+
+    struct Rebuild {
+        std::vector<AABB> bounds;
+        Tree tree;
+        JobCounter counter;
+        JobSystem * jobs = nullptr;
+    };
+
+    /// Splits a node is tried at on each axis.
+    static constexpr size_t binCount = 16;
+    /// Below this depth splits fall back to the median, to bound the depth
+    /// of the stacks of queries.
+    static constexpr uint32_t maxSahDepth = 30;
+    static constexpr size_t stackSize = 64;
+
+    size_t maxLeafSize;
+    size_t rebuildInterval;
+    size_t framesSinceBuild = 0;
+
+    Tree tree;
+
+    // By object
+    std::vector<AABB> bounds;
+    std::vector<uint8_t> alive;
+    std::vector<uint8_t> dirtyFlags;
+    std::vector<uint32_t> pendingSlots;
+
+    std::vector<uint32_t> freeObjects;
+    std::vector<uint32_t> pending;
+    std::vector<uint32_t> dirty;
+    size_t count = 0;
+
+    std::unique_ptr<Rebuild> rebuilding;
+
+public:
+    /**
+     * @param maxLeafSize the most objects of a leaf, unless they can't be
+     * told apart
+     * @param rebuildInterval frames between the rebuilds of maintain()
+     */
+    explicit BVH(size_t maxLeafSize = 4, size_t rebuildInterval = 60)
+        : maxLeafSize(std::max<size_t>(1, maxLeafSize)),
+          rebuildInterval(rebuildInterval) {}
+
+    ~BVH() {
+        waitForRebuild();
+    }
+
+    BVH(BVH && other) = default;
+
+    BVH & operator=(BVH && other) {
+        waitForRebuild();
+        maxLeafSize = other.maxLeafSize;
+        rebuildInterval = other.rebuildInterval;
+        framesSinceBuild = other.framesSinceBuild;
+        tree = std::move(other.tree);
+        bounds = std::move(other.bounds);
+        alive = std::move(other.alive);
+        dirtyFlags = std::move(other.dirtyFlags);
+        pendingSlots = std::move(other.pendingSlots);
+        freeObjects = std::move(other.freeObjects);
+        pending = std::move(other.pending);
+        dirty = std::move(other.dirty);
+        count = other.count;
+        rebuilding = std::move(other.rebuilding);
+        return *this;
+    }
+
+    BVH(const BVH &) = delete;
+    BVH & operator=(const BVH &) = delete;
+
+    /**
+     * Add an object, queries find it from now on.
+     *
+     * @return its id, the ids of removed objects are reused
+     */
+    uint32_t insert(const AABB & box) {
+        uint32_t object;
+        if (!freeObjects.empty()) {
+            object = freeObjects.back();
+            freeObjects.pop_back();
+        }
+        else {
+            object = uint32_t(bounds.size());
+            bounds.emplace_back();
+            alive.push_back(0);
+            dirtyFlags.push_back(0);
+            pendingSlots.push_back(none);
+        }
+        bounds[object] = box;
+        alive[object] = 1;
+        count++;
+        // The id of a removed object can still have a leaf, refit it so
+        // queries find the object there from now on
+        if (inTree(object))
+            refitLeaf(tree.leaves[object]);
+        else
+            addPending(object);
+        return object;
+    }
+
+    /// The world box of bounds, as last updated from its Transform.
+    uint32_t insert(const Bounds & bounds) {
+        return insert(bounds.world);
+    }
+
+    /// Remove an object, throws std::out_of_range if there is none.
+    void remove(uint32_t object) {
+        check(object);
+        bounds[object] = AABB();
+        alive[object] = 0;
+        count--;
+        if (pendingSlots[object] != none)
+            removePending(object);
+        else if (inTree(object))
+            markDirty(object);
+        freeObjects.push_back(object);
+    }
+
+    /**
+     * Move an object, its nodes grow or shrink to it in the next refit().
+     * Until then queries test its new box, where its nodes still reach.
+     * Throws std::out_of_range if there is none.
+     */
+    void update(uint32_t object, const AABB & box) {
+        check(object);
+        bounds[object] = box;
+        if (inTree(object)) {
+            setLeafBox(object);
+            markDirty(object);
+        }
+    }
+
+    void update(uint32_t object, const Bounds & bounds) {
+        update(object, bounds.world);
+    }
+
+    bool contains(uint32_t object) const {
+        return object < alive.size() && alive[object];
+    }
+
+    const AABB & getBounds(uint32_t object) const {
+        check(object);
+        return bounds[object];
+    }
+
+    /// Objects inserted and not removed.
+    size_t size() const {
+        return count;
+    }
+
+    const std::vector<Node> & getNodes() const {
+        return tree.nodes;
+    }
+
+    /// The objects of the leaves, in leaf order.
+    const std::vector<uint32_t> & getObjects() const {
+        return tree.objects;
+    }
+
+    /// Objects inserted since the last build, tested one by one.
+    size_t getPendingCount() const {
+        return pending.size();
+    }
+
+    /**
+     * The expected cost of a query by the surface area heuristic, the area
+     * of each inner node plus the area of each leaf times its objects,
+     * relative to the root. Lower is better, it grows as objects move.
+     */
+    float getCost() const {
+        if (tree.nodes.empty())
+            return 0;
+        float root = area(tree.nodes[0].bounds);
+        if (root <= 0)
+            return float(tree.nodes[0].count);
+        float cost = 0;
+        for (auto & node : tree.nodes)
+            cost += area(node.bounds) * (node.leaf() ? node.count : 1);
+        return cost / root;
+    }
+
+    /// Grow and shrink the nodes above the objects moved since the last
+    /// refit, or all nodes if many moved.
+    void refit() {
+        PROFILE_ZONE("BVH::refit");
+        if (dirty.size() > tree.nodes.size() / 8) {
+            refitAll();
+        }
+        else {
+            for (uint32_t object : dirty)
+                refitLeaf(tree.leaves[object]);
+        }
+        for (uint32_t object : dirty)
+            dirtyFlags[object] = 0;
+        dirty.clear();
+    }
+
+    /// Build the tree again from the current bounds on the calling thread.
+    void rebuild() {
+        PROFILE_ZONE("BVH::rebuild");
+        waitForRebuild();
+        rebuilding.reset();
+        swapIn(build(bounds, maxLeafSize));
+    }
+
+    /**
+     * Build a new tree from a copy of the current bounds on a worker of
+     * jobs, unless one is being built. The tree in use keeps working until
+     * finishRebuild(). With one thread it builds before returning.
+     */
+    void startRebuild(JobSystem & jobs) {
+        if (rebuilding)
+            return;
+        framesSinceBuild = 0;
+        if (jobs.getThreadCount() == 1) {
+            rebuild();
+            return;
+        }
+        rebuilding.reset(new Rebuild());
+        rebuilding->bounds = bounds;
+        rebuilding->jobs = &jobs;
+        Rebuild * rebuild = rebuilding.get();
+        size_t leafSize = maxLeafSize;
+        jobs.run(
+            [rebuild, leafSize] {
+                PROFILE_ZONE("BVH::rebuild");
+                rebuild->tree = build(rebuild->bounds, leafSize);
+            },
+            &rebuild->counter);
+    }
+
+    bool isRebuilding() const {
+        return rebuilding != nullptr;
+    }
+
+    /**
+     * Swap in the tree of startRebuild() if it is built, refit to the
+     * objects moved since it started.
+     *
+     * @param wait wait for the build instead of returning false
+     * @return if the tree was swapped
+     */
+    bool finishRebuild(bool wait = false) {
+        if (!rebuilding)
+            return false;
+        if (wait)
+            rebuilding->jobs->wait(rebuilding->counter);
+        if (!rebuilding->counter.done())
+            return false;
+        PROFILE_ZONE("BVH::finishRebuild");
+        std::unique_ptr<Rebuild> rebuild = std::move(rebuilding);
+        swapIn(std::move(rebuild->tree));
+        return true;
+    }
+
+    /**
+     * Once a frame: swap in a finished rebuild, refit, and start a rebuild
+     * every rebuildInterval frames, or sooner if many objects wait outside
+     * the tree. The first tree is built before returning, queries would
+     * test every object until then.
+     */
+    void maintain(JobSystem & jobs) {
+        if (tree.nodes.empty() && !pending.empty() && !rebuilding) {
+            rebuild();
+            framesSinceBuild = 0;
+            return;
+        }
+        finishRebuild();
+        refit();
+        framesSinceBuild++;
+        bool crowded = pending.size() > std::max<size_t>(64, count / 16);
+        if (!rebuilding && (framesSinceBuild >= rebuildInterval || crowded))
+            startRebuild(jobs);
+    }
+
+    /// Call function(object) for each object whose bounds overlap box.
+    template <typename Function>
+    void query(const AABB & box, Function function) const {
+        PROFILE_ZONE("BVH::query");
+        if (!tree.nodes.empty() && tree.nodes[0].bounds.overlaps(box)) {
+            std::array<uint32_t, stackSize> stack;
+            size_t top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                const Node & node = tree.nodes[stack[--top]];
+                if (node.leaf()) {
+                    for (uint32_t i = node.first; i < node.first + node.count;
+                         i++) {
+                        // Removed objects stay in their leaf until a refit
+                        if (alive[tree.objects[i]]
+                            && tree.boxes[i].overlaps(box))
+                            function(tree.objects[i]);
+                    }
+                    continue;
+                }
+                for (uint32_t child = node.first; child < node.first + 2;
+                     child++) {
+                    if (tree.nodes[child].bounds.overlaps(box))
+                        stack[top++] = child;
+                }
+            }
+        }
+        for (uint32_t object : pending) {
+            if (bounds[object].overlaps(box))
+                function(object);
+        }
+    }
+
+    /**
+     * Call function(object) for each object whose bounds intersect
+     * frustum, as Frustum::intersects(). The planes a node is fully inside
+     * are not tested again below it, and nodes inside all of them report
+     * their objects without tests.
+     */
+    template <typename Function>
+    void query(const Frustum & frustum, Function function) const {
+        PROFILE_ZONE("BVH::query");
+        struct Entry {
+            uint32_t node;
+            uint32_t planes;
+        };
+        if (!tree.nodes.empty()) {
+            std::array<Entry, stackSize> stack;
+            size_t top = 0;
+            stack[top++] = {0, 0x3f};
+            while (top > 0) {
+                Entry entry = stack[--top];
+                const Node & node = tree.nodes[entry.node];
+                uint32_t planes = entry.planes;
+                if (!cull(frustum, node.bounds, planes))
+                    continue;
+                if (!node.leaf()) {
+                    stack[top++] = {node.first + 1, planes};
+                    stack[top++] = {node.first, planes};
+                    continue;
+                }
+                for (uint32_t i = node.first; i < node.first + node.count;
+                     i++) {
+                    uint32_t objectPlanes = planes;
+                    if (alive[tree.objects[i]]
+                        && cull(frustum, tree.boxes[i], objectPlanes))
+                        function(tree.objects[i]);
+                }
+            }
+        }
+        for (uint32_t object : pending) {
+            if (frustum.intersects(bounds[object]))
+                function(object);
+        }
+    }
+
+    /**
+     * The closest object whose bounds the ray from origin along direction
+     * enters before maxDistance, 0 if it starts inside. Distances are in
+     * lengths of direction. Children are visited nearest first and skipped
+     * past the closest hit so far.
+     *
+     * @return if there is one
+     */
+    bool raycast(const glm::vec3 & origin,
+                 const glm::vec3 & direction,
+                 Hit & hit,
+                 float maxDistance = std::numeric_limits<float>::infinity())
+        const {
+        PROFILE_ZONE("BVH::raycast");
+        glm::vec3 inverse(1 / direction.x, 1 / direction.y, 1 / direction.z);
+        hit = Hit();
+        hit.distance = maxDistance;
+        float distance;
+
+        if (!tree.nodes.empty()
+            && intersect(tree.nodes[0].bounds, origin, inverse, hit.distance,
+                         distance)) {
+            std::array<uint32_t, stackSize> stack;
+            size_t top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                const Node & node = tree.nodes[stack[--top]];
+                if (node.leaf()) {
+                    for (uint32_t i = node.first; i < node.first + node.count;
+                         i++) {
+                        if (alive[tree.objects[i]]
+                            && intersect(tree.boxes[i], origin, inverse,
+                                         hit.distance, distance)) {
+                            hit.object = tree.objects[i];
+                            hit.distance = distance;
+                        }
+                    }
+                    continue;
+                }
+
+                float leftDistance, rightDistance;
+                bool left = intersect(tree.nodes[node.first].bounds, origin,
+                                      inverse, hit.distance, leftDistance);
+                bool right = intersect(tree.nodes[node.first + 1].bounds,
+                                       origin, inverse, hit.distance,
+                                       rightDistance);
+                uint32_t first = node.first, second = node.first + 1;
+                if (left && right && rightDistance < leftDistance)
+                    std::swap(first, second);
+                // The nearer child is popped first
+                if (left && right) {
+                    stack[top++] = second;
+                    stack[top++] = first;
+                }
+                else if (left || right) {
+                    stack[top++] = left ? first : second;
+                }
+            }
+        }
+        for (uint32_t object : pending) {
+            if (intersect(bounds[object], origin, inverse, hit.distance,
+                          distance)) {
+                hit.object = object;
+                hit.distance = distance;
+            }
+        }
+        return hit.object != none;
+    }
+
+    /**
+     * If the ray from origin with 1 / direction as inverse enters box
+     * before maxDistance, at distance, by the slab test. Empty boxes are
+     * never hit.
+     */
+    static bool intersect(const AABB & box,
+                          const glm::vec3 & origin,
+                          const glm::vec3 & inverse,
+                          float maxDistance,
+                          float & distance) {
+        if (box.empty())
+            return false;
+        float enter = 0, exit = maxDistance;
+        for (int axis = 0; axis < 3; axis++) {
+            float t0 = (box.min[axis] - origin[axis]) * inverse[axis];
+            float t1 = (box.max[axis] - origin[axis]) * inverse[axis];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            // NaN when the origin is on a slab parallel to the ray, keeps
+            // the other bound
+            enter = t0 > enter ? t0 : enter;
+            exit = t1 < exit ? t1 : exit;
+        }
+        distance = enter;
+        return enter <= exit && enter < maxDistance;
+    }
+
+private:
+    void check(uint32_t object) const {
+        if (!contains(object))
+            throw std::out_of_range("No object " + std::to_string(object));
+    }
+
+    bool inTree(uint32_t object) const {
+        return object < tree.leaves.size() && tree.leaves[object] != none;
+    }
+
+    /// Copy the bounds of an object to its place in its leaf.
+    void setLeafBox(uint32_t object) {
+        const Node & leaf = tree.nodes[tree.leaves[object]];
+        for (uint32_t i = leaf.first; i < leaf.first + leaf.count; i++) {
+            if (tree.objects[i] == object) {
+                tree.boxes[i] = bounds[object];
+                return;
+            }
+        }
+    }
+
+    void markDirty(uint32_t object) {
+        if (dirtyFlags[object])
+            return;
+        dirtyFlags[object] = 1;
+        dirty.push_back(object);
+    }
+
+    void addPending(uint32_t object) {
+        pendingSlots[object] = uint32_t(pending.size());
+        pending.push_back(object);
+    }
+
+    void removePending(uint32_t object) {
+        uint32_t slot = pendingSlots[object];
+        pending[slot] = pending.back();
+        pendingSlots[pending[slot]] = slot;
+        pending.pop_back();
+        pendingSlots[object] = none;
+    }
+
+    /// Half the surface area of box.
+    static float area(const AABB & box) {
+        if (box.empty())
+            return 0;
+        glm::vec3 size = box.max - box.min;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    static bool same(const AABB & a, const AABB & b) {
+        return a.min == b.min && a.max == b.max;
+    }
+
+    /**
+     * Test box against the planes of frustum set in planes, clearing the
+     * ones it is fully inside.
+     *
+     * @return false if it is outside one of them
+     */
+    static bool cull(const Frustum & frustum,
+                     const AABB & box,
+                     uint32_t & planes) {
+        if (box.empty())
+            return false;
+        if (!planes)
+            return true;
+        glm::vec3 center = box.center(), extents = box.extents();
+        for (int p = 0; p < 6; p++) {
+            if (!(planes & (1u << p)))
+                continue;
+            const glm::vec4 & plane = frustum.planes[p];
+            float distance = Frustum::distance(plane, center);
+            float radius = Frustum::radius(plane, extents);
+            if (distance + radius < 0)
+                return false;
+            if (distance - radius >= 0)
+                planes &= ~(1u << p);
+        }
+        return true;
+    }
+
+    /// Refit a leaf and its parents, up to the first that doesn't change.
+    void refitLeaf(uint32_t leaf) {
+        Node & node = tree.nodes[leaf];
+        AABB box;
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            tree.boxes[i] = bounds[tree.objects[i]];
+            box.add(tree.boxes[i]);
+        }
+        if (same(box, node.bounds))
+            return;
+        node.bounds = box;
+
+        for (uint32_t parent = tree.parents[leaf]; parent != none;
+             parent = tree.parents[parent]) {
+            Node & inner = tree.nodes[parent];
+            AABB children = tree.nodes[inner.first].bounds;
+            children.add(tree.nodes[inner.first + 1].bounds);
+            if (same(children, inner.bounds))
+                return;
+            inner.bounds = children;
+        }
+    }
+
+    /// Refit every node, children come after their parents.
+    void refitAll() {
+        for (size_t i = tree.nodes.size(); i-- > 0;) {
+            Node & node = tree.nodes[i];
+            AABB box;
+            if (node.leaf()) {
+                for (uint32_t k = node.first; k < node.first + node.count;
+                     k++) {
+                    tree.boxes[k] = bounds[tree.objects[k]];
+                    box.add(tree.boxes[k]);
+                }
+            }
+            else {
+                box = tree.nodes[node.first].bounds;
+                box.add(tree.nodes[node.first + 1].bounds);
+            }
+            node.bounds = box;
+        }
+    }
+
+    void waitForRebuild() {
+        if (rebuilding)
+            rebuilding->jobs->wait(rebuilding->counter);
+    }
+
+    /// Use a tree built from older bounds: refit it to the current ones and
+    /// wait with the objects it lacks.
+    void swapIn(Tree && built) {
+        tree = std::move(built);
+        for (uint32_t object : dirty)
+            dirtyFlags[object] = 0;
+        dirty.clear();
+        for (uint32_t object : pending)
+            pendingSlots[object] = none;
+        pending.clear();
+        for (uint32_t object = 0; object < bounds.size(); object++) {
+            if (alive[object] && !inTree(object))
+                addPending(object);
+        }
+        refitAll();
+    }
+
+    /// An object being built, in the order of the leaves.
+    struct Item {
+        AABB box;
+        glm::vec3 center;
+        uint32_t object;
+    };
+
+    /// Build a tree of the non-empty bounds with binned SAH splits.
+    static Tree build(const std::vector<AABB> & bounds, size_t maxLeafSize) {
+        Tree tree;
+        tree.leaves.assign(bounds.size(), none);
+        std::vector<Item> items;
+        for (uint32_t object = 0; object < bounds.size(); object++) {
+            if (!bounds[object].empty())
+                items.push_back(
+                    {bounds[object], bounds[object].center(), object});
+        }
+        if (items.empty())
+            return tree;
+
+        tree.nodes.reserve(2 * items.size());
+        tree.parents.reserve(2 * items.size());
+        tree.nodes.emplace_back();
+        tree.nodes[0].count = uint32_t(items.size());
+        tree.parents.push_back(none);
+
+        struct Task {
+            uint32_t node;
+            uint32_t depth;
+        };
+        std::vector<Task> tasks = {{0, 0}};
+        while (!tasks.empty()) {
+            Task task = tasks.back();
+            tasks.pop_back();
+            uint32_t first = tree.nodes[task.node].first;
+            uint32_t size = tree.nodes[task.node].count;
+            Item * nodeItems = items.data() + first;
+
+            AABB box, centerBox;
+            for (uint32_t i = 0; i < size; i++) {
+                box.add(nodeItems[i].box);
+                centerBox.add(nodeItems[i].center);
+            }
+            tree.nodes[task.node].bounds = box;
+
+            uint32_t middle = split(nodeItems, size, box, centerBox,
+                                    maxLeafSize, task.depth >= maxSahDepth);
+            if (middle == 0) {
+                for (uint32_t i = 0; i < size; i++)
+                    tree.leaves[nodeItems[i].object] = task.node;
+                continue;
+            }
+
+            uint32_t left = uint32_t(tree.nodes.size());
+            tree.nodes.resize(left + 2);
+            tree.parents.push_back(task.node);
+            tree.parents.push_back(task.node);
+            tree.nodes[left].first = first;
+            tree.nodes[left].count = middle;
+            tree.nodes[left + 1].first = first + middle;
+            tree.nodes[left + 1].count = size - middle;
+            tree.nodes[task.node].first = left;
+            tree.nodes[task.node].count = 0;
+            tasks.push_back({left + 1, task.depth + 1});
+            tasks.push_back({left, task.depth + 1});
+        }
+
+        tree.objects.resize(items.size());
+        tree.boxes.resize(items.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            tree.objects[i] = items[i].object;
+            tree.boxes[i] = items[i].box;
+        }
+        return tree;
+    }
+
+    /**
+     * Partition the items of a node at the cheapest of binCount planes on
+     * each axis by the surface area heuristic, or at the median of the
+     * longest axis if median is set or no plane separates them.
+     *
+     * @return the items left of the split, 0 to make a leaf
+     */
+    static uint32_t split(Item * items,
+                          uint32_t size,
+                          const AABB & box,
+                          const AABB & centerBox,
+                          size_t maxLeafSize,
+                          bool median) {
+        if (size <= 1 || (median && size <= maxLeafSize))
+            return 0;
+        glm::vec3 extent = centerBox.max - centerBox.min;
+        int longest = extent.x >= extent.y && extent.x >= extent.z ? 0
+                      : extent.y >= extent.z                      ? 1
+                                                                  : 2;
+        if (extent[longest] <= 0) {
+            // All centered alike, no split separates them
+            if (size <= maxLeafSize)
+                return 0;
+            return size / 2;
+        }
+
+        float bestCost = std::numeric_limits<float>::infinity();
+        int bestAxis = -1;
+        uint32_t bestBin = 0;
+        glm::vec3 scale(0);
+        for (int axis = 0; axis < 3; axis++) {
+            if (extent[axis] > 0)
+                scale[axis] = binCount / extent[axis];
+        }
+
+        if (!median) {
+            // One pass over the items bins them on all axes
+            std::array<std::array<AABB, binCount>, 3> bins;
+            std::array<std::array<uint32_t, binCount>, 3> counts = {};
+            for (uint32_t i = 0; i < size; i++) {
+                for (int axis = 0; axis < 3; axis++) {
+                    uint32_t bin = binOf(items[i].center[axis],
+                                         centerBox.min[axis], scale[axis]);
+                    bins[axis][bin].add(items[i].box);
+                    counts[axis][bin]++;
+                }
+            }
+
+            for (int axis = 0; axis < 3; axis++) {
+                if (extent[axis] <= 0)
+                    continue;
+                // Area and count left of each plane, then right of it
+                std::array<float, binCount - 1> leftArea;
+                std::array<uint32_t, binCount - 1> leftCount;
+                AABB left;
+                uint32_t leftSum = 0;
+                for (size_t b = 0; b + 1 < binCount; b++) {
+                    left.add(bins[axis][b]);
+                    leftSum += counts[axis][b];
+                    leftArea[b] = area(left);
+                    leftCount[b] = leftSum;
+                }
+                AABB right;
+                uint32_t rightSum = 0;
+                for (size_t b = binCount - 1; b > 0; b--) {
+                    right.add(bins[axis][b]);
+                    rightSum += counts[axis][b];
+                    if (leftCount[b - 1] == 0 || rightSum == 0)
+                        continue;
+                    float cost = leftArea[b - 1] * leftCount[b - 1]
+                                 + area(right) * rightSum;
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBin = uint32_t(b);
+                    }
+                }
+            }
+
+            // A split costs a node visit, the area of the node
+            float leafCost = area(box) * size;
+            if (size <= maxLeafSize && bestCost + area(box) >= leafCost)
+                return 0;
+        }
+
+        uint32_t middle = 0;
+        if (bestAxis >= 0) {
+            float min = centerBox.min[bestAxis];
+            float axisScale = scale[bestAxis];
+            middle = uint32_t(
+                std::partition(items, items + size,
+                               [&](const Item & item) {
+                                   return binOf(item.center[bestAxis], min,
+                                                axisScale)
+                                          < bestBin;
+                               })
+                - items);
+        }
+        if (middle == 0 || middle == size) {
+            middle = size / 2;
+            std::nth_element(items, items + middle, items + size,
+                             [&](const Item & a, const Item & b) {
+                                 return a.center[longest] < b.center[longest];
+                             });
+        }
+        return middle;
+    }
+
+    static uint32_t binOf(float center, float min, float scale) {
+        auto bin = uint32_t((center - min) * scale);
+        return std::min<uint32_t>(bin, binCount - 1);
+    }
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/// An axis aligned bounding box. Empty while min is above max.
+struct AABB {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    AABB() {}
+
+    AABB(const glm::vec3 & min, const glm::vec3 & max) : min(min), max(max) {}
+
+    /// The bounds of count points of stride bytes, like a vertex buffer.
+    static AABB fromPoints(const float * points,
+                           size_t count,
+                           size_t stride = 3 * sizeof(float)) {
+        AABB box;
+        auto bytes = reinterpret_cast<const unsigned char *>(points);
+        for (size_t i = 0; i < count; i++) {
+            auto point = reinterpret_cast<const float *>(bytes + i * stride);
+            box.add(glm::vec3(point[0], point[1], point[2]));
+        }
+        return box;
+    }
+
+    bool empty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    glm::vec3 center() const {
+        return (min + max) * 0.5f;
+    }
+
+    /// Half the size along each axis.
+    glm::vec3 extents() const {
+        return (max - min) * 0.5f;
+    }
+
+    void add(const glm::vec3 & point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void add(const AABB & other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    bool contains(const glm::vec3 & point) const {
+        return point.x >= min.x && point.x <= max.x && point.y >= min.y
+               && point.y <= max.y && point.z >= min.z && point.z <= max.z;
+    }
+
+    bool overlaps(const AABB & other) const {
+        return min.x <= other.max.x && max.x >= other.min.x
+               && min.y <= other.max.y && max.y >= other.min.y
+               && min.z <= other.max.z && max.z >= other.min.z;
+    }
+
+    /**
+     * The bounds of this box transformed by matrix, from the transformed
+     * center and the extents projected on the axes (Arvo). The same box as
+     * the bounds of the 8 transformed corners, for less work.
+     */
+    AABB transformed(const glm::mat4 & matrix) const {
+        if (empty())
+            return *this;
+        glm::vec3 c = center(), e = extents();
+        glm::vec3 center(matrix[3]), extents(0);
+        for (int i = 0; i < 3; i++) {
+            center += glm::vec3(matrix[i]) * c[i];
+            extents += glm::abs(glm::vec3(matrix[i])) * e[i];
+        }
+        return AABB(center - extents, center + extents);
+    }
+};
+
+/// A bounding sphere. Empty while the radius is negative.
+struct Sphere {
+    glm::vec3 center = glm::vec3(0);
+    float radius = -1;
+
+    Sphere() {}
+
+    Sphere(const glm::vec3 & center, float radius)
+        : center(center), radius(radius) {}
+
+    /// The sphere through the corners of box.
+    static Sphere fromAABB(const AABB & box) {
+        if (box.empty())
+            return Sphere();
+        return Sphere(box.center(), glm::length(box.extents()));
+    }
+
+    bool empty() const {
+        return radius < 0;
+    }
+
+    /// The sphere around this one transformed by matrix, scaled by the
+    /// longest axis of the matrix.
+    Sphere transformed(const glm::mat4 & matrix) const {
+        if (empty())
+            return *this;
+        float scale = 0;
+        for (int i = 0; i < 3; i++)
+            scale = std::max(scale, glm::length(glm::vec3(matrix[i])));
+        return Sphere(glm::vec3(matrix * glm::vec4(center, 1)),
+                      radius * scale);
+    }
+};
+
+/// Bounds of an object, in its own space and as last placed in the world.
+struct Bounds {
+    AABB local;
+    AABB world;
+
+    Bounds() {}
+
+    explicit Bounds(const AABB & local) : local(local), world(local) {}
+
+    void update(const glm::mat4 & model) {
+        world = local.transformed(model);
+    }
+};
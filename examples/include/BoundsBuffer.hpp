@@ -0,0 +1,476 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define BOUNDS_BUFFER_SSE
+#endif
+#if defined(__AVX2__)
+#define BOUNDS_BUFFER_AVX2
+#endif
+
+#include "Bounds.hpp"
+#include "Frustum.hpp"
+#include "JobSystem.hpp"
+#include "Profiler.hpp"
+
+/**
+ * World bounds of many objects, boxes or spheres, stored as one array per
+ * component and culled against a Frustum in batches.
+ *
+ * Each object is a center, extents and a radius, a box has a radius of 0
+ * and a sphere extents of 0, so one test covers both: an object is outside
+ * a plane if distance(center) + dot(|normal|, extents) + radius < 0. The
+ * results equal Frustum::intersects(). cull() tests 8 objects (AVX2) or 4
+ * (SSE) at a time, whichever the compiler targets, and writes the indices
+ * of the visible ones packed, for gather() to pack their instance data.
+ * Build with -DENABLE_AVX2=ON for the AVX2 kernel.
+ */
+class BoundsBuffer {
+public:
+    /// A culling kernel, see supported().
+    enum Kernel {
+        Scalar,
+        SSE,
+        AVX2,
+    };
+
+    /// Counts of a cull.
+    struct Stats {
+        size_t tested = 0;
+        size_t visible = 0;
+
+        size_t culled() const {
+            return tested - visible;
+        }
+    };
+
+    /// Objects per job of a parallel cull.
+    static constexpr size_t blockSize = 4096;
+
+private:
+    std::vector<float> cx, cy, cz;
+    std::vector<float> ex, ey, ez;
+    std::vector<float> radii;
+
+public:
+    BoundsBuffer() {}
+
+    BoundsBuffer(BoundsBuffer && other) = default;
+    BoundsBuffer & operator=(BoundsBuffer && other) = default;
+
+    BoundsBuffer(const BoundsBuffer &) = delete;
+    BoundsBuffer & operator=(const BoundsBuffer &) = delete;
+
+    /// If this build has the kernel.
+    static bool supported(Kernel kernel) {
+        switch (kernel) {
+            case Scalar:
+                return true;
+#ifdef BOUNDS_BUFFER_SSE
+            case SSE:
+                return true;
+#endif
+#ifdef BOUNDS_BUFFER_AVX2
+            case AVX2:
+                return true;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    /// The widest supported kernel.
+    static Kernel bestKernel() {
+        return supported(AVX2) ? AVX2 : supported(SSE) ? SSE : Scalar;
+    }
+
+    /// Add a box, an empty one is never visible. @return its index
+    size_t add(const AABB & box) {
+        size_t i = size();
+        for (auto * v : {&cx, &cy, &cz, &ex, &ey, &ez, &radii})
+            v->push_back(0);
+        set(i, box);
+        return i;
+    }
+
+    /// Add a sphere, an empty one is never visible. @return its index
+    size_t add(const Sphere & sphere) {
+        size_t i = size();
+        for (auto * v : {&cx, &cy, &cz, &ex, &ey, &ez, &radii})
+            v->push_back(0);
+        set(i, sphere);
+        return i;
+    }
+
+    void set(size_t i, const AABB & box) {
+        if (box.empty()) {
+            setEmpty(i);
+            return;
+        }
+        glm::vec3 center = box.center(), extents = box.extents();
+        cx[i] = center.x;
+        cy[i] = center.y;
+        cz[i] = center.z;
+        ex[i] = extents.x;
+        ey[i] = extents.y;
+        ez[i] = extents.z;
+        radii[i] = 0;
+    }
+
+    void set(size_t i, const Sphere & sphere) {
+        if (sphere.empty()) {
+            setEmpty(i);
+            return;
+        }
+        cx[i] = sphere.center.x;
+        cy[i] = sphere.center.y;
+        cz[i] = sphere.center.z;
+        ex[i] = ey[i] = ez[i] = 0;
+        radii[i] = sphere.radius;
+    }
+
+    void reserve(size_t count) {
+        for (auto * v : {&cx, &cy, &cz, &ex, &ey, &ez, &radii})
+            v->reserve(count);
+    }
+
+    void clear() {
+        for (auto * v : {&cx, &cy, &cz, &ex, &ey, &ez, &radii})
+            v->clear();
+    }
+
+    size_t size() const {
+        return cx.size();
+    }
+
+    /**
+     * Cull objects first to first + count, writing the indices of the
+     * visible ones to visible, in order.
+     *
+     * @param visible room for count indices
+     * @return the number of visible objects
+     */
+    size_t cull(const Frustum & frustum,
+                size_t first,
+                size_t count,
+                uint32_t * visible,
+                Kernel kernel = bestKernel()) const {
+        Planes planes(frustum);
+        uint32_t * out = visible;
+        size_t i = first, end = first + count;
+#ifdef BOUNDS_BUFFER_AVX2
+        if (kernel >= AVX2) {
+            for (; i + 8 <= end; i += 8)
+                out += cullLanes<AVX2Lanes>(planes, i, out);
+        }
+#endif
+#ifdef BOUNDS_BUFFER_SSE
+        if (kernel >= SSE) {
+            for (; i + 4 <= end; i += 4)
+                out += cullLanes<SSELanes>(planes, i, out);
+        }
+#endif
+        for (; i < end; i++)
+            out += cullLanes<ScalarLanes>(planes, i, out);
+        return size_t(out - visible);
+    }
+
+    /// Cull all objects, resizing visible to the visible ones.
+    Stats cull(const Frustum & frustum,
+               std::vector<uint32_t> & visible,
+               Kernel kernel = bestKernel()) const {
+        PROFILE_ZONE("BoundsBuffer::cull");
+        visible.resize(size());
+        Stats stats;
+        stats.tested = size();
+        stats.visible = cull(frustum, 0, size(), visible.data(), kernel);
+        visible.resize(stats.visible);
+        return stats;
+    }
+
+    /**
+     * cull() in parallel, in blocks of blockSize objects, each packed into
+     * place in visible after all have run.
+     */
+    Stats cull(const Frustum & frustum,
+               std::vector<uint32_t> & visible,
+               JobSystem & jobs,
+               Kernel kernel = bestKernel()) const {
+        PROFILE_ZONE("BoundsBuffer::cull");
+        visible.resize(size());
+        size_t blocks = (size() + blockSize - 1) / blockSize;
+        std::vector<size_t> counts(blocks);
+        jobs.parallelFor(0, blocks, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++) {
+                size_t first = b * blockSize;
+                size_t count = std::min(blockSize, size() - first);
+                counts[b] = cull(frustum, first, count, &visible[first],
+                                 kernel);
+            }
+        });
+
+        Stats stats;
+        stats.tested = size();
+        for (size_t b = 0; b < blocks; b++) {
+            auto from = visible.begin() + b * blockSize;
+            std::copy(from, from + counts[b], visible.begin() + stats.visible);
+            stats.visible += counts[b];
+        }
+        visible.resize(stats.visible);
+        return stats;
+    }
+
+    /**
+     * Pack the items of data at the indices of a cull into out, like the
+     * per-instance attributes of the visible objects.
+     *
+     * @param out room for count items
+     */
+    template <typename T>
+    static void gather(const uint32_t * indices,
+                       size_t count,
+                       const T * data,
+                       T * out) {
+        for (size_t i = 0; i < count; i++)
+            out[i] = data[indices[i]];
+    }
+
+private:
+    void setEmpty(size_t i) {
+        cx[i] = cy[i] = cz[i] = 0;
+        ex[i] = ey[i] = ez[i] = 0;
+        radii[i] = -std::numeric_limits<float>::infinity();
+    }
+
+    /// The frustum planes, with the absolute values of the normals.
+    struct Planes {
+        float nx[6], ny[6], nz[6], d[6];
+        float ax[6], ay[6], az[6];
+
+        explicit Planes(const Frustum & frustum) {
+            for (int p = 0; p < 6; p++) {
+                const glm::vec4 & plane = frustum.planes[p];
+                nx[p] = plane.x;
+                ny[p] = plane.y;
+                nz[p] = plane.z;
+                d[p] = plane.w;
+                ax[p] = std::abs(plane.x);
+                ay[p] = std::abs(plane.y);
+                az[p] = std::abs(plane.z);
+            }
+        }
+    };
+
+    static unsigned countTrailingZeros(uint32_t word) {
+#if defined(__GNUC__)
+        return __builtin_ctz(word);
+#else
+        unsigned n = 0;
+        for (; !(word & 1); word >>= 1)
+            n++;
+        return n;
+#endif
+    }
+
+    static unsigned countBits(uint32_t word) {
+#if defined(__GNUC__)
+        return __builtin_popcount(word);
+#else
+        unsigned n = 0;
+        for (; word; word &= word - 1)
+            n++;
+        return n;
+#endif
+    }
+
+    struct ScalarLanes {
+        using Vector = float;
+        using Mask = bool;
+
+        static Vector load(const float * p) {
+            return *p;
+        }
+
+        static Vector set(float value) {
+            return value;
+        }
+
+        static Vector add(Vector a, Vector b) {
+            return a + b;
+        }
+
+        static Vector mul(Vector a, Vector b) {
+            return a * b;
+        }
+
+        static Mask notNegative(Vector a) {
+            return a >= 0;
+        }
+
+        static Mask both(Mask a, Mask b) {
+            return a && b;
+        }
+
+        static bool none(Mask a) {
+            return !a;
+        }
+
+        static size_t pack(Mask visible, size_t i, uint32_t * out) {
+            *out = uint32_t(i);
+            return visible ? 1 : 0;
+        }
+    };
+
+#ifdef BOUNDS_BUFFER_SSE
+    struct SSELanes {
+        using Vector = __m128;
+        using Mask = __m128;
+
+        static Vector load(const float * p) {
+            return _mm_loadu_ps(p);
+        }
+
+        static Vector set(float value) {
+            return _mm_set1_ps(value);
+        }
+
+        static Vector add(Vector a, Vector b) {
+            return _mm_add_ps(a, b);
+        }
+
+        static Vector mul(Vector a, Vector b) {
+            return _mm_mul_ps(a, b);
+        }
+
+        static Mask notNegative(Vector a) {
+            return _mm_cmpge_ps(a, _mm_setzero_ps());
+        }
+
+        static Mask both(Mask a, Mask b) {
+            return _mm_and_ps(a, b);
+        }
+
+        static bool none(Mask a) {
+            return _mm_movemask_ps(a) == 0;
+        }
+
+        /// Write i + k for each visible lane k to out, in order.
+        static size_t pack(Mask visible, size_t i, uint32_t * out) {
+            uint32_t bits = uint32_t(_mm_movemask_ps(visible));
+            size_t n = 0;
+            for (; bits; bits &= bits - 1)
+                out[n++] = uint32_t(i + countTrailingZeros(bits));
+            return n;
+        }
+    };
+#endif
+
+#ifdef BOUNDS_BUFFER_AVX2
+    struct AVX2Lanes {
+        using Vector = __m256;
+        using Mask = __m256;
+
+        static Vector load(const float * p) {
+            return _mm256_loadu_ps(p);
+        }
+
+        static Vector set(float value) {
+            return _mm256_set1_ps(value);
+        }
+
+        static Vector add(Vector a, Vector b) {
+            return _mm256_add_ps(a, b);
+        }
+
+        static Vector mul(Vector a, Vector b) {
+            return _mm256_mul_ps(a, b);
+        }
+
+        static Mask notNegative(Vector a) {
+            return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GE_OQ);
+        }
+
+        static Mask both(Mask a, Mask b) {
+            return _mm256_and_ps(a, b);
+        }
+
+        static bool none(Mask a) {
+            return _mm256_testz_ps(a, a);
+        }
+
+        /// The lanes set in each 8 bit mask, a byte each from the lowest.
+        static constexpr std::array<uint64_t, 256> packTable() {
+            std::array<uint64_t, 256> table = {};
+            for (uint32_t bits = 0; bits < 256; bits++) {
+                unsigned n = 0;
+                for (uint32_t lane = 0; lane < 8; lane++) {
+                    if (bits & (1u << lane))
+                        table[bits] |= uint64_t(lane) << (8 * n++);
+                }
+            }
+            return table;
+        }
+
+        /**
+         * Write i + k for each visible lane k to out, in order, with one
+         * permute: the table has the visible lanes of each mask packed to
+         * the front, a byte each. Writes 8 indices, only the visible ones
+         * count.
+         */
+        static size_t pack(Mask visible, size_t i, uint32_t * out) {
+            static constexpr std::array<uint64_t, 256> table = packTable();
+            uint32_t bits = uint32_t(_mm256_movemask_ps(visible));
+            __m256i lanes = _mm256_cvtepu8_epi32(
+                _mm_cvtsi64_si128(int64_t(table[bits])));
+            __m256i indices = _mm256_add_epi32(
+                _mm256_set1_epi32(int32_t(i)),
+                _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out),
+                                _mm256_permutevar8x32_epi32(indices, lanes));
+            return countBits(bits);
+        }
+    };
+#endif
+
+    /**
+     * Test the objects from i, one per lane, against all planes, in the
+     * order of operations of Frustum::distance() and Frustum::radius(),
+     * and pack the visible ones to out.
+     *
+     * @return the number of visible objects
+     */
+    template <typename L>
+    size_t cullLanes(const Planes & planes, size_t i, uint32_t * out) const {
+        using V = typename L::Vector;
+        V x = L::load(&cx[i]), y = L::load(&cy[i]), z = L::load(&cz[i]);
+        V sx = L::load(&ex[i]), sy = L::load(&ey[i]), sz = L::load(&ez[i]);
+        V r = L::load(&radii[i]);
+
+        typename L::Mask visible = L::notNegative(r);
+        for (int p = 0; p < 6; p++) {
+            V distance = L::add(
+                L::add(L::add(L::mul(L::set(planes.nx[p]), x),
+                              L::mul(L::set(planes.ny[p]), y)),
+                       L::mul(L::set(planes.nz[p]), z)),
+                L::set(planes.d[p]));
+            V extent = L::add(L::add(L::mul(L::set(planes.ax[p]), sx),
+                                     L::mul(L::set(planes.ay[p]), sy)),
+                              L::mul(L::set(planes.az[p]), sz));
+            visible = L::both(visible, L::notNegative(L::add(
+                                           L::add(distance, extent), r)));
+            if (L::none(visible))
+                return 0;
+        }
+        return L::pack(visible, i, out);
+    }
+};
@@ -10,6 +10,10 @@
 #include <stdexcept>
 #include <vector>
 
+#include "Capture.hpp"
+#include "GLStats.hpp"
+#include "Profiler.hpp"
+
 struct Attribute {
     GLuint index;
     GLint size;
@@ -20,12 +24,17 @@ struct Attribute {
     GLuint divisor = 0;
 
     void enable() const {
+        GL_CAPTURE(VertexAttribPointer, index, size, type, normalized, stride,
+                   pointer);
+        GL_CAPTURE(VertexAttribDivisor, index, divisor);
+        GL_CAPTURE(EnableVertexAttribArray, index);
         glVertexAttribPointer(index, size, type, normalized, stride, pointer);
         glVertexAttribDivisor(index, divisor);
         glEnableVertexAttribArray(index);
     }
 
     void disable() const {
+        GL_CAPTURE(DisableVertexAttribArray, index);
         glDisableVertexAttribArray(index);
     }
 };
@@ -37,6 +46,7 @@ class Buffer {
 public:
     Buffer(GLenum target = GL_ARRAY_BUFFER) : target(target) {
         glGenBuffers(1, &buffer);
+        GL_CAPTURE(GenBuffer, buffer);
     }
 
     Buffer(Buffer && other) : target(other.target), buffer(other.buffer) {
@@ -54,8 +64,10 @@ public:
     Buffer & operator=(const Buffer &) = delete;
 
     ~Buffer() {
-        if (buffer != 0)
+        if (buffer != 0) {
+            GL_CAPTURE(DeleteBuffer, buffer);
             glDeleteBuffers(1, &buffer);
+        }
     }
 
     GLenum getTarget() const {
@@ -67,20 +79,44 @@ public:
     }
 
     void bind() const {
+        GL_CAPTURE(BindBuffer, target, buffer);
         glBindBuffer(target, buffer);
     }
 
     void unbind() const {
+        GL_CAPTURE(BindBuffer, target, 0);
         glBindBuffer(target, 0);
     }
 
+    /// Bind to an indexed target like GL_SHADER_STORAGE_BUFFER.
+    void bindBase(GLuint index) const {
+        GL_CAPTURE(BindBufferBase, target, index, buffer);
+        glBindBufferBase(target, index, buffer);
+    }
+
+    /**
+     * Bind to an indexed target other than the own one, like a vertex or
+     * indirect buffer written by a compute shader as GL_SHADER_STORAGE_BUFFER.
+     */
+    void bindBase(GLenum target, GLuint index) const {
+        GL_CAPTURE(BindBufferBase, target, index, buffer);
+        glBindBufferBase(target, index, buffer);
+    }
+
     void bufferData(GLsizeiptr size, const void * data, GLenum usage = GL_STATIC_DRAW) {
+        PROFILE_ZONE("Buffer::bufferData");
+        if (data)
+            GL_STATS_UPLOAD(BufferUpload, size);
         bind();
+        GL_CAPTURE_DATA(BufferData, data, size, target, size, usage);
         glBufferData(target, size, data, usage);
     }
 
     void bufferSubData(GLintptr offset, GLsizeiptr size, const void * data) {
+        PROFILE_ZONE("Buffer::bufferSubData");
+        GL_STATS_UPLOAD(BufferUpload, size);
         bind();
+        GL_CAPTURE_DATA(BufferSubData, data, size, target, offset, size);
         glBufferSubData(target, offset, size, data);
     }
 };
@@ -126,6 +162,7 @@ class BufferArray {
 public:
     BufferArray() : elementBuffer(nullptr) {
         glGenVertexArrays(1, &array);
+        GL_CAPTURE(GenVertexArray, array);
     }
 
     BufferArray(const std::vector<std::vector<Attribute>> & attributes)
@@ -159,8 +196,10 @@ public:
     BufferArray & operator=(const BufferArray &) = delete;
 
     ~BufferArray() {
-        if (array)
+        if (array) {
+            GL_CAPTURE(DeleteVertexArray, array);
             glDeleteVertexArrays(1, &array);
+        }
     }
 
     GLuint getArrayId() const {
@@ -171,7 +210,7 @@ public:
         return buffers.size();
     }
 
-    void addBuffer(const vector<Attribute> & attributes) {
+    void addBuffer(const std::vector<Attribute> & attributes) {
         Buffer buffer(GL_ARRAY_BUFFER);
         buffers.emplace_back(attributes, std::move(buffer));
     }
@@ -185,10 +224,14 @@ public:
     }
 
     void bind() const {
+        GL_STATS_BIND(VertexArrayBinding, array);
+        GL_CAPTURE(BindVertexArray, array);
         glBindVertexArray(array);
     }
 
     void unbind() const {
+        GL_STATS_BIND(VertexArrayBinding, 0);
+        GL_CAPTURE(BindVertexArray, 0);
         glBindVertexArray(0);
     }
 
@@ -215,7 +258,10 @@ public:
     }
 
     void drawArrays(GLenum mode, GLint first, GLsizei count) const {
+        PROFILE_ZONE("BufferArray::drawArrays");
+        GL_STATS_DRAW(count, 1);
         bind();
+        GL_CAPTURE(DrawArrays, mode, first, count);
         glDrawArrays(mode, first, count);
     }
 
@@ -223,7 +269,10 @@ public:
                              GLint first,
                              GLsizei count,
                              GLsizei primcount) const {
+        PROFILE_ZONE("BufferArray::drawArraysInstanced");
+        GL_STATS_DRAW(count, primcount);
         bind();
+        GL_CAPTURE(DrawArraysInstanced, mode, first, count, primcount);
         glDrawArraysInstanced(mode, first, count, primcount);
     }
 
@@ -231,7 +280,10 @@ public:
                       GLsizei count,
                       GLenum type,
                       const void * indices) const {
+        PROFILE_ZONE("BufferArray::drawElements");
+        GL_STATS_DRAW(count, 1);
         bind();
+        GL_CAPTURE(DrawElements, mode, count, type, indices);
         glDrawElements(mode, count, type, indices);
     }
 
@@ -240,9 +292,34 @@ public:
                                GLenum type,
                                const void * indices,
                                GLsizei primcount) const {
+        PROFILE_ZONE("BufferArray::drawElementsInstanced");
+        GL_STATS_DRAW(count, primcount);
         bind();
+        GL_CAPTURE(DrawElementsInstanced, mode, count, type, indices,
+                   primcount);
         glDrawElementsInstanced(mode, count, type, indices, primcount);
     }
+
+    /**
+     * Draw drawCount indexed draws with arguments from the bound
+     * GL_DRAW_INDIRECT_BUFFER, in one call. Needs OpenGL 4.3.
+     *
+     * Vertex and instance counts live in the indirect buffer, so GL stats
+     * count the call only. Indirect draws are not captured.
+     *
+     * @param indirect the offset of the first DrawElementsIndirectCommand
+     * @param stride the bytes between commands, 0 if tightly packed
+     */
+    void multiDrawElementsIndirect(GLenum mode,
+                                   GLenum type,
+                                   const void * indirect,
+                                   GLsizei drawCount,
+                                   GLsizei stride = 0) const {
+        PROFILE_ZONE("BufferArray::multiDrawElementsIndirect");
+        GL_STATS_DRAW(0, 0);
+        bind();
+        glMultiDrawElementsIndirect(mode, type, indirect, drawCount, stride);
+    }
 };
 
 class Quad {
@@ -251,7 +328,7 @@ class Quad {
     float x, y;
     float width, height;
 
-    const float texCoords[8] = {
+    float texCoords[8] = {
         0.0f, 1.0f, //
         0.0f, 0.0f, //
         1.0f, 0.0f, //
@@ -303,6 +380,21 @@ public:
         array.bufferSubData(0, 0, sizeof(vertices), vertices);
     }
 
+    /**
+     * Set the texture coordinates at the corners of the quad, for example
+     * to draw a TextureAtlas region.
+     *
+     * @param min the bottom left texture coordinate
+     * @param max the top right texture coordinate
+     */
+    void setTexRect(const glm::vec2 & min, const glm::vec2 & max) {
+        texCoords[0] = texCoords[2] = min.x;
+        texCoords[4] = texCoords[6] = max.x;
+        texCoords[1] = texCoords[7] = max.y;
+        texCoords[3] = texCoords[5] = min.y;
+        array.bufferSubData(1, 0, sizeof(texCoords), texCoords);
+    }
+
     void draw() const {
         array.drawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
     }
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "CaptureFormat.hpp"
+
+/**
+ * Records the GL calls of the wrapper classes to a binary log for gl_replay,
+ * compiled in with -DGL_CAPTURE_ENABLED (the CMake option
+ * ENABLE_GL_CAPTURE) and to nothing otherwise.
+ *
+ * Resources are created when the application starts, so start capturing
+ * before creating any, with GL_CAPTURE_START right after glewInit, and
+ * select frames when replaying:
+ *
+ *     GL_CAPTURE=frames.glcap GL_CAPTURE_FRAMES=600 ./10_instanced
+ *     gl_replay frames.glcap --frames 300:600
+ *
+ * GL calls made outside the wrappers are only captured if recorded with
+ * GL_CAPTURE next to them.
+ */
+#ifdef GL_CAPTURE_ENABLED
+#define GL_CAPTURE(op, ...)                                         \
+    do {                                                            \
+        if (GLCapture::active())                                    \
+            GLCapture::get().call(CaptureFormat::op, 0, __VA_ARGS__); \
+    } while (0)
+/// Record a call with a payload of size bytes, data may be null.
+#define GL_CAPTURE_DATA(op, data, size, ...)                          \
+    do {                                                              \
+        if (GLCapture::active())                                      \
+            GLCapture::get().call(CaptureFormat::op,                  \
+                                  GLCapture::get().payload(data, size), \
+                                  __VA_ARGS__);                       \
+    } while (0)
+/// Start capturing if GL_CAPTURE is set, see startFromEnvironment().
+#define GL_CAPTURE_START(width, height) \
+    GLCapture::get().startFromEnvironment(width, height)
+/// Mark the end of a frame before swapping buffers.
+#define GL_CAPTURE_FRAME() GLCapture::get().frame()
+#else
+#define GL_CAPTURE(op, ...) ((void)0)
+#define GL_CAPTURE_DATA(op, data, size, ...) ((void)0)
+#define GL_CAPTURE_START(width, height) ((void)0)
+#define GL_CAPTURE_FRAME() ((void)0)
+#endif
+
+class GLCapture {
+    std::unique_ptr<std::fstream> file;
+    std::unique_ptr<CaptureWriter> writer;
+    std::string path;
+    uint64_t frames;
+    uint64_t frameLimit;
+    GLint unpackAlignment;
+    GLint unpackRowLength;
+
+    GLCapture()
+        : frames(0), frameLimit(0), unpackAlignment(4), unpackRowLength(0) {}
+
+public:
+    GLCapture(const GLCapture &) = delete;
+    GLCapture & operator=(const GLCapture &) = delete;
+
+    ~GLCapture() {
+        stop();
+    }
+
+    static GLCapture & get() {
+        static GLCapture capture;
+        return capture;
+    }
+
+    static bool active() {
+        return get().writer != nullptr;
+    }
+
+    /**
+     * Start writing to path.
+     *
+     * @param width the default frame buffer width
+     * @param height the default frame buffer height
+     * @param frameLimit stop after this many frames, 0 for no limit
+     *
+     * @throws std::runtime_error if the file can't be opened
+     */
+    void start(const std::string & path,
+               uint32_t width,
+               uint32_t height,
+               uint64_t frameLimit = 0) {
+        stop();
+        // Read and written, CaptureWriter reads payloads back to compare
+        file = std::make_unique<std::fstream>(
+            path, std::ios::in | std::ios::out | std::ios::trunc
+                      | std::ios::binary);
+        if (!*file)
+            throw std::runtime_error("Failed to open capture " + path);
+        writer = std::make_unique<CaptureWriter>(*file, width, height);
+        this->path = path;
+        this->frameLimit = frameLimit;
+        frames = 0;
+        unpackAlignment = 4;
+        unpackRowLength = 0;
+    }
+
+    /**
+     * Start if the GL_CAPTURE environment variable names a file, stopping
+     * after GL_CAPTURE_FRAMES frames if set.
+     *
+     * @return true if capturing
+     */
+    bool startFromEnvironment(uint32_t width, uint32_t height) {
+        const char * target = std::getenv("GL_CAPTURE");
+        if (!target || !*target)
+            return false;
+        const char * limit = std::getenv("GL_CAPTURE_FRAMES");
+        start(target, width, height,
+              limit ? std::strtoull(limit, nullptr, 10) : 0);
+        return true;
+    }
+
+    void stop() {
+        writer.reset();
+        file.reset();
+    }
+
+    /// Mark the end of a frame, call before swapping buffers.
+    void frame() {
+        if (!writer)
+            return;
+        writer->record(CaptureFormat::EndFrame, {});
+        if (frameLimit && ++frames >= frameLimit)
+            stop();
+    }
+
+    uint64_t getFrameCount() const {
+        return frames;
+    }
+
+    const std::string & getPath() const {
+        return path;
+    }
+
+    uint32_t payload(const void * data, size_t size) {
+        return writer->payload(data, size);
+    }
+
+    /// Record a call, use the GL_CAPTURE macros instead.
+    template <typename... Args>
+    void call(CaptureFormat::Op op, uint32_t payload, const Args &... args) {
+        if (op == CaptureFormat::PixelStorei)
+            trackPixelStore(args...);
+        if (payload)
+            writer->record(op, {toArg(args)...}, {payload});
+        else
+            writer->record(op, {toArg(args)...});
+    }
+
+    /// Record a program with the sources it was linked from.
+    void createProgram(GLuint program,
+                       const char * vertexSource,
+                       const char * fragmentSource) {
+        uint32_t vertex = payload(vertexSource, std::strlen(vertexSource) + 1);
+        uint32_t fragment =
+            payload(fragmentSource, std::strlen(fragmentSource) + 1);
+        writer->record(CaptureFormat::CreateProgram, {program},
+                       {vertex, fragment});
+    }
+
+    /**
+     * Bytes GL reads for an image upload with the current unpack state.
+     *
+     * @param format the pixel format like GL_RGBA
+     * @param type the component type like GL_UNSIGNED_BYTE
+     */
+    size_t imageBytes(GLsizei width,
+                      GLsizei height,
+                      GLsizei depth,
+                      GLenum format,
+                      GLenum type) const {
+        size_t pixel = pixelBytes(format, type);
+        size_t rowPixels = unpackRowLength > 0 ? unpackRowLength : width;
+        size_t row = rowPixels * pixel;
+        row = (row + unpackAlignment - 1) / unpackAlignment * unpackAlignment;
+        size_t rows = size_t(height) * depth;
+        return rows == 0 ? 0 : row * (rows - 1) + width * pixel;
+    }
+
+private:
+    template <typename T> static uint64_t toArg(const T & value) {
+        if constexpr (std::is_pointer_v<T>)
+            return reinterpret_cast<uintptr_t>(value);
+        else if constexpr (std::is_floating_point_v<T>)
+            return CaptureFormat::floatBits(value);
+        else if constexpr (std::is_signed_v<T> && sizeof(T) <= 4)
+            return uint32_t(value);
+        else
+            return uint64_t(value);
+    }
+
+    template <typename... Args> void trackPixelStore(const Args &... args) {
+        uint64_t values[] = {toArg(args)...};
+        if (sizeof...(args) < 2)
+            return;
+        if (values[0] == GL_UNPACK_ALIGNMENT)
+            unpackAlignment = GLint(values[1]);
+        else if (values[0] == GL_UNPACK_ROW_LENGTH)
+            unpackRowLength = GLint(values[1]);
+    }
+
+    static size_t pixelBytes(GLenum format, GLenum type) {
+        switch (type) {
+            case GL_UNSIGNED_INT_24_8:
+            case GL_UNSIGNED_INT_10F_11F_11F_REV:
+            case GL_UNSIGNED_INT_2_10_10_10_REV:
+                return 4;
+            case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+                return 8;
+        }
+
+        size_t components = 4;
+        switch (format) {
+            case GL_RED:
+            case GL_DEPTH_COMPONENT:
+            case GL_STENCIL_INDEX:
+                components = 1;
+                break;
+            case GL_RG:
+                components = 2;
+                break;
+            case GL_RGB:
+            case GL_BGR:
+                components = 3;
+                break;
+        }
+
+        size_t size = 1;
+        switch (type) {
+            case GL_SHORT:
+            case GL_UNSIGNED_SHORT:
+            case GL_HALF_FLOAT:
+                size = 2;
+                break;
+            case GL_INT:
+            case GL_UNSIGNED_INT:
+            case GL_FLOAT:
+                size = 4;
+                break;
+        }
+        return components * size;
+    }
+};
@@ -0,0 +1,358 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Binary log of GL calls written by GLCapture and read by gl_replay.
+ *
+ * The file starts with a header, the magic "GLCAPTUR", the version and the
+ * default frame buffer size, followed by records. A record is an opcode
+ * byte, the number of arguments and payloads, the arguments as LEB128
+ * varints and the payload ids as varints. Floats are stored as their bits.
+ *
+ * Payloads (buffer data, pixels, shader sources) are written once as a Blob
+ * record and referenced by id after that, so data uploaded every frame or
+ * shared between resources is only stored once.
+ *
+ * Object names are stored as they were at capture time, the replay maps
+ * them to its own objects.
+ */
+class CaptureFormat {
+public:
+    static constexpr const char magic[9] = "GLCAPTUR";
+    static const uint32_t version = 1;
+
+    enum Op : uint8_t {
+        Blob,
+        EndFrame,
+
+        GenBuffer,
+        DeleteBuffer,
+        BindBuffer,
+        BindBufferBase,
+        BufferData,
+        BufferSubData,
+
+        GenVertexArray,
+        DeleteVertexArray,
+        BindVertexArray,
+        VertexAttribPointer,
+        VertexAttribDivisor,
+        EnableVertexAttribArray,
+        DisableVertexAttribArray,
+
+        DrawArrays,
+        DrawArraysInstanced,
+        DrawElements,
+        DrawElementsInstanced,
+
+        CreateProgram,
+        DeleteProgram,
+        UseProgram,
+        UniformLocation,
+        Uniform,
+
+        GenTexture,
+        DeleteTexture,
+        BindTexture,
+        ActiveTexture,
+        TexImage2D,
+        TexSubImage2D,
+        TexImage3D,
+        TexSubImage3D,
+        CompressedTexImage2D,
+        TexImage2DMultisample,
+        TexStorage2D,
+        TexStorage2DMultisample,
+        TexParameteri,
+        GenerateMipmap,
+        PixelStorei,
+
+        GenFramebuffer,
+        DeleteFramebuffer,
+        BindFramebuffer,
+        FramebufferTexture2D,
+        FramebufferRenderbuffer,
+        GenRenderbuffer,
+        DeleteRenderbuffer,
+        BindRenderbuffer,
+        RenderbufferStorage,
+        RenderbufferStorageMultisample,
+        BlitFramebuffer,
+        Viewport,
+
+        Clear,
+        ClearColor,
+        Enable,
+        Disable,
+        BlendFunc,
+        DepthFunc,
+
+        OpCount,
+    };
+
+    /// Uniform types, the first argument of Uniform records.
+    enum UniformType : uint8_t {
+        Uniform1i,
+        Uniform1ui,
+        Uniform1f,
+        Uniform1d,
+        Uniform2fv,
+        Uniform3fv,
+        Uniform4fv,
+        UniformMatrix2fv,
+        UniformMatrix3fv,
+        UniformMatrix4fv,
+    };
+
+    struct Record {
+        Op op;
+        std::vector<uint64_t> args;
+        std::vector<uint32_t> payloads;
+    };
+
+    static uint64_t floatBits(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    static float bitsFloat(uint64_t value) {
+        uint32_t bits = uint32_t(value);
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    static void writeVarint(std::ostream & out, uint64_t value) {
+        do {
+            uint8_t byte = value & 0x7f;
+            value >>= 7;
+            if (value)
+                byte |= 0x80;
+            out.put(char(byte));
+        } while (value);
+    }
+
+    static uint64_t readVarint(std::istream & in) {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int byte = in.get();
+            if (byte == EOF)
+                throw std::runtime_error("Truncated capture");
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw std::runtime_error("Invalid varint in capture");
+    }
+};
+
+/**
+ * Writes records and deduplicated payloads to a stream. Only the offset of
+ * each distinct payload is kept, a payload with the same hash is compared
+ * with the bytes read back from the stream.
+ */
+class CaptureWriter {
+    struct Blob {
+        uint32_t id;
+        std::streamoff offset;
+        size_t size;
+    };
+
+    std::iostream & out;
+    // Content hash and size to the blobs with it, usually one
+    std::unordered_map<uint64_t, std::vector<Blob>> blobs;
+    uint32_t nextBlob;
+    uint64_t payloadBytes;
+    uint64_t dedupedBytes;
+
+public:
+    /// @param out a stream that can also be read back, fstream or stringstream
+    CaptureWriter(std::iostream & out, uint32_t width, uint32_t height)
+        : out(out), nextBlob(1), payloadBytes(0), dedupedBytes(0) {
+        out.write(CaptureFormat::magic, 8);
+        uint32_t header[3] = {CaptureFormat::version, width, height};
+        out.write(reinterpret_cast<const char *>(header), sizeof(header));
+    }
+
+    /**
+     * Store a payload, or find an identical one stored before.
+     *
+     * @return the blob id, 0 for no data
+     */
+    uint32_t payload(const void * data, size_t size) {
+        if (!data)
+            return 0;
+
+        uint64_t key = hash(data, size) ^ (uint64_t(size) * 0x9e3779b97f4a7c15);
+        auto & bucket = blobs[key];
+        for (auto & blob : bucket) {
+            if (blob.size == size && written(blob, data)) {
+                dedupedBytes += size;
+                return blob.id;
+            }
+        }
+
+        uint32_t id = nextBlob++;
+        out.put(char(CaptureFormat::Blob));
+        CaptureFormat::writeVarint(out, id);
+        CaptureFormat::writeVarint(out, size);
+        bucket.push_back({id, std::streamoff(out.tellp()), size});
+        out.write(static_cast<const char *>(data), size);
+        payloadBytes += size;
+        return id;
+    }
+
+    void record(CaptureFormat::Op op,
+                std::initializer_list<uint64_t> args,
+                std::initializer_list<uint32_t> payloads = {}) {
+        out.put(char(op));
+        out.put(char(args.size()));
+        out.put(char(payloads.size()));
+        for (auto arg : args)
+            CaptureFormat::writeVarint(out, arg);
+        for (auto id : payloads)
+            CaptureFormat::writeVarint(out, id);
+    }
+
+    /// Bytes of payloads written, after deduplication.
+    uint64_t getPayloadBytes() const {
+        return payloadBytes;
+    }
+
+    /// Bytes of payloads that were already stored.
+    uint64_t getDedupedBytes() const {
+        return dedupedBytes;
+    }
+
+private:
+    /// Whether the bytes stored for blob are data, read back from the
+    /// stream, which then goes on writing at the end.
+    bool written(const Blob & blob, const void * data) {
+        auto end = out.tellp();
+        out.seekg(blob.offset);
+        auto bytes = static_cast<const char *>(data);
+        char chunk[4096];
+        bool same = true;
+        for (size_t i = 0; same && i < blob.size; i += sizeof(chunk)) {
+            size_t count = std::min(sizeof(chunk), blob.size - i);
+            same = out.read(chunk, count)
+                   && std::memcmp(chunk, bytes + i, count) == 0;
+        }
+        out.clear();
+        out.seekp(end);
+        return same;
+    }
+
+    // FNV-1a over 8 byte words, then the tail
+    static uint64_t hash(const void * data, size_t size) {
+        const uint64_t prime = 0x100000001b3;
+        uint64_t h = 0xcbf29ce484222325;
+        auto bytes = static_cast<const unsigned char *>(data);
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, 8);
+            h = (h ^ word) * prime;
+        }
+        for (; i < size; i++)
+            h = (h ^ bytes[i]) * prime;
+        return h;
+    }
+};
+
+/// Reads records, keeping the payloads in memory.
+class CaptureReader {
+    std::istream & in;
+    uint32_t width;
+    uint32_t height;
+    std::unordered_map<uint32_t, std::vector<unsigned char>> blobs;
+
+public:
+    /// @throws std::runtime_error if the stream is not a capture
+    CaptureReader(std::istream & in) : in(in) {
+        char magic[8];
+        uint32_t header[3];
+        in.read(magic, 8);
+        in.read(reinterpret_cast<char *>(header), sizeof(header));
+        if (!in || std::memcmp(magic, CaptureFormat::magic, 8) != 0)
+            throw std::runtime_error("Not a GL capture");
+        if (header[0] != CaptureFormat::version)
+            throw std::runtime_error("Unsupported capture version "
+                                     + std::to_string(header[0]));
+        width = header[1];
+        height = header[2];
+    }
+
+    uint32_t getWidth() const {
+        return width;
+    }
+
+    uint32_t getHeight() const {
+        return height;
+    }
+
+    /**
+     * Read the next record, storing any blobs before it.
+     *
+     * @return false at the end of the stream
+     * @throws std::runtime_error if the stream is truncated
+     */
+    bool next(CaptureFormat::Record & record) {
+        while (true) {
+            int op = in.get();
+            if (op == EOF)
+                return false;
+
+            if (op == CaptureFormat::Blob) {
+                uint32_t id = CaptureFormat::readVarint(in);
+                size_t size = CaptureFormat::readVarint(in);
+                auto & blob = blobs[id];
+                blob.resize(size);
+                in.read(reinterpret_cast<char *>(blob.data()), size);
+                if (!in)
+                    throw std::runtime_error("Truncated capture");
+                continue;
+            }
+
+            int args = in.get();
+            int payloads = in.get();
+            if (args == EOF || payloads == EOF)
+                throw std::runtime_error("Truncated capture");
+
+            record.op = CaptureFormat::Op(op);
+            record.args.resize(args);
+            record.payloads.resize(payloads);
+            for (auto & arg : record.args)
+                arg = CaptureFormat::readVarint(in);
+            for (auto & id : record.payloads)
+                id = CaptureFormat::readVarint(in);
+            return true;
+        }
+    }
+
+    /// Data of a payload, nullptr for id 0.
+    const unsigned char * getPayload(uint32_t id) const {
+        if (id == 0)
+            return nullptr;
+        auto it = blobs.find(id);
+        if (it == blobs.end())
+            throw std::runtime_error("Missing capture payload "
+                                     + std::to_string(id));
+        return it->second.data();
+    }
+
+    size_t getPayloadSize(uint32_t id) const {
+        auto it = blobs.find(id);
+        return it == blobs.end() ? 0 : it->second.size();
+    }
+};
@@ -0,0 +1,407 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Texture.hpp"
+
+/**
+ * CPU decoder for the BC1-BC5 block formats, used when the driver does not
+ * support a format. Output is tightly packed RGBA with 8 bits per channel.
+ * BC4 decodes to red and BC5 to red and green, matching what the shader
+ * would sample from the compressed texture.
+ */
+class BlockDecoder {
+public:
+    /**
+     * Decode a single mip level.
+     *
+     * @throws Texture::TextureLoadException for BC6H and BC7, which have
+     * no CPU fallback
+     */
+    static std::vector<unsigned char> decode(Texture::Format format,
+                                             const glm::uvec2 & size,
+                                             const unsigned char * data) {
+        std::vector<unsigned char> pixels(size.x * size.y * 4);
+        size_t blockBytes = Texture::blockBytes(format);
+        unsigned blocksX = std::max(1u, (size.x + 3) / 4);
+        unsigned blocksY = std::max(1u, (size.y + 3) / 4);
+
+        for (unsigned by = 0; by < blocksY; by++) {
+            for (unsigned bx = 0; bx < blocksX; bx++) {
+                unsigned char block[16 * 4];
+                decodeBlock(format, data, block);
+                data += blockBytes;
+
+                // Copy the part of the block inside the image
+                for (unsigned y = 0; y < 4 && by * 4 + y < size.y; y++) {
+                    for (unsigned x = 0; x < 4 && bx * 4 + x < size.x; x++) {
+                        size_t dst = ((by * 4 + y) * size.x + bx * 4 + x) * 4;
+                        std::memcpy(&pixels[dst], &block[(y * 4 + x) * 4], 4);
+                    }
+                }
+            }
+        }
+        return pixels;
+    }
+
+private:
+    static void decodeBlock(Texture::Format format,
+                            const unsigned char * src,
+                            unsigned char * dst) {
+        switch (format) {
+            case Texture::BC1:
+            case Texture::BC1SRGB:
+                decodeColor(src, dst, false);
+                break;
+            case Texture::BC2:
+            case Texture::BC2SRGB:
+                decodeColor(src + 8, dst, true);
+                for (int i = 0; i < 16; i++) {
+                    unsigned nibble = (src[i / 2] >> ((i % 2) * 4)) & 0xF;
+                    dst[i * 4 + 3] = nibble * 17;
+                }
+                break;
+            case Texture::BC3:
+            case Texture::BC3SRGB:
+                decodeColor(src + 8, dst, true);
+                decodeChannel(src, dst + 3);
+                break;
+            case Texture::BC4:
+                for (int i = 0; i < 16; i++) {
+                    dst[i * 4 + 1] = dst[i * 4 + 2] = 0;
+                    dst[i * 4 + 3] = 255;
+                }
+                decodeChannel(src, dst);
+                break;
+            case Texture::BC5:
+                for (int i = 0; i < 16; i++) {
+                    dst[i * 4 + 2] = 0;
+                    dst[i * 4 + 3] = 255;
+                }
+                decodeChannel(src, dst);
+                decodeChannel(src + 8, dst + 1);
+                break;
+            default:
+                throw Texture::TextureLoadException(
+                    "No CPU decoder for compressed format");
+        }
+    }
+
+    static void decodeColor(const unsigned char * src,
+                            unsigned char * dst,
+                            bool fourColor) {
+        unsigned c0 = src[0] | (src[1] << 8);
+        unsigned c1 = src[2] | (src[3] << 8);
+
+        unsigned char palette[4][4];
+        expand565(c0, palette[0]);
+        expand565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            if (fourColor || c0 > c1) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            else {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+        palette[2][3] = 255;
+        palette[3][3] = (fourColor || c0 > c1) ? 255 : 0;
+
+        uint32_t indices = src[4] | (src[5] << 8) | (src[6] << 16)
+                           | (uint32_t(src[7]) << 24);
+        for (int i = 0; i < 16; i++)
+            std::memcpy(dst + i * 4, palette[(indices >> (i * 2)) & 3], 4);
+    }
+
+    /// Decode a BC4 style block into every 4th byte of dst.
+    static void decodeChannel(const unsigned char * src, unsigned char * dst) {
+        unsigned a0 = src[0];
+        unsigned a1 = src[1];
+
+        unsigned char values[8];
+        values[0] = a0;
+        values[1] = a1;
+        if (a0 > a1) {
+            for (int i = 2; i < 8; i++)
+                values[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+        }
+        else {
+            for (int i = 2; i < 6; i++)
+                values[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+            values[6] = 0;
+            values[7] = 255;
+        }
+
+        uint64_t indices = 0;
+        for (int i = 0; i < 6; i++)
+            indices |= uint64_t(src[2 + i]) << (i * 8);
+        for (int i = 0; i < 16; i++)
+            dst[i * 4] = values[(indices >> (i * 3)) & 7];
+    }
+
+    static void expand565(unsigned color, unsigned char * dst) {
+        dst[0] = ((color >> 11) & 31) * 255 / 31;
+        dst[1] = ((color >> 5) & 63) * 255 / 63;
+        dst[2] = (color & 31) * 255 / 31;
+        dst[3] = 255;
+    }
+};
+
+/**
+ * A block compressed image with its mip chain, loaded from a KTX2 or DDS
+ * container. Supercompressed KTX2, cube maps and arrays are not supported.
+ */
+struct CompressedImage {
+    Texture::Format format;
+    glm::uvec2 size;
+    std::vector<std::vector<unsigned char>> levels;
+
+    /**
+     * Create a texture from the image. If the driver does not support the
+     * format, the first level is decoded on the CPU and uploaded as RGBA,
+     * or SRGB8A8 for the sRGB formats, with generated mipmaps instead.
+     *
+     * @throws Texture::TextureLoadException if the format is unsupported
+     * and can't be decoded on the CPU
+     */
+    Texture toTexture(Texture::Filter magFilter = Texture::Linear,
+                      Texture::Filter minFilter = Texture::LinearMmLinear,
+                      Texture::Wrap wrap = Texture::Repeat) const {
+        if (!Texture::isSupported(format)) {
+            auto pixels = BlockDecoder::decode(format, size, levels[0].data());
+            if (!isSRGB(format))
+                return Texture(pixels.data(), size, 4, magFilter, minFilter,
+                               wrap, true);
+            Texture texture(size, Texture::SRGB8A8, Texture::RGBA,
+                            GL_UNSIGNED_BYTE, 0, magFilter, minFilter, wrap,
+                            true);
+            texture.loadSubImage(pixels.data(), glm::uvec2(0), size, 4);
+            texture.generateMipmaps();
+            return texture;
+        }
+
+        Texture texture(glm::uvec2(0), Texture::RGBA, Texture::RGBA,
+                        GL_UNSIGNED_BYTE, 0, magFilter, minFilter, wrap, false);
+        texture.loadCompressed(format, size, levels);
+        return texture;
+    }
+
+    /**
+     * Load a KTX2 or DDS file, picking the container from its header.
+     *
+     * @throws Texture::TextureLoadException if the file can't be read or
+     * is not a supported container
+     */
+    static CompressedImage fromPath(const std::string & path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            throw Texture::TextureLoadException("Failed to open " + path);
+        std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)),
+                                        std::istreambuf_iterator<char>());
+
+        if (data.size() >= 12 && std::memcmp(data.data(), ktx2Magic, 12) == 0)
+            return fromKTX2(data);
+        if (data.size() >= 4 && std::memcmp(data.data(), "DDS ", 4) == 0)
+            return fromDDS(data);
+        throw Texture::TextureLoadException("Unknown container " + path);
+    }
+
+    /**
+     * Parse a DDS file in memory. Both the legacy FourCC header and the
+     * DX10 extension are supported.
+     *
+     * @throws Texture::TextureLoadException if the data is not a block
+     * compressed DDS file
+     */
+    static CompressedImage fromDDS(const std::vector<unsigned char> & data) {
+        if (data.size() < 128 || std::memcmp(data.data(), "DDS ", 4) != 0)
+            throw Texture::TextureLoadException("Invalid DDS header");
+
+        CompressedImage image;
+        image.size = glm::uvec2(read32(data, 16), read32(data, 12));
+        unsigned mipCount = std::max(read32(data, 28), 1u);
+
+        size_t offset = 128;
+        uint32_t fourCC = read32(data, 84);
+        if (fourCC == makeFourCC("DXT1"))
+            image.format = Texture::BC1;
+        else if (fourCC == makeFourCC("DXT3"))
+            image.format = Texture::BC2;
+        else if (fourCC == makeFourCC("DXT5"))
+            image.format = Texture::BC3;
+        else if (fourCC == makeFourCC("ATI1") || fourCC == makeFourCC("BC4U"))
+            image.format = Texture::BC4;
+        else if (fourCC == makeFourCC("ATI2") || fourCC == makeFourCC("BC5U"))
+            image.format = Texture::BC5;
+        else if (fourCC == makeFourCC("DX10")) {
+            if (data.size() < 148)
+                throw Texture::TextureLoadException("Invalid DDS header");
+            image.format = fromDXGI(read32(data, 128));
+            if (read32(data, 140) > 1)
+                throw Texture::TextureLoadException("DDS arrays not supported");
+            offset = 148;
+        }
+        else
+            throw Texture::TextureLoadException("Unsupported DDS format");
+
+        glm::uvec2 levelSize = image.size;
+        for (unsigned i = 0; i < mipCount; i++) {
+            size_t length = levelBytes(image.format, levelSize);
+            if (length > data.size() - offset)
+                throw Texture::TextureLoadException("Truncated DDS data");
+            image.levels.emplace_back(data.begin() + offset,
+                                      data.begin() + offset + length);
+            offset += length;
+            levelSize = glm::max(levelSize / 2u, glm::uvec2(1));
+        }
+        return image;
+    }
+
+    /**
+     * Parse a KTX2 file in memory.
+     *
+     * @throws Texture::TextureLoadException if the data is not a block
+     * compressed KTX2 file without supercompression
+     */
+    static CompressedImage fromKTX2(const std::vector<unsigned char> & data) {
+        if (data.size() < 80 || std::memcmp(data.data(), ktx2Magic, 12) != 0)
+            throw Texture::TextureLoadException("Invalid KTX2 header");
+
+        CompressedImage image;
+        image.format = fromVkFormat(read32(data, 12));
+        image.size = glm::uvec2(read32(data, 20), read32(data, 24));
+        if (read32(data, 32) > 1 || read32(data, 36) != 1)
+            throw Texture::TextureLoadException(
+                "KTX2 arrays and cube maps not supported");
+        if (read32(data, 44) != 0)
+            throw Texture::TextureLoadException(
+                "KTX2 supercompression not supported");
+
+        // In 64 bits, so a huge level count can't wrap past the check
+        uint64_t levelCount = std::max(read32(data, 40), 1u);
+        if (80 + levelCount * 24 > data.size())
+            throw Texture::TextureLoadException("Truncated KTX2 data");
+
+        glm::uvec2 levelSize = image.size;
+        for (size_t i = 0; i < levelCount; i++) {
+            uint64_t offset = read64(data, 80 + i * 24);
+            uint64_t length = read64(data, 80 + i * 24 + 8);
+            // Not offset + length > size, which can wrap
+            if (length < levelBytes(image.format, levelSize)
+                || offset > data.size() || length > data.size() - offset)
+                throw Texture::TextureLoadException("Truncated KTX2 data");
+            image.levels.emplace_back(data.begin() + offset,
+                                      data.begin() + offset + length);
+            levelSize = glm::max(levelSize / 2u, glm::uvec2(1));
+        }
+        return image;
+    }
+
+    static size_t levelBytes(Texture::Format format, const glm::uvec2 & size) {
+        // size_t before adding, a size near 2^32 would wrap
+        return std::max<size_t>(1, (size_t(size.x) + 3) / 4)
+               * std::max<size_t>(1, (size_t(size.y) + 3) / 4)
+               * Texture::blockBytes(format);
+    }
+
+private:
+    static constexpr unsigned char ktx2Magic[12] = {
+        0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A,
+    };
+
+    static uint32_t read32(const std::vector<unsigned char> & data,
+                           size_t offset) {
+        return data[offset] | (data[offset + 1] << 8)
+               | (data[offset + 2] << 16) | (uint32_t(data[offset + 3]) << 24);
+    }
+
+    static uint64_t read64(const std::vector<unsigned char> & data,
+                           size_t offset) {
+        return read32(data, offset) | (uint64_t(read32(data, offset + 4)) << 32);
+    }
+
+    /// The formats BlockDecoder decodes that hold sRGB colors.
+    static bool isSRGB(Texture::Format format) {
+        return format == Texture::BC1SRGB || format == Texture::BC2SRGB
+               || format == Texture::BC3SRGB;
+    }
+
+    static uint32_t makeFourCC(const char * code) {
+        return code[0] | (code[1] << 8) | (code[2] << 16)
+               | (uint32_t(code[3]) << 24);
+    }
+
+    static Texture::Format fromDXGI(uint32_t format) {
+        switch (format) {
+            case 71: // DXGI_FORMAT_BC1_UNORM
+                return Texture::BC1;
+            case 72: // DXGI_FORMAT_BC1_UNORM_SRGB
+                return Texture::BC1SRGB;
+            case 74: // DXGI_FORMAT_BC2_UNORM
+                return Texture::BC2;
+            case 75: // DXGI_FORMAT_BC2_UNORM_SRGB
+                return Texture::BC2SRGB;
+            case 77: // DXGI_FORMAT_BC3_UNORM
+                return Texture::BC3;
+            case 78: // DXGI_FORMAT_BC3_UNORM_SRGB
+                return Texture::BC3SRGB;
+            case 80: // DXGI_FORMAT_BC4_UNORM
+                return Texture::BC4;
+            case 83: // DXGI_FORMAT_BC5_UNORM
+                return Texture::BC5;
+            case 95: // DXGI_FORMAT_BC6H_UF16
+                return Texture::BC6H;
+            case 98: // DXGI_FORMAT_BC7_UNORM
+                return Texture::BC7;
+            case 99: // DXGI_FORMAT_BC7_UNORM_SRGB
+                return Texture::BC7SRGB;
+            default:
+                throw Texture::TextureLoadException("Unsupported DXGI format");
+        }
+    }
+
+    static Texture::Format fromVkFormat(uint32_t format) {
+        switch (format) {
+            case 131: // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+            case 133: // VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+                return Texture::BC1;
+            case 132: // VK_FORMAT_BC1_RGB_SRGB_BLOCK
+            case 134: // VK_FORMAT_BC1_RGBA_SRGB_BLOCK
+                return Texture::BC1SRGB;
+            case 135: // VK_FORMAT_BC2_UNORM_BLOCK
+                return Texture::BC2;
+            case 136: // VK_FORMAT_BC2_SRGB_BLOCK
+                return Texture::BC2SRGB;
+            case 137: // VK_FORMAT_BC3_UNORM_BLOCK
+                return Texture::BC3;
+            case 138: // VK_FORMAT_BC3_SRGB_BLOCK
+                return Texture::BC3SRGB;
+            case 139: // VK_FORMAT_BC4_UNORM_BLOCK
+                return Texture::BC4;
+            case 141: // VK_FORMAT_BC5_UNORM_BLOCK
+                return Texture::BC5;
+            case 143: // VK_FORMAT_BC6H_UFLOAT_BLOCK
+                return Texture::BC6H;
+            case 145: // VK_FORMAT_BC7_UNORM_BLOCK
+                return Texture::BC7;
+            case 146: // VK_FORMAT_BC7_SRGB_BLOCK
+                return Texture::BC7SRGB;
+            default:
+                throw Texture::TextureLoadException("Unsupported KTX2 format");
+        }
+    }
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+#include "Buffer.hpp"
+#include "FrameBuffer.hpp"
+#include "Shader.hpp"
+#include "Texture.hpp"
+
+/**
+ * Pick the render scale that holds a target GPU frame time.
+ *
+ * Feed it the measured GPU time each frame and resize the scene frame
+ * buffer to getSize(). Use a bucketed FrameBuffer allocated for the full
+ * window (see FrameBuffer::setBucketSize) and don't trim() it, so scale
+ * changes only move the viewport instead of reallocating.
+ *
+ * Cost is assumed proportional to the pixel count, so the scale moves
+ * towards sqrt(target / measured). It drops quickly when over budget and
+ * grows slowly when there is headroom. After a change it waits for the
+ * measurements still in flight before changing again.
+ */
+class DynamicResolution {
+    double targetMs;
+    float minScale;
+    float maxScale;
+    float scale;
+    double smoothed;
+    int cooldown;
+    int wait;
+
+public:
+    /**
+     * @param targetMs the GPU time per frame to hold
+     * @param minScale the lowest scale of each dimension
+     * @param maxScale the highest scale of each dimension
+     * @param latency frames between a change and its first measurement,
+     *                the GpuTimer latency
+     */
+    DynamicResolution(double targetMs = 1000.0 / 60,
+                      float minScale = 0.5f,
+                      float maxScale = 1.0f,
+                      int latency = 4)
+        : targetMs(targetMs), minScale(minScale), maxScale(maxScale),
+          scale(maxScale), smoothed(0), cooldown(latency), wait(0) {}
+
+    /**
+     * Update the scale from a GPU frame time measurement.
+     *
+     * @return the new scale
+     */
+    float update(double gpuMs) {
+        smoothed = smoothed > 0 ? smoothed + (gpuMs - smoothed) * 0.25 : gpuMs;
+
+        if (wait > 0) {
+            wait--;
+            return scale;
+        }
+
+        double ratio = targetMs / std::max(smoothed, 1e-3);
+        float ideal = scale * float(std::sqrt(ratio));
+        float next = scale;
+        if (smoothed > targetMs)
+            next = std::max(ideal, scale - 0.1f);
+        else if (smoothed < targetMs * 0.85)
+            next = std::min(ideal, scale + 0.02f);
+        next = std::min(std::max(next, minScale), maxScale);
+
+        if (next != scale) {
+            scale = next;
+            wait = cooldown;
+        }
+        return scale;
+    }
+
+    /// Size of the scene drawing area for a window size.
+    glm::ivec2 getSize(int width, int height) const {
+        glm::vec2 size = glm::round(glm::vec2(width, height) * scale);
+        return glm::max(glm::ivec2(size), glm::ivec2(1));
+    }
+
+    float getScale() const {
+        return scale;
+    }
+
+    void setScale(float scale) {
+        this->scale = std::min(std::max(scale, minScale), maxScale);
+    }
+
+    /// Smoothed GPU frame time in milliseconds.
+    double getFrameTime() const {
+        return smoothed;
+    }
+
+    double getTarget() const {
+        return targetMs;
+    }
+
+    void setTarget(double targetMs) {
+        this->targetMs = targetMs;
+    }
+};
+
+/**
+ * Upscale the drawing area of a frame buffer with a sharpening filter, to
+ * recover some of the detail lost to a lower render scale. A cheaper
+ * alternative is FrameBuffer::blit with GL_LINEAR.
+ */
+class Upscaler {
+    Shader shader;
+    Shader::Uniform uvScale;
+    Shader::Uniform texelSize;
+    Shader::Uniform sharpness;
+    Quad quad;
+
+public:
+    Upscaler()
+        : shader(vertexShaderSource, fragmentShaderSource),
+          uvScale(shader.uniform("uvScale")),
+          texelSize(shader.uniform("texelSize")),
+          sharpness(shader.uniform("sharpness")) {}
+
+    /**
+     * Draw the drawing area of source over the drawing area of target.
+     *
+     * @param source the scene frame buffer
+     * @param color the color texture attached to source
+     * @param target the frame buffer to draw into
+     * @param amount the sharpening strength, 0 is plain bilinear
+     */
+    void draw(const FrameBuffer & source,
+              const Texture & color,
+              const FrameBuffer & target,
+              float amount = 0.5f) {
+        target.bind();
+        target.viewport();
+
+        shader.bind();
+        uvScale.setVec2(source.getUVScale());
+        texelSize.setVec2(glm::vec2(1.0f) / glm::vec2(color.getSize()));
+        sharpness.setValue(amount);
+        color.bind();
+        quad.draw();
+    }
+
+private:
+    static constexpr const char * vertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+out vec2 FragTex;
+void main() {
+    gl_Position = vec4(aPos, 1.0);
+    FragTex = aTex;
+})";
+
+    // Unsharp mask with the 4 neighbours, clamped to the drawing area so
+    // stale texels of a larger allocation never leak in
+    static constexpr const char * fragmentShaderSource = R"(
+#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+uniform vec2 uvScale;
+uniform vec2 texelSize;
+uniform float sharpness;
+vec3 fetch(vec2 uv) {
+    vec2 lo = texelSize * 0.5;
+    return texture(gTexture, clamp(uv, lo, uvScale - lo)).rgb;
+}
+void main() {
+    vec2 uv = FragTex * uvScale;
+    vec3 c = fetch(uv);
+    vec3 n = fetch(uv + vec2(0.0, texelSize.y));
+    vec3 s = fetch(uv - vec2(0.0, texelSize.y));
+    vec3 e = fetch(uv + vec2(texelSize.x, 0.0));
+    vec3 w = fetch(uv - vec2(texelSize.x, 0.0));
+    vec3 sharp = c + (4.0 * c - n - s - e - w) * sharpness * 0.25;
+    // Limit ringing to the local range
+    vec3 lo = min(c, min(min(n, s), min(e, w)));
+    vec3 hi = max(c, max(max(n, s), max(e, w)));
+    FragColor = vec4(clamp(sharp, lo, hi), 1.0);
+})";
+};
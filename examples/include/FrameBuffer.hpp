@@ -4,6 +4,8 @@
 // gl.h after glew.h, clang-format don't sort
 #include <GL/gl.h>
 
+#include <algorithm>
+#include <chrono>
 #include <glm/glm.hpp>
 #include <iostream>
 #include <memory>
@@ -16,11 +18,13 @@ class RenderBuffer {
     GLuint buffer;
     GLenum internal;
     int width, height;
+    GLsizei samples;
 
 public:
-    RenderBuffer(int width, int height, GLenum internal)
-        : internal(internal), width(width), height(height) {
+    RenderBuffer(int width, int height, GLenum internal, GLsizei samples = 0)
+        : internal(internal), width(width), height(height), samples(samples) {
         glGenRenderbuffers(1, &buffer);
+        GL_CAPTURE(GenRenderbuffer, buffer);
         resize(width, height);
     }
 
@@ -28,7 +32,8 @@ public:
         : buffer(other.buffer),
           internal(other.internal),
           width(other.width),
-          height(other.height) {
+          height(other.height),
+          samples(other.samples) {
         other.buffer = 0;
     }
 
@@ -38,6 +43,7 @@ public:
         internal = other.internal;
         width = other.width;
         height = other.height;
+        samples = other.samples;
         return *this;
     }
 
@@ -45,8 +51,10 @@ public:
     RenderBuffer & operator=(const RenderBuffer &) = delete;
 
     ~RenderBuffer() {
-        if (buffer)
+        if (buffer) {
+            GL_CAPTURE(DeleteRenderbuffer, buffer);
             glDeleteRenderbuffers(1, &buffer);
+        }
     }
 
     GLuint getBufferId() const {
@@ -61,18 +69,38 @@ public:
         return height;
     }
 
+    GLenum getInternal() const {
+        return internal;
+    }
+
+    GLsizei getSamples() const {
+        return samples;
+    }
+
     void resize(int width, int height) {
         this->width = width;
         this->height = height;
         bind();
-        glRenderbufferStorage(GL_RENDERBUFFER, internal, width, height);
+        if (samples > 0) {
+            GL_CAPTURE(RenderbufferStorageMultisample, GL_RENDERBUFFER,
+                       samples, internal, width, height);
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples,
+                                             internal, width, height);
+        }
+        else {
+            GL_CAPTURE(RenderbufferStorage, GL_RENDERBUFFER, internal, width,
+                       height);
+            glRenderbufferStorage(GL_RENDERBUFFER, internal, width, height);
+        }
     }
 
     void bind() const {
+        GL_CAPTURE(BindRenderbuffer, GL_RENDERBUFFER, buffer);
         glBindRenderbuffer(GL_RENDERBUFFER, buffer);
     }
 
     void unbind() const {
+        GL_CAPTURE(BindRenderbuffer, GL_RENDERBUFFER, 0);
         glBindRenderbuffer(GL_RENDERBUFFER, 0);
     }
 };
@@ -99,21 +127,71 @@ class FrameBuffer {
 
         void resize(int width, int height) {
             if (type == TEXTURE)
-                texture->resize({width, height});
+                texture->resize(glm::uvec2(width, height));
+            else
+                buffer->resize(width, height);
+        }
+
+        void reallocate(int width, int height) {
+            if (type == TEXTURE)
+                texture->reallocate(glm::uvec2(width, height));
             else
                 buffer->resize(width, height);
         }
+
+        void attach() const {
+            if (type == TEXTURE) {
+                GL_CAPTURE(FramebufferTexture2D, GL_FRAMEBUFFER, attachment,
+                           texture->getTarget(), texture->getTextureId(), 0);
+                glFramebufferTexture2D(GL_FRAMEBUFFER,
+                                       attachment,
+                                       texture->getTarget(),
+                                       texture->getTextureId(),
+                                       0);
+            }
+            else {
+                GL_CAPTURE(FramebufferRenderbuffer, GL_FRAMEBUFFER, attachment,
+                           GL_RENDERBUFFER, buffer->getBufferId());
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER,
+                                          attachment,
+                                          GL_RENDERBUFFER,
+                                          buffer->getBufferId());
+            }
+        }
     };
 
     GLuint buffer;
     std::vector<Attachment> attachments;
     int width, height;
 
-    FrameBuffer(GLuint buffer) : buffer(buffer) {}
+    // Allocated attachment size, larger than width and height when bucketed
+    int allocWidth, allocHeight;
+    int bucket;
+    std::chrono::milliseconds shrinkDelay;
+    std::chrono::steady_clock::time_point shrinkAt;
+    bool shrinkPending;
+
+    FrameBuffer(GLuint buffer)
+        : buffer(buffer),
+          width(0),
+          height(0),
+          allocWidth(0),
+          allocHeight(0),
+          bucket(0),
+          shrinkDelay(0),
+          shrinkPending(false) {}
 
 public:
-    FrameBuffer(int width, int height) : width(width), height(height) {
+    FrameBuffer(int width, int height)
+        : width(width),
+          height(height),
+          allocWidth(width),
+          allocHeight(height),
+          bucket(0),
+          shrinkDelay(0),
+          shrinkPending(false) {
         glGenFramebuffers(1, &buffer);
+        GL_CAPTURE(GenFramebuffer, buffer);
         bind();
     }
 
@@ -121,7 +199,13 @@ public:
         : buffer(other.buffer),
           attachments(std::move(other.attachments)),
           width(other.width),
-          height(other.height) {
+          height(other.height),
+          allocWidth(other.allocWidth),
+          allocHeight(other.allocHeight),
+          bucket(other.bucket),
+          shrinkDelay(other.shrinkDelay),
+          shrinkAt(other.shrinkAt),
+          shrinkPending(other.shrinkPending) {
         other.buffer = 0;
     }
 
@@ -131,6 +215,12 @@ public:
         attachments = std::move(other.attachments);
         width = other.width;
         height = other.height;
+        allocWidth = other.allocWidth;
+        allocHeight = other.allocHeight;
+        bucket = other.bucket;
+        shrinkDelay = other.shrinkDelay;
+        shrinkAt = other.shrinkAt;
+        shrinkPending = other.shrinkPending;
         return *this;
     }
 
@@ -138,36 +228,41 @@ public:
     FrameBuffer & operator=(const FrameBuffer &) = delete;
 
     ~FrameBuffer() {
-        if (buffer)
+        if (buffer) {
+            GL_CAPTURE(DeleteFramebuffer, buffer);
             glDeleteFramebuffers(1, &buffer);
+        }
     }
 
     GLuint getBufferId() const {
         return buffer;
     }
 
+    /**
+     * Attach a texture. The texture must match the allocated size, which
+     * is larger than getWidth() and getHeight() when bucketed.
+     */
     void attach(Texture * texture, GLenum attachment = GL_COLOR_ATTACHMENT0) {
-        if (texture->getSize().x != width || texture->getSize().y != height)
+        if (texture->getSize().x != allocWidth
+            || texture->getSize().y != allocHeight)
             throw std::runtime_error("Attachment size does not match");
 
         attachments.emplace_back(texture, attachment);
-        glFramebufferTexture2D(GL_FRAMEBUFFER,
-                               attachment,
-                               texture->getTarget(),
-                               texture->getTextureId(),
-                               0);
+        attachments.back().attach();
     }
 
+    /**
+     * Attach a render buffer. The buffer must match the allocated size,
+     * which is larger than getWidth() and getHeight() when bucketed.
+     */
     void attach(RenderBuffer * buffer,
                 GLenum attachment = GL_DEPTH_STENCIL_ATTACHMENT) {
-        if (buffer->getWidth() != width || buffer->getHeight() != height)
+        if (buffer->getWidth() != allocWidth
+            || buffer->getHeight() != allocHeight)
             throw std::runtime_error("Attachment size does not match");
 
         attachments.emplace_back(buffer, attachment);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER,
-                                  attachment,
-                                  GL_RENDERBUFFER,
-                                  buffer->getBufferId());
+        attachments.back().attach();
     }
 
     int getWidth() const {
@@ -178,31 +273,114 @@ public:
         return height;
     }
 
-    const std::vector<Attachment> & getAttachments() const {
-        return attachments;
+    int getAllocatedWidth() const {
+        return allocWidth;
+    }
+
+    int getAllocatedHeight() const {
+        return allocHeight;
+    }
+
+    /// Part of the attachments in use, to scale texture coordinates when
+    /// sampling an attachment.
+    glm::vec2 getUVScale() const {
+        return glm::vec2(float(width) / allocWidth, float(height) / allocHeight);
+    }
+
+    /**
+     * Allocate attachments in multiples of bucket pixels with immutable
+     * storage. Resizing within the allocation only changes the viewport, so
+     * a burst of resize events doesn't reallocate each time. Growing past
+     * the allocation reallocates at once, shrinking below it only after
+     * shrinkDelay without further resizes, see trim().
+     *
+     * Call before attaching, then create the attachments with
+     * getAllocatedWidth() and getAllocatedHeight().
+     *
+     * @param bucket the allocation granularity in pixels, 0 to allocate
+     *               the exact size
+     * @param shrinkDelay how long the size must be stable before shrinking
+     */
+    void setBucketSize(int bucket,
+                       std::chrono::milliseconds shrinkDelay =
+                           std::chrono::milliseconds(500)) {
+        this->bucket = bucket;
+        this->shrinkDelay = shrinkDelay;
+        shrinkPending = false;
+        allocate(roundUp(width), roundUp(height));
     }
 
+    /**
+     * Set the size of the drawing area. When bucketed the attachments are
+     * only reallocated if the new size does not fit.
+     */
     void resize(int width, int height) {
         this->width = width;
         this->height = height;
-        for (auto & att : attachments) {
-            att.resize(width, height);
+
+        if (bucket <= 0) {
+            allocWidth = width;
+            allocHeight = height;
+            for (auto & att : attachments) {
+                att.resize(width, height);
+            }
+            return;
+        }
+
+        int bucketWidth = roundUp(width);
+        int bucketHeight = roundUp(height);
+        if (width > allocWidth || height > allocHeight) {
+            allocate(std::max(bucketWidth, allocWidth),
+                     std::max(bucketHeight, allocHeight));
+        }
+
+        shrinkPending = bucketWidth < allocWidth || bucketHeight < allocHeight;
+        if (shrinkPending)
+            shrinkAt = std::chrono::steady_clock::now() + shrinkDelay;
+    }
+
+    /**
+     * Release memory from a bucketed allocation that is larger than needed
+     * once the size has been stable for the shrink delay. Call once per
+     * frame.
+     */
+    void trim() {
+        if (shrinkPending && std::chrono::steady_clock::now() >= shrinkAt) {
+            shrinkPending = false;
+            allocate(roundUp(width), roundUp(height));
         }
     }
 
+    /// Set the viewport to the drawing area.
+    void viewport() const {
+        GL_CAPTURE(Viewport, 0, 0, width, height);
+        glViewport(0, 0, width, height);
+    }
+
+    const std::vector<Attachment> & getAttachments() const {
+        return attachments;
+    }
+
     void bind(GLenum target = GL_FRAMEBUFFER) const {
+        GL_STATS_BIND(FrameBufferBinding, buffer);
+        GL_CAPTURE(BindFramebuffer, target, buffer);
         glBindFramebuffer(target, buffer);
     }
 
     void unbind() const {
+        GL_STATS_BIND(FrameBufferBinding, 0);
+        GL_CAPTURE(BindFramebuffer, GL_FRAMEBUFFER, 0);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
+    /// Copy the drawing area of source to the drawing area of this buffer.
     void blit(const FrameBuffer & source,
               GLbitfield mask = GL_COLOR_BUFFER_BIT,
               GLenum filter = GL_NEAREST) const {
         source.bind(GL_READ_FRAMEBUFFER);
         bind(GL_DRAW_FRAMEBUFFER);
+        GL_CAPTURE(BlitFramebuffer, 0, 0, source.width, source.height, 0, 0,
+                   width, height, mask, filter);
         glBlitFramebuffer(0, 0, source.width, source.height, //
                           0, 0, width, height, //
                           mask, filter);
@@ -212,4 +390,29 @@ public:
         static FrameBuffer buffer(0);
         return buffer;
     }
+
+private:
+    int roundUp(int size) const {
+        if (bucket <= 0)
+            return size;
+        return std::max(1, (size + bucket - 1) / bucket) * bucket;
+    }
+
+    void allocate(int width, int height) {
+        if (buffer == 0 || (width == allocWidth && height == allocHeight))
+            return;
+
+        allocWidth = width;
+        allocHeight = height;
+
+        GLint previous = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+        bind();
+        for (auto & att : attachments) {
+            att.reallocate(width, height);
+            att.attach();
+        }
+        GL_CAPTURE(BindFramebuffer, GL_FRAMEBUFFER, previous);
+        glBindFramebuffer(GL_FRAMEBUFFER, previous);
+    }
 };
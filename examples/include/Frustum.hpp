@@ -0,0 +1,99 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cmath>
+
+#include "Bounds.hpp"
+
+/**
+ * The six planes of a view frustum, facing inwards, with normals of unit
+ * length so plane distances are in world units.
+ */
+struct Frustum {
+    enum Plane {
+        Left,
+        Right,
+        Bottom,
+        Top,
+        Near,
+        Far,
+    };
+
+    /// (normal, distance), a point p is inside if dot(normal, p) + distance
+    /// is not negative for each plane
+    std::array<glm::vec4, 6> planes = {};
+
+    /**
+     * The frustum of a projection * view matrix, in world space, or of a
+     * projection * view * model matrix, in model space. The planes are sums
+     * and differences of the rows of the matrix (Gribb and Hartmann), for
+     * OpenGL clip space where -w <= z <= w.
+     */
+    static Frustum fromMatrix(const glm::mat4 & viewProjection) {
+        const glm::mat4 & m = viewProjection;
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+        Frustum frustum;
+        frustum.planes[Left] = row[3] + row[0];
+        frustum.planes[Right] = row[3] - row[0];
+        frustum.planes[Bottom] = row[3] + row[1];
+        frustum.planes[Top] = row[3] - row[1];
+        frustum.planes[Near] = row[3] + row[2];
+        frustum.planes[Far] = row[3] - row[2];
+        for (auto & plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    /// If point is inside or on all planes.
+    bool contains(const glm::vec3 & point) const {
+        for (auto & plane : planes) {
+            if (distance(plane, point) < 0)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * If box is not fully outside any plane. Conservative, a box outside
+     * the frustum near a corner can still intersect.
+     */
+    bool intersects(const AABB & box) const {
+        if (box.empty())
+            return false;
+        glm::vec3 center = box.center(), extents = box.extents();
+        for (auto & plane : planes) {
+            if (distance(plane, center) + radius(plane, extents) < 0)
+                return false;
+        }
+        return true;
+    }
+
+    /// If sphere is not fully outside any plane, conservative like boxes.
+    bool intersects(const Sphere & sphere) const {
+        if (sphere.empty())
+            return false;
+        for (auto & plane : planes) {
+            if (distance(plane, sphere.center) + sphere.radius < 0)
+                return false;
+        }
+        return true;
+    }
+
+    /// Signed distance of point to plane, in the order of operations of
+    /// the BoundsBuffer kernels.
+    static float distance(const glm::vec4 & plane, const glm::vec3 & point) {
+        return plane.x * point.x + plane.y * point.y + plane.z * point.z
+               + plane.w;
+    }
+
+    /// The extent of a box along the normal of plane.
+    static float radius(const glm::vec4 & plane, const glm::vec3 & extents) {
+        return std::abs(plane.x) * extents.x + std::abs(plane.y) * extents.y
+               + std::abs(plane.z) * extents.z;
+    }
+};
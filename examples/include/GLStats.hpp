@@ -0,0 +1,171 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * Counters of GL work done through the wrapper classes, compiled in with
+ * -DGL_STATS_ENABLED (the CMake option ENABLE_GL_STATS) and to nothing
+ * otherwise.
+ *
+ * Counters are relaxed atomics, so any thread may draw or upload. The last
+ * bound object of each kind is tracked per thread, like GL contexts, to tell
+ * switches from redundant binds. Texture switches are counted per thread,
+ * not per texture unit.
+ */
+#ifdef GL_STATS_ENABLED
+#define GL_STATS_DRAW(vertices, instances) \
+    GLStats::get().draw(vertices, instances)
+#define GL_STATS_BIND(kind, id) GLStats::get().bind(GLStats::kind, id)
+#define GL_STATS_UPLOAD(kind, bytes) GLStats::get().upload(GLStats::kind, bytes)
+#else
+#define GL_STATS_DRAW(vertices, instances) ((void)0)
+#define GL_STATS_BIND(kind, id) ((void)0)
+#define GL_STATS_UPLOAD(kind, bytes) ((void)0)
+#endif
+
+/// GL work of one frame.
+struct GLFrameStats {
+    uint64_t drawCalls;
+    uint64_t instances;
+    uint64_t vertices;
+    uint64_t programSwitches;
+    uint64_t vertexArraySwitches;
+    uint64_t textureSwitches;
+    uint64_t frameBufferSwitches;
+    /// Binds of the object that was already bound
+    uint64_t redundantBinds;
+    uint64_t bufferBytes;
+    uint64_t textureBytes;
+};
+
+class GLStats {
+public:
+    enum Binding {
+        ProgramBinding,
+        VertexArrayBinding,
+        TextureBinding,
+        FrameBufferBinding,
+        BindingCount,
+    };
+
+    enum Upload {
+        BufferUpload,
+        TextureUpload,
+    };
+
+    /// Stop counting on this thread while in scope, for tools like overlays.
+    class Suspend {
+    public:
+        Suspend() {
+            suspended()++;
+        }
+
+        Suspend(const Suspend &) = delete;
+        Suspend & operator=(const Suspend &) = delete;
+
+        ~Suspend() {
+            suspended()--;
+        }
+    };
+
+private:
+    enum Counter {
+        DrawCalls,
+        Instances,
+        Vertices,
+        ProgramSwitches,
+        VertexArraySwitches,
+        TextureSwitches,
+        FrameBufferSwitches,
+        RedundantBinds,
+        BufferBytes,
+        TextureBytes,
+        CounterCount,
+    };
+
+    std::atomic<uint64_t> counters[CounterCount];
+    std::mutex frameMutex;
+    GLFrameStats frame;
+
+    GLStats() : frame() {
+        for (auto & counter : counters)
+            counter.store(0, std::memory_order_relaxed);
+    }
+
+    static int & suspended() {
+        thread_local int count = 0;
+        return count;
+    }
+
+    void add(Counter counter, uint64_t value) {
+        counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+public:
+    GLStats(const GLStats &) = delete;
+    GLStats & operator=(const GLStats &) = delete;
+
+    static GLStats & get() {
+        static GLStats stats;
+        return stats;
+    }
+
+    void draw(uint64_t vertices, uint64_t instances = 1) {
+        if (suspended())
+            return;
+        add(DrawCalls, 1);
+        add(Instances, instances);
+        add(Vertices, vertices * instances);
+    }
+
+    void bind(Binding binding, GLuint id) {
+        // Tracked while suspended too, the binding still changes
+        thread_local GLuint bound[BindingCount] = {};
+        bool counted = !suspended();
+
+        if (bound[binding] == id) {
+            if (counted)
+                add(RedundantBinds, 1);
+            return;
+        }
+        bound[binding] = id;
+        if (counted)
+            add(Counter(ProgramSwitches + binding), 1);
+    }
+
+    void upload(Upload upload, uint64_t bytes) {
+        if (suspended())
+            return;
+        add(upload == BufferUpload ? BufferBytes : TextureBytes, bytes);
+    }
+
+    /**
+     * Store the counts since the last call as the frame stats and start
+     * counting the next frame.
+     */
+    GLFrameStats endFrame() {
+        uint64_t values[CounterCount];
+        for (int i = 0; i < CounterCount; i++)
+            values[i] = counters[i].exchange(0, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(frameMutex);
+        frame = {values[DrawCalls],           values[Instances],
+                 values[Vertices],            values[ProgramSwitches],
+                 values[VertexArraySwitches], values[TextureSwitches],
+                 values[FrameBufferSwitches], values[RedundantBinds],
+                 values[BufferBytes],         values[TextureBytes]};
+        return frame;
+    }
+
+    /// Stats of the last frame ended with endFrame().
+    GLFrameStats getFrame() {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        return frame;
+    }
+};
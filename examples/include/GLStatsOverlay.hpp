@@ -0,0 +1,178 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Buffer.hpp"
+#include "GLStats.hpp"
+#include "Shader.hpp"
+#include "Texture.hpp"
+
+/**
+ * Draws GLFrameStats in the top left corner of the bound frame buffer with
+ * a built in 3x5 pixel font. Its own GL calls are not counted.
+ */
+class GLStatsOverlay {
+    static constexpr const char * glyphs =
+        " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ:./";
+
+    // Rows from top to bottom, bit 2 is the left column
+    static constexpr unsigned char bitmaps[][5] = {
+        {0, 0, 0, 0, 0}, // space
+        {7, 5, 5, 5, 7}, {2, 6, 2, 2, 7}, {7, 1, 7, 4, 7}, {7, 1, 7, 1, 7},
+        {5, 5, 7, 1, 1}, {7, 4, 7, 1, 7}, {7, 4, 7, 5, 7}, {7, 1, 1, 2, 2},
+        {7, 5, 7, 5, 7}, {7, 5, 7, 1, 7}, // 0-9
+        {2, 5, 7, 5, 5}, {6, 5, 6, 5, 6}, {3, 4, 4, 4, 3}, {6, 5, 5, 5, 6},
+        {7, 4, 6, 4, 7}, {7, 4, 6, 4, 4}, {3, 4, 5, 5, 3}, {5, 5, 7, 5, 5},
+        {7, 2, 2, 2, 7}, {1, 1, 1, 5, 2}, {5, 5, 6, 5, 5}, {4, 4, 4, 4, 7},
+        {5, 7, 7, 5, 5}, {6, 5, 5, 5, 5}, {2, 5, 5, 5, 2}, {6, 5, 6, 4, 4},
+        {2, 5, 5, 6, 3}, {6, 5, 6, 5, 5}, {3, 4, 2, 1, 6}, {7, 2, 2, 2, 2},
+        {5, 5, 5, 5, 7}, {5, 5, 5, 5, 2}, {5, 5, 7, 7, 5}, {5, 5, 2, 5, 5},
+        {5, 5, 2, 2, 2}, {7, 1, 2, 4, 7}, // A-Z
+        {0, 2, 0, 2, 0}, {0, 0, 0, 0, 2}, {1, 1, 2, 4, 4}, // : . /
+    };
+
+    // Glyph cells are 4x6 pixels, the font plus one pixel of spacing
+    static const int cellWidth = 4;
+    static const int cellHeight = 6;
+
+    Shader shader;
+    Texture font;
+    BufferArray array;
+    std::vector<float> vertices;
+
+public:
+    GLStatsOverlay()
+        : shader(vertexShaderSource, fragmentShaderSource),
+          font(createFont()),
+          array(std::vector<std::vector<Attribute>> {{
+              Attribute {0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0},
+              Attribute {1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float),
+                         (void *)(2 * sizeof(float))},
+          }}) {}
+
+    /**
+     * @param stats the stats to show
+     * @param width the viewport width in pixels
+     * @param height the viewport height in pixels
+     * @param scale the size of a font pixel in screen pixels
+     */
+    void draw(const GLFrameStats & stats, int width, int height, int scale = 2) {
+        GLStats::Suspend suspend;
+
+        vertices.clear();
+        int line = 0;
+        auto print = [&](const std::string & text, uint64_t value) {
+            addText(text + " " + std::to_string(value), line++, width, height,
+                    scale);
+        };
+        print("DRAWS", stats.drawCalls);
+        print("INSTANCES", stats.instances);
+        print("VERTICES", stats.vertices);
+        print("PROGRAMS", stats.programSwitches);
+        print("VAOS", stats.vertexArraySwitches);
+        print("TEXTURES", stats.textureSwitches);
+        print("FRAMEBUFFERS", stats.frameBufferSwitches);
+        print("REDUNDANT", stats.redundantBinds);
+        print("BUFFER KB", stats.bufferBytes / 1024);
+        print("TEXTURE KB", stats.textureBytes / 1024);
+
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        GLboolean depth = glIsEnabled(GL_DEPTH_TEST);
+        GL_CAPTURE(Enable, GL_BLEND);
+        glEnable(GL_BLEND);
+        GL_CAPTURE(BlendFunc, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        GL_CAPTURE(Disable, GL_DEPTH_TEST);
+        glDisable(GL_DEPTH_TEST);
+
+        shader.bind();
+        font.bind();
+        array.bind();
+        array.bufferData(0, vertices.size() * sizeof(float), vertices.data(),
+                         GL_STREAM_DRAW);
+        array.drawArrays(GL_TRIANGLES, 0, vertices.size() / 4);
+        array.unbind();
+
+        if (!blend) {
+            GL_CAPTURE(Disable, GL_BLEND);
+            glDisable(GL_BLEND);
+        }
+        if (depth) {
+            GL_CAPTURE(Enable, GL_DEPTH_TEST);
+            glEnable(GL_DEPTH_TEST);
+        }
+    }
+
+private:
+    static Texture createFont() {
+        int count = strlen(glyphs);
+        int width = count * cellWidth;
+        std::vector<unsigned char> pixels(width * cellHeight, 0);
+        for (int g = 0; g < count; g++) {
+            for (int row = 0; row < 5; row++) {
+                for (int col = 0; col < 3; col++) {
+                    if (bitmaps[g][row] & (4 >> col))
+                        // Texture rows go bottom up
+                        pixels[(cellHeight - 1 - row) * width + g * cellWidth
+                               + col] = 255;
+                }
+            }
+        }
+        return Texture(pixels.data(), glm::uvec2(width, cellHeight), 1,
+                       Texture::Nearest, Texture::Nearest, Texture::Clamp,
+                       false);
+    }
+
+    void addText(const std::string & text,
+                 int line,
+                 int width,
+                 int height,
+                 int scale) {
+        float count = strlen(glyphs);
+        float cw = cellWidth * scale * 2.0f / width;
+        float ch = cellHeight * scale * 2.0f / height;
+        float x = -1 + 8 * 2.0f / width;
+        float top = 1 - 8 * 2.0f / height - line * ch;
+
+        for (char c : text) {
+            const char * found = strchr(glyphs, c);
+            int g = found && c ? found - glyphs : 0;
+            float u0 = g / count;
+            float u1 = (g + 1) / count;
+            float quad[6][4] = {
+                {x, top - ch, u0, 0},      {x + cw, top - ch, u1, 0},
+                {x + cw, top, u1, 1},      {x, top - ch, u0, 0},
+                {x + cw, top, u1, 1},      {x, top, u0, 1},
+            };
+            for (auto & vertex : quad)
+                vertices.insert(vertices.end(), vertex, vertex + 4);
+            x += cw;
+        }
+    }
+
+    static constexpr const char * vertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTex;
+out vec2 FragTex;
+void main() {
+    gl_Position = vec4(aPos, 0.0, 1.0);
+    FragTex = aTex;
+})";
+
+    static constexpr const char * fragmentShaderSource = R"(
+#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+void main() {
+    float v = texture(gTexture, FragTex).r;
+    FragColor = mix(vec4(0.0, 0.0, 0.0, 0.6), vec4(1.0), v);
+})";
+};
@@ -0,0 +1,757 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Bounds.hpp"
+#include "Buffer.hpp"
+#include "Frustum.hpp"
+#include "Profiler.hpp"
+#include "Shader.hpp"
+#include "Texture.hpp"
+
+/// The arguments of one draw of glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+/**
+ * A max depth mip chain of a depth texture (a Hi-Z pyramid) for occlusion
+ * tests, reduced by a compute shader. Needs OpenGL 4.3.
+ *
+ * Level 0 is half the size of the depth texture. Each texel holds the
+ * farthest depth of the texels it covers, also when a level above has an
+ * odd size, so a box nearer than a texel is behind nothing it covers.
+ */
+class HiZPyramid {
+    Shader reduce;
+    Shader::Uniform sourceLevel;
+    GLuint texture;
+    glm::uvec2 size;
+    GLsizei levels;
+
+public:
+    HiZPyramid()
+        : reduce(reduceSource),
+          sourceLevel(reduce.uniform("sourceLevel")),
+          texture(0),
+          size(0),
+          levels(0) {}
+
+    HiZPyramid(HiZPyramid && other)
+        : reduce(std::move(other.reduce)),
+          sourceLevel(other.sourceLevel),
+          texture(other.texture),
+          size(other.size),
+          levels(other.levels) {
+        other.texture = 0;
+    }
+
+    HiZPyramid & operator=(HiZPyramid && other) {
+        reduce = std::move(other.reduce);
+        sourceLevel = other.sourceLevel;
+        texture = other.texture;
+        other.texture = 0;
+        size = other.size;
+        levels = other.levels;
+        return *this;
+    }
+
+    HiZPyramid(const HiZPyramid &) = delete;
+    HiZPyramid & operator=(const HiZPyramid &) = delete;
+
+    ~HiZPyramid() {
+        if (texture)
+            glDeleteTextures(1, &texture);
+    }
+
+    GLuint getTextureId() const {
+        return texture;
+    }
+
+    /// The size of level 0, 0 before the first build.
+    const glm::uvec2 & getSize() const {
+        return size;
+    }
+
+    GLsizei getLevels() const {
+        return levels;
+    }
+
+    /**
+     * Reduce a depth texture into the pyramid, reallocating it when the
+     * depth size changed. Leaves the pyramid bound to the active texture
+     * unit.
+     *
+     * @param depth a depth texture without multisampling
+     */
+    void build(const Texture & depth) {
+        PROFILE_ZONE("HiZPyramid::build");
+        glm::uvec2 depthSize = depth.getSize();
+        glm::uvec2 levelSize(std::max(depthSize.x / 2, 1u),
+                             std::max(depthSize.y / 2, 1u));
+        if (levelSize != size)
+            allocate(levelSize);
+
+        reduce.bind();
+        depth.bind();
+        for (GLsizei level = 0; level < levels; level++) {
+            if (level > 0) {
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+            }
+            sourceLevel.setValue(std::max(level - 1, 0));
+            glBindImageTexture(0, texture, level, GL_FALSE, 0, GL_WRITE_ONLY,
+                               GL_R32F);
+            reduce.dispatch((levelSize.x + 7) / 8, (levelSize.y + 7) / 8);
+            levelSize = glm::uvec2(std::max(levelSize.x / 2, 1u),
+                                   std::max(levelSize.y / 2, 1u));
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    /// Mip levels of a pyramid with level 0 of size, down to 1x1.
+    static GLsizei levelCount(const glm::uvec2 & size) {
+        GLsizei count = 1;
+        for (GLuint side = std::max(size.x, size.y); side > 1; side /= 2)
+            count++;
+        return count;
+    }
+
+private:
+    void allocate(const glm::uvec2 & levelSize) {
+        if (texture)
+            glDeleteTextures(1, &texture);
+        size = levelSize;
+        levels = levelCount(size);
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_R32F, size.x, size.y);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Each texel takes the max of the source texels overlapping it, between
+    // 2 and 3 along an axis, so texel t of a level covers exactly the range
+    // [t, t + 1) / size of texture coordinates
+    static constexpr const char * reduceSource = R"(
+#version 430 core
+layout (local_size_x = 8, local_size_y = 8) in;
+layout (r32f, binding = 0) uniform writeonly image2D destination;
+layout (binding = 0) uniform sampler2D source;
+uniform int sourceLevel;
+void main() {
+    ivec2 size = imageSize(destination);
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, size)))
+        return;
+    ivec2 sourceSize = textureSize(source, sourceLevel);
+    ivec2 first = texel * sourceSize / size;
+    ivec2 last = min(((texel + 1) * sourceSize + size - 1) / size,
+                     sourceSize) - 1;
+    float depth = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+            depth = max(depth, texelFetch(source, ivec2(x, y), sourceLevel).r);
+    imageStore(destination, texel, vec4(depth));
+})";
+};
+
+/**
+ * Culls instances on the GPU and draws the visible ones with one
+ * glMultiDrawElementsIndirect, whatever their count. Needs OpenGL 4.3.
+ *
+ * Meshes are index ranges of one BufferArray. Instances of a mesh have a
+ * model matrix and take the local bounds of their mesh. cull() runs three
+ * compute passes over the instances:
+ *
+ * - test each world box against the frustum and the Hi-Z pyramid of the
+ *   last buildHiZ(), and scan the visible flags of each work group
+ * - scan the visible counts of the work groups
+ * - copy the matrices of visible instances to the visible buffer at their
+ *   prefix sum, grouped by mesh, and write one draw command per mesh
+ *
+ * The CPU never reads the counts back. Attach the visible buffer to the
+ * BufferArray as per instance matrices with attach(), then draw().
+ *
+ * Occlusion uses the depth of the previous frame, with its view projection,
+ * so objects coming out from behind an occluder appear a frame late.
+ */
+class GpuCuller {
+public:
+    /// An index range of the BufferArray and the bounds of its vertices.
+    struct Mesh {
+        GLuint count;
+        GLuint firstIndex;
+        GLint baseVertex;
+        AABB bounds;
+    };
+
+    /// Instances per work group of the culling passes.
+    static constexpr uint32_t groupSize = 256;
+
+private:
+    // std430 layouts of the shader storage buffers
+    struct InstanceBounds {
+        glm::vec3 center;
+        uint32_t mesh;
+        glm::vec3 extents;
+        float padding;
+    };
+
+    struct MeshRange {
+        GLuint count;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint firstInstance;
+        GLuint instanceCount;
+    };
+
+    enum Binding : GLuint {
+        TransformBinding,
+        BoundsBinding,
+        OffsetBinding,
+        GroupBinding,
+        VisibleBinding,
+        MeshBinding,
+        CommandBinding,
+    };
+
+    Shader cullShader;
+    Shader scanShader;
+    Shader compactShader;
+    std::vector<Shader::Uniform> planes;
+    Shader::Uniform cullCount, occlusion, occlusionViewProjection;
+    Shader::Uniform scanGroups;
+    Shader::Uniform compactCount, compactMeshCount;
+
+    Buffer transformBuffer;
+    Buffer boundsBuffer;
+    Buffer offsetBuffer;
+    Buffer groupBuffer;
+    Buffer meshBuffer;
+    Buffer visibleBuffer;
+    Buffer commandBuffer;
+
+    std::vector<Mesh> meshes;
+    std::vector<uint32_t> instanceMeshes;
+    std::vector<glm::mat4> transforms;
+
+    // Slot of each instance in the buffers, sorted by mesh, and the
+    // instance of each slot
+    std::vector<uint32_t> slots;
+    std::vector<uint32_t> order;
+    std::vector<glm::mat4> staged;
+    bool layoutDirty;
+    uint32_t dirtyFirst, dirtyEnd;
+
+    HiZPyramid hiz;
+    glm::mat4 hizViewProjection;
+    bool hizValid;
+
+public:
+    GpuCuller()
+        : cullShader(cullSource),
+          scanShader(scanSource),
+          compactShader(compactSource),
+          cullCount(cullShader.uniform("count")),
+          occlusion(cullShader.uniform("occlusion")),
+          occlusionViewProjection(cullShader.uniform("hizViewProjection")),
+          scanGroups(scanShader.uniform("groups")),
+          compactCount(compactShader.uniform("count")),
+          compactMeshCount(compactShader.uniform("meshCount")),
+          transformBuffer(GL_SHADER_STORAGE_BUFFER),
+          boundsBuffer(GL_SHADER_STORAGE_BUFFER),
+          offsetBuffer(GL_SHADER_STORAGE_BUFFER),
+          groupBuffer(GL_SHADER_STORAGE_BUFFER),
+          meshBuffer(GL_SHADER_STORAGE_BUFFER),
+          visibleBuffer(GL_ARRAY_BUFFER),
+          commandBuffer(GL_DRAW_INDIRECT_BUFFER),
+          layoutDirty(true),
+          dirtyFirst(0),
+          dirtyEnd(0),
+          hizViewProjection(1),
+          hizValid(false) {
+        for (int i = 0; i < 6; i++)
+            planes.push_back(cullShader.uniform(
+                ("planes[" + std::to_string(i) + "]").c_str()));
+    }
+
+    /// If the context has compute shaders and indirect multi draws.
+    static bool supported() {
+        return GLEW_VERSION_4_3;
+    }
+
+    /// Add a mesh and return its index.
+    uint32_t addMesh(const Mesh & mesh) {
+        meshes.push_back(mesh);
+        layoutDirty = true;
+        return static_cast<uint32_t>(meshes.size() - 1);
+    }
+
+    /**
+     * Add an instance of a mesh and return its index.
+     *
+     * @throws std::out_of_range if there is no such mesh
+     */
+    uint32_t add(uint32_t mesh, const glm::mat4 & transform) {
+        if (mesh >= meshes.size())
+            throw std::out_of_range("No mesh " + std::to_string(mesh));
+        instanceMeshes.push_back(mesh);
+        transforms.push_back(transform);
+        layoutDirty = true;
+        return static_cast<uint32_t>(transforms.size() - 1);
+    }
+
+    /**
+     * Move an instance. Uploads at the next upload() or cull() cover the
+     * range of slots changed since the last one.
+     *
+     * @throws std::out_of_range if there is no such instance
+     */
+    void set(uint32_t instance, const glm::mat4 & transform) {
+        transforms.at(instance) = transform;
+        if (!layoutDirty) {
+            dirtyFirst = std::min(dirtyFirst, slots[instance]);
+            dirtyEnd = std::max(dirtyEnd, slots[instance] + 1);
+        }
+    }
+
+    const glm::mat4 & get(uint32_t instance) const {
+        return transforms.at(instance);
+    }
+
+    size_t size() const {
+        return transforms.size();
+    }
+
+    size_t getMeshCount() const {
+        return meshes.size();
+    }
+
+    /// Per instance matrices of the visible instances, written by cull().
+    const Buffer & getVisibleBuffer() const {
+        return visibleBuffer;
+    }
+
+    /// One DrawElementsIndirectCommand per mesh, written by cull().
+    const Buffer & getCommandBuffer() const {
+        return commandBuffer;
+    }
+
+    const HiZPyramid & getHiZ() const {
+        return hiz;
+    }
+
+    /**
+     * Set up the visible buffer as a mat4 per instance attribute of array,
+     * at location to location + 3.
+     */
+    void attach(const BufferArray & array, GLuint location) const {
+        array.bind();
+        visibleBuffer.bind();
+        for (GLuint i = 0; i < 4; i++)
+            Attribute {location + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                       reinterpret_cast<void *>(i * sizeof(glm::vec4)), 1}
+                .enable();
+        array.unbind();
+        visibleBuffer.unbind();
+    }
+
+    /// Upload added instances, or the changed range of matrices.
+    void upload() {
+        PROFILE_ZONE("GpuCuller::upload");
+        if (layoutDirty)
+            layout();
+        else if (dirtyFirst < dirtyEnd) {
+            for (uint32_t slot = dirtyFirst; slot < dirtyEnd; slot++)
+                staged[slot] = transforms[order[slot]];
+            transformBuffer.bufferSubData(
+                dirtyFirst * sizeof(glm::mat4),
+                (dirtyEnd - dirtyFirst) * sizeof(glm::mat4),
+                staged.data() + dirtyFirst);
+        }
+        dirtyFirst = static_cast<uint32_t>(transforms.size());
+        dirtyEnd = 0;
+    }
+
+    /**
+     * Cull the instances against the frustum of viewProjection, and the
+     * pyramid of the last buildHiZ() if any, and write the draw commands.
+     * Uploads changes first.
+     */
+    void cull(const glm::mat4 & viewProjection) {
+        PROFILE_ZONE("GpuCuller::cull");
+        upload();
+
+        uint32_t count = static_cast<uint32_t>(transforms.size());
+        uint32_t groups = (count + groupSize - 1) / groupSize;
+        uint32_t meshGroups =
+            (static_cast<uint32_t>(meshes.size()) + groupSize - 1) / groupSize;
+
+        transformBuffer.bindBase(TransformBinding);
+        boundsBuffer.bindBase(BoundsBinding);
+        offsetBuffer.bindBase(OffsetBinding);
+        groupBuffer.bindBase(GroupBinding);
+        meshBuffer.bindBase(MeshBinding);
+        visibleBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, VisibleBinding);
+        commandBuffer.bindBase(GL_SHADER_STORAGE_BUFFER, CommandBinding);
+
+        Frustum frustum = Frustum::fromMatrix(viewProjection);
+        cullShader.bind();
+        cullCount.setValue(count);
+        for (int i = 0; i < 6; i++)
+            planes[i].setVec4(frustum.planes[i]);
+        occlusion.setValue(hizValid);
+        occlusionViewProjection.setMat4(hizViewProjection);
+        if (hizValid) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, hiz.getTextureId());
+        }
+        cullShader.dispatch(groups);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        scanShader.bind();
+        scanGroups.setValue(groups);
+        scanShader.dispatch(1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        compactShader.bind();
+        compactCount.setValue(count);
+        compactMeshCount.setValue(static_cast<uint32_t>(meshes.size()));
+        compactShader.dispatch(std::max(groups, meshGroups));
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT
+                        | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+                        | GL_SHADER_STORAGE_BARRIER_BIT);
+        compactShader.unbind();
+    }
+
+    /**
+     * Build the Hi-Z pyramid the next cull() tests against, from the depth
+     * of the frame drawn with viewProjection.
+     */
+    void buildHiZ(const Texture & depth, const glm::mat4 & viewProjection) {
+        glActiveTexture(GL_TEXTURE0);
+        hiz.build(depth);
+        hizViewProjection = viewProjection;
+        hizValid = true;
+    }
+
+    /// Test against the frustum only until the next buildHiZ().
+    void clearHiZ() {
+        hizValid = false;
+    }
+
+    /**
+     * Draw the visible instances of every mesh of array in one call, with
+     * the commands of the last cull(). The shader and textures must be
+     * bound.
+     */
+    void draw(const BufferArray & array, GLenum mode = GL_TRIANGLES) const {
+        if (meshes.empty())
+            return;
+        commandBuffer.bind();
+        array.multiDrawElementsIndirect(mode, GL_UNSIGNED_INT, nullptr,
+                                        static_cast<GLsizei>(meshes.size()));
+        commandBuffer.unbind();
+    }
+
+    /**
+     * Read the draw commands of the last cull() back. Waits for the GPU,
+     * for tests and statistics.
+     */
+    std::vector<DrawElementsIndirectCommand> readCommands() const {
+        std::vector<DrawElementsIndirectCommand> commands(meshes.size());
+        commandBuffer.bind();
+        glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0,
+                           commands.size() * sizeof(commands[0]),
+                           commands.data());
+        commandBuffer.unbind();
+        return commands;
+    }
+
+    /// Visible instances of the last cull(), read back like readCommands().
+    size_t readVisibleCount() const {
+        size_t visible = 0;
+        for (auto & command : readCommands())
+            visible += command.instanceCount;
+        return visible;
+    }
+
+private:
+    /// Sort the slots by mesh and upload every buffer.
+    void layout() {
+        uint32_t count = static_cast<uint32_t>(transforms.size());
+        uint32_t groups = (count + groupSize - 1) / groupSize;
+
+        std::vector<MeshRange> ranges(meshes.size());
+        for (uint32_t mesh : instanceMeshes)
+            ranges[mesh].instanceCount++;
+        uint32_t first = 0;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            ranges[i].count = meshes[i].count;
+            ranges[i].firstIndex = meshes[i].firstIndex;
+            ranges[i].baseVertex = meshes[i].baseVertex;
+            ranges[i].firstInstance = first;
+            first += ranges[i].instanceCount;
+        }
+
+        std::vector<uint32_t> next(meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++)
+            next[i] = ranges[i].firstInstance;
+        slots.resize(count);
+        order.resize(count);
+        staged.resize(count);
+        std::vector<InstanceBounds> bounds(count);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t mesh = instanceMeshes[i];
+            uint32_t slot = next[mesh]++;
+            slots[i] = slot;
+            order[slot] = i;
+            staged[slot] = transforms[i];
+
+            const AABB & box = meshes[mesh].bounds;
+            bounds[slot] = {box.center(), mesh, box.extents(), 0};
+        }
+
+        transformBuffer.bufferData(count * sizeof(glm::mat4), staged.data(),
+                                   GL_DYNAMIC_DRAW);
+        boundsBuffer.bufferData(count * sizeof(InstanceBounds), bounds.data());
+        meshBuffer.bufferData(ranges.size() * sizeof(MeshRange),
+                              ranges.data());
+        offsetBuffer.bufferData(count * sizeof(uint32_t), nullptr,
+                                GL_DYNAMIC_COPY);
+        groupBuffer.bufferData((groups + 1) * sizeof(uint32_t), nullptr,
+                               GL_DYNAMIC_COPY);
+        visibleBuffer.bufferData(count * sizeof(glm::mat4), nullptr,
+                                 GL_DYNAMIC_COPY);
+        commandBuffer.bufferData(
+            meshes.size() * sizeof(DrawElementsIndirectCommand), nullptr,
+            GL_DYNAMIC_COPY);
+        commandBuffer.unbind();
+        layoutDirty = false;
+    }
+
+    // The offset of each instance among the visible ones of its work group,
+    // with the top bit set if visible, and the visible count of each group.
+    // Empty boxes have negative extents and are never visible.
+    static constexpr const char * cullSource = R"(
+#version 430 core
+layout (local_size_x = 256) in;
+struct InstanceBounds {
+    vec3 center;
+    uint mesh;
+    vec3 extents;
+    float padding;
+};
+layout (std430, binding = 0) readonly buffer Transforms {
+    mat4 transforms[];
+};
+layout (std430, binding = 1) readonly buffer Bounds {
+    InstanceBounds bounds[];
+};
+layout (std430, binding = 2) writeonly buffer Offsets {
+    uint offsets[];
+};
+layout (std430, binding = 3) writeonly buffer Groups {
+    uint groupCounts[];
+};
+uniform uint count;
+uniform vec4 planes[6];
+uniform bool occlusion;
+uniform mat4 hizViewProjection;
+layout (binding = 0) uniform sampler2D hiz;
+shared uint scan[256];
+
+bool inFrustum(vec3 center, vec3 extents) {
+    for (int i = 0; i < 6; i++) {
+        if (dot(planes[i].xyz, center) + planes[i].w
+                + dot(abs(planes[i].xyz), extents) < 0.0)
+            return false;
+    }
+    return true;
+}
+
+// If the box is behind the farthest depth of the pyramid texels its screen
+// rectangle covers, on the level where that is at most 2x2 texels
+bool occluded(vec3 center, vec3 extents) {
+    vec3 low = vec3(1.0e30), high = vec3(-1.0e30);
+    for (int i = 0; i < 8; i++) {
+        vec3 corner = center + extents * vec3((i & 1) != 0 ? 1.0 : -1.0,
+                                              (i & 2) != 0 ? 1.0 : -1.0,
+                                              (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = hizViewProjection * vec4(corner, 1.0);
+        // Crossing the camera plane, the rectangle is unbounded
+        if (clip.w <= 0.0)
+            return false;
+        vec3 window = clip.xyz / clip.w * 0.5 + 0.5;
+        low = min(low, window);
+        high = max(high, window);
+    }
+    low.xy = clamp(low.xy, 0.0, 1.0);
+    high.xy = clamp(high.xy, 0.0, 1.0);
+
+    ivec2 size = textureSize(hiz, 0);
+    vec2 span = (high.xy - low.xy) * vec2(size);
+    int level = int(ceil(log2(max(max(span.x, span.y), 1.0))));
+    level = min(level, textureQueryLevels(hiz) - 1);
+    // Not textureSize(hiz, level), which returns the size of level 0 on
+    // llvmpipe when the level varies between invocations
+    size = max(size >> level, ivec2(1));
+    ivec2 first = min(ivec2(low.xy * vec2(size)), size - 1);
+    ivec2 last = min(ivec2(high.xy * vec2(size)), size - 1);
+    float depth = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+            depth = max(depth, texelFetch(hiz, ivec2(x, y), level).r);
+    return low.z > depth;
+}
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    uint local = gl_LocalInvocationID.x;
+    bool visible = false;
+    if (i < count && all(greaterThanEqual(bounds[i].extents, vec3(0.0)))) {
+        mat4 model = transforms[i];
+        vec3 extents = bounds[i].extents;
+        vec3 center = vec3(model * vec4(bounds[i].center, 1.0));
+        extents = abs(model[0].xyz) * extents.x
+                  + abs(model[1].xyz) * extents.y
+                  + abs(model[2].xyz) * extents.z;
+        visible = inFrustum(center, extents)
+                  && !(occlusion && occluded(center, extents));
+    }
+
+    uint flag = visible ? 1u : 0u;
+    scan[local] = flag;
+    barrier();
+    for (uint offset = 1u; offset < 256u; offset <<= 1) {
+        uint value = local >= offset ? scan[local - offset] : 0u;
+        barrier();
+        scan[local] += value;
+        barrier();
+    }
+
+    if (i < count)
+        offsets[i] = (scan[local] - flag) | (flag << 31);
+    if (local == 255u)
+        groupCounts[gl_WorkGroupID.x] = scan[255];
+})";
+
+    // One work group turns the visible counts of the groups into exclusive
+    // prefix sums, each thread scanning a run of groups, and writes the
+    // total after them
+    static constexpr const char * scanSource = R"(
+#version 430 core
+layout (local_size_x = 256) in;
+layout (std430, binding = 3) buffer Groups {
+    uint groupCounts[];
+};
+uniform uint groups;
+shared uint scan[256];
+void main() {
+    uint local = gl_LocalInvocationID.x;
+    uint run = (groups + 255u) / 256u;
+    uint first = min(local * run, groups);
+    uint last = min(first + run, groups);
+
+    uint sum = 0u;
+    for (uint g = first; g < last; g++)
+        sum += groupCounts[g];
+    scan[local] = sum;
+    barrier();
+    for (uint offset = 1u; offset < 256u; offset <<= 1) {
+        uint value = local >= offset ? scan[local - offset] : 0u;
+        barrier();
+        scan[local] += value;
+        barrier();
+    }
+
+    uint offset = scan[local] - sum;
+    for (uint g = first; g < last; g++) {
+        uint visible = groupCounts[g];
+        groupCounts[g] = offset;
+        offset += visible;
+    }
+    if (local == 255u)
+        groupCounts[groups] = scan[255];
+})";
+
+    // Visible instances go to their prefix sum, which keeps them grouped by
+    // mesh, so the draw of a mesh starts at the prefix sum of its first slot
+    static constexpr const char * compactSource = R"(
+#version 430 core
+layout (local_size_x = 256) in;
+struct MeshRange {
+    uint count;
+    uint firstIndex;
+    int baseVertex;
+    uint firstInstance;
+    uint instanceCount;
+};
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+layout (std430, binding = 0) readonly buffer Transforms {
+    mat4 transforms[];
+};
+layout (std430, binding = 2) readonly buffer Offsets {
+    uint offsets[];
+};
+layout (std430, binding = 3) readonly buffer Groups {
+    uint groupOffsets[];
+};
+layout (std430, binding = 4) writeonly buffer Visible {
+    mat4 visible[];
+};
+layout (std430, binding = 5) readonly buffer Meshes {
+    MeshRange meshes[];
+};
+layout (std430, binding = 6) writeonly buffer Commands {
+    DrawCommand commands[];
+};
+uniform uint count;
+uniform uint meshCount;
+
+uint prefix(uint i) {
+    if (i >= count)
+        return groupOffsets[(count + 255u) / 256u];
+    return groupOffsets[i / 256u] + (offsets[i] & 0x7fffffffu);
+}
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i < count && (offsets[i] & 0x80000000u) != 0u)
+        visible[prefix(i)] = transforms[i];
+
+    if (i < meshCount) {
+        MeshRange mesh = meshes[i];
+        uint first = prefix(mesh.firstInstance);
+        uint end = prefix(mesh.firstInstance + mesh.instanceCount);
+        commands[i] = DrawCommand(mesh.count, end - first, mesh.firstIndex,
+                                  mesh.baseVertex, first);
+    }
+})";
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Query.hpp"
+#include "Trace.hpp"
+
+/**
+ * Measures GPU time of named, nested zones of a frame.
+ *
+ * Each zone records a GL_TIMESTAMP query at its start and end, taken from a
+ * pool. Results are read back when the GPU has finished them, up to latency
+ * frames later, so profiling never waits for the GPU unless it falls more
+ * than latency frames behind. Zones also push a debug group, so they show
+ * up in RenderDoc or apitrace.
+ *
+ * Durations are kept per zone name, with a rolling average and percentiles.
+ * While a ChromeTrace is set, each zone is added to it twice: GPU execution
+ * on the GPU track and command submission on the CPU track.
+ *
+ *     profiler.beginFrame();
+ *     {
+ *         auto zone = profiler.zone("scene");
+ *         ...
+ *     }
+ *     profiler.endFrame();
+ */
+class GpuProfiler {
+public:
+    static const int gpuThread = 0;
+    static const int cpuThread = 1;
+
+    struct ZoneStats {
+        std::string name;
+        /// Nesting depth where the zone was first seen
+        int depth;
+        size_t samples;
+        double last;
+        double average;
+        double p50;
+        double p95;
+        double p99;
+    };
+
+    /// Ends its zone when it goes out of scope.
+    class Zone {
+        GpuProfiler * profiler;
+
+    public:
+        Zone(GpuProfiler & profiler, const std::string & name)
+            : profiler(&profiler) {
+            profiler.begin(name);
+        }
+
+        Zone(Zone && other) : profiler(other.profiler) {
+            other.profiler = nullptr;
+        }
+
+        Zone(const Zone &) = delete;
+        Zone & operator=(const Zone &) = delete;
+
+        ~Zone() {
+            if (profiler)
+                profiler->end();
+        }
+    };
+
+private:
+    struct Record {
+        size_t zone;
+        Query * start;
+        Query * end;
+        double cpuStart;
+        double cpuEnd;
+    };
+
+    struct Frame {
+        std::vector<Record> records;
+        Query * last = nullptr;
+        bool pending = false;
+    };
+
+    std::vector<std::unique_ptr<Query>> queries;
+    std::vector<Query *> free;
+    std::vector<Frame> frames;
+    size_t current;
+    std::vector<size_t> stack;
+
+    std::map<std::string, size_t> ids;
+    std::vector<std::string> names;
+    std::vector<int> depths;
+    std::vector<RollingStats> stats;
+    size_t history;
+
+    bool debugGroups;
+    ChromeTrace * trace;
+    // CPU microseconds minus GPU microseconds
+    double offset;
+    int frameCount;
+
+public:
+    /**
+     * @param latency the number of frames results can be in flight
+     * @param history the number of samples per zone for statistics
+     * @param debugGroups push a debug group for each zone when supported
+     */
+    GpuProfiler(size_t latency = 4, size_t history = 128, bool debugGroups = true)
+        : frames(latency + 1), current(0), history(history),
+          debugGroups(debugGroups && (GLEW_VERSION_4_3 || GLEW_KHR_debug)),
+          trace(nullptr), offset(0), frameCount(0) {
+        synchronize();
+    }
+
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler & operator=(const GpuProfiler &) = delete;
+
+    /**
+     * Read back finished frames and start recording a new one.
+     *
+     * @throws std::runtime_error if a zone of the previous frame is open
+     */
+    void beginFrame() {
+        if (!stack.empty())
+            throw std::runtime_error("GpuProfiler zone " + names[stack.back()]
+                                     + " was not ended");
+
+        // Resolve from the oldest frame, stopping at the first unfinished
+        for (size_t i = 1; i < frames.size(); i++) {
+            Frame & frame = frames[(current + i) % frames.size()];
+            if (frame.pending && !frame.last->isAvailable())
+                break;
+            if (frame.pending)
+                collect(frame);
+        }
+
+        current = (current + 1) % frames.size();
+        // Only waits when the GPU is more than latency frames behind
+        if (frames[current].pending)
+            collect(frames[current]);
+
+        // The GPU clock drifts from the CPU clock
+        if (++frameCount % 120 == 0)
+            synchronize();
+    }
+
+    void endFrame() {
+        Frame & frame = frames[current];
+        frame.pending = !frame.records.empty();
+    }
+
+    /// Start a zone nested in the currently open one.
+    void begin(const std::string & name) {
+        size_t zone = id(name, stack.size());
+        Frame & frame = frames[current];
+
+        Record record {zone, acquire(), nullptr, ChromeTrace::now(), 0};
+        record.start->timestamp();
+        frame.records.push_back(record);
+        stack.push_back(frame.records.size() - 1);
+
+        if (debugGroups)
+            glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, GLuint(zone), -1,
+                             name.c_str());
+    }
+
+    /**
+     * End the most recently started zone.
+     *
+     * @throws std::runtime_error if no zone is open
+     */
+    void end() {
+        if (stack.empty())
+            throw std::runtime_error("GpuProfiler::end without begin");
+
+        Frame & frame = frames[current];
+        Record & record = frame.records[stack.back()];
+        stack.pop_back();
+
+        if (debugGroups)
+            glPopDebugGroup();
+
+        record.end = acquire();
+        record.end->timestamp();
+        record.cpuEnd = ChromeTrace::now();
+        frame.last = record.end;
+    }
+
+    /// Start a zone ended by the destructor of the returned object.
+    Zone zone(const std::string & name) {
+        return Zone(*this, name);
+    }
+
+    /// Statistics of all zones, in the order they were first seen.
+    std::vector<ZoneStats> getStats() const {
+        std::vector<ZoneStats> result;
+        for (size_t i = 0; i < names.size(); i++) {
+            const RollingStats & s = stats[i];
+            result.push_back({names[i], depths[i], s.count(), s.last(),
+                              s.average(), s.percentile(50),
+                              s.percentile(95), s.percentile(99)});
+        }
+        return result;
+    }
+
+    /// Add finished zones to trace from now on, nullptr to stop.
+    void setTrace(ChromeTrace * trace) {
+        this->trace = trace;
+        if (trace) {
+            trace->setThreadName(gpuThread, "GPU");
+            trace->setThreadName(cpuThread, "GPU submission");
+        }
+    }
+
+    void clearStats() {
+        for (auto & s : stats)
+            s.clear();
+    }
+
+private:
+    size_t id(const std::string & name, size_t depth) {
+        auto it = ids.find(name);
+        if (it != ids.end())
+            return it->second;
+
+        ids[name] = names.size();
+        names.push_back(name);
+        depths.push_back(depth);
+        stats.emplace_back(history);
+        return names.size() - 1;
+    }
+
+    Query * acquire() {
+        if (free.empty()) {
+            queries.push_back(std::make_unique<Query>(GL_TIMESTAMP));
+            return queries.back().get();
+        }
+        Query * query = free.back();
+        free.pop_back();
+        return query;
+    }
+
+    void collect(Frame & frame) {
+        for (auto & record : frame.records) {
+            GLuint64 start = record.start->getResult();
+            GLuint64 end = record.end->getResult();
+            double ms = (end - start) / 1.0e6;
+            stats[record.zone].add(ms);
+
+            if (trace) {
+                const std::string & name = names[record.zone];
+                trace->add(name, "gpu", start / 1.0e3 + offset, ms * 1.0e3,
+                           gpuThread);
+                trace->add(name, "cpu", record.cpuStart,
+                           record.cpuEnd - record.cpuStart, cpuThread);
+            }
+
+            free.push_back(record.start);
+            free.push_back(record.end);
+        }
+        frame.records.clear();
+        frame.last = nullptr;
+        frame.pending = false;
+    }
+
+    void synchronize() {
+        GLint64 gpu = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpu);
+        offset = ChromeTrace::now() - gpu / 1.0e3;
+    }
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <stdexcept>
+#include <string>
+
+/**
+ * A GL context without a window or surface, for tools and benchmarks that
+ * render into frame buffers only.
+ *
+ * Uses the EGL surfaceless platform (Mesa, including llvmpipe without a
+ * GPU) and falls back to the default display. The context has no default
+ * frame buffer, bind a FrameBuffer before drawing.
+ */
+class HeadlessContext {
+    EGLDisplay display;
+    EGLContext context;
+
+public:
+    /**
+     * Create a core profile context and make it current.
+     *
+     * @throws std::runtime_error if no display or context is available
+     */
+    HeadlessContext(int major = 3, int minor = 3)
+        : display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT) {
+        auto getPlatformDisplay =
+            reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                         EGL_DEFAULT_DISPLAY, nullptr);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint eglMajor, eglMinor;
+        if (display == EGL_NO_DISPLAY
+            || !eglInitialize(display, &eglMajor, &eglMinor))
+            throw std::runtime_error("No EGL display");
+
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            eglTerminate(display);
+            throw std::runtime_error("EGL has no desktop OpenGL");
+        }
+
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION,
+            major,
+            EGL_CONTEXT_MINOR_VERSION,
+            minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK,
+            EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE,
+        };
+
+        EGLConfig config = EGL_NO_CONFIG_KHR;
+        if (!hasExtension("EGL_KHR_no_config_context")) {
+            const EGLint configAttributes[] = {
+                EGL_RENDERABLE_TYPE,
+                EGL_OPENGL_BIT,
+                EGL_NONE,
+            };
+            EGLint count = 0;
+            eglChooseConfig(display, configAttributes, &config, 1, &count);
+            if (count == 0) {
+                eglTerminate(display);
+                throw std::runtime_error("No EGL config for OpenGL");
+            }
+        }
+
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT,
+                                   contextAttributes);
+        if (context == EGL_NO_CONTEXT) {
+            eglTerminate(display);
+            throw std::runtime_error("Failed to create an OpenGL "
+                                     + std::to_string(major) + "."
+                                     + std::to_string(minor) + " context");
+        }
+
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                            context)) {
+            eglDestroyContext(display, context);
+            eglTerminate(display);
+            throw std::runtime_error("Surfaceless contexts not supported");
+        }
+    }
+
+    HeadlessContext(const HeadlessContext &) = delete;
+    HeadlessContext & operator=(const HeadlessContext &) = delete;
+
+    ~HeadlessContext() {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                       EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+
+    EGLDisplay getDisplay() const {
+        return display;
+    }
+
+    EGLContext getContext() const {
+        return context;
+    }
+
+    bool hasExtension(const std::string & name) const {
+        const char * extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (!extensions)
+            return false;
+        std::string list = std::string(" ") + extensions + " ";
+        return list.find(" " + name + " ") != std::string::npos;
+    }
+};
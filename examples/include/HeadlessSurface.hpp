@@ -0,0 +1,101 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <glm/glm.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "FrameBuffer.hpp"
+#include "HeadlessContext.hpp"
+#include "Texture.hpp"
+
+/**
+ * An offscreen stand in for a window, for running scenes without a display.
+ *
+ * Owns a HeadlessContext and a frame buffer of a fixed size that takes the
+ * place of the default frame buffer. Draw into getFrameBuffer() instead of
+ * FrameBuffer::getDefault(). WindowSurface has the same interface for an
+ * SFML window, so code templated on the surface runs in both.
+ */
+class HeadlessSurface {
+    HeadlessContext context;
+    bool loaded;
+    glm::uvec2 size;
+    Texture color;
+    RenderBuffer depth;
+    FrameBuffer frameBuffer;
+
+public:
+    /**
+     * @param size the frame buffer size in pixels
+     *
+     * @throws std::runtime_error if there is no context or GLEW fails
+     */
+    HeadlessSurface(const glm::uvec2 & size, int major = 3, int minor = 3)
+        : context(major, minor),
+          loaded(loadGlew()),
+          size(size),
+          color(Texture::renderTarget(size, Texture::RGBA8)),
+          depth(size.x, size.y, GL_DEPTH24_STENCIL8),
+          frameBuffer(size.x, size.y) {
+        frameBuffer.attach(&color, GL_COLOR_ATTACHMENT0);
+        frameBuffer.attach(&depth, GL_DEPTH_STENCIL_ATTACHMENT);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            throw std::runtime_error("Headless frame buffer is not complete");
+        frameBuffer.viewport();
+    }
+
+    HeadlessSurface(const HeadlessSurface &) = delete;
+    HeadlessSurface & operator=(const HeadlessSurface &) = delete;
+
+    const glm::uvec2 & getSize() const {
+        return size;
+    }
+
+    /// The frame buffer that stands in for the window.
+    FrameBuffer & getFrameBuffer() {
+        return frameBuffer;
+    }
+
+    /// Always open, there are no events to close it.
+    bool isOpen() const {
+        return true;
+    }
+
+    void pollEvents() {}
+
+    /// Submit the frame, nothing is shown.
+    void display() {
+        glFlush();
+    }
+
+    /// Read the color of the frame buffer as RGB, bottom row first.
+    std::vector<unsigned char> readPixels() {
+        std::vector<unsigned char> pixels(size_t(size.x) * size.y * 3);
+        frameBuffer.bind(GL_READ_FRAMEBUFFER);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, size.x, size.y, GL_RGB, GL_UNSIGNED_BYTE,
+                     pixels.data());
+        return pixels;
+    }
+
+private:
+    static bool loadGlew() {
+        GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+        // GLEW built for GLX loads the GL functions, then fails to find an
+        // X display, which an EGL context doesn't need
+        if (err == GLEW_ERROR_NO_GLX_DISPLAY)
+            err = GLEW_OK;
+#endif
+        if (err != GLEW_OK)
+            throw std::runtime_error(
+                std::string("glewInit failed: ")
+                + reinterpret_cast<const char *>(glewGetErrorString(err)));
+        return true;
+    }
+};
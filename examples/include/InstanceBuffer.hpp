@@ -0,0 +1,245 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Buffer.hpp"
+#include "Profiler.hpp"
+#include "TransformBuffer.hpp"
+
+/**
+ * The transforms of a TransformBuffer as instance attributes, packed
+ * smaller than a mat4 and decoded in the vertex shader, uploading only
+ * the instances that changed.
+ *
+ * attach() enables the attributes of the packing on consecutive locations
+ * with divisor 1, shaderSource() declares them and the GLSL function that
+ * decodes them. update() packs the dirty runs of the transforms into a
+ * copy of the buffer and uploads them with one bufferSubData per range,
+ * joining runs less than mergeGap instances apart, as a call costs more
+ * than uploading a few clean instances. When every instance changed it
+ * respecifies the whole buffer instead, so the driver can give it new
+ * storage rather than wait for draws still reading the old one.
+ */
+class InstanceBuffer {
+public:
+    /// The layout of an instance, see stride() and locations().
+    enum Packing {
+        /// The model matrix, 64 bytes over 4 locations
+        Mat4,
+        /// The top three rows of the model matrix, 48 bytes over 3
+        Mat3x4,
+        /// The rotation quaternion, position and scale, 40 bytes over 3
+        QuatPosScale,
+    };
+
+    /// What an update() uploaded.
+    struct Stats {
+        /// Instances packed, the ones that changed
+        size_t instances = 0;
+        /// Buffer calls
+        size_t ranges = 0;
+        size_t bytes = 0;
+    };
+
+private:
+    Packing packing;
+    size_t mergeGap;
+    Buffer buffer;
+    // Instances the buffer storage has room for
+    size_t capacity = 0;
+    std::vector<float> data;
+    std::vector<std::pair<size_t, size_t>> ranges;
+
+public:
+    /// @param mergeGap the most clean instances uploaded to join two runs
+    explicit InstanceBuffer(Packing packing = Mat3x4, size_t mergeGap = 16)
+        : packing(packing), mergeGap(mergeGap), buffer(GL_ARRAY_BUFFER) {}
+
+    InstanceBuffer(InstanceBuffer && other) = default;
+    InstanceBuffer & operator=(InstanceBuffer && other) = default;
+
+    InstanceBuffer(const InstanceBuffer &) = delete;
+    InstanceBuffer & operator=(const InstanceBuffer &) = delete;
+
+    /// Bytes per instance.
+    static GLsizei stride(Packing packing) {
+        return GLsizei(floats(packing) * sizeof(float));
+    }
+
+    /// Attribute locations per instance.
+    static GLuint locations(Packing packing) {
+        return packing == Mat4 ? 4 : 3;
+    }
+
+    /// The attributes of packing from location on, with divisor 1.
+    static std::vector<Attribute> attributes(Packing packing,
+                                             GLuint location) {
+        GLsizei size = stride(packing);
+        auto offset = [](size_t floats) {
+            return reinterpret_cast<const void *>(floats * sizeof(float));
+        };
+        if (packing == QuatPosScale)
+            return {
+                {location, 4, GL_FLOAT, GL_FALSE, size, offset(0), 1},
+                {location + 1, 3, GL_FLOAT, GL_FALSE, size, offset(4), 1},
+                {location + 2, 3, GL_FLOAT, GL_FALSE, size, offset(7), 1},
+            };
+        std::vector<Attribute> attributes;
+        for (GLuint i = 0; i < locations(packing); i++)
+            attributes.push_back({location + i, 4, GL_FLOAT, GL_FALSE, size,
+                                  offset(i * 4), 1});
+        return attributes;
+    }
+
+    /**
+     * GLSL declaring the attributes of packing from location on, as
+     * aInstance0 and up, and `vec3 instanceTransform(vec3 position)`,
+     * which moves a model space position to world space. Insert it after
+     * the #version line of a vertex shader.
+     */
+    static std::string shaderSource(Packing packing, GLuint location) {
+        std::string source;
+        for (auto & attribute : attributes(packing, location)) {
+            source += "layout (location = " + std::to_string(attribute.index)
+                      + ") in vec" + std::to_string(attribute.size)
+                      + " aInstance"
+                      + std::to_string(attribute.index - location) + ";\n";
+        }
+        source += "vec3 instanceTransform(vec3 position) {\n";
+        switch (packing) {
+            case Mat4:
+                source += "    return (mat4(aInstance0, aInstance1, "
+                          "aInstance2, aInstance3)\n"
+                          "            * vec4(position, 1.0)).xyz;\n";
+                break;
+            case Mat3x4:
+                // Column r of the mat3x4 is row r of the model matrix
+                source += "    return vec4(position, 1.0)\n"
+                          "           * mat3x4(aInstance0, aInstance1, "
+                          "aInstance2);\n";
+                break;
+            case QuatPosScale:
+                // Scale, rotate by the quaternion q, then translate
+                source += "    vec3 v = position * aInstance2;\n"
+                          "    vec3 u = aInstance0.xyz;\n"
+                          "    v += 2.0 * cross(u, cross(u, v) "
+                          "+ aInstance0.w * v);\n"
+                          "    return v + aInstance1;\n";
+                break;
+        }
+        source += "}\n";
+        return source;
+    }
+
+    Packing getPacking() const {
+        return packing;
+    }
+
+    const Buffer & getBuffer() const {
+        return buffer;
+    }
+
+    /// Instances as of the last update().
+    size_t size() const {
+        return data.size() / floats(packing);
+    }
+
+    /// The packed instances as of the last update(), as uploaded.
+    const std::vector<float> & getData() const {
+        return data;
+    }
+
+    /// Enable the attributes of the instances in array, from location on.
+    void attach(const BufferArray & array, GLuint location) const {
+        array.bind();
+        buffer.bind();
+        for (auto & attribute : attributes(packing, location))
+            attribute.enable();
+        array.unbind();
+        buffer.unbind();
+    }
+
+    /**
+     * Pack the dirty transforms, upload them and clear their dirty bits.
+     * Leaves the matrices of transforms as they were, call its update()
+     * instead if something reads them. Added transforms are dirty, when
+     * the count changes every instance is uploaded.
+     */
+    Stats update(
+        TransformBuffer & transforms,
+        TransformBuffer::Kernel kernel = TransformBuffer::bestKernel()) {
+        PROFILE_ZONE("InstanceBuffer::update");
+        size_t count = transforms.size();
+        size_t n = floats(packing);
+        if (count != size()) {
+            data.resize(count * n);
+            transforms.markAllDirty();
+        }
+
+        Stats stats;
+        ranges.clear();
+        transforms.forEachDirtyRun([&](size_t first, size_t end) {
+            pack(transforms, first, end, kernel);
+            stats.instances += end - first;
+            if (!ranges.empty() && first - ranges.back().second <= mergeGap)
+                ranges.back().second = end;
+            else
+                ranges.emplace_back(first, end);
+        });
+        transforms.clearDirty();
+
+        size_t bytes = n * sizeof(float);
+        if (count > capacity
+            || (ranges.size() == 1 && ranges[0].second - ranges[0].first
+                                          == count)) {
+            buffer.bufferData(count * bytes, data.data(), GL_DYNAMIC_DRAW);
+            capacity = count;
+            stats.ranges = 1;
+            stats.bytes = count * bytes;
+            return stats;
+        }
+        for (auto & range : ranges) {
+            buffer.bufferSubData(range.first * bytes,
+                                 (range.second - range.first) * bytes,
+                                 &data[range.first * n]);
+            stats.bytes += (range.second - range.first) * bytes;
+        }
+        stats.ranges = ranges.size();
+        return stats;
+    }
+
+private:
+    static size_t floats(Packing packing) {
+        return packing == Mat4 ? 16 : packing == Mat3x4 ? 12 : 10;
+    }
+
+    void pack(const TransformBuffer & transforms,
+              size_t first,
+              size_t end,
+              TransformBuffer::Kernel kernel) {
+        float * out = &data[first * floats(packing)];
+        switch (packing) {
+            case Mat4:
+                transforms.composeMat4(first, end - first,
+                                       reinterpret_cast<glm::mat4 *>(out),
+                                       kernel);
+                break;
+            case Mat3x4:
+                transforms.composeMat3x4(first, end - first,
+                                         reinterpret_cast<glm::mat3x4 *>(out),
+                                         kernel);
+                break;
+            case QuatPosScale:
+                transforms.packQuatPosScale(first, end - first, out);
+                break;
+        }
+    }
+};
@@ -0,0 +1,491 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Profiler.hpp"
+
+class JobCounter;
+
+/// A function to run and the counter it counts on.
+struct Job {
+    std::function<void()> function;
+    JobCounter * counter;
+};
+
+/**
+ * Counts unfinished jobs, to wait for them or to start jobs after them.
+ *
+ * A counter has to outlive the jobs that count on it, wait for it before
+ * destroying it. It can be reused once it reaches zero.
+ */
+class JobCounter {
+    std::atomic<int> pending;
+    std::mutex mutex;
+    std::vector<Job *> continuations;
+
+    friend class JobSystem;
+
+public:
+    JobCounter() : pending(0) {}
+
+    ~JobCounter() {
+        // The last job may still hold the lock after the count reaches zero
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+
+    JobCounter(const JobCounter &) = delete;
+    JobCounter & operator=(const JobCounter &) = delete;
+
+    int getPending() const {
+        return pending.load(std::memory_order_acquire);
+    }
+
+    bool done() const {
+        return getPending() == 0;
+    }
+};
+
+/**
+ * A Chase-Lev work stealing deque of a fixed capacity, with the memory
+ * orders of Lê et al., "Correct and Efficient Work-Stealing for Weak Memory
+ * Models" (2013). The owning thread pushes and pops at the bottom, any
+ * thread steals from the top.
+ */
+template <typename T>
+class WorkStealingDeque {
+    alignas(64) std::atomic<int64_t> top;
+    alignas(64) std::atomic<int64_t> bottom;
+    std::vector<std::atomic<T *>> buffer;
+    int64_t mask;
+
+public:
+    /// @param capacity a power of two
+    explicit WorkStealingDeque(size_t capacity = 4096)
+        : top(0), bottom(0), buffer(capacity), mask(int64_t(capacity) - 1) {}
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque & operator=(const WorkStealingDeque &) = delete;
+
+    /// Owner only. False if the deque is full.
+    bool push(T * item) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t > mask)
+            return false;
+        buffer[b & mask].store(item, std::memory_order_relaxed);
+        // A release store rather than the paper's fence, the same on x86
+        // and visible to thread sanitizers
+        bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Owner only. The last item pushed, or nullptr if empty.
+    T * pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        T * item = nullptr;
+        if (t <= b) {
+            item = buffer[b & mask].load(std::memory_order_relaxed);
+            if (t == b) {
+                // The last item, race the thieves for it
+                if (!top.compare_exchange_strong(t, t + 1,
+                                                 std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed))
+                    item = nullptr;
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+        }
+        else
+            bottom.store(b + 1, std::memory_order_relaxed);
+        return item;
+    }
+
+    /// Any thread. The first item pushed, or nullptr if empty or lost.
+    T * steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+
+        T * item = buffer[t & mask].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed))
+            return nullptr;
+        return item;
+    }
+
+    /// Only a hint while other threads use the deque.
+    bool empty() const {
+        return bottom.load(std::memory_order_relaxed)
+               <= top.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * Runs jobs on a pool of worker threads that steal from each other's
+ * deques.
+ *
+ * The thread that creates the system is worker 0, it runs jobs while it
+ * waits on a counter and is the only one to run jobs of runOnMain(), for
+ * GL calls. Jobs submitted from a thread that isn't a worker go through a
+ * shared queue. Jobs must not throw.
+ *
+ * A thread can belong to several systems, say one created inside a job of
+ * another, and keeps its place in each.
+ *
+ * Idle workers spin briefly, then sleep until a job is submitted.
+ */
+class JobSystem {
+    struct ThreadState {
+        uint64_t system;
+        size_t index;
+        uint32_t random;
+    };
+
+    // Thread states are keyed by this rather than the address: a system
+    // destroyed off its main thread leaves a stale state there, which a new
+    // system at the same address would otherwise pick up
+    uint64_t id;
+    std::vector<std::unique_ptr<WorkStealingDeque<Job>>> deques;
+    std::vector<std::thread> threads;
+
+    std::mutex injectedMutex;
+    std::deque<Job *> injected;
+
+    std::mutex mainMutex;
+    std::deque<Job *> mainJobs;
+
+    std::atomic<bool> stopping;
+    std::atomic<int> queued;
+    std::atomic<int> sleeping;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+public:
+    /**
+     * @param threadCount the number of workers including the calling thread,
+     * 0 for one per hardware thread
+     */
+    explicit JobSystem(size_t threadCount = 0)
+        : id(nextId()), stopping(false), queued(0), sleeping(0) {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < threadCount; i++)
+            deques.emplace_back(new WorkStealingDeque<Job>());
+
+        enter(0, 1);
+        for (size_t i = 1; i < threadCount; i++)
+            threads.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem & operator=(const JobSystem &) = delete;
+
+    ~JobSystem() {
+        stopping = true;
+        wake.notify_all();
+        for (auto & thread : threads)
+            thread.join();
+
+        for (auto & deque : deques) {
+            while (Job * job = deque->steal())
+                delete job;
+        }
+        for (Job * job : injected)
+            delete job;
+        for (Job * job : mainJobs)
+            delete job;
+        leave();
+    }
+
+    /// The number of workers, including the thread that created the system.
+    size_t getThreadCount() const {
+        return deques.size();
+    }
+
+    /// If the calling thread is one of the workers.
+    bool isWorker() const {
+        return threadState() != nullptr;
+    }
+
+    /// If the calling thread created the system, the one for runOnMain().
+    bool isMain() const {
+        const ThreadState * state = threadState();
+        return state && state->index == 0;
+    }
+
+    /**
+     * Run a job on any worker.
+     *
+     * @param counter counts the job until it finishes, may be nullptr
+     * @param after don't start before this counter reaches zero, may be
+     * nullptr
+     */
+    void run(std::function<void()> function,
+             JobCounter * counter = nullptr,
+             JobCounter * after = nullptr) {
+        if (counter)
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        Job * job = new Job {std::move(function), counter};
+
+        if (after) {
+            std::lock_guard<std::mutex> lock(after->mutex);
+            if (after->pending.load(std::memory_order_acquire) > 0) {
+                after->continuations.push_back(job);
+                return;
+            }
+        }
+        submit(job);
+    }
+
+    /// Run a job on the main thread, in runMainJobs() or wait().
+    void runOnMain(std::function<void()> function,
+                   JobCounter * counter = nullptr) {
+        if (counter)
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mainMutex);
+        mainJobs.push_back(new Job {std::move(function), counter});
+    }
+
+    /// Main thread only. Run the jobs of runOnMain() queued so far.
+    void runMainJobs() {
+        PROFILE_ZONE("JobSystem::runMainJobs");
+        while (Job * job = takeMainJob())
+            execute(job);
+    }
+
+    /**
+     * Run jobs until counter reaches zero. Only workers run jobs, other
+     * threads yield.
+     */
+    void wait(JobCounter & counter) {
+        PROFILE_ZONE("JobSystem::wait");
+        while (!counter.done()) {
+            Job * job = nullptr;
+            const ThreadState * state = threadState();
+            if (state && state->index == 0)
+                job = takeMainJob();
+            if (!job && state)
+                job = findJob(state->index);
+            if (job)
+                execute(job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    /**
+     * Call function(first, last) on ranges covering begin to end, in
+     * parallel, and wait for them.
+     *
+     * Ranges are split in half lazily, only while the calling worker's
+     * deque is empty, so idle workers have something to steal and busy ones
+     * don't pay for jobs nobody takes.
+     *
+     * @param grain the smallest range, 0 picks one from the thread count
+     */
+    template <typename Function>
+    void parallelFor(size_t begin,
+                     size_t end,
+                     const Function & function,
+                     size_t grain = 0) {
+        if (begin >= end)
+            return;
+        if (grain == 0)
+            grain = std::max<size_t>(1, (end - begin)
+                                            / (getThreadCount() * 32));
+
+        JobCounter counter;
+        if (isWorker())
+            forRange(begin, end, function, grain, counter);
+        else
+            run([this, &function, &counter, begin, end, grain] {
+                forRange(begin, end, function, grain, counter);
+            },
+                &counter);
+        wait(counter);
+    }
+
+private:
+    static uint64_t nextId() {
+        static std::atomic<uint64_t> id(1);
+        return id++;
+    }
+
+    /// The systems the calling thread is a worker of, usually one.
+    static std::vector<ThreadState> & threadStates() {
+        thread_local std::vector<ThreadState> states;
+        return states;
+    }
+
+    /// The calling thread's place in this system, nullptr if it has none.
+    /// Valid until the thread enters or leaves a system.
+    ThreadState * threadState() const {
+        for (auto & state : threadStates()) {
+            if (state.system == id)
+                return &state;
+        }
+        return nullptr;
+    }
+
+    void enter(size_t index, uint32_t random) {
+        threadStates().push_back({id, index, random});
+    }
+
+    void leave() {
+        auto & states = threadStates();
+        states.erase(std::remove_if(states.begin(), states.end(),
+                                    [this](const ThreadState & state) {
+                                        return state.system == id;
+                                    }),
+                     states.end());
+    }
+
+    template <typename Function>
+    void forRange(size_t begin,
+                  size_t end,
+                  const Function & function,
+                  size_t grain,
+                  JobCounter & counter) {
+        auto & deque = *deques[threadState()->index];
+        while (end - begin > grain) {
+            if (deque.empty() && end - begin >= 2 * grain) {
+                size_t middle = begin + (end - begin) / 2;
+                run([this, &function, &counter, middle, end, grain] {
+                    forRange(middle, end, function, grain, counter);
+                },
+                    &counter);
+                end = middle;
+                continue;
+            }
+            function(begin, begin + grain);
+            begin += grain;
+        }
+        function(begin, end);
+    }
+
+    void submit(Job * job) {
+        if (const ThreadState * state = threadState()) {
+            if (!deques[state->index]->push(job)) {
+                // Full, run it here instead
+                execute(job);
+                return;
+            }
+        }
+        else {
+            std::lock_guard<std::mutex> lock(injectedMutex);
+            injected.push_back(job);
+        }
+        queued.fetch_add(1, std::memory_order_release);
+        if (sleeping.load(std::memory_order_acquire) > 0)
+            wake.notify_one();
+    }
+
+    void execute(Job * job) {
+        job->function();
+        JobCounter * counter = job->counter;
+        delete job;
+        if (counter)
+            finish(*counter);
+    }
+
+    /// Count a job of counter as done, submit the jobs waiting for it.
+    void finish(JobCounter & counter) {
+        int pending = counter.pending.load(std::memory_order_relaxed);
+        while (pending > 1) {
+            if (counter.pending.compare_exchange_weak(
+                    pending, pending - 1, std::memory_order_acq_rel,
+                    std::memory_order_relaxed))
+                return;
+        }
+
+        // Maybe the last, take the continuations in the same lock as run()
+        // checks the count in
+        std::vector<Job *> ready;
+        {
+            std::lock_guard<std::mutex> lock(counter.mutex);
+            if (counter.pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                ready.swap(counter.continuations);
+        }
+        for (Job * job : ready)
+            submit(job);
+    }
+
+    Job * takeMainJob() {
+        std::lock_guard<std::mutex> lock(mainMutex);
+        if (mainJobs.empty())
+            return nullptr;
+        Job * job = mainJobs.front();
+        mainJobs.pop_front();
+        return job;
+    }
+
+    /// Pop from the own deque, else take an injected job, else steal.
+    Job * findJob(size_t index) {
+        Job * job = deques[index]->pop();
+        if (!job) {
+            std::lock_guard<std::mutex> lock(injectedMutex);
+            if (!injected.empty()) {
+                job = injected.front();
+                injected.pop_front();
+            }
+        }
+        if (!job) {
+            // xorshift, to start stealing at a random victim
+            uint32_t & random = threadState()->random;
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            for (size_t i = 0; i < deques.size() && !job; i++) {
+                size_t victim = (random + i) % deques.size();
+                if (victim != index)
+                    job = deques[victim]->steal();
+            }
+        }
+        if (job)
+            queued.fetch_sub(1, std::memory_order_relaxed);
+        return job;
+    }
+
+    void workerLoop(size_t index) {
+        enter(index, uint32_t(index * 2654435761u) | 1);
+        PROFILE_THREAD("worker");
+
+        int spins = 0;
+        while (!stopping.load(std::memory_order_acquire)) {
+            if (Job * job = findJob(index)) {
+                execute(job);
+                spins = 0;
+                continue;
+            }
+            if (++spins < 64) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // The timeout covers a submit between the check and the wait
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleeping++;
+            wake.wait_for(lock, std::chrono::milliseconds(1), [this] {
+                return stopping.load() || queued.load() > 0;
+            });
+            sleeping--;
+            spins = 0;
+        }
+        leave();
+    }
+};
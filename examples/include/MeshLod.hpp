@@ -0,0 +1,789 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "Bounds.hpp"
+#include "Profiler.hpp"
+
+/// One level of detail of a mesh, a range of the indices of its elements.
+struct LodLevel {
+    GLint first = 0;
+    GLsizei count = 0;
+    /// How far the level strays from the full mesh, in model units
+    float error = 0;
+};
+
+/// The levels of detail of a mesh, the full mesh first.
+struct LodChain {
+    std::vector<LodLevel> levels;
+
+    /**
+     * The level to draw, given the one drawn last, for a mesh whose model
+     * units are pixelsPerUnit pixels on screen.
+     *
+     * Changes to a finer level once the error of current passes threshold
+     * pixels by the fraction hysteresis, and to a coarser one once its
+     * error is under threshold by that much, so a mesh at the threshold
+     * doesn't switch back and forth every frame.
+     */
+    size_t select(float pixelsPerUnit,
+                  size_t current,
+                  float threshold,
+                  float hysteresis) const {
+        if (levels.empty())
+            return 0;
+        size_t level = std::min(current, levels.size() - 1);
+        while (level > 0
+               && levels[level].error * pixelsPerUnit
+                      > threshold * (1 + hysteresis))
+            level--;
+        while (level + 1 < levels.size()
+               && levels[level + 1].error * pixelsPerUnit
+                      < threshold * (1 - hysteresis))
+            level++;
+        return level;
+    }
+};
+
+/// The camera levels of detail are chosen for, see LodChain::select().
+struct LodView {
+    glm::vec3 eye;
+    /// Pixels across a unit at distance 1
+    float pixelsPerUnit = 1;
+    /// The most error of a level on screen, in pixels
+    float threshold = 1;
+    /// How far past the threshold the error goes before a level changes,
+    /// as a fraction of it
+    float hysteresis = 0.25f;
+
+    /// The view of a perspective projection with vertical field of view
+    /// fovy in radians onto a viewport height pixels high.
+    static LodView perspective(const glm::vec3 & eye,
+                               float fovy,
+                               float height,
+                               float threshold = 1,
+                               float hysteresis = 0.25f) {
+        return {eye, height / (2 * std::tan(fovy / 2)), threshold,
+                hysteresis};
+    }
+
+    /// Pixels per model unit of a mesh scaled by scale at its world box,
+    /// at the distance of the closest point of the box.
+    float pixelsPerUnitOf(const AABB & world, float scale) const {
+        float distance = glm::length(glm::clamp(eye, world.min, world.max)
+                                     - eye);
+        // From inside the box no level is fine enough but the first
+        if (distance <= 0)
+            return std::numeric_limits<float>::max();
+        return pixelsPerUnit * scale / distance;
+    }
+};
+
+/**
+ * The level of detail chain of an entity's Mesh and the level it drew
+ * last, a World component. RenderQueue::collect() with a LodView draws the
+ * level chosen by LodChain::select() instead of the Mesh range.
+ */
+struct Lod {
+    const LodChain * chain = nullptr;
+    uint32_t level = 0;
+};
+
+/**
+ * Simplifies triangle meshes by collapsing edges in the order of their
+ * quadric error (Garland and Heckbert), to make the levels of a LodChain.
+ *
+ * Each collapse moves a vertex onto a neighbour, so every level uses the
+ * vertices of the full mesh and needs only its own indices, appended to
+ * the same element buffer. The error of a collapse is the distance of the
+ * neighbour to the planes of the triangles merged into the vertex, plus
+ * how far the attributes of the neighbour, texture coordinates say, are
+ * from the ones those triangles interpolate at that point (Hoppe).
+ *
+ * Vertices at the same position with different attributes, a seam, move
+ * together and only along the seam, and vertices on a border only along
+ * the border, so neither opens a hole. Where seams and borders meet or
+ * branch the vertices stay. A collapse that would flip a triangle is
+ * skipped.
+ */
+class MeshSimplifier {
+public:
+    static constexpr size_t maxAttributes = 8;
+
+private:
+    static constexpr GLuint none = ~GLuint(0);
+    static constexpr GLuint many = none - 1;
+
+    // The weighted squared distance to a set of planes, and the weight of
+    // the triangles among them
+    struct Quadric {
+        double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+        double b0 = 0, b1 = 0, b2 = 0, c = 0, weight = 0;
+
+        // The plane dot(normal, p) + d = 0
+        static Quadric plane(const glm::dvec3 & n, double d, double w) {
+            Quadric q;
+            q.a00 = w * n.x * n.x;
+            q.a11 = w * n.y * n.y;
+            q.a22 = w * n.z * n.z;
+            q.a01 = w * n.x * n.y;
+            q.a02 = w * n.x * n.z;
+            q.a12 = w * n.y * n.z;
+            q.b0 = w * n.x * d;
+            q.b1 = w * n.y * d;
+            q.b2 = w * n.z * d;
+            q.c = w * d * d;
+            return q;
+        }
+
+        Quadric & operator+=(const Quadric & o) {
+            a00 += o.a00, a11 += o.a11, a22 += o.a22;
+            a01 += o.a01, a02 += o.a02, a12 += o.a12;
+            b0 += o.b0, b1 += o.b1, b2 += o.b2;
+            c += o.c, weight += o.weight;
+            return *this;
+        }
+
+        double error(const glm::dvec3 & p) const {
+            double e = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+                       + 2 * (a01 * p.x * p.y + a02 * p.x * p.z
+                              + a12 * p.y * p.z)
+                       + 2 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+            return std::max(e, 0.0);
+        }
+    };
+
+    // The weighted squared difference of an attribute s from s(p) =
+    // dot(g, p) + d, its linear interpolation over a set of triangles
+    struct AttributeQuadric {
+        // Sum of w g g^T, w g d, w d d, w g, w d and w
+        Quadric gg;
+        double g0 = 0, g1 = 0, g2 = 0, d = 0;
+
+        AttributeQuadric & operator+=(const AttributeQuadric & o) {
+            gg += o.gg;
+            g0 += o.g0, g1 += o.g1, g2 += o.g2, d += o.d;
+            return *this;
+        }
+
+        double error(const glm::dvec3 & p, double s) const {
+            double e = gg.error(p)
+                       - 2 * s * (g0 * p.x + g1 * p.y + g2 * p.z + d)
+                       + s * s * gg.weight;
+            return std::max(e, 0.0);
+        }
+    };
+
+    enum Kind : uint8_t { Manifold, Border, Seam, Locked };
+
+    struct Collapse {
+        GLuint from;
+        GLuint to;
+        double error;
+    };
+
+    // In a unit box, so errors are relative to the size of the mesh
+    std::vector<glm::dvec3> positions;
+    double extent = 1;
+    std::vector<double> attributes;
+    size_t attributeCount = 0;
+    // The first vertex at the same position, and the next vertex there in
+    // a ring of them
+    std::vector<GLuint> remap;
+    std::vector<GLuint> wedge;
+
+public:
+    /**
+     * @param attributes attributeCount floats per vertex that collapses
+     * should keep, or empty
+     * @param weight the error of an attribute one apart against a vertex
+     * the size of the mesh away
+     */
+    explicit MeshSimplifier(const std::vector<glm::vec3> & positions,
+                            const std::vector<float> & attributes = {},
+                            size_t attributeCount = 0,
+                            float weight = 1) {
+        if (attributeCount > maxAttributes
+            || attributes.size() != positions.size() * attributeCount)
+            throw std::invalid_argument(
+                "MeshSimplifier attributes don't match the vertices");
+
+        AABB box;
+        for (auto & p : positions)
+            box.add(p);
+        glm::vec3 size = box.empty() ? glm::vec3(0) : box.max - box.min;
+        extent = std::max({double(size.x), double(size.y), double(size.z)});
+        if (extent <= 0)
+            extent = 1;
+        this->positions.reserve(positions.size());
+        for (auto & p : positions)
+            this->positions.push_back(glm::dvec3(p - box.min) / extent);
+        this->attributeCount = attributeCount;
+        this->attributes.reserve(attributes.size());
+        for (float a : attributes)
+            this->attributes.push_back(double(a) * weight);
+
+        // Ring the vertices at each position
+        remap.resize(positions.size());
+        wedge.resize(positions.size());
+        std::unordered_map<glm::vec3, GLuint, PositionHash> first;
+        for (GLuint v = 0; v < positions.size(); v++) {
+            auto it = first.emplace(positions[v], v).first;
+            remap[v] = it->second;
+            wedge[v] = v;
+            if (it->second != v) {
+                wedge[v] = wedge[it->second];
+                wedge[it->second] = v;
+            }
+        }
+    }
+
+    size_t getVertexCount() const {
+        return positions.size();
+    }
+
+    /**
+     * Collapse edges of the count indices of a triangle list until at most
+     * target are left, or the next collapse would stray more than maxError
+     * model units from the mesh.
+     *
+     * @param error if not null, set to the error of the result, in model
+     * units
+     * @return the indices of the simplified triangles
+     */
+    std::vector<GLuint> simplify(const GLuint * source,
+                                 size_t count,
+                                 size_t target,
+                                 float maxError =
+                                     std::numeric_limits<float>::max(),
+                                 float * error = nullptr) const {
+        PROFILE_ZONE("MeshSimplifier::simplify");
+        std::vector<GLuint> indices(source, source + count / 3 * 3);
+        for (GLuint v : indices) {
+            if (v >= positions.size())
+                throw std::out_of_range("MeshSimplifier index out of range");
+        }
+        double limit = double(maxError) / extent;
+        limit *= limit;
+
+        // Per position, then per vertex and attribute
+        std::vector<GLuint> adjacencyFirst, adjacency;
+        adjacent(indices, adjacencyFirst, adjacency);
+        std::vector<Quadric> quadrics(positions.size());
+        std::vector<AttributeQuadric> attributeQuadrics(positions.size()
+                                                        * attributeCount);
+        addQuadrics(indices, adjacencyFirst, adjacency, quadrics,
+                    attributeQuadrics);
+
+        std::vector<Kind> kinds;
+        std::vector<GLuint> openIn, openOut;
+        std::vector<Collapse> collapses;
+        std::vector<uint8_t> locked(positions.size());
+        std::vector<GLuint> moved(positions.size());
+        double worst = 0;
+        while (indices.size() > target) {
+            adjacent(indices, adjacencyFirst, adjacency);
+            classify(indices, adjacencyFirst, adjacency, kinds, openIn,
+                     openOut);
+
+            // The cheapest allowed collapse of each position, along the
+            // edges leaving it in its triangles' winding, which is each
+            // edge both ways but the ones on a border
+            collapses.clear();
+            for (GLuint from = 0; from < positions.size(); from++) {
+                if (remap[from] != from || kinds[from] == Locked)
+                    continue;
+                Collapse best {from, none, 0};
+                for (GLuint t = adjacencyFirst[from];
+                     t < adjacencyFirst[from + 1]; t++) {
+                    const GLuint * corners = &indices[adjacency[t] * 3];
+                    int c = remap[corners[0]] == from   ? 0
+                            : remap[corners[1]] == from ? 1
+                                                        : 2;
+                    GLuint to = remap[corners[(c + 1) % 3]];
+                    GLuint map[maxWedges];
+                    if (to == best.to
+                        || !allowed(from, to, kinds, openIn, openOut)
+                        || !mapWedges(from, to, indices, adjacencyFirst,
+                                      adjacency, map))
+                        continue;
+                    double error =
+                        cost(from, to, map, quadrics, attributeQuadrics);
+                    if (best.to == none || error < best.error)
+                        best = {from, to, error};
+                }
+                if (best.to != none)
+                    collapses.push_back(best);
+            }
+            std::sort(collapses.begin(), collapses.end(),
+                      [](const Collapse & x, const Collapse & y) {
+                          return x.error < y.error;
+                      });
+
+            // The cheapest ones that don't touch each other
+            std::fill(locked.begin(), locked.end(), 0);
+            for (GLuint v = 0; v < moved.size(); v++)
+                moved[v] = v;
+            size_t goal = (indices.size() - target + 2) / 3;
+            size_t removed = 0, performed = 0;
+            for (auto & collapse : collapses) {
+                if (removed >= goal || collapse.error > limit)
+                    break;
+                GLuint from = collapse.from, to = collapse.to;
+                if (locked[from] || locked[to])
+                    continue;
+                GLuint map[maxWedges];
+                if (!mapWedges(from, to, indices, adjacencyFirst, adjacency,
+                               map)
+                    || flips(from, to, indices, adjacencyFirst, adjacency)
+                    || pinches(from, to, indices, adjacencyFirst, adjacency))
+                    continue;
+
+                quadrics[to] += quadrics[from];
+                GLuint v = from, n = 0;
+                do {
+                    if (map[n] != none) {
+                        moved[v] = map[n];
+                        for (size_t k = 0; k < attributeCount; k++)
+                            attributeQuadrics[map[n] * attributeCount + k] +=
+                                attributeQuadrics[v * attributeCount + k];
+                    }
+                    v = wedge[v], n++;
+                } while (v != from);
+
+                // Lock the neighbours too, so the triangles checked for
+                // flips keep their corners until the next pass
+                locked[to] = 1;
+                for (GLuint t = adjacencyFirst[from];
+                     t < adjacencyFirst[from + 1]; t++) {
+                    bool both = false;
+                    for (int c = 0; c < 3; c++) {
+                        GLuint r = remap[indices[adjacency[t] * 3 + c]];
+                        locked[r] = 1;
+                        both = both || r == to;
+                    }
+                    removed += both;
+                }
+                worst = std::max(worst, collapse.error);
+                performed++;
+            }
+            if (performed == 0)
+                break;
+
+            // Move the collapsed corners and drop the triangles that lost
+            // their area
+            size_t out = 0;
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                GLuint a = moved[indices[i]], b = moved[indices[i + 1]],
+                       c = moved[indices[i + 2]];
+                if (remap[a] == remap[b] || remap[b] == remap[c]
+                    || remap[a] == remap[c])
+                    continue;
+                indices[out++] = a;
+                indices[out++] = b;
+                indices[out++] = c;
+            }
+            indices.resize(out);
+        }
+
+        if (error)
+            *error = float(std::sqrt(worst) * extent);
+        return indices;
+    }
+
+    /**
+     * Simplify the count indices at first in indices by ratio, again and
+     * again, appending each level to indices. Stops after maxLevels, or
+     * once a level would take less than a quarter off the one before
+     * without straying more than maxError, a fraction of the size of the
+     * mesh.
+     *
+     * The error of a level adds up the errors of the ones before it, as
+     * each is simplified from the last.
+     */
+    LodChain buildChain(std::vector<GLuint> & indices,
+                        size_t first,
+                        size_t count,
+                        size_t maxLevels = 8,
+                        float ratio = 0.5f,
+                        float maxError = 0.1f) const {
+        PROFILE_ZONE("MeshSimplifier::buildChain");
+        LodChain chain;
+        chain.levels.push_back({GLint(first), GLsizei(count), 0});
+        while (chain.levels.size() < maxLevels) {
+            LodLevel last = chain.levels.back();
+            float budget = float(maxError * extent) - last.error;
+            if (budget <= 0)
+                break;
+            size_t target = size_t(last.count * ratio) / 3 * 3;
+            float error = 0;
+            std::vector<GLuint> level =
+                simplify(&indices[last.first], size_t(last.count), target,
+                         budget, &error);
+            if (level.empty() || level.size() > last.count * 0.75f)
+                break;
+            chain.levels.push_back({GLint(indices.size()),
+                                    GLsizei(level.size()),
+                                    last.error + error});
+            indices.insert(indices.end(), level.begin(), level.end());
+        }
+        return chain;
+    }
+
+private:
+    // Vertices at a position whose attributes can move in one collapse
+    static constexpr size_t maxWedges = 16;
+
+    struct PositionHash {
+        size_t operator()(const glm::vec3 & p) const {
+            auto bits = [](float f) {
+                uint32_t u;
+                std::memcpy(&u, &f, sizeof(u));
+                return size_t(u);
+            };
+            // Adding 0 makes -0 and 0 the same bits, as they compare equal
+            return bits(p.x + 0.0f) * 73856093 ^ bits(p.y + 0.0f) * 19349663
+                   ^ bits(p.z + 0.0f) * 83492791;
+        }
+    };
+
+    /// Area weighted quadrics of the triangle planes at each position and of
+    /// the attributes at each vertex, and of planes along borders and seams
+    /// that keep them in place.
+    void addQuadrics(const std::vector<GLuint> & indices,
+                     const std::vector<GLuint> & first,
+                     const std::vector<GLuint> & adjacency,
+                     std::vector<Quadric> & quadrics,
+                     std::vector<AttributeQuadric> & attributeQuadrics) const {
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            const GLuint v[3] = {indices[i], indices[i + 1], indices[i + 2]};
+            glm::dvec3 p0 = positions[v[0]], p1 = positions[v[1]],
+                       p2 = positions[v[2]];
+            glm::dvec3 e1 = p1 - p0, e2 = p2 - p0;
+            glm::dvec3 n = glm::cross(e1, e2);
+            double length = glm::length(n);
+            if (length <= 0)
+                continue;
+            double area = length / 2;
+            glm::dvec3 normal = n / length;
+
+            Quadric plane = Quadric::plane(normal, -glm::dot(normal, p0),
+                                           area);
+            plane.weight = area;
+            for (GLuint corner : v)
+                quadrics[remap[corner]] += plane;
+
+            // The gradient of each attribute in the plane, the one g with
+            // dot(g, e1) and dot(g, e2) the differences along the edges
+            glm::dvec3 u1 = glm::cross(e2, n) / (length * length);
+            glm::dvec3 u2 = glm::cross(n, e1) / (length * length);
+            for (size_t k = 0; k < attributeCount; k++) {
+                double s0 = attributes[v[0] * attributeCount + k];
+                double s1 = attributes[v[1] * attributeCount + k];
+                double s2 = attributes[v[2] * attributeCount + k];
+                glm::dvec3 g = (s1 - s0) * u1 + (s2 - s0) * u2;
+                double d = s0 - glm::dot(g, p0);
+                double length2 = glm::length(g);
+                AttributeQuadric q;
+                if (length2 > 0)
+                    q.gg = Quadric::plane(g / length2, d / length2,
+                                          area * length2 * length2);
+                else
+                    q.gg.c = area * d * d;
+                q.gg.weight = area;
+                q.g0 = area * g.x, q.g1 = area * g.y, q.g2 = area * g.z;
+                q.d = area * d;
+                for (GLuint corner : v)
+                    attributeQuadrics[corner * attributeCount + k] += q;
+            }
+
+            // Edges of one triangle are on a border or a seam
+            for (int c = 0; c < 3; c++) {
+                GLuint a = v[c], b = v[(c + 1) % 3];
+                if (hasEdge(b, a, indices, first, adjacency))
+                    continue;
+                glm::dvec3 along = positions[b] - positions[a];
+                glm::dvec3 side = glm::cross(along, normal);
+                double sideLength = glm::length(side);
+                if (sideLength <= 0)
+                    continue;
+                side /= sideLength;
+                Quadric border = Quadric::plane(
+                    side, -glm::dot(side, positions[a]),
+                    borderWeight * glm::dot(along, along));
+                quadrics[remap[a]] += border;
+                quadrics[remap[b]] += border;
+            }
+        }
+    }
+
+    /// The kind of each position, and the other end of the one edge of
+    /// each vertex that no other triangle has the other way, none if there
+    /// is no such edge or many if there are more.
+    void classify(const std::vector<GLuint> & indices,
+                  const std::vector<GLuint> & first,
+                  const std::vector<GLuint> & adjacency,
+                  std::vector<Kind> & kinds,
+                  std::vector<GLuint> & openIn,
+                  std::vector<GLuint> & openOut) const {
+        openIn.assign(positions.size(), none);
+        openOut.assign(positions.size(), none);
+        std::vector<uint8_t> used(positions.size());
+        for (size_t i = 0; i < indices.size(); i++) {
+            GLuint a = indices[i], b = indices[i - i % 3 + (i + 1) % 3];
+            used[a] = 1;
+            if (hasEdge(b, a, indices, first, adjacency))
+                continue;
+            openOut[a] = openOut[a] == none || openOut[a] == b ? b : many;
+            openIn[b] = openIn[b] == none || openIn[b] == a ? a : many;
+        }
+
+        auto single = [](GLuint v) { return v != none && v != many; };
+        kinds.assign(positions.size(), Locked);
+        for (GLuint r = 0; r < positions.size(); r++) {
+            if (remap[r] != r)
+                continue;
+            GLuint used0 = none, used1 = none;
+            size_t count = 0;
+            GLuint v = r;
+            do {
+                if (used[v]) {
+                    (count == 0 ? used0 : used1) = v;
+                    count++;
+                }
+                v = wedge[v];
+            } while (v != r);
+
+            if (count == 1 && openIn[used0] == none
+                && openOut[used0] == none)
+                kinds[r] = Manifold;
+            else if (count == 1 && single(openIn[used0])
+                     && single(openOut[used0]))
+                kinds[r] = Border;
+            else if (count == 2 && single(openIn[used0])
+                     && single(openOut[used0]) && single(openIn[used1])
+                     && single(openOut[used1])
+                     && remap[openOut[used0]] == remap[openIn[used1]]
+                     && remap[openIn[used0]] == remap[openOut[used1]])
+                kinds[r] = Seam;
+        }
+    }
+
+    /// The triangles at each position, those of r from adjacency[first[r]]
+    /// to adjacency[first[r + 1]].
+    void adjacent(const std::vector<GLuint> & indices,
+                  std::vector<GLuint> & first,
+                  std::vector<GLuint> & adjacency) const {
+        first.assign(positions.size() + 1, 0);
+        for (GLuint v : indices)
+            first[remap[v] + 1]++;
+        for (size_t r = 0; r < positions.size(); r++)
+            first[r + 1] += first[r];
+        adjacency.resize(indices.size());
+        std::vector<GLuint> next(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[next[remap[indices[i]]]++] = GLuint(i / 3);
+    }
+
+    /// Whether the position from may move onto its neighbour to: any way if
+    /// it has no border or seam, else only along it.
+    bool allowed(GLuint from,
+                 GLuint to,
+                 const std::vector<Kind> & kinds,
+                 const std::vector<GLuint> & openIn,
+                 const std::vector<GLuint> & openOut) const {
+        switch (kinds[from]) {
+            case Manifold:
+                return true;
+            case Border:
+            case Seam: {
+                GLuint v = from;
+                do {
+                    if (openOut[v] != none && openOut[v] != many
+                        && (remap[openOut[v]] == to
+                            || remap[openIn[v]] == to))
+                        return true;
+                    v = wedge[v];
+                } while (v != from);
+                return false;
+            }
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * Pair each vertex at from, in ring order, with the vertex at to it
+     * shares a triangle with, none for the unused ones. False if a used
+     * one shares none, as its attributes would have nowhere to go.
+     */
+    bool mapWedges(GLuint from,
+                   GLuint to,
+                   const std::vector<GLuint> & indices,
+                   const std::vector<GLuint> & first,
+                   const std::vector<GLuint> & adjacency,
+                   GLuint * map) const {
+        GLuint ring[maxWedges];
+        size_t count = 0;
+        GLuint v = from;
+        do {
+            if (count == maxWedges)
+                return false;
+            ring[count] = v;
+            map[count++] = none;
+            v = wedge[v];
+        } while (v != from);
+
+        for (GLuint t = first[from]; t < first[from + 1]; t++) {
+            const GLuint * corners = &indices[adjacency[t] * 3];
+            GLuint source = none, destination = none;
+            for (int c = 0; c < 3; c++) {
+                if (remap[corners[c]] == from)
+                    source = corners[c];
+                else if (remap[corners[c]] == to)
+                    destination = corners[c];
+            }
+            if (destination == none)
+                continue;
+            for (size_t n = 0; n < count; n++) {
+                if (ring[n] != source)
+                    continue;
+                if (map[n] != none && map[n] != destination)
+                    return false;
+                map[n] = destination;
+            }
+        }
+        // Every vertex of a triangle at from must have somewhere to go
+        for (GLuint t = first[from]; t < first[from + 1]; t++) {
+            for (int c = 0; c < 3; c++) {
+                GLuint corner = indices[adjacency[t] * 3 + c];
+                if (remap[corner] != from)
+                    continue;
+                for (size_t n = 0; n < count; n++) {
+                    if (ring[n] == corner && map[n] == none)
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /// The error of moving from onto to, squared and relative to the size
+    /// of the mesh.
+    double cost(GLuint from,
+                GLuint to,
+                const GLuint * map,
+                const std::vector<Quadric> & quadrics,
+                const std::vector<AttributeQuadric> & attributeQuadrics)
+        const {
+        const glm::dvec3 & p = positions[to];
+        double error = quadrics[from].error(p);
+        GLuint v = from, n = 0;
+        do {
+            if (map[n] != none) {
+                for (size_t k = 0; k < attributeCount; k++)
+                    error += attributeQuadrics[v * attributeCount + k].error(
+                        p, attributes[map[n] * attributeCount + k]);
+            }
+            v = wedge[v], n++;
+        } while (v != from);
+        return error / std::max(quadrics[from].weight, 1e-20);
+    }
+
+    /// Whether moving from onto to turns a triangle that stays by more than
+    /// about 75 degrees, over or nearly on its side.
+    bool flips(GLuint from,
+               GLuint to,
+               const std::vector<GLuint> & indices,
+               const std::vector<GLuint> & first,
+               const std::vector<GLuint> & adjacency) const {
+        for (GLuint t = first[from]; t < first[from + 1]; t++) {
+            const GLuint * corners = &indices[adjacency[t] * 3];
+            glm::dvec3 before[3], after[3];
+            bool stays = true;
+            for (int c = 0; c < 3; c++) {
+                GLuint r = remap[corners[c]];
+                stays = stays && r != to;
+                before[c] = positions[corners[c]];
+                after[c] = r == from ? positions[to] : before[c];
+            }
+            if (!stays)
+                continue;
+            glm::dvec3 n0 = glm::cross(before[1] - before[0],
+                                       before[2] - before[0]);
+            glm::dvec3 n1 = glm::cross(after[1] - after[0],
+                                       after[2] - after[0]);
+            if (glm::dot(n0, n1)
+                <= 0.25 * glm::length(n0) * glm::length(n1))
+                return true;
+        }
+        return false;
+    }
+
+    /// Whether from and to share neighbours other than the corners across
+    /// their edge, which moving from onto to would fold together.
+    bool pinches(GLuint from,
+                 GLuint to,
+                 const std::vector<GLuint> & indices,
+                 const std::vector<GLuint> & first,
+                 const std::vector<GLuint> & adjacency) const {
+        std::vector<GLuint> around, shared;
+        size_t across = 0;
+        for (GLuint t = first[from]; t < first[from + 1]; t++) {
+            bool both = false;
+            for (int c = 0; c < 3; c++) {
+                GLuint r = remap[indices[adjacency[t] * 3 + c]];
+                both = both || r == to;
+                if (r != from)
+                    around.push_back(r);
+            }
+            across += both;
+        }
+        std::sort(around.begin(), around.end());
+        for (GLuint t = first[to]; t < first[to + 1]; t++) {
+            for (int c = 0; c < 3; c++) {
+                GLuint r = remap[indices[adjacency[t] * 3 + c]];
+                if (r != to && r != from
+                    && std::binary_search(around.begin(), around.end(), r))
+                    shared.push_back(r);
+            }
+        }
+        std::sort(shared.begin(), shared.end());
+        return size_t(std::unique(shared.begin(), shared.end())
+                      - shared.begin())
+               != across;
+    }
+
+    /// Whether a triangle goes from vertex a to vertex b.
+    bool hasEdge(GLuint a,
+                 GLuint b,
+                 const std::vector<GLuint> & indices,
+                 const std::vector<GLuint> & first,
+                 const std::vector<GLuint> & adjacency) const {
+        GLuint r = remap[a];
+        for (GLuint t = first[r]; t < first[r + 1]; t++) {
+            const GLuint * corners = &indices[adjacency[t] * 3];
+            for (int c = 0; c < 3; c++) {
+                if (corners[c] == a && corners[(c + 1) % 3] == b)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // How much more moving a border or seam costs than the same distance
+    // off a triangle's plane
+    static constexpr double borderWeight = 10;
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+/**
+ * A GL loader that points the GLEW function pointers the wrappers use at
+ * stubs that do nothing, so their CPU side can be timed without a driver or
+ * a context. Use it instead of glewInit().
+ *
+ * Gen and Create calls hand out increasing names, so destructors still run
+ * their deletes. Shaders compile and programs link, uniform lookups return
+ * location 0 and other queries leave their output alone.
+ *
+ * GLEW doesn't load the GL 1.1 functions (glGenTextures, glTexImage2D,
+ * glDrawElements, ...), they go to libGL, which ignores calls without a
+ * current context under GLVND. The GLEW_VERSION and extension flags stay
+ * false, so the wrappers take their GL 3.3 paths.
+ */
+class NullGL {
+    template <typename Function>
+    struct Stub;
+
+    template <typename Result, typename... Args>
+    struct Stub<Result(GLAPIENTRY *)(Args...)> {
+        static Result GLAPIENTRY call(Args...) {
+            return Result();
+        }
+    };
+
+    static GLuint nextName() {
+        static GLuint name = 0;
+        return ++name;
+    }
+
+    static void GLAPIENTRY gen(GLsizei n, GLuint * names) {
+        for (GLsizei i = 0; i < n; i++)
+            names[i] = nextName();
+    }
+
+    static GLuint GLAPIENTRY createShader(GLenum) {
+        return nextName();
+    }
+
+    static GLuint GLAPIENTRY createProgram() {
+        return nextName();
+    }
+
+    static void GLAPIENTRY getObjectiv(GLuint, GLenum pname, GLint * param) {
+        if (pname == GL_COMPILE_STATUS || pname == GL_LINK_STATUS)
+            *param = GL_TRUE;
+        else if (pname == GL_INFO_LOG_LENGTH)
+            *param = 0;
+    }
+
+public:
+    static void load() {
+#define NULL_GL(name) __glew##name = Stub<decltype(__glew##name)>::call
+        NULL_GL(ActiveTexture);
+        NULL_GL(AttachShader);
+        NULL_GL(BindBuffer);
+        NULL_GL(BindBufferBase);
+        NULL_GL(BindFramebuffer);
+        NULL_GL(BindRenderbuffer);
+        NULL_GL(BindVertexArray);
+        NULL_GL(BlitFramebuffer);
+        NULL_GL(BufferData);
+        NULL_GL(BufferSubData);
+        NULL_GL(CheckFramebufferStatus);
+        NULL_GL(CompileShader);
+        NULL_GL(CompressedTexImage2D);
+        NULL_GL(DeleteBuffers);
+        NULL_GL(DeleteFramebuffers);
+        NULL_GL(DeleteProgram);
+        NULL_GL(DeleteRenderbuffers);
+        NULL_GL(DeleteShader);
+        NULL_GL(DeleteVertexArrays);
+        NULL_GL(DetachShader);
+        NULL_GL(DisableVertexAttribArray);
+        NULL_GL(DrawArraysInstanced);
+        NULL_GL(DrawElementsInstanced);
+        NULL_GL(EnableVertexAttribArray);
+        NULL_GL(FramebufferRenderbuffer);
+        NULL_GL(FramebufferTexture2D);
+        NULL_GL(GenerateMipmap);
+        NULL_GL(GetInternalformativ);
+        NULL_GL(GetProgramInfoLog);
+        NULL_GL(GetShaderInfoLog);
+        NULL_GL(GetTextureHandleARB);
+        NULL_GL(GetUniformLocation);
+        NULL_GL(LinkProgram);
+        NULL_GL(MakeTextureHandleNonResidentARB);
+        NULL_GL(MakeTextureHandleResidentARB);
+        NULL_GL(RenderbufferStorage);
+        NULL_GL(RenderbufferStorageMultisample);
+        NULL_GL(ShaderSource);
+        NULL_GL(TexImage2DMultisample);
+        NULL_GL(TexImage3D);
+        NULL_GL(TexStorage2D);
+        NULL_GL(TexStorage2DMultisample);
+        NULL_GL(TexSubImage3D);
+        NULL_GL(Uniform1d);
+        NULL_GL(Uniform1f);
+        NULL_GL(Uniform1i);
+        NULL_GL(Uniform1ui);
+        NULL_GL(Uniform2fv);
+        NULL_GL(Uniform3fv);
+        NULL_GL(Uniform4fv);
+        NULL_GL(UniformMatrix2fv);
+        NULL_GL(UniformMatrix3fv);
+        NULL_GL(UniformMatrix4fv);
+        NULL_GL(UseProgram);
+        NULL_GL(VertexAttribDivisor);
+        NULL_GL(VertexAttribPointer);
+#undef NULL_GL
+
+        __glewGenBuffers = gen;
+        __glewGenFramebuffers = gen;
+        __glewGenRenderbuffers = gen;
+        __glewGenVertexArrays = gen;
+        __glewCreateShader = createShader;
+        __glewCreateProgram = createProgram;
+        __glewGetShaderiv = getObjectiv;
+        __glewGetProgramiv = getObjectiv;
+    }
+};
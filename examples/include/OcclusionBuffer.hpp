@@ -0,0 +1,841 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define OCCLUSION_BUFFER_SSE
+#endif
+#if defined(__AVX2__)
+#define OCCLUSION_BUFFER_AVX2
+#endif
+
+#include "Bounds.hpp"
+#include "JobSystem.hpp"
+#include "Profiler.hpp"
+
+/**
+ * Triangles drawn into an OcclusionBuffer, in model space. Usually a few
+ * large triangles of a simplified mesh, like a box for a wall, from the
+ * same vertices and indices as its BufferArray. They must not cover more
+ * than the mesh does or they hide objects that are visible.
+ */
+struct Occluder {
+    /// The adjacent triangle of an edge no other triangle shares
+    static constexpr uint32_t none = uint32_t(-1);
+
+    std::vector<glm::vec3> vertices;
+    /// Three per triangle
+    std::vector<uint32_t> indices;
+    /// The triangle on the other side of the edge from each index to the
+    /// next of its triangle, or none, see connect()
+    std::vector<uint32_t> adjacent;
+    /// If the triangles enclose a volume, wound counter clockwise seen
+    /// from outside, so only the ones facing the camera are drawn
+    bool closed = false;
+
+    Occluder() {}
+
+    /// From count points of stride bytes and indices, like a vertex buffer
+    /// and an element buffer.
+    Occluder(const float * points,
+             size_t count,
+             const uint32_t * indices,
+             size_t indexCount,
+             size_t stride = 3 * sizeof(float))
+        : indices(indices, indices + indexCount) {
+        auto bytes = reinterpret_cast<const unsigned char *>(points);
+        vertices.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            auto point = reinterpret_cast<const float *>(bytes + i * stride);
+            vertices.emplace_back(point[0], point[1], point[2]);
+        }
+        connect();
+    }
+
+    /// The 12 triangles of box.
+    static Occluder fromBox(const AABB & box) {
+        Occluder occluder;
+        for (int corner = 0; corner < 8; corner++)
+            occluder.vertices.emplace_back(
+                corner & 1 ? box.max.x : box.min.x,
+                corner & 2 ? box.max.y : box.min.y,
+                corner & 4 ? box.max.z : box.min.z);
+        // Two triangles per face, corners by bit: x 1, y 2, z 4
+        occluder.indices = {0, 2, 3, 0, 3, 1, 4, 5, 7, 4, 7, 6,
+                            0, 1, 5, 0, 5, 4, 2, 6, 7, 2, 7, 3,
+                            0, 4, 6, 0, 6, 2, 1, 3, 7, 1, 7, 5};
+        occluder.closed = true;
+        occluder.connect();
+        return occluder;
+    }
+
+    /**
+     * Find the triangles that share each edge, wound the other way. Call
+     * after changing indices, an occluder without them draws each triangle
+     * on its own, which hides less.
+     */
+    void connect() {
+        std::unordered_map<uint64_t, uint32_t> edges;
+        auto key = [](uint32_t from, uint32_t to) {
+            return uint64_t(from) << 32 | to;
+        };
+        size_t count = indices.size() / 3 * 3;
+        for (size_t i = 0; i < count; i++)
+            edges[key(indices[i], indices[i / 3 * 3 + (i + 1) % 3])] =
+                uint32_t(i / 3);
+        adjacent.assign(count, none);
+        for (size_t i = 0; i < count; i++) {
+            auto found =
+                edges.find(key(indices[i / 3 * 3 + (i + 1) % 3], indices[i]));
+            if (found != edges.end())
+                adjacent[i] = found->second;
+        }
+    }
+};
+
+/**
+ * A small CPU depth buffer of occluders to test the bounds of objects
+ * against before drawing them, without a GPU or a frame of latency.
+ *
+ * begin() takes the view-projection matrix, add() transforms the triangles
+ * of an occluder, joins neighbours into convex polygons, clips them to the
+ * near plane and a guard band and sorts them into bins of binWidth by
+ * binHeight pixels. render() rasterizes each bin as one job: it evaluates
+ * the edge functions and depth planes of a polygon at 8 (AVX2) or 4 (SSE)
+ * pixel centres at a time and keeps the nearest depth where all edges
+ * pass, a masked min. It then stores the
+ * farthest depth of each block of blockSize pixels square, so occluded()
+ * skips the pixels of a block nearer than the object.
+ *
+ * The buffer is conservative at any size: a pixel holds a depth only where
+ * the occluders cover all of it, and no nearer than they are anywhere in
+ * it, so a low resolution hides fewer objects but never a visible one.
+ *
+ * Depth is the window depth of OpenGL, 0 at the near plane and 1 at the far
+ * one, bottom row first. Every kernel and thread count writes the same
+ * depths: each pixel is the min of the same values, in any order.
+ */
+class OcclusionBuffer {
+public:
+    /// A rasterizing kernel, see supported().
+    enum Kernel {
+        Scalar,
+        SSE,
+        AVX2,
+    };
+
+    /// Pixels along each side of a block of getBlockDepth().
+    static constexpr int blockSize = 8;
+    /// Pixels of a bin, the polygons of a bin are one job of render().
+    static constexpr int binWidth = 64;
+    static constexpr int binHeight = 32;
+    /// Polygons are clipped this many times the screen size out, nearer
+    /// to the screen they are only bounded, to save clipping most of them.
+    static constexpr float guardBand = 2;
+    /// An object is occluded where the depth is at least this much nearer
+    /// than its own, so rounding in the depth planes never hides it.
+    static constexpr float depthBias = 1e-6f;
+
+private:
+    /// A triangle clipped by 5 planes, or two sharing an edge, has at most
+    /// 9 vertices.
+    static constexpr int maxClipVertices = 9;
+
+    /// A convex polygon of the edge functions a * x + b * y + c, inside
+    /// where all are not negative, and the farther of two depth planes
+    /// zA * x + zB * y + zC, over pixels x0 to x1 and y0 to y1, x0 a
+    /// multiple of 8 and x1 one less.
+    struct Polygon {
+        float a[maxClipVertices], b[maxClipVertices], c[maxClipVertices];
+        int edges;
+        float zA[2], zB[2], zC[2];
+        int x0, y0, x1, y1;
+    };
+
+    /// A triangle of an occluder, see face().
+    struct Face {
+        int facing;
+        float zA, zB, zC;
+        float slope;
+    };
+
+    int width = 0, height = 0;
+    int binsX = 0, binsY = 0;
+    int blocksX = 0, blocksY = 0;
+    glm::mat4 viewProjection = glm::mat4(1);
+
+    std::vector<float> depth;
+    std::vector<float> blockDepth;
+    std::vector<Polygon> polygons;
+    std::vector<std::vector<uint32_t>> bins;
+    std::vector<glm::vec4> clipVertices;
+    std::vector<Face> faces;
+    std::vector<bool> drawn;
+
+public:
+    /// A buffer of width by height pixels, rounded up to multiples of
+    /// blockSize. Cleared to the far plane.
+    explicit OcclusionBuffer(int width = 256, int height = 128) {
+        resize(width, height);
+    }
+
+    OcclusionBuffer(OcclusionBuffer && other) = default;
+    OcclusionBuffer & operator=(OcclusionBuffer && other) = default;
+
+    OcclusionBuffer(const OcclusionBuffer &) = delete;
+    OcclusionBuffer & operator=(const OcclusionBuffer &) = delete;
+
+    /// If this build has the kernel.
+    static bool supported(Kernel kernel) {
+        switch (kernel) {
+            case Scalar:
+                return true;
+#ifdef OCCLUSION_BUFFER_SSE
+            case SSE:
+                return true;
+#endif
+#ifdef OCCLUSION_BUFFER_AVX2
+            case AVX2:
+                return true;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    /// The widest supported kernel.
+    static Kernel bestKernel() {
+        return supported(AVX2) ? AVX2 : supported(SSE) ? SSE : Scalar;
+    }
+
+    /// Resize and clear to the far plane, dropping the triangles added.
+    void resize(int width, int height) {
+        if (width <= 0 || height <= 0)
+            throw std::invalid_argument(
+                "OcclusionBuffer size must be positive");
+        this->width = (width + blockSize - 1) / blockSize * blockSize;
+        this->height = (height + blockSize - 1) / blockSize * blockSize;
+        binsX = (this->width + binWidth - 1) / binWidth;
+        binsY = (this->height + binHeight - 1) / binHeight;
+        blocksX = this->width / blockSize;
+        blocksY = this->height / blockSize;
+        depth.assign(size_t(this->width) * this->height, 1.0f);
+        blockDepth.assign(size_t(blocksX) * blocksY, 1.0f);
+        polygons.clear();
+        bins.assign(size_t(binsX) * binsY, {});
+    }
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    /// Start a frame seen through viewProjection, dropping the triangles
+    /// added for the last one.
+    void begin(const glm::mat4 & viewProjection) {
+        this->viewProjection = viewProjection;
+        polygons.clear();
+        for (auto & bin : bins)
+            bin.clear();
+    }
+
+    /**
+     * Add the triangles of occluder placed by model, for the next render().
+     * Each pair of triangles facing the same way across an edge is drawn
+     * as one polygon if it is convex, so the pixels along the edge are
+     * covered whole, and the triangles in no such pair on their own.
+     */
+    void add(const Occluder & occluder,
+             const glm::mat4 & model = glm::mat4(1)) {
+        glm::mat4 matrix = viewProjection * model;
+        clipVertices.resize(occluder.vertices.size());
+        for (size_t i = 0; i < occluder.vertices.size(); i++)
+            clipVertices[i] = matrix * glm::vec4(occluder.vertices[i], 1);
+
+        size_t count = occluder.indices.size() / 3;
+        const uint32_t * indices = occluder.indices.data();
+        faces.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            for (int k = 0; k < 3; k++) {
+                if (indices[i * 3 + k] >= clipVertices.size())
+                    throw std::out_of_range("Occluder index out of range");
+            }
+            faces[i] = face(clipVertices[indices[i * 3]],
+                            clipVertices[indices[i * 3 + 1]],
+                            clipVertices[indices[i * 3 + 2]]);
+            if (occluder.closed && faces[i].facing < 0)
+                faces[i].facing = 0;
+        }
+
+        drawn.assign(count, false);
+        if (occluder.adjacent.size() == count * 3) {
+            for (size_t i = 0; i < count; i++) {
+                if (faces[i].facing == 0)
+                    continue;
+                for (int k = 0; k < 3; k++) {
+                    uint32_t other = occluder.adjacent[i * 3 + k];
+                    if (other >= count || other <= i
+                        || faces[other].facing != faces[i].facing)
+                        continue;
+                    // Around the pair: the shared edge is from k to k + 1
+                    uint32_t from = indices[i * 3 + k];
+                    uint32_t to = indices[i * 3 + (k + 1) % 3];
+                    uint32_t opposite = from;
+                    for (int j = 0; j < 3; j++) {
+                        uint32_t index = indices[other * 3 + j];
+                        if (index != from && index != to)
+                            opposite = index;
+                    }
+                    glm::vec4 polygon[maxClipVertices] = {
+                        clipVertices[from], clipVertices[opposite],
+                        clipVertices[to],
+                        clipVertices[indices[i * 3 + (k + 2) % 3]]};
+                    if (opposite == from
+                        || !convex(polygon, 4, faces[i].facing))
+                        continue;
+                    setup(polygon, clip(polygon, 4), faces[i], faces[other]);
+                    drawn[i] = drawn[other] = true;
+                }
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (faces[i].facing == 0 || drawn[i])
+                continue;
+            glm::vec4 polygon[maxClipVertices];
+            for (int k = 0; k < 3; k++)
+                polygon[k] = clipVertices[indices[i * 3 + k]];
+            setup(polygon, clip(polygon, 3), faces[i], faces[i]);
+        }
+    }
+
+    /// Polygons added since begin(), after clipping.
+    size_t getPolygonCount() const {
+        return polygons.size();
+    }
+
+    /// Clear the depth and rasterize the polygons added.
+    void render(Kernel kernel = bestKernel()) {
+        PROFILE_ZONE("OcclusionBuffer::render");
+        for (size_t bin = 0; bin < bins.size(); bin++)
+            renderBin(bin, kernel);
+    }
+
+    /// render() in parallel, a bin per job.
+    void render(JobSystem & jobs, Kernel kernel = bestKernel()) {
+        PROFILE_ZONE("OcclusionBuffer::render");
+        jobs.parallelFor(0, bins.size(),
+                         [this, kernel](size_t begin, size_t end) {
+                             for (size_t bin = begin; bin < end; bin++)
+                                 renderBin(bin, kernel);
+                         },
+                         1);
+    }
+
+    /**
+     * If box, in world space, is hidden behind the occluders of the last
+     * render(): the depth of every pixel its projection touches is nearer
+     * than its nearest corner. Blocks farther than that are not read pixel
+     * by pixel. A box reaching behind the camera or off the screen is never
+     * occluded, nor is an empty one.
+     */
+    bool occluded(const AABB & box) const {
+        if (box.empty())
+            return false;
+        float minX = std::numeric_limits<float>::infinity(), minY = minX;
+        float maxX = -minX, maxY = -minX, nearest = 1;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec4 clip = viewProjection
+                             * glm::vec4(corner & 1 ? box.max.x : box.min.x,
+                                         corner & 2 ? box.max.y : box.min.y,
+                                         corner & 4 ? box.max.z : box.min.z,
+                                         1);
+            if (clip.w <= 0)
+                return false;
+            glm::vec3 window = toWindow(clip);
+            minX = std::min(minX, window.x);
+            minY = std::min(minY, window.y);
+            maxX = std::max(maxX, window.x);
+            maxY = std::max(maxY, window.y);
+            nearest = std::min(nearest, window.z);
+        }
+
+        // The pixels the projected box touches, clamped before converting
+        int x0 = int(std::max(0.0f, std::min(float(width), std::floor(minX))));
+        int y0 =
+            int(std::max(0.0f, std::min(float(height), std::floor(minY))));
+        int x1 =
+            int(std::min(float(width - 1), std::floor(std::max(-1.0f, maxX))));
+        int y1 = int(
+            std::min(float(height - 1), std::floor(std::max(-1.0f, maxY))));
+        if (x0 > x1 || y0 > y1)
+            return false;
+
+        float limit = nearest - depthBias;
+        for (int by = y0 / blockSize; by <= y1 / blockSize; by++) {
+            for (int bx = x0 / blockSize; bx <= x1 / blockSize; bx++) {
+                if (blockDepth[by * blocksX + bx] < limit)
+                    continue;
+                int px0 = std::max(x0, bx * blockSize);
+                int px1 = std::min(x1, bx * blockSize + blockSize - 1);
+                int py0 = std::max(y0, by * blockSize);
+                int py1 = std::min(y1, by * blockSize + blockSize - 1);
+                for (int y = py0; y <= py1; y++) {
+                    const float * row = &depth[size_t(y) * width];
+                    for (int x = px0; x <= px1; x++) {
+                        if (row[x] >= limit)
+                            return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    /// The depth of each pixel, bottom row first, as of the last render().
+    const std::vector<float> & getDepth() const {
+        return depth;
+    }
+
+    /// The farthest depth of each block of blockSize pixels square.
+    const std::vector<float> & getBlockDepth() const {
+        return blockDepth;
+    }
+
+private:
+    /// Window x and y in pixels and depth of a clip space position.
+    glm::vec3 toWindow(const glm::vec4 & clip) const {
+        float w = 1 / clip.w;
+        return glm::vec3((clip.x * w * 0.5f + 0.5f) * width,
+                         (clip.y * w * 0.5f + 0.5f) * height,
+                         clip.z * w * 0.5f + 0.5f);
+    }
+
+    /**
+     * Clip the convex polygon of count vertices to the near plane and the
+     * guard band (Sutherland-Hodgman), in clip space.
+     *
+     * @return the vertices of the polygon left, 0 if it is outside
+     */
+    static int clip(glm::vec4 * polygon, int count) {
+        // Inside where dot(plane, vertex) is not negative
+        static const glm::vec4 planes[] = {
+            {0, 0, 1, 1},          {1, 0, 0, guardBand}, {-1, 0, 0, guardBand},
+            {0, 1, 0, guardBand},  {0, -1, 0, guardBand},
+        };
+        bool inside = true;
+        for (auto & plane : planes) {
+            bool outside = true;
+            for (int k = 0; k < count; k++) {
+                float distance = glm::dot(plane, polygon[k]);
+                outside = outside && distance < 0;
+                inside = inside && distance >= 0;
+            }
+            if (outside)
+                return 0;
+        }
+        // Beyond the far plane it is behind everything
+        bool far = true;
+        for (int k = 0; k < count; k++)
+            far = far && polygon[k].z > polygon[k].w;
+        if (far)
+            return 0;
+        if (inside)
+            return count;
+
+        glm::vec4 buffer[maxClipVertices];
+        glm::vec4 * from = polygon, * to = buffer;
+        for (auto & plane : planes) {
+            int next = 0;
+            for (int k = 0; k < count; k++) {
+                const glm::vec4 & a = from[k];
+                const glm::vec4 & b = from[(k + 1) % count];
+                float da = glm::dot(plane, a), db = glm::dot(plane, b);
+                if (da >= 0)
+                    to[next++] = a;
+                if ((da >= 0) != (db >= 0))
+                    to[next++] = a + (b - a) * (da / (da - db));
+            }
+            count = next;
+            std::swap(from, to);
+            if (count < 3)
+                return 0;
+        }
+        // An odd number of planes leaves the result in buffer
+        std::copy(from, from + count, polygon);
+        return count;
+    }
+
+    /**
+     * If the polygon of count vertices in clip space turns the way of
+     * facing at every vertex in front of the camera. Only the part in
+     * front is drawn, any polygon is drawn no larger than it is, this
+     * only keeps the ones that would cover less than their triangles.
+     */
+    static bool convex(const glm::vec4 * polygon, int count, int facing) {
+        for (int k = 0; k < count; k++) {
+            const glm::vec4 & a = polygon[(k + count - 1) % count];
+            const glm::vec4 & b = polygon[k];
+            const glm::vec4 & c = polygon[(k + 1) % count];
+            if (a.w <= 0 || b.w <= 0 || c.w <= 0)
+                continue;
+            float turn = (b.x / b.w - a.x / a.w) * (c.y / c.w - b.y / b.w)
+                         - (b.y / b.w - a.y / a.w) * (c.x / c.w - b.x / b.w);
+            if (turn * float(facing) < 0)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * The facing of a triangle, 1 if it is wound counter clockwise on
+     * the screen, -1 if clockwise and 0 if edge on, and its window depth
+     * plane. Solved in clip space, so it holds for triangles reaching
+     * behind the camera too.
+     */
+    Face face(const glm::vec4 & v0,
+              const glm::vec4 & v1,
+              const glm::vec4 & v2) const {
+        // The plane z = A x + B y + C w through the vertices, by Cramer,
+        // in double as near the far plane depths differ in the fifth digit
+        auto det = [](const glm::dvec3 & a,
+                      const glm::dvec3 & b,
+                      const glm::dvec3 & c) {
+            return a.x * (b.y * c.z - b.z * c.y)
+                   - a.y * (b.x * c.z - b.z * c.x)
+                   + a.z * (b.x * c.y - b.y * c.x);
+        };
+        glm::dvec3 x(v0.x, v1.x, v2.x), y(v0.y, v1.y, v2.y);
+        glm::dvec3 z(v0.z, v1.z, v2.z), w(v0.w, v1.w, v2.w);
+        double d = det(x, y, w);
+        double a = det(z, y, w) / d, b = det(x, z, w) / d;
+        double c = det(x, y, z) / d;
+        // The same plane in window x and y in pixels and depth 0 to 1
+        Face face;
+        face.facing = d > 0 ? 1 : d < 0 ? -1 : 0;
+        face.zA = a / width;
+        face.zB = b / height;
+        face.zC = (c - a - b) * 0.5f + 0.5f;
+        face.slope = std::abs(face.zA) + std::abs(face.zB);
+        if (!std::isfinite(face.slope) || !std::isfinite(face.zC))
+            face.facing = 0;
+        return face;
+    }
+
+    /**
+     * Set up a convex polygon in clip space, of the triangles first and
+     * second, and add it to the bins it covers. Its edges move in by half
+     * a pixel, so it covers only pixels it covers whole, and its depth
+     * planes back by half a pixel of slope, so their farther is the
+     * farthest depth over each pixel.
+     */
+    void setup(const glm::vec4 * polygon,
+               int count,
+               const Face & first,
+               const Face & second) {
+        if (count < 3)
+            return;
+        glm::vec3 v[maxClipVertices];
+        float area = 0;
+        for (int k = 0; k < count; k++)
+            v[k] = toWindow(polygon[k]);
+        for (int k = 0; k < count; k++) {
+            const glm::vec3 & a = v[k], & b = v[(k + 1) % count];
+            area += a.x * b.y - a.y * b.x;
+        }
+        if (area == 0 || !std::isfinite(area))
+            return;
+        // Back faces of open occluders are drawn too, wound counter
+        // clockwise
+        if (area < 0)
+            std::reverse(v, v + count);
+
+        float minX = v[0].x, maxX = v[0].x, minY = v[0].y, maxY = v[0].y;
+        for (int k = 1; k < count; k++) {
+            minX = std::min(minX, v[k].x);
+            maxX = std::max(maxX, v[k].x);
+            minY = std::min(minY, v[k].y);
+            maxY = std::max(maxY, v[k].y);
+        }
+        Polygon p;
+        p.x0 = std::max(0, int(std::ceil(minX - 0.5f)));
+        p.y0 = std::max(0, int(std::ceil(minY - 0.5f)));
+        p.x1 = std::min(width - 1, int(std::floor(maxX - 0.5f)));
+        p.y1 = std::min(height - 1, int(std::floor(maxY - 0.5f)));
+        if (p.x0 > p.x1 || p.y0 > p.y1)
+            return;
+        // Whole groups of 8 pixels, so every kernel tests the same ones
+        p.x0 = p.x0 / 8 * 8;
+        p.x1 = p.x1 / 8 * 8 + 7;
+
+        p.edges = count;
+        for (int e = 0; e < count; e++) {
+            const glm::vec3 & from = v[e];
+            const glm::vec3 & to = v[(e + 1) % count];
+            p.a[e] = from.y - to.y;
+            p.b[e] = to.x - from.x;
+            p.c[e] = -(p.a[e] * from.x + p.b[e] * from.y)
+                     - (std::abs(p.a[e]) + std::abs(p.b[e])) * 0.5f;
+        }
+        const Face * faces[2] = {&first, &second};
+        for (int i = 0; i < 2; i++) {
+            p.zA[i] = faces[i]->zA;
+            p.zB[i] = faces[i]->zB;
+            p.zC[i] = faces[i]->zC + faces[i]->slope * 0.5f;
+        }
+
+        uint32_t index = uint32_t(polygons.size());
+        polygons.push_back(p);
+        for (int by = p.y0 / binHeight; by <= p.y1 / binHeight; by++) {
+            for (int bx = p.x0 / binWidth; bx <= p.x1 / binWidth; bx++)
+                bins[by * binsX + bx].push_back(index);
+        }
+    }
+
+    /// Clear, rasterize and reduce to blocks the pixels of a bin.
+    void renderBin(size_t bin, Kernel kernel) {
+        int bx0 = int(bin % binsX) * binWidth;
+        int by0 = int(bin / binsX) * binHeight;
+        int bx1 = std::min(width, bx0 + binWidth) - 1;
+        int by1 = std::min(height, by0 + binHeight) - 1;
+        for (int y = by0; y <= by1; y++)
+            std::fill(&depth[size_t(y) * width + bx0],
+                      &depth[size_t(y) * width + bx1] + 1, 1.0f);
+
+        for (uint32_t index : bins[bin]) {
+            const Polygon & p = polygons[index];
+            int x0 = std::max(p.x0, bx0), x1 = std::min(p.x1, bx1);
+            int y0 = std::max(p.y0, by0), y1 = std::min(p.y1, by1);
+#ifdef OCCLUSION_BUFFER_AVX2
+            if (kernel >= AVX2) {
+                rasterize<AVX2Lanes>(p, x0, y0, x1, y1);
+                continue;
+            }
+#endif
+#ifdef OCCLUSION_BUFFER_SSE
+            if (kernel >= SSE) {
+                rasterize<SSELanes>(p, x0, y0, x1, y1);
+                continue;
+            }
+#endif
+            rasterize<ScalarLanes>(p, x0, y0, x1, y1);
+        }
+
+        // The farthest of each column of a row of blocks, which vectorizes,
+        // then of the columns of each block
+        float columns[binWidth];
+        int count = bx1 - bx0 + 1;
+        for (int by = by0; by <= by1; by += blockSize) {
+            std::fill(columns, columns + count, 0.0f);
+            for (int y = by; y < by + blockSize; y++) {
+                const float * row = &depth[size_t(y) * width + bx0];
+                for (int x = 0; x < count; x++) {
+                    float pixel = row[x];
+                    columns[x] = columns[x] < pixel ? pixel : columns[x];
+                }
+            }
+            float * blocks = &blockDepth[by / blockSize * blocksX
+                                         + bx0 / blockSize];
+            for (int x = 0; x < count; x += blockSize)
+                blocks[x / blockSize] =
+                    *std::max_element(columns + x, columns + x + blockSize);
+        }
+    }
+
+    struct ScalarLanes {
+        using Vector = float;
+        using Mask = bool;
+        static constexpr int width = 1;
+
+        /// The pixel centre of each lane from x.
+        static Vector centres(int x) {
+            return float(x) + 0.5f;
+        }
+
+        static Vector set(float value) {
+            return value;
+        }
+
+        static Vector add(Vector a, Vector b) {
+            return a + b;
+        }
+
+        static Vector mul(Vector a, Vector b) {
+            return a * b;
+        }
+
+        static Vector max(Vector a, Vector b) {
+            return std::max(a, b);
+        }
+
+        static Mask notNegative(Vector a) {
+            return a >= 0;
+        }
+
+        static Mask both(Mask a, Mask b) {
+            return a && b;
+        }
+
+        /// Keep the nearer of depth and the stored depth where mask is set.
+        static void storeNearer(float * p, Vector depth, Mask mask) {
+            if (mask)
+                *p = std::min(depth, *p);
+        }
+    };
+
+#ifdef OCCLUSION_BUFFER_SSE
+    struct SSELanes {
+        using Vector = __m128;
+        using Mask = __m128;
+        static constexpr int width = 4;
+
+        static Vector centres(int x) {
+            return _mm_add_ps(_mm_set1_ps(float(x)),
+                              _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+        }
+
+        static Vector set(float value) {
+            return _mm_set1_ps(value);
+        }
+
+        static Vector add(Vector a, Vector b) {
+            return _mm_add_ps(a, b);
+        }
+
+        static Vector mul(Vector a, Vector b) {
+            return _mm_mul_ps(a, b);
+        }
+
+        static Vector max(Vector a, Vector b) {
+            return _mm_max_ps(a, b);
+        }
+
+        static Mask notNegative(Vector a) {
+            return _mm_cmpge_ps(a, _mm_setzero_ps());
+        }
+
+        static Mask both(Mask a, Mask b) {
+            return _mm_and_ps(a, b);
+        }
+
+        static void storeNearer(float * p, Vector depth, Mask mask) {
+            __m128 stored = _mm_loadu_ps(p);
+            __m128 nearer = _mm_min_ps(depth, stored);
+            _mm_storeu_ps(p, _mm_or_ps(_mm_and_ps(mask, nearer),
+                                       _mm_andnot_ps(mask, stored)));
+        }
+    };
+#endif
+
+#ifdef OCCLUSION_BUFFER_AVX2
+    struct AVX2Lanes {
+        using Vector = __m256;
+        using Mask = __m256;
+        static constexpr int width = 8;
+
+        static Vector centres(int x) {
+            return _mm256_add_ps(_mm256_set1_ps(float(x)),
+                                 _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f,
+                                                5.5f, 6.5f, 7.5f));
+        }
+
+        static Vector set(float value) {
+            return _mm256_set1_ps(value);
+        }
+
+        static Vector add(Vector a, Vector b) {
+            return _mm256_add_ps(a, b);
+        }
+
+        static Vector mul(Vector a, Vector b) {
+            return _mm256_mul_ps(a, b);
+        }
+
+        static Vector max(Vector a, Vector b) {
+            return _mm256_max_ps(a, b);
+        }
+
+        static Mask notNegative(Vector a) {
+            return _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GE_OQ);
+        }
+
+        static Mask both(Mask a, Mask b) {
+            return _mm256_and_ps(a, b);
+        }
+
+        static void storeNearer(float * p, Vector depth, Mask mask) {
+            __m256 stored = _mm256_loadu_ps(p);
+            _mm256_storeu_ps(
+                p, _mm256_blendv_ps(stored, _mm256_min_ps(depth, stored),
+                                    mask));
+        }
+    };
+#endif
+
+    /// Rasterize p with the loop over its edges unrolled for triangles
+    /// and quads, most of them.
+    template <typename L>
+    void rasterize(const Polygon & p, int x0, int y0, int x1, int y1) {
+        switch (p.edges) {
+            case 3:
+                rasterize<L, 3>(p, x0, y0, x1, y1);
+                break;
+            case 4:
+                rasterize<L, 4>(p, x0, y0, x1, y1);
+                break;
+            default:
+                rasterize<L, maxClipVertices>(p, x0, y0, x1, y1);
+                break;
+        }
+    }
+
+    /**
+     * Rasterize pixels x0 to x1 and y0 to y1 of p, of at most edges edges,
+     * a lane per pixel, x0 a multiple of 8 and x1 one less. Each kernel
+     * does the same operations in the same order on each pixel, so they
+     * write the same depths. Occluders are mostly small and far, so every
+     * row has the same groups of pixels, which costs less than
+     * mispredicting where each row ends.
+     */
+    template <typename L, int edges>
+    void rasterize(const Polygon & p, int x0, int y0, int x1, int y1) {
+        using V = typename L::Vector;
+        int count = std::min(edges, p.edges);
+        V a[edges], row[edges];
+        for (int e = 0; e < count; e++)
+            a[e] = L::set(p.a[e]);
+        V zA0 = L::set(p.zA[0]), zA1 = L::set(p.zA[1]);
+        for (int y = y0; y <= y1; y++) {
+            float py = float(y) + 0.5f;
+            for (int e = 0; e < count; e++)
+                row[e] = L::set(p.b[e] * py + p.c[e]);
+            V zRow0 = L::set(p.zB[0] * py + p.zC[0]);
+            V zRow1 = L::set(p.zB[1] * py + p.zC[1]);
+            float * out = &depth[size_t(y) * width];
+            for (int x = x0; x <= x1; x += L::width) {
+                V px = L::centres(x);
+                typename L::Mask inside =
+                    L::notNegative(L::add(L::mul(a[0], px), row[0]));
+                for (int e = 1; e < count; e++)
+                    inside = L::both(
+                        inside, L::notNegative(L::add(L::mul(a[e], px),
+                                                      row[e])));
+                V z = L::max(L::add(L::mul(zA0, px), zRow0),
+                             L::add(L::mul(zA1, px), zRow1));
+                L::storeNearer(out + x, z, inside);
+            }
+        }
+    }
+};
@@ -0,0 +1,518 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Buffer.hpp"
+#include "FrameBuffer.hpp"
+#include "RenderTargetPool.hpp"
+#include "Shader.hpp"
+#include "Texture.hpp"
+
+/**
+ * A stack of full screen effects applied to a texture.
+ *
+ * Per pixel effects (color and warp) next to each other at the same scale
+ * are fused into one generated shader, so they cost a single full screen
+ * pass together. A warp only moves the coordinate the input is sampled at
+ * and a color effect only changes the sampled color, so the fused shader
+ * applies all warps (last to first) before sampling and all colors (first
+ * to last) after.
+ *
+ * Blur and bloom need neighbouring pixels and run as their own passes.
+ * Intermediate targets come from a RenderTargetPool and ping-pong between
+ * two textures. Each effect can run at a fraction of the output size,
+ * later passes upscale with linear filtering.
+ */
+class PostChain {
+    struct Effect {
+        enum Type {
+            Warp,
+            Color,
+            Blur,
+            Bloom,
+        };
+
+        Type type;
+        std::string code;
+        float scale;
+        float threshold;
+        float intensity;
+        int levels;
+    };
+
+    struct Stage {
+        Effect::Type type;
+        float scale;
+        const Effect * effect;
+        std::unique_ptr<Shader> shader;
+        Shader::Uniform time;
+
+        Stage(Effect::Type type, float scale, const Effect * effect)
+            : type(type), scale(scale), effect(effect), time(GLuint(-1)) {}
+    };
+
+    std::vector<Effect> effects;
+    std::vector<Stage> stages;
+    bool compiled;
+    Texture::Format format;
+
+    Quad quad;
+    std::unique_ptr<Shader> blurShader;
+    std::unique_ptr<Shader> prefilterShader;
+    std::unique_ptr<Shader> downShader;
+    std::unique_ptr<Shader> upShader;
+    std::unique_ptr<Shader> compositeShader;
+
+public:
+    /**
+     * @param format the format of intermediate targets, RGBA16F keeps HDR
+     *               values for bloom and tonemapping
+     */
+    PostChain(Texture::Format format = Texture::RGBA16F)
+        : compiled(false), format(format) {}
+
+    PostChain(PostChain && other) = default;
+    PostChain & operator=(PostChain && other) = default;
+
+    PostChain(const PostChain &) = delete;
+    PostChain & operator=(const PostChain &) = delete;
+
+    /**
+     * Add a per pixel color effect. The GLSL body gets `vec4 c`, the input
+     * color, and `vec2 uv`, and returns the new color. `float t` is the
+     * time passed to apply.
+     */
+    PostChain & color(const std::string & glsl, float scale = 1.0f) {
+        return add({Effect::Color, glsl, scale, 0, 0, 0});
+    }
+
+    /**
+     * Add a per pixel coordinate effect. The GLSL body gets `vec2 uv` and
+     * `vec2 pos` in -1 to 1, and returns the coordinate to sample.
+     */
+    PostChain & warp(const std::string & glsl, float scale = 1.0f) {
+        return add({Effect::Warp, glsl, scale, 0, 0, 0});
+    }
+
+    PostChain & grayscale(float scale = 1.0f) {
+        return color(R"(
+    float v = dot(c.rgb, vec3(0.2126, 0.7152, 0.0722));
+    return vec4(vec3(v), c.a);)",
+                     scale);
+    }
+
+    /// ACES filmic tonemapping, Narkowicz's fit.
+    PostChain & tonemap(float exposure = 1.0f, float scale = 1.0f) {
+        return color(R"(
+    vec3 x = c.rgb * )" + std::to_string(exposure)
+                         + R"(;
+    x = (x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14);
+    return vec4(clamp(x, 0.0, 1.0), c.a);)",
+                     scale);
+    }
+
+    /// Horizontal wave moving with time.
+    PostChain & distortion(float amplitude = 0.1f,
+                           float frequency = 3.0f,
+                           float scale = 1.0f) {
+        return warp(R"(
+    return uv + vec2(sin(t + pos.x * )" + std::to_string(frequency)
+                        + ") * " + std::to_string(amplitude) + ", 0.0);",
+                    scale);
+    }
+
+    /// Separable Gaussian blur, two passes at scale of the output size.
+    PostChain & blur(float scale = 0.5f) {
+        return add({Effect::Blur, "", scale, 0, 0, 0});
+    }
+
+    /**
+     * Add the bright parts back blurred, through a chain of downsampled
+     * targets starting at half size.
+     *
+     * @param threshold the brightness where bloom starts
+     * @param intensity the amount of bloom added
+     * @param levels the number of downsampled targets
+     */
+    PostChain & bloom(float threshold = 1.0f,
+                      float intensity = 0.5f,
+                      int levels = 5) {
+        return add({Effect::Bloom, "", 1.0f, threshold, intensity, levels});
+    }
+
+    void clear() {
+        effects.clear();
+        stages.clear();
+        compiled = false;
+    }
+
+    /// Number of full screen passes the chain runs, excluding bloom levels.
+    size_t getStageCount() const {
+        return stages.size();
+    }
+
+    /**
+     * Group effects into stages and build their shaders. Called by apply
+     * after effects were added.
+     *
+     * @throws Shader::CompileException if a custom effect does not compile
+     */
+    void compile() {
+        stages.clear();
+
+        for (size_t i = 0; i < effects.size();) {
+            const Effect & effect = effects[i];
+            if (effect.type == Effect::Blur || effect.type == Effect::Bloom) {
+                stages.emplace_back(effect.type, effect.scale, &effect);
+                i++;
+                continue;
+            }
+
+            // Collect the run of per pixel effects at the same scale
+            size_t end = i;
+            while (end < effects.size() && effects[end].scale == effect.scale
+                   && (effects[end].type == Effect::Warp
+                       || effects[end].type == Effect::Color))
+                end++;
+
+            stages.emplace_back(Effect::Color, effect.scale, &effect);
+            Stage & stage = stages.back();
+            stage.shader = std::make_unique<Shader>(
+                vertexShaderSource,
+                fuse(effects.begin() + i, effects.begin() + end).c_str());
+            stage.time = stage.shader->uniform("t");
+            i = end;
+        }
+
+        // An empty chain still copies the input to the output
+        if (stages.empty()) {
+            stages.emplace_back(Effect::Color, 1.0f, nullptr);
+            stages.back().shader = std::make_unique<Shader>(
+                vertexShaderSource,
+                fuse(effects.end(), effects.end()).c_str());
+        }
+
+        createShaders();
+        compiled = true;
+    }
+
+    /**
+     * Run the chain on input and draw the result into output.
+     *
+     * @param input the texture to process
+     * @param output the frame buffer to draw into, its size sets the size of
+     *               all passes so resize the default frame buffer with the
+     *               window
+     * @param pool provides the intermediate targets
+     * @param time the value of `t` in effects
+     *
+     * @throws std::runtime_error if output has no size
+     */
+    void apply(const Texture & input,
+               FrameBuffer & output,
+               RenderTargetPool & pool,
+               float time = 0) {
+        if (!compiled)
+            compile();
+
+        glm::uvec2 size(output.getWidth(), output.getHeight());
+        if (size.x == 0 || size.y == 0)
+            throw std::runtime_error("Output frame buffer has no size");
+
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        GLboolean depth = glIsEnabled(GL_DEPTH_TEST);
+        GL_CAPTURE(Disable, GL_BLEND);
+        glDisable(GL_BLEND);
+        GL_CAPTURE(Disable, GL_DEPTH_TEST);
+        glDisable(GL_DEPTH_TEST);
+
+        const Texture * current = &input;
+        Texture * owned = nullptr;
+
+        for (size_t i = 0; i < stages.size(); i++) {
+            Stage & stage = stages[i];
+            bool last = i + 1 == stages.size();
+            Texture * target = last ? nullptr : acquire(pool, size, stage.scale);
+
+            if (stage.type == Effect::Blur) {
+                Texture * temp = acquire(pool, size, stage.scale);
+                blurShader->bind();
+                blurPass(*current, temp, glm::vec2(1, 0), output, pool);
+                blurPass(*temp, target, glm::vec2(0, 1), output, pool);
+                pool.release(temp);
+            }
+            else if (stage.type == Effect::Bloom) {
+                bloomPass(*stage.effect, *current, target, size, output, pool);
+            }
+            else {
+                stage.shader->bind();
+                stage.time.setValue(time);
+                current->bind();
+                drawTo(target, output, pool);
+            }
+
+            if (owned)
+                pool.release(owned);
+            owned = target;
+            current = target;
+        }
+
+        if (blend) {
+            GL_CAPTURE(Enable, GL_BLEND);
+            glEnable(GL_BLEND);
+        }
+        if (depth) {
+            GL_CAPTURE(Enable, GL_DEPTH_TEST);
+            glEnable(GL_DEPTH_TEST);
+        }
+    }
+
+private:
+    PostChain & add(const Effect & effect) {
+        effects.push_back(effect);
+        compiled = false;
+        return *this;
+    }
+
+    static std::string fuse(std::vector<Effect>::const_iterator begin,
+                            std::vector<Effect>::const_iterator end) {
+        std::ostringstream glsl;
+        glsl << R"(#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+uniform float t;
+)";
+
+        int index = 0;
+        for (auto it = begin; it != end; ++it, ++index) {
+            if (it->type == Effect::Warp)
+                glsl << "vec2 effect" << index << "(vec2 uv) {\n"
+                     << "    vec2 pos = uv * 2.0 - 1.0;" << it->code << "\n}\n";
+            else
+                glsl << "vec4 effect" << index << "(vec4 c, vec2 uv) {"
+                     << it->code << "\n}\n";
+        }
+
+        glsl << "void main() {\n    vec2 uv = FragTex;\n";
+        for (int i = index - 1; i >= 0; i--) {
+            if ((begin + i)->type == Effect::Warp)
+                glsl << "    uv = effect" << i << "(uv);\n";
+        }
+        glsl << "    vec4 c = texture(gTexture, uv);\n";
+        for (int i = 0; i < index; i++) {
+            if ((begin + i)->type == Effect::Color)
+                glsl << "    c = effect" << i << "(c, FragTex);\n";
+        }
+        glsl << "    FragColor = c;\n}\n";
+        return glsl.str();
+    }
+
+    void createShaders() {
+        if (!blurShader)
+            blurShader =
+                std::make_unique<Shader>(vertexShaderSource, blurShaderSource);
+        if (!prefilterShader)
+            prefilterShader = std::make_unique<Shader>(vertexShaderSource,
+                                                       prefilterShaderSource);
+        if (!downShader)
+            downShader =
+                std::make_unique<Shader>(vertexShaderSource, downShaderSource);
+        if (!upShader)
+            upShader =
+                std::make_unique<Shader>(vertexShaderSource, upShaderSource);
+        if (!compositeShader) {
+            compositeShader = std::make_unique<Shader>(vertexShaderSource,
+                                                       compositeShaderSource);
+            compositeShader->bind();
+            compositeShader->uniform("gBloom").setValue(1);
+        }
+    }
+
+    Texture * acquire(RenderTargetPool & pool,
+                      const glm::uvec2 & size,
+                      float scale) {
+        glm::uvec2 scaled = glm::max(glm::uvec2(glm::vec2(size) * scale),
+                                     glm::uvec2(1));
+        return pool.acquireTexture(scaled, format);
+    }
+
+    /// Draw a full screen quad into target, or into output if null.
+    void drawTo(Texture * target, FrameBuffer & output, RenderTargetPool & pool) {
+        FrameBuffer * fbo = target ? pool.getFrameBuffer({{target}}) : &output;
+        fbo->bind();
+        fbo->viewport();
+        quad.draw();
+    }
+
+    static glm::vec2 texelSize(const Texture & texture) {
+        return glm::vec2(1.0f) / glm::vec2(texture.getSize());
+    }
+
+    void blurPass(const Texture & source,
+                  Texture * target,
+                  const glm::vec2 & direction,
+                  FrameBuffer & output,
+                  RenderTargetPool & pool) {
+        blurShader->uniform("direction").setVec2(direction * texelSize(source));
+        source.bind();
+        drawTo(target, output, pool);
+    }
+
+    void bloomPass(const Effect & effect,
+                   const Texture & source,
+                   Texture * target,
+                   const glm::uvec2 & size,
+                   FrameBuffer & output,
+                   RenderTargetPool & pool) {
+        std::vector<Texture *> chain;
+        float scale = 0.5f;
+        for (int i = 0; i < effect.levels; i++, scale *= 0.5f) {
+            if (size.x * scale < 2 || size.y * scale < 2)
+                break;
+            chain.push_back(acquire(pool, size, scale));
+        }
+
+        if (!chain.empty()) {
+            prefilterShader->bind();
+            prefilterShader->uniform("threshold").setValue(effect.threshold);
+            prefilterShader->uniform("texelSize").setVec2(texelSize(source));
+            source.bind();
+            drawTo(chain[0], output, pool);
+
+            downShader->bind();
+            for (size_t i = 1; i < chain.size(); i++) {
+                downShader->uniform("texelSize").setVec2(
+                    texelSize(*chain[i - 1]));
+                chain[i - 1]->bind();
+                drawTo(chain[i], output, pool);
+            }
+
+            // Add each level onto the next larger one
+            upShader->bind();
+            GL_CAPTURE(Enable, GL_BLEND);
+            glEnable(GL_BLEND);
+            GL_CAPTURE(BlendFunc, GL_ONE, GL_ONE);
+            glBlendFunc(GL_ONE, GL_ONE);
+            for (size_t i = chain.size() - 1; i > 0; i--) {
+                upShader->uniform("texelSize").setVec2(texelSize(*chain[i]));
+                chain[i]->bind();
+                drawTo(chain[i - 1], output, pool);
+            }
+            GL_CAPTURE(Disable, GL_BLEND);
+            glDisable(GL_BLEND);
+        }
+
+        compositeShader->bind();
+        compositeShader->uniform("intensity").setValue(
+            chain.empty() ? 0.0f : effect.intensity);
+        source.bind();
+        if (!chain.empty()) {
+            GL_CAPTURE(ActiveTexture, GL_TEXTURE1);
+            glActiveTexture(GL_TEXTURE1);
+            chain[0]->bind();
+            GL_CAPTURE(ActiveTexture, GL_TEXTURE0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        drawTo(target, output, pool);
+
+        for (auto * texture : chain)
+            pool.release(texture);
+    }
+
+    static constexpr const char * vertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+out vec2 FragTex;
+void main() {
+    gl_Position = vec4(aPos, 1.0);
+    FragTex = aTex;
+})";
+
+    // 9 tap Gaussian using linear filtering to sample two texels per tap
+    static constexpr const char * blurShaderSource = R"(
+#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+uniform vec2 direction;
+void main() {
+    const float offset[3] = float[](0.0, 1.3846153846, 3.2307692308);
+    const float weight[3] = float[](0.2270270270, 0.3162162162, 0.0702702703);
+    vec4 c = texture(gTexture, FragTex) * weight[0];
+    for (int i = 1; i < 3; i++) {
+        c += texture(gTexture, FragTex + direction * offset[i]) * weight[i];
+        c += texture(gTexture, FragTex - direction * offset[i]) * weight[i];
+    }
+    FragColor = c;
+})";
+
+    static constexpr const char * prefilterShaderSource = R"(
+#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+uniform vec2 texelSize;
+uniform float threshold;
+void main() {
+    vec4 o = texelSize.xyxy * vec4(-0.5, -0.5, 0.5, 0.5);
+    vec3 c = (texture(gTexture, FragTex + o.xy).rgb
+              + texture(gTexture, FragTex + o.zy).rgb
+              + texture(gTexture, FragTex + o.xw).rgb
+              + texture(gTexture, FragTex + o.zw).rgb) * 0.25;
+    float brightness = max(c.r, max(c.g, c.b));
+    float contribution = max(brightness - threshold, 0.0) / max(brightness, 1e-4);
+    FragColor = vec4(c * contribution, 1.0);
+})";
+
+    static constexpr const char * downShaderSource = R"(
+#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+uniform vec2 texelSize;
+void main() {
+    vec4 o = texelSize.xyxy * vec4(-1.0, -1.0, 1.0, 1.0);
+    FragColor = (texture(gTexture, FragTex + o.xy)
+                 + texture(gTexture, FragTex + o.zy)
+                 + texture(gTexture, FragTex + o.xw)
+                 + texture(gTexture, FragTex + o.zw)) * 0.25;
+})";
+
+    static constexpr const char * upShaderSource = R"(
+#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+uniform vec2 texelSize;
+void main() {
+    vec4 o = texelSize.xyxy * vec4(-0.5, -0.5, 0.5, 0.5);
+    FragColor = (texture(gTexture, FragTex + o.xy)
+                 + texture(gTexture, FragTex + o.zy)
+                 + texture(gTexture, FragTex + o.xw)
+                 + texture(gTexture, FragTex + o.zw)) * 0.25;
+})";
+
+    static constexpr const char * compositeShaderSource = R"(
+#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+uniform sampler2D gBloom;
+uniform float intensity;
+void main() {
+    vec4 c = texture(gTexture, FragTex);
+    FragColor = vec4(c.rgb + texture(gBloom, FragTex).rgb * intensity, c.a);
+})";
+};
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Trace.hpp"
+
+/**
+ * Scoped CPU zones, compiled in with -DPROFILE_ENABLED (the CMake option
+ * ENABLE_PROFILER) and to nothing otherwise.
+ *
+ *     void update() {
+ *         PROFILE_FUNCTION();
+ *         {
+ *             PROFILE_ZONE("physics");
+ *             ...
+ *         }
+ *     }
+ *
+ * Names must outlive the profiler, use string literals.
+ */
+#ifdef PROFILE_ENABLED
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) \
+    CpuProfiler::Scope PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+/// Mark the end of a frame on the main thread.
+#define PROFILE_FRAME() CpuProfiler::get().frame()
+/// Name the current thread in traces.
+#define PROFILE_THREAD(name) CpuProfiler::get().setThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+/**
+ * Collects CPU zones from all threads.
+ *
+ * Each thread writes finished zones into its own single producer, single
+ * consumer ring buffer, so recording a zone is two clock reads and a
+ * release store, with no locks. A background thread drains the buffers,
+ * keeps per zone statistics and adds the zones to a ChromeTrace while one
+ * is set. Zones are dropped, and counted, when a buffer is full.
+ *
+ * Frame times from PROFILE_FRAME() go into a histogram for p50/p95/p99
+ * over the whole run and into rolling statistics of the last frames.
+ */
+class CpuProfiler {
+public:
+    /// First trace thread id, lower ids are used by GpuProfiler.
+    static const int firstThread = 2;
+
+    struct Event {
+        const char * name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    struct ZoneStats {
+        std::string name;
+        size_t calls;
+        double average;
+        double p50;
+        double p95;
+        double p99;
+    };
+
+    struct FrameStats {
+        uint64_t frames;
+        double average;
+        double p50;
+        double p95;
+        double p99;
+        double max;
+        /// Average of the last frames
+        double recent;
+        uint64_t dropped;
+    };
+
+    class ThreadBuffer {
+        std::vector<Event> events;
+        size_t mask;
+        // Separate cache lines, the owner writes head and the collector tail
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+        alignas(64) std::atomic<uint64_t> dropped;
+        int thread;
+        std::string name;
+
+        friend class CpuProfiler;
+
+    public:
+        /// @param capacity the number of events, a power of two
+        ThreadBuffer(size_t capacity, int thread)
+            : events(capacity), mask(capacity - 1), head(0), tail(0),
+              dropped(0), thread(thread),
+              name("Thread " + std::to_string(thread - firstThread)) {}
+
+        /// Called by the owning thread only.
+        void push(const Event & event) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) > mask) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            events[h & mask] = event;
+            head.store(h + 1, std::memory_order_release);
+        }
+
+        /// Called by the collector only.
+        template <typename F> void drain(F consume) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t h = head.load(std::memory_order_acquire);
+            for (; t != h; t++)
+                consume(events[t & mask]);
+            tail.store(t, std::memory_order_release);
+        }
+    };
+
+    /// Records a zone from construction to destruction.
+    class Scope {
+        const char * name;
+        uint64_t start;
+
+    public:
+        explicit Scope(const char * name) : name(name), start(now()) {}
+
+        Scope(const Scope &) = delete;
+        Scope & operator=(const Scope &) = delete;
+
+        ~Scope() {
+            CpuProfiler::get().record(name, start, now());
+        }
+    };
+
+private:
+    size_t capacity;
+    std::chrono::milliseconds interval;
+
+    std::mutex threadsMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads;
+
+    // Guards everything the collector updates
+    std::mutex collectMutex;
+    std::map<std::string, RollingStats> zones;
+    std::map<std::string, size_t> calls;
+    ChromeTrace * trace;
+
+    std::mutex frameMutex;
+    Histogram frameHistogram;
+    RollingStats recentFrames;
+    uint64_t lastFrame;
+
+    std::thread collector;
+    std::mutex stopMutex;
+    std::condition_variable stopped;
+    bool stopping;
+
+    CpuProfiler(size_t capacity = 1 << 14,
+                std::chrono::milliseconds interval = std::chrono::milliseconds(10))
+        : capacity(capacity), interval(interval), trace(nullptr),
+          frameHistogram(0.25, 400), recentFrames(120), lastFrame(0),
+          stopping(false) {}
+
+public:
+    CpuProfiler(const CpuProfiler &) = delete;
+    CpuProfiler & operator=(const CpuProfiler &) = delete;
+
+    ~CpuProfiler() {
+        if (collector.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(stopMutex);
+                stopping = true;
+            }
+            stopped.notify_all();
+            collector.join();
+        }
+    }
+
+    static CpuProfiler & get() {
+        static CpuProfiler profiler;
+        return profiler;
+    }
+
+    /// Nanoseconds on the steady clock.
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    void record(const char * name, uint64_t start, uint64_t end) {
+        localBuffer().push({name, start, end});
+    }
+
+    void setThreadName(const std::string & name) {
+        ThreadBuffer & buffer = localBuffer();
+        std::lock_guard<std::mutex> lock(collectMutex);
+        buffer.name = name;
+        if (trace)
+            trace->setThreadName(buffer.thread, name);
+    }
+
+    /// Mark the end of a frame, call from one thread.
+    void frame() {
+        uint64_t time = now();
+        if (lastFrame != 0) {
+            record("Frame", lastFrame, time);
+            double ms = (time - lastFrame) / 1.0e6;
+            std::lock_guard<std::mutex> lock(frameMutex);
+            frameHistogram.add(ms);
+            recentFrames.add(ms);
+        }
+        lastFrame = time;
+    }
+
+    /**
+     * Add collected zones to trace from now on, nullptr to stop. The
+     * collector thread adds to it, so don't share it with another profiler
+     * and only read it once it is unset.
+     */
+    void setTrace(ChromeTrace * trace) {
+        flush();
+        std::lock_guard<std::mutex> lock(collectMutex);
+        this->trace = trace;
+        if (trace) {
+            std::lock_guard<std::mutex> threadsLock(threadsMutex);
+            for (auto & buffer : threads)
+                trace->setThreadName(buffer->thread, buffer->name);
+        }
+    }
+
+    /// Collect all recorded zones now instead of waiting for the collector.
+    void flush() {
+        std::lock_guard<std::mutex> lock(collectMutex);
+        collect();
+    }
+
+    FrameStats getFrameStats() {
+        uint64_t dropped = 0;
+        {
+            std::lock_guard<std::mutex> lock(threadsMutex);
+            for (auto & buffer : threads)
+                dropped += buffer->dropped.load(std::memory_order_relaxed);
+        }
+
+        std::lock_guard<std::mutex> lock(frameMutex);
+        return {frameHistogram.count(),    frameHistogram.average(),
+                frameHistogram.percentile(50), frameHistogram.percentile(95),
+                frameHistogram.percentile(99), frameHistogram.max(),
+                recentFrames.average(),    dropped};
+    }
+
+    /// Frame times in milliseconds since the start or the last reset.
+    Histogram getFrameHistogram() {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        return frameHistogram;
+    }
+
+    /// Durations in milliseconds of the last calls of each zone.
+    std::vector<ZoneStats> getZoneStats() {
+        std::lock_guard<std::mutex> lock(collectMutex);
+        std::vector<ZoneStats> result;
+        for (auto & zone : zones) {
+            const RollingStats & s = zone.second;
+            result.push_back({zone.first, calls[zone.first], s.average(),
+                              s.percentile(50), s.percentile(95),
+                              s.percentile(99)});
+        }
+        return result;
+    }
+
+    void reset() {
+        {
+            std::lock_guard<std::mutex> lock(collectMutex);
+            zones.clear();
+            calls.clear();
+        }
+        std::lock_guard<std::mutex> lock(frameMutex);
+        frameHistogram.clear();
+        recentFrames.clear();
+    }
+
+private:
+    ThreadBuffer & localBuffer() {
+        thread_local ThreadBuffer * buffer = nullptr;
+        if (!buffer)
+            buffer = registerThread();
+        return *buffer;
+    }
+
+    ThreadBuffer * registerThread() {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        int thread = firstThread + int(threads.size());
+        threads.push_back(std::make_unique<ThreadBuffer>(capacity, thread));
+        if (!collector.joinable())
+            collector = std::thread(&CpuProfiler::run, this);
+        return threads.back().get();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(stopMutex);
+        while (!stopping) {
+            stopped.wait_for(lock, interval);
+            flush();
+        }
+    }
+
+    /// Called with collectMutex held.
+    void collect() {
+        std::vector<ThreadBuffer *> buffers;
+        {
+            std::lock_guard<std::mutex> lock(threadsMutex);
+            for (auto & buffer : threads)
+                buffers.push_back(buffer.get());
+        }
+
+        for (auto * buffer : buffers) {
+            buffer->drain([&](const Event & event) {
+                double ms = (event.end - event.start) / 1.0e6;
+                auto it = zones.find(event.name);
+                if (it == zones.end())
+                    it = zones.emplace(event.name, RollingStats(256)).first;
+                it->second.add(ms);
+                calls[event.name]++;
+
+                if (trace)
+                    trace->add(event.name, "cpu", event.start / 1.0e3,
+                               ms * 1.0e3, buffer->thread);
+            });
+        }
+    }
+};
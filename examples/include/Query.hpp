@@ -0,0 +1,128 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <vector>
+
+/// A GL query object, like a timer or an occlusion query.
+class Query {
+    GLuint query;
+    GLenum target;
+
+public:
+    /**
+     * @param target what begin() and end() measure, GL_TIME_ELAPSED,
+     *               GL_SAMPLES_PASSED, GL_PRIMITIVES_GENERATED, ...
+     */
+    Query(GLenum target = GL_TIME_ELAPSED) : target(target) {
+        glGenQueries(1, &query);
+    }
+
+    Query(Query && other) : query(other.query), target(other.target) {
+        other.query = 0;
+    }
+
+    Query & operator=(Query && other) {
+        glDeleteQueries(1, &query);
+        query = other.query;
+        target = other.target;
+        other.query = 0;
+        return *this;
+    }
+
+    Query(const Query &) = delete;
+    Query & operator=(const Query &) = delete;
+
+    ~Query() {
+        glDeleteQueries(1, &query);
+    }
+
+    /// Only one query per target can be active at a time.
+    void begin() const {
+        glBeginQuery(target, query);
+    }
+
+    void end() const {
+        glEndQuery(target);
+    }
+
+    /// Record the GPU time once all previous commands have finished.
+    void timestamp() const {
+        glQueryCounter(query, GL_TIMESTAMP);
+    }
+
+    /// Check if the result can be read without waiting for the GPU.
+    bool isAvailable() const {
+        GLint available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        return available;
+    }
+
+    /// Read the result, waits for the GPU if it's not available yet.
+    GLuint64 getResult() const {
+        GLuint64 result = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+        return result;
+    }
+
+    GLenum getTarget() const {
+        return target;
+    }
+
+    GLuint getQueryId() const {
+        return query;
+    }
+};
+
+/**
+ * GPU time of a section of the frame, read back without stalling.
+ *
+ * Each begin()/end() pair uses the next of a ring of queries and poll()
+ * returns results once the GPU has finished them, usually a few frames
+ * later. If all queries are still in flight the section is not measured.
+ */
+class GpuTimer {
+    std::vector<Query> queries;
+    size_t issued;
+    size_t read;
+    bool active;
+
+public:
+    /// @param latency the number of measurements that can be in flight
+    GpuTimer(size_t latency = 4) : issued(0), read(0), active(false) {
+        for (size_t i = 0; i < latency; i++)
+            queries.emplace_back(GL_TIME_ELAPSED);
+    }
+
+    void begin() {
+        active = issued - read < queries.size();
+        if (active)
+            queries[issued % queries.size()].begin();
+    }
+
+    void end() {
+        if (!active)
+            return;
+        queries[issued % queries.size()].end();
+        issued++;
+        active = false;
+    }
+
+    /**
+     * Get the latest finished measurement.
+     *
+     * @param ms set to the GPU time in milliseconds if a result was ready
+     * @return true if ms was set
+     */
+    bool poll(double & ms) {
+        bool ready = false;
+        while (read < issued && queries[read % queries.size()].isAvailable()) {
+            ms = queries[read % queries.size()].getResult() / 1.0e6;
+            read++;
+            ready = true;
+        }
+        return ready;
+    }
+};
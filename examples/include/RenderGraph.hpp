@@ -0,0 +1,417 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <functional>
+#include <glm/glm.hpp>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "FrameBuffer.hpp"
+#include "RenderTargetPool.hpp"
+#include "Texture.hpp"
+
+/**
+ * Frame passes declared with the textures and frame buffers they read and
+ * write, instead of a hand written bind/draw sequence.
+ *
+ * compile() walks the passes backwards from the outputs (imported frame
+ * buffers and resources passed to markOutput) and culls every pass whose
+ * writes are never consumed. Transient resources are acquired from a
+ * RenderTargetPool right before their first use and released after their
+ * last, so resources with disjoint lifetimes share memory. Attachments
+ * that nothing reads after a pass are discarded with
+ * glInvalidateFramebuffer.
+ *
+ * Passes run in declaration order. Each pass renders into a frame buffer
+ * built from its writes, which is bound before its execute function is
+ * called.
+ */
+class RenderGraph {
+public:
+    using Handle = size_t;
+
+    struct ResourceDesc {
+        glm::uvec2 size;
+        Texture::Format format;
+        GLsizei samples = 0;
+        /// Use a RenderBuffer, for attachments that are never sampled
+        bool renderBuffer = false;
+    };
+
+    class Builder {
+        RenderGraph & graph;
+        size_t pass;
+
+        Builder(RenderGraph & graph, size_t pass) : graph(graph), pass(pass) {}
+
+        friend class RenderGraph;
+
+    public:
+        /// Declare a transient resource written by this pass.
+        Handle create(const std::string & name,
+                      const ResourceDesc & desc,
+                      GLenum attachment = GL_COLOR_ATTACHMENT0) {
+            Resource resource;
+            resource.name = name;
+            resource.desc = desc;
+            graph.resources.push_back(resource);
+            return write(graph.resources.size() - 1, attachment);
+        }
+
+        /// Declare that this pass samples a resource.
+        Handle read(Handle resource) {
+            graph.checkHandle(resource);
+            graph.passes[pass].reads.push_back(resource);
+            return resource;
+        }
+
+        /// Declare that this pass renders into a resource.
+        Handle write(Handle resource, GLenum attachment = GL_COLOR_ATTACHMENT0) {
+            graph.checkHandle(resource);
+            graph.passes[pass].writes.push_back({resource, attachment});
+            return resource;
+        }
+    };
+
+    class Context {
+        RenderGraph & graph;
+        FrameBuffer * target;
+
+        Context(RenderGraph & graph, FrameBuffer * target)
+            : graph(graph), target(target) {}
+
+        friend class RenderGraph;
+
+    public:
+        /**
+         * Get the texture of a resource declared by this pass.
+         *
+         * @throws std::runtime_error if the resource is not a texture
+         */
+        Texture & getTexture(Handle resource) const {
+            return graph.getTexture(resource);
+        }
+
+        /// Frame buffer the pass renders into, already bound.
+        FrameBuffer * getFrameBuffer() const {
+            return target;
+        }
+    };
+
+    using Setup = std::function<void(Builder &)>;
+    using Execute = std::function<void(Context &)>;
+
+private:
+    struct Resource {
+        std::string name;
+        ResourceDesc desc {glm::uvec2(0), Texture::RGBA};
+        Texture * texture = nullptr;
+        RenderBuffer * buffer = nullptr;
+        FrameBuffer * frameBuffer = nullptr;
+        bool imported = false;
+        bool output = false;
+        // Position of the first and last pass using it in the execution order
+        int first = -1;
+        int last = -1;
+    };
+
+    struct Write {
+        Handle resource;
+        GLenum attachment;
+    };
+
+    struct Pass {
+        std::string name;
+        Execute execute;
+        std::vector<Handle> reads;
+        std::vector<Write> writes;
+        bool live = false;
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<size_t> order;
+    bool compiled = false;
+
+public:
+    /// Remove all passes and resources, to declare the next frame.
+    void clear() {
+        resources.clear();
+        passes.clear();
+        order.clear();
+        compiled = false;
+    }
+
+    /**
+     * Add a pass. setup is called immediately to declare the resources,
+     * execute is called by execute() if the pass survives culling.
+     */
+    void addPass(const std::string & name, Setup setup, Execute execute) {
+        passes.push_back(Pass {name, std::move(execute), {}, {}, false});
+        Builder builder(*this, passes.size() - 1);
+        setup(builder);
+        compiled = false;
+    }
+
+    /// Use an existing texture. It is never culled, acquired or released.
+    Handle importTexture(const std::string & name, Texture * texture) {
+        Resource resource;
+        resource.name = name;
+        resource.desc.size = texture->getSize();
+        resource.desc.format = texture->getInternal();
+        resource.texture = texture;
+        resource.imported = true;
+        resources.push_back(resource);
+        return resources.size() - 1;
+    }
+
+    /**
+     * Use an existing frame buffer, like FrameBuffer::getDefault(). Writes
+     * to it are outputs of the graph. A pass writing an imported frame
+     * buffer can't write any other resource.
+     */
+    Handle importFrameBuffer(const std::string & name, FrameBuffer * buffer) {
+        Resource resource;
+        resource.name = name;
+        resource.desc.size = glm::uvec2(buffer->getWidth(), buffer->getHeight());
+        resource.frameBuffer = buffer;
+        resource.imported = true;
+        resource.output = true;
+        resources.push_back(resource);
+        return resources.size() - 1;
+    }
+
+    /// Keep a resource and the passes producing it alive after execute().
+    void markOutput(Handle resource) {
+        checkHandle(resource);
+        resources[resource].output = true;
+        compiled = false;
+    }
+
+    /**
+     * Cull unused passes and compute resource lifetimes.
+     *
+     * @throws std::runtime_error if a pass writes an imported frame buffer
+     * together with other resources
+     */
+    void compile() {
+        // Walk backwards, a pass is live if a later pass or the output
+        // needs something it writes
+        std::vector<bool> needed(resources.size());
+        for (size_t i = 0; i < resources.size(); i++)
+            needed[i] = resources[i].output;
+
+        for (size_t p = passes.size(); p-- > 0;) {
+            Pass & pass = passes[p];
+            pass.live = false;
+            for (auto & write : pass.writes) {
+                if (needed[write.resource])
+                    pass.live = true;
+            }
+            if (!pass.live)
+                continue;
+
+            // Earlier writes are overwritten unless this pass reads them
+            for (auto & write : pass.writes) {
+                if (!resources[write.resource].output)
+                    needed[write.resource] = false;
+            }
+            for (auto resource : pass.reads)
+                needed[resource] = true;
+        }
+
+        order.clear();
+        for (auto & resource : resources)
+            resource.first = resource.last = -1;
+
+        for (size_t p = 0; p < passes.size(); p++) {
+            Pass & pass = passes[p];
+            if (!pass.live)
+                continue;
+
+            int position = order.size();
+            order.push_back(p);
+
+            size_t frameBuffers = 0;
+            for (auto & write : pass.writes) {
+                if (resources[write.resource].frameBuffer)
+                    frameBuffers++;
+                use(write.resource, position);
+            }
+            for (auto resource : pass.reads)
+                use(resource, position);
+
+            if (frameBuffers > 0 && pass.writes.size() > 1)
+                throw std::runtime_error(
+                    "Pass " + pass.name
+                    + " writes an imported frame buffer and other resources");
+        }
+
+        compiled = true;
+    }
+
+    /**
+     * Run the live passes, compiling first if needed. Transient outputs
+     * stay acquired until the pool starts the next frame.
+     */
+    void execute(RenderTargetPool & pool) {
+        if (!compiled)
+            compile();
+
+        for (size_t position = 0; position < order.size(); position++) {
+            Pass & pass = passes[order[position]];
+
+            for (auto & write : pass.writes)
+                acquire(pool, write.resource, position);
+            for (auto resource : pass.reads)
+                acquire(pool, resource, position);
+
+            FrameBuffer * target = nullptr;
+            if (!pass.writes.empty()) {
+                Resource & first = resources[pass.writes[0].resource];
+                if (first.frameBuffer) {
+                    target = first.frameBuffer;
+                }
+                else {
+                    std::vector<RenderTargetPool::Target> targets;
+                    for (auto & write : pass.writes) {
+                        Resource & resource = resources[write.resource];
+                        if (resource.buffer)
+                            targets.emplace_back(resource.buffer,
+                                                 write.attachment);
+                        else
+                            targets.emplace_back(resource.texture,
+                                                 write.attachment);
+                    }
+                    target = pool.getFrameBuffer(targets);
+                }
+
+                target->bind();
+                if (target->getWidth() > 0 && target->getHeight() > 0)
+                    target->viewport();
+            }
+
+            Context context(*this, target);
+            pass.execute(context);
+
+            // Nothing reads these attachments after this pass
+            std::vector<GLenum> discard;
+            for (auto & write : pass.writes) {
+                Resource & resource = resources[write.resource];
+                if (!resource.imported && !resource.output
+                    && resource.last == int(position))
+                    discard.push_back(write.attachment);
+            }
+            if (!discard.empty()
+                && (GLEW_VERSION_4_3 || GLEW_ARB_invalidate_subdata))
+                glInvalidateFramebuffer(GL_FRAMEBUFFER, discard.size(),
+                                        discard.data());
+
+            for (auto & write : pass.writes)
+                release(pool, write.resource, position);
+            for (auto resource : pass.reads)
+                release(pool, resource, position);
+        }
+    }
+
+    /**
+     * Get the texture of a resource, valid while the resource is acquired.
+     *
+     * @throws std::runtime_error if the resource is not a texture or is not
+     * acquired
+     */
+    Texture & getTexture(Handle resource) const {
+        checkHandle(resource);
+        if (!resources[resource].texture)
+            throw std::runtime_error("Resource " + resources[resource].name
+                                     + " is not an acquired texture");
+        return *resources[resource].texture;
+    }
+
+    /**
+     * Write the graph in Graphviz dot format. Culled passes are dashed and
+     * resources show their lifetime in execution order.
+     */
+    void dump(std::ostream & out) const {
+        out << "digraph RenderGraph {\n";
+        out << "    rankdir=LR;\n";
+
+        for (size_t p = 0; p < passes.size(); p++) {
+            out << "    pass" << p << " [shape=box, label=\"" << passes[p].name
+                << "\"";
+            if (compiled && !passes[p].live)
+                out << ", style=dashed, color=gray";
+            out << "];\n";
+        }
+
+        for (size_t r = 0; r < resources.size(); r++) {
+            const Resource & resource = resources[r];
+            out << "    res" << r << " [shape=ellipse, label=\"" << resource.name
+                << "\\n" << resource.desc.size.x << "x" << resource.desc.size.y;
+            if (resource.imported)
+                out << "\\nimported";
+            else if (resource.first >= 0)
+                out << "\\nlive " << resource.first << "-" << resource.last;
+            out << "\"";
+            if (resource.output)
+                out << ", peripheries=2";
+            out << "];\n";
+        }
+
+        for (size_t p = 0; p < passes.size(); p++) {
+            for (auto & write : passes[p].writes)
+                out << "    pass" << p << " -> res" << write.resource << ";\n";
+            for (auto resource : passes[p].reads)
+                out << "    res" << resource << " -> pass" << p << ";\n";
+        }
+
+        out << "}\n";
+    }
+
+private:
+    void checkHandle(Handle resource) const {
+        if (resource >= resources.size())
+            throw std::runtime_error("Invalid render graph handle");
+    }
+
+    void use(Handle handle, int position) {
+        Resource & resource = resources[handle];
+        if (resource.first < 0)
+            resource.first = position;
+        resource.last = position;
+    }
+
+    void acquire(RenderTargetPool & pool, Handle handle, size_t position) {
+        Resource & resource = resources[handle];
+        if (resource.imported || resource.first != int(position)
+            || resource.texture || resource.buffer)
+            return;
+
+        const ResourceDesc & desc = resource.desc;
+        if (desc.renderBuffer)
+            resource.buffer =
+                pool.acquireRenderBuffer(desc.size, desc.format, desc.samples);
+        else
+            resource.texture =
+                pool.acquireTexture(desc.size, desc.format, desc.samples);
+    }
+
+    void release(RenderTargetPool & pool, Handle handle, size_t position) {
+        Resource & resource = resources[handle];
+        if (resource.imported || resource.output
+            || resource.last != int(position))
+            return;
+
+        if (resource.buffer)
+            pool.release(resource.buffer);
+        if (resource.texture)
+            pool.release(resource.texture);
+        resource.buffer = nullptr;
+        resource.texture = nullptr;
+    }
+};
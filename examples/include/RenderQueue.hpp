@@ -0,0 +1,437 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Bounds.hpp"
+#include "Buffer.hpp"
+#include "Capture.hpp"
+#include "Frustum.hpp"
+#include "JobSystem.hpp"
+#include "MeshLod.hpp"
+#include "OcclusionBuffer.hpp"
+#include "Profiler.hpp"
+#include "Shader.hpp"
+#include "Texture.hpp"
+#include "Transform.hpp"
+#include "World.hpp"
+
+/// A range of the vertices or elements of a BufferArray, a World component.
+struct Mesh {
+    BufferArray * array = nullptr;
+    GLsizei count = 0;
+    /// GL_NONE to draw arrays instead of elements
+    GLenum indexType = GL_UNSIGNED_INT;
+    GLenum mode = GL_TRIANGLES;
+    /// The first vertex or index
+    GLint first = 0;
+    /// The buffer of array with the model matrix of each instance, a mat4
+    /// attribute with divisor 1, or -1 to set a uniform per instance
+    int instanceBuffer = -1;
+
+    bool operator==(const Mesh & other) const {
+        return array == other.array && count == other.count
+               && indexType == other.indexType && mode == other.mode
+               && first == other.first
+               && instanceBuffer == other.instanceBuffer;
+    }
+
+    void draw(GLsizei instances = 1) const {
+        if (indexType == GL_NONE) {
+            if (instances == 1)
+                array->drawArrays(mode, first, count);
+            else
+                array->drawArraysInstanced(mode, first, count, instances);
+            return;
+        }
+
+        size_t indexSize = indexType == GL_UNSIGNED_BYTE    ? 1
+                           : indexType == GL_UNSIGNED_SHORT ? 2
+                                                            : 4;
+        auto offset = reinterpret_cast<const void *>(first * indexSize);
+        if (instances == 1)
+            array->drawElements(mode, count, indexType, offset);
+        else
+            array->drawElementsInstanced(mode, count, indexType, offset,
+                                         instances);
+    }
+};
+
+/// The shader and the textures of texture units 0 to 3, a World component.
+struct Material {
+    const Shader * shader = nullptr;
+    std::array<const Texture *, 4> textures = {};
+
+    bool operator==(const Material & other) const {
+        return shader == other.shader && textures == other.textures;
+    }
+};
+
+/**
+ * The draws of a frame, sorted by state and merged into batches.
+ *
+ * Draws are sorted by shader, then textures, then mesh, so changing
+ * program costs least often. Consecutive draws with the same mesh and
+ * material form a batch, drawn instanced with one upload of its model
+ * matrices if the mesh has an instance buffer, else with one uniform
+ * update and draw call per object. Entities collected with a frustum are
+ * dropped by sort() if they have Bounds outside it, and with an occlusion
+ * buffer if their Bounds are hidden in it. Entities collected with a
+ * LodView draw the level of their Lod chain it calls for, and the ones at
+ * the same level batch together.
+ */
+class RenderQueue {
+public:
+    /// Draws with the same mesh and material, their model matrices are
+    /// first to first + count in getMatrices().
+    struct Batch {
+        Mesh mesh;
+        Material material;
+        uint32_t first;
+        uint32_t count;
+    };
+
+private:
+    /// Sort key, the ids of the shader, the textures and the vertex array
+    /// and the first vertex or index, so the meshes and levels of detail
+    /// that share an array batch apart. Only the texture ids are hashed, a
+    /// collision there costs batches, which compare the full state.
+    struct Key {
+        GLuint program;
+        uint64_t textures;
+        GLuint array;
+        GLint first;
+
+        bool operator<(const Key & other) const {
+            return std::tie(program, textures, array, first)
+                   < std::tie(other.program, other.textures, other.array,
+                              other.first);
+        }
+
+        bool operator==(const Key & other) const {
+            return program == other.program && textures == other.textures
+                   && array == other.array && first == other.first;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key & key) const {
+            // FNV-1a over the words
+            uint64_t hash = 0xcbf29ce484222325;
+            for (uint64_t word : {uint64_t(key.program), key.textures,
+                                  uint64_t(key.array), uint64_t(key.first)})
+                hash = (hash ^ word) * 0x100000001b3;
+            return size_t(hash);
+        }
+    };
+
+    struct ChunkRange {
+        World::Archetype * archetype;
+        size_t chunk;
+        size_t first;
+    };
+
+    const Frustum * frustum = nullptr;
+    const OcclusionBuffer * occlusion = nullptr;
+    const LodView * lodView = nullptr;
+
+    std::string modelUniform;
+
+    // By draw, in the order added
+    std::vector<Key> keys;
+    std::vector<Mesh> meshes;
+    std::vector<Material> materials;
+    std::vector<glm::mat4> models;
+    std::vector<uint8_t> visible;
+    size_t culled = 0;
+
+    // In sorted order
+    std::vector<uint32_t> order;
+    std::vector<glm::mat4> matrices;
+    std::vector<Batch> batches;
+
+    // The draws of each key, then the first of them in order
+    std::unordered_map<Key, uint32_t, KeyHash> keyDraws;
+    std::vector<std::pair<Key, uint32_t>> sortedKeys;
+
+    std::vector<ChunkRange> chunks;
+
+public:
+    /// @param modelUniform the mat4 uniform set per object without instancing
+    explicit RenderQueue(const std::string & modelUniform = "model")
+        : modelUniform(modelUniform) {}
+
+    void clear() {
+        keys.clear();
+        meshes.clear();
+        materials.clear();
+        models.clear();
+        visible.clear();
+        matrices.clear();
+        batches.clear();
+        culled = 0;
+    }
+
+    void reserve(size_t count) {
+        keys.reserve(count);
+        meshes.reserve(count);
+        materials.reserve(count);
+        models.reserve(count);
+        visible.reserve(count);
+        matrices.reserve(count);
+    }
+
+    /// Draws added since clear().
+    size_t size() const {
+        return keys.size();
+    }
+
+    void add(const Mesh & mesh,
+             const Material & material,
+             const glm::mat4 & model) {
+        keys.push_back(key(mesh, material));
+        meshes.push_back(mesh);
+        materials.push_back(material);
+        models.push_back(model);
+        visible.push_back(1);
+    }
+
+    /**
+     * Add a draw for each entity with a Transform, a Mesh and a Material.
+     *
+     * @param frustum if not null, cull the entities with Bounds whose
+     * world box is outside it
+     * @param occlusion if not null, cull the entities with Bounds whose
+     * world box it occludes, rendered for this frame
+     * @param lod if not null, draw the entities with a Lod at the level
+     * LodChain::select() picks from their world box, or their position
+     * without Bounds, and their largest scale, and keep it in the Lod
+     */
+    void collect(World & world,
+                 const Frustum * frustum = nullptr,
+                 const OcclusionBuffer * occlusion = nullptr,
+                 const LodView * lod = nullptr) {
+        PROFILE_ZONE("RenderQueue::collect");
+        this->frustum = frustum;
+        this->occlusion = occlusion;
+        lodView = lod;
+        resizeForChunks(world);
+        for (auto & range : chunks)
+            collect(range);
+    }
+
+    /// collect() in parallel over the chunks of the world.
+    void collect(World & world,
+                 JobSystem & jobs,
+                 const Frustum * frustum = nullptr,
+                 const OcclusionBuffer * occlusion = nullptr,
+                 const LodView * lod = nullptr) {
+        PROFILE_ZONE("RenderQueue::collect");
+        this->frustum = frustum;
+        this->occlusion = occlusion;
+        lodView = lod;
+        resizeForChunks(world);
+        jobs.parallelFor(0, chunks.size(),
+                         [this](size_t begin, size_t end) {
+                             for (size_t i = begin; i < end; i++)
+                                 collect(chunks[i]);
+                         },
+                         1);
+    }
+
+    /// Sort the draws added and merge them into batches.
+    void sort() {
+        PROFILE_ZONE("RenderQueue::sort");
+        // A counting sort, there are far fewer states than draws: count
+        // the draws of each key, sort the keys, then place each draw after
+        // the ones before it with the same key
+        keyDraws.clear();
+        culled = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (visible[i])
+                keyDraws[keys[i]]++;
+            else
+                culled++;
+        }
+        sortedKeys.assign(keyDraws.begin(), keyDraws.end());
+        std::sort(sortedKeys.begin(), sortedKeys.end());
+        uint32_t first = 0;
+        for (auto & key : sortedKeys) {
+            keyDraws[key.first] = first;
+            first += key.second;
+        }
+        order.resize(keys.size() - culled);
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (visible[i])
+                order[keyDraws[keys[i]]++] = uint32_t(i);
+        }
+
+        matrices.resize(order.size());
+        batches.clear();
+        for (size_t i = 0; i < order.size(); i++) {
+            uint32_t index = order[i];
+            matrices[i] = models[index];
+            if (batches.empty() || !(batches.back().mesh == meshes[index])
+                || !(batches.back().material == materials[index]))
+                batches.push_back(
+                    {meshes[index], materials[index], uint32_t(i), 0});
+            batches.back().count++;
+        }
+    }
+
+    /// Draws dropped by the last sort(), outside the frustum or occluded.
+    size_t getCulledCount() const {
+        return culled;
+    }
+
+    /// The batches of the last sort().
+    const std::vector<Batch> & getBatches() const {
+        return batches;
+    }
+
+    /// The model matrices in batch order, as of the last sort().
+    const std::vector<glm::mat4> & getMatrices() const {
+        return matrices;
+    }
+
+    /// Draw the batches of the last sort(), binding only state that
+    /// changes between them. Leaves texture unit 0 active.
+    void submit() const {
+        PROFILE_ZONE("RenderQueue::submit");
+        const Shader * shader = nullptr;
+        Shader::Uniform model(GLuint(-1));
+        std::array<const Texture *, 4> textures = {};
+
+        for (auto & batch : batches) {
+            if (batch.material.shader != shader) {
+                shader = batch.material.shader;
+                shader->bind();
+                model = shader->uniform(modelUniform.c_str());
+            }
+
+            GLenum unit = GL_TEXTURE0;
+            for (size_t i = 0; i < textures.size(); i++) {
+                const Texture * texture = batch.material.textures[i];
+                if (!texture || texture == textures[i])
+                    continue;
+                if (unit != GL_TEXTURE0 + i) {
+                    unit = GLenum(GL_TEXTURE0 + i);
+                    GL_CAPTURE(ActiveTexture, unit);
+                    glActiveTexture(unit);
+                }
+                texture->bind();
+                textures[i] = texture;
+            }
+            if (unit != GL_TEXTURE0) {
+                GL_CAPTURE(ActiveTexture, GL_TEXTURE0);
+                glActiveTexture(GL_TEXTURE0);
+            }
+
+            const Mesh & mesh = batch.mesh;
+            if (mesh.instanceBuffer >= 0) {
+                mesh.array->bind();
+                mesh.array->bufferData(mesh.instanceBuffer,
+                                       batch.count * sizeof(glm::mat4),
+                                       &matrices[batch.first],
+                                       GL_STREAM_DRAW);
+                mesh.draw(batch.count);
+            }
+            else {
+                for (uint32_t i = 0; i < batch.count; i++) {
+                    model.setMat4(matrices[batch.first + i]);
+                    mesh.draw();
+                }
+            }
+        }
+    }
+
+private:
+    static Key key(const Mesh & mesh, const Material & material) {
+        Key key;
+        key.program = material.shader ? material.shader->getProgram() : 0;
+        key.textures = 0;
+        for (auto * t : material.textures)
+            key.textures = key.textures * 31 + (t ? t->getTextureId() : 0);
+        key.array = mesh.array ? mesh.array->getArrayId() : 0;
+        key.first = mesh.first;
+        return key;
+    }
+
+    /// List the chunks to collect and grow the arrays for their entities.
+    void resizeForChunks(World & world) {
+        size_t count = keys.size();
+        ComponentMask required = World::mask<Transform, Mesh, Material>();
+        chunks.clear();
+        for (auto & archetype : world.getArchetypes()) {
+            if (!archetype->matches(required))
+                continue;
+            for (size_t c = 0; c < archetype->getChunkCount(); c++) {
+                chunks.push_back({archetype.get(), c, count});
+                count += archetype->getChunkSize(c);
+            }
+        }
+        keys.resize(count);
+        meshes.resize(count);
+        materials.resize(count);
+        models.resize(count);
+        visible.resize(count);
+    }
+
+    /// Pick the level of lod to draw and point mesh at its indices.
+    void selectLevel(Lod & lod,
+                     const Transform & transform,
+                     const AABB * world,
+                     Mesh & mesh) const {
+        if (lod.chain->levels.empty())
+            return;
+        glm::vec3 scale = glm::abs(transform.getScale());
+        AABB box = world ? *world
+                         : AABB(transform.getPosition(),
+                                transform.getPosition());
+        float pixels = lodView->pixelsPerUnitOf(
+            box, std::max(scale.x, std::max(scale.y, scale.z)));
+        lod.level = uint32_t(lod.chain->select(pixels, lod.level,
+                                               lodView->threshold,
+                                               lodView->hysteresis));
+        const LodLevel & level = lod.chain->levels[lod.level];
+        mesh.first = level.first;
+        mesh.count = level.count;
+    }
+
+    void collect(const ChunkRange & range) {
+        World::Archetype & archetype = *range.archetype;
+        size_t count = archetype.getChunkSize(range.chunk);
+        auto transforms = archetype.getColumn<const Transform>(range.chunk);
+        auto chunkMeshes = archetype.getColumn<const Mesh>(range.chunk);
+        auto chunkMaterials = archetype.getColumn<const Material>(range.chunk);
+        auto bounds = archetype.getColumn<const Bounds>(range.chunk);
+        auto lods = lodView ? archetype.getColumn<Lod>(range.chunk) : nullptr;
+        for (size_t i = 0; i < count; i++) {
+            size_t index = range.first + i;
+            // Occlusion costs more, test the frustum first
+            visible[index] =
+                !bounds
+                || ((!frustum || frustum->intersects(bounds[i].world))
+                    && (!occlusion || !occlusion->occluded(bounds[i].world)));
+            meshes[index] = chunkMeshes[i];
+            if (lods && lods[i].chain && visible[index])
+                selectLevel(lods[i], transforms[i],
+                            bounds ? &bounds[i].world : nullptr,
+                            meshes[index]);
+            keys[index] = key(meshes[index], chunkMaterials[i]);
+            materials[index] = chunkMaterials[i];
+            models[index] = transforms[i].toMatrix();
+        }
+    }
+};
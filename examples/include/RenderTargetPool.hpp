@@ -0,0 +1,332 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "FrameBuffer.hpp"
+#include "Texture.hpp"
+
+/**
+ * Transient render targets shared between passes.
+ *
+ * Textures and render buffers are keyed by (size, format, samples). A
+ * pass acquires what it writes and releases it once the last reader is
+ * done, after which a later pass with the same key gets the same object.
+ * Passes whose lifetimes don't overlap therefore alias the same memory.
+ * Frame buffers are cached per attachment set so rebuilding them each
+ * frame is free.
+ *
+ * Targets not used for maxAge frames are deleted, so a window resize
+ * frees the old sizes a few frames later.
+ */
+class RenderTargetPool {
+public:
+    struct Desc {
+        glm::uvec2 size;
+        Texture::Format format;
+        GLsizei samples;
+
+        bool operator==(const Desc & other) const {
+            return size == other.size && format == other.format
+                   && samples == other.samples;
+        }
+    };
+
+    /// One attachment of a pooled FrameBuffer, either texture or buffer.
+    struct Target {
+        Texture * texture;
+        RenderBuffer * buffer;
+        GLenum attachment;
+
+        Target(Texture * texture, GLenum attachment = GL_COLOR_ATTACHMENT0)
+            : texture(texture), buffer(nullptr), attachment(attachment) {}
+
+        Target(RenderBuffer * buffer,
+               GLenum attachment = GL_DEPTH_STENCIL_ATTACHMENT)
+            : texture(nullptr), buffer(buffer), attachment(attachment) {}
+    };
+
+    struct FrameStats {
+        /// Most transient memory acquired at once during the frame
+        size_t peakBytes = 0;
+        /// Memory held by the pool, used or not
+        size_t pooledBytes = 0;
+        size_t textures = 0;
+        size_t renderBuffers = 0;
+        size_t frameBuffers = 0;
+    };
+
+private:
+    template <typename T>
+    struct Entry {
+        Desc desc;
+        std::unique_ptr<T> object;
+        bool inUse;
+        unsigned lastUsed;
+    };
+
+    struct FrameBufferKey {
+        GLuint id;
+        GLenum attachment;
+        bool texture;
+
+        bool operator==(const FrameBufferKey & other) const {
+            return id == other.id && attachment == other.attachment
+                   && texture == other.texture;
+        }
+    };
+
+    struct FrameBufferEntry {
+        std::vector<FrameBufferKey> key;
+        std::unique_ptr<FrameBuffer> frameBuffer;
+        unsigned lastUsed;
+    };
+
+    std::vector<Entry<Texture>> textures;
+    std::vector<Entry<RenderBuffer>> renderBuffers;
+    std::vector<FrameBufferEntry> frameBuffers;
+
+    unsigned frame;
+    unsigned maxAge;
+    size_t inUseBytes;
+    size_t peakBytes;
+    FrameStats lastFrame;
+
+public:
+    RenderTargetPool(unsigned maxAge = 3)
+        : frame(0), maxAge(maxAge), inUseBytes(0), peakBytes(0) {}
+
+    RenderTargetPool(RenderTargetPool && other) = default;
+    RenderTargetPool & operator=(RenderTargetPool && other) = default;
+
+    RenderTargetPool(const RenderTargetPool &) = delete;
+    RenderTargetPool & operator=(const RenderTargetPool &) = delete;
+
+    /**
+     * Start a new frame. Everything acquired in the previous frame is
+     * considered released and targets unused for maxAge frames are deleted.
+     */
+    void beginFrame() {
+        lastFrame = currentStats();
+
+        frame++;
+        inUseBytes = 0;
+        peakBytes = 0;
+        for (auto & entry : textures)
+            entry.inUse = false;
+        for (auto & entry : renderBuffers)
+            entry.inUse = false;
+
+        evict(textures, true);
+        evict(renderBuffers, false);
+        frameBuffers.erase(std::remove_if(frameBuffers.begin(),
+                                          frameBuffers.end(),
+                                          [&](const FrameBufferEntry & entry) {
+                                              return expired(entry.lastUsed);
+                                          }),
+                           frameBuffers.end());
+    }
+
+    /// Statistics of the last completed frame.
+    const FrameStats & getFrameStats() const {
+        return lastFrame;
+    }
+
+    /**
+     * Get a texture until it is released or the frame ends. Pooled textures
+     * use linear filtering and clamp to edge.
+     */
+    Texture * acquireTexture(const glm::uvec2 & size,
+                             Texture::Format format,
+                             GLsizei samples = 0) {
+        Desc desc {size, format, samples};
+        for (auto & entry : textures) {
+            if (!entry.inUse && entry.desc == desc)
+                return use(entry);
+        }
+
+        textures.push_back(Entry<Texture> {
+            desc,
+            std::make_unique<Texture>(
+                Texture::renderTarget(size, format, samples)),
+            false,
+            frame,
+        });
+        return use(textures.back());
+    }
+
+    /// Get a render buffer until it is released or the frame ends.
+    RenderBuffer * acquireRenderBuffer(const glm::uvec2 & size,
+                                       Texture::Format format,
+                                       GLsizei samples = 0) {
+        Desc desc {size, format, samples};
+        for (auto & entry : renderBuffers) {
+            if (!entry.inUse && entry.desc == desc)
+                return use(entry);
+        }
+
+        renderBuffers.push_back(Entry<RenderBuffer> {
+            desc,
+            std::make_unique<RenderBuffer>(size.x, size.y, format, samples),
+            false,
+            frame,
+        });
+        return use(renderBuffers.back());
+    }
+
+    /**
+     * Return a texture to the pool so later passes can reuse it.
+     *
+     * @throws std::runtime_error if the texture is not acquired from this
+     * pool
+     */
+    void release(Texture * texture) {
+        release(textures, texture);
+    }
+
+    /**
+     * Return a render buffer to the pool so later passes can reuse it.
+     *
+     * @throws std::runtime_error if the buffer is not acquired from this
+     * pool
+     */
+    void release(RenderBuffer * buffer) {
+        release(renderBuffers, buffer);
+    }
+
+    /**
+     * Get a FrameBuffer with these attachments, reusing the one created for
+     * the same attachments in an earlier pass or frame. All attachments
+     * must have the same size.
+     *
+     * @throws std::runtime_error if the attachments are incomplete
+     */
+    FrameBuffer * getFrameBuffer(const std::vector<Target> & targets) {
+        std::vector<FrameBufferKey> key;
+        for (auto & target : targets) {
+            if (target.texture)
+                key.push_back({target.texture->getTextureId(),
+                               target.attachment, true});
+            else
+                key.push_back(
+                    {target.buffer->getBufferId(), target.attachment, false});
+        }
+
+        for (auto & entry : frameBuffers) {
+            if (entry.key == key) {
+                entry.lastUsed = frame;
+                return entry.frameBuffer.get();
+            }
+        }
+
+        if (targets.empty())
+            throw std::runtime_error("FrameBuffer needs an attachment");
+
+        glm::ivec2 size;
+        if (targets[0].texture)
+            size = glm::ivec2(targets[0].texture->getSize());
+        else
+            size = glm::ivec2(targets[0].buffer->getWidth(),
+                              targets[0].buffer->getHeight());
+
+        auto frameBuffer = std::make_unique<FrameBuffer>(size.x, size.y);
+        for (auto & target : targets) {
+            if (target.texture)
+                frameBuffer->attach(target.texture, target.attachment);
+            else
+                frameBuffer->attach(target.buffer, target.attachment);
+        }
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            throw std::runtime_error("FrameBuffer is not complete");
+
+        frameBuffers.push_back({key, std::move(frameBuffer), frame});
+        return frameBuffers.back().frameBuffer.get();
+    }
+
+private:
+    bool expired(unsigned lastUsed) const {
+        return lastUsed + maxAge < frame;
+    }
+
+    static size_t bytes(const Desc & desc) {
+        return Texture::storageBytes(desc.format, desc.size, desc.samples);
+    }
+
+    template <typename T>
+    T * use(Entry<T> & entry) {
+        entry.inUse = true;
+        entry.lastUsed = frame;
+        inUseBytes += bytes(entry.desc);
+        peakBytes = std::max(peakBytes, inUseBytes);
+        return entry.object.get();
+    }
+
+    template <typename T>
+    void release(std::vector<Entry<T>> & entries, T * object) {
+        for (auto & entry : entries) {
+            if (entry.object.get() == object && entry.inUse) {
+                entry.inUse = false;
+                inUseBytes -= bytes(entry.desc);
+                return;
+            }
+        }
+        throw std::runtime_error("Target was not acquired from this pool");
+    }
+
+    template <typename T>
+    void evict(std::vector<Entry<T>> & entries, bool texture) {
+        for (auto & entry : entries) {
+            if (!expired(entry.lastUsed))
+                continue;
+
+            // GL may reuse the id, so drop frame buffers that reference it
+            GLuint id = getId(*entry.object);
+            frameBuffers.erase(
+                std::remove_if(frameBuffers.begin(), frameBuffers.end(),
+                               [&](const FrameBufferEntry & fbo) {
+                                   for (auto & key : fbo.key) {
+                                       if (key.texture == texture
+                                           && key.id == id)
+                                           return true;
+                                   }
+                                   return false;
+                               }),
+                frameBuffers.end());
+        }
+
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [&](const Entry<T> & entry) {
+                                         return expired(entry.lastUsed);
+                                     }),
+                      entries.end());
+    }
+
+    static GLuint getId(const Texture & texture) {
+        return texture.getTextureId();
+    }
+
+    static GLuint getId(const RenderBuffer & buffer) {
+        return buffer.getBufferId();
+    }
+
+    FrameStats currentStats() const {
+        FrameStats stats;
+        stats.peakBytes = peakBytes;
+        for (auto & entry : textures)
+            stats.pooledBytes += bytes(entry.desc);
+        for (auto & entry : renderBuffers)
+            stats.pooledBytes += bytes(entry.desc);
+        stats.textures = textures.size();
+        stats.renderBuffers = renderBuffers.size();
+        stats.frameBuffers = frameBuffers.size();
+        return stats;
+    }
+};
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "Profiler.hpp"
+#include "Transform.hpp"
+
+/**
+ * A hierarchy of transforms, each node's world matrix is its parent's world
+ * matrix times its local Transform.
+ *
+ * Nodes are kept in flat arrays ordered so parents always come before their
+ * children, update() computes the world matrices in one pass over them.
+ * Only nodes whose local transform changed and their descendants are
+ * recomputed, the others cost a flag check.
+ *
+ * Nodes are handles that stay valid until removed. add() appends, reparent
+ * and remove reorder the arrays in place, without allocating once the
+ * scratch arrays have grown to the node count.
+ */
+class SceneGraph {
+public:
+    using Node = uint32_t;
+
+    /// The parent of a root node.
+    static constexpr Node none = ~Node(0);
+
+private:
+    // By slot, in update order
+    std::vector<Node> nodes;
+    std::vector<Node> parents;
+    std::vector<uint32_t> parentSlots;
+    std::vector<Transform> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<uint8_t> dirty;
+    std::vector<uint8_t> updated;
+
+    // By node
+    std::vector<uint32_t> slots;
+    std::vector<Node> freeNodes;
+
+    // Reused by setParent and remove
+    std::vector<uint8_t> mask;
+    std::vector<uint32_t> order;
+
+public:
+    SceneGraph() {}
+
+    SceneGraph(SceneGraph && other) = default;
+    SceneGraph & operator=(SceneGraph && other) = default;
+
+    SceneGraph(const SceneGraph &) = delete;
+    SceneGraph & operator=(const SceneGraph &) = delete;
+
+    void reserve(size_t count) {
+        nodes.reserve(count);
+        parents.reserve(count);
+        parentSlots.reserve(count);
+        locals.reserve(count);
+        worlds.reserve(count);
+        dirty.reserve(count);
+        updated.reserve(count);
+        slots.reserve(count);
+        mask.reserve(count);
+        order.reserve(count);
+    }
+
+    size_t size() const {
+        return nodes.size();
+    }
+
+    /**
+     * Add a node as the last child of parent, or a root.
+     *
+     * @throws std::out_of_range if parent isn't a node
+     */
+    Node add(Node parent = none, const Transform & local = Transform()) {
+        uint32_t parentSlot = parent == none ? none : slotOf(parent);
+
+        Node node;
+        if (!freeNodes.empty()) {
+            node = freeNodes.back();
+            freeNodes.pop_back();
+        }
+        else {
+            node = Node(slots.size());
+            slots.push_back(none);
+        }
+
+        slots[node] = uint32_t(nodes.size());
+        nodes.push_back(node);
+        parents.push_back(parent);
+        parentSlots.push_back(parentSlot);
+        locals.push_back(local);
+        worlds.emplace_back(1);
+        dirty.push_back(1);
+        updated.push_back(0);
+        return node;
+    }
+
+    /**
+     * Remove a node and all of its descendants.
+     *
+     * @throws std::out_of_range if node isn't a node
+     */
+    void remove(Node node) {
+        uint32_t first = slotOf(node);
+        markSubtree(first, uint32_t(size()));
+
+        // Keep the others in order, the removed end up at the back
+        uint32_t write = first;
+        for (uint32_t read = first; read < size(); read++) {
+            if (mask[read]) {
+                slots[nodes[read]] = none;
+                freeNodes.push_back(nodes[read]);
+                continue;
+            }
+            if (read != write)
+                swapSlots(read, write);
+            slots[nodes[write]] = write;
+            write++;
+        }
+
+        nodes.resize(write);
+        parents.resize(write);
+        parentSlots.resize(write);
+        locals.resize(write);
+        worlds.resize(write);
+        dirty.resize(write);
+        updated.resize(write);
+        updateParentSlots(first);
+    }
+
+    bool contains(Node node) const {
+        return node < slots.size() && slots[node] != none;
+    }
+
+    Node getParent(Node node) const {
+        return parents[slotOf(node)];
+    }
+
+    /**
+     * Move a node and its descendants under a new parent, or make it a
+     * root. The local transform is kept, so the world matrix changes.
+     *
+     * Cheap if the new parent comes before the node in update order. If it
+     * comes after, the nodes between them are reordered to move the
+     * subtree after it, which costs about as much as an update() of them.
+     *
+     * @throws std::invalid_argument if parent is node or a descendant of it
+     * @throws std::out_of_range if node or parent isn't a node
+     */
+    void setParent(Node node, Node parent) {
+        uint32_t slot = slotOf(node);
+        uint32_t parentSlot = parent == none ? none : slotOf(parent);
+
+        if (parent != none && parentSlot >= slot) {
+            // The subtree has to move after the new parent
+            markSubtree(slot, parentSlot + 1);
+            if (mask[parentSlot])
+                throw std::invalid_argument(
+                    "Can't parent a node to itself or its descendant");
+
+            // Stable partition of slot to parentSlot, subtree last
+            order.clear();
+            for (uint32_t i = slot; i <= parentSlot; i++) {
+                if (!mask[i])
+                    order.push_back(i);
+            }
+            for (uint32_t i = slot; i <= parentSlot; i++) {
+                if (mask[i])
+                    order.push_back(i);
+            }
+            permute(slot);
+            for (uint32_t i = slot; i <= parentSlot; i++)
+                slots[nodes[i]] = i;
+            parents[slots[node]] = parent;
+            updateParentSlots(slot);
+        }
+        else {
+            parents[slot] = parent;
+            parentSlots[slot] = parentSlot;
+        }
+        dirty[slots[node]] = 1;
+    }
+
+    /// If ancestor is node or one of its ancestors.
+    bool isAncestor(Node ancestor, Node node) const {
+        for (; node != none; node = getParent(node)) {
+            if (node == ancestor)
+                return true;
+        }
+        return false;
+    }
+
+    const Transform & getLocal(Node node) const {
+        return locals[slotOf(node)];
+    }
+
+    void setLocal(Node node, const Transform & local) {
+        uint32_t slot = slotOf(node);
+        locals[slot] = local;
+        dirty[slot] = 1;
+    }
+
+    /// The local transform to change in place, marks the node dirty.
+    Transform & editLocal(Node node) {
+        uint32_t slot = slotOf(node);
+        dirty[slot] = 1;
+        return locals[slot];
+    }
+
+    /// The world matrix of node as of the last update().
+    const glm::mat4 & getWorld(Node node) const {
+        return worlds[slotOf(node)];
+    }
+
+    /// If the last update() changed the world matrix of node.
+    bool wasUpdated(Node node) const {
+        return updated[slotOf(node)];
+    }
+
+    /**
+     * Compute the world matrices of the dirty nodes and their descendants.
+     *
+     * @return the number of world matrices computed
+     */
+    size_t update() {
+        PROFILE_ZONE("SceneGraph::update");
+        size_t count = 0;
+        for (size_t i = 0; i < size(); i++) {
+            uint32_t parent = parentSlots[i];
+            bool changed = dirty[i] || (parent != none && updated[parent]);
+            updated[i] = changed;
+            if (changed) {
+                if (parent == none)
+                    worlds[i] = locals[i].toMatrix();
+                else
+                    worlds[i] = worlds[parent] * locals[i].toMatrix();
+                dirty[i] = 0;
+                count++;
+            }
+        }
+        return count;
+    }
+
+    /// The node at slot, slots are in update order.
+    Node getNode(size_t slot) const {
+        return nodes[slot];
+    }
+
+    /// World matrices by slot, as of the last update().
+    const std::vector<glm::mat4> & getWorlds() const {
+        return worlds;
+    }
+
+private:
+    uint32_t slotOf(Node node) const {
+        if (!contains(node))
+            throw std::out_of_range("Not a node of the scene graph");
+        return slots[node];
+    }
+
+    /// Set mask[i] for the descendants of first up to end, and first.
+    void markSubtree(uint32_t first, uint32_t end) {
+        if (mask.size() < size())
+            mask.resize(size());
+        mask[first] = 1;
+        for (uint32_t i = first + 1; i < end; i++) {
+            uint32_t parent = parentSlots[i];
+            mask[i] = parent != none && parent >= first && mask[parent];
+        }
+    }
+
+    void updateParentSlots(uint32_t first) {
+        for (size_t i = first; i < size(); i++)
+            parentSlots[i] = parents[i] == none ? none : slots[parents[i]];
+    }
+
+    void swapSlots(uint32_t a, uint32_t b) {
+        std::swap(nodes[a], nodes[b]);
+        std::swap(parents[a], parents[b]);
+        std::swap(locals[a], locals[b]);
+        std::swap(worlds[a], worlds[b]);
+        std::swap(dirty[a], dirty[b]);
+        std::swap(updated[a], updated[b]);
+    }
+
+    /**
+     * Move slot first + order[k] - first to first + k for each k, following
+     * the cycles of the permutation with swaps. Uses mask as the visited
+     * flags.
+     */
+    void permute(uint32_t first) {
+        for (size_t k = 0; k < order.size(); k++)
+            mask[first + k] = 0;
+        for (uint32_t k = 0; k < order.size(); k++) {
+            if (mask[first + k])
+                continue;
+            uint32_t j = k;
+            while (true) {
+                mask[first + j] = 1;
+                uint32_t next = order[j] - first;
+                if (next == k)
+                    break;
+                swapSlots(first + j, first + next);
+                j = next;
+            }
+        }
+    }
+};
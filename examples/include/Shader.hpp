@@ -5,9 +5,13 @@
 #include <GL/gl.h>
 
 #include <glm/glm.hpp>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 
+#include "Capture.hpp"
+#include "GLStats.hpp"
+
 class Shader {
 public:
     class Uniform {
@@ -21,46 +25,65 @@ public:
         }
 
         void setValue(bool value) const {
+            GL_CAPTURE(Uniform, CaptureFormat::Uniform1i, location,
+                       static_cast<int>(value));
             glUniform1i(location, static_cast<int>(value));
         }
 
         void setValue(int value) const {
+            GL_CAPTURE(Uniform, CaptureFormat::Uniform1i, location, value);
             glUniform1i(location, value);
         }
 
         void setValue(unsigned int value) const {
+            GL_CAPTURE(Uniform, CaptureFormat::Uniform1ui, location, value);
             glUniform1ui(location, value);
         }
 
         void setValue(float value) const {
+            GL_CAPTURE(Uniform, CaptureFormat::Uniform1f, location, value);
             glUniform1f(location, value);
         }
 
         void setValue(double value) const {
+            GL_CAPTURE_DATA(Uniform, &value, sizeof(value),
+                            CaptureFormat::Uniform1d, location);
             glUniform1d(location, value);
         }
 
         void setVec2(const glm::vec2 & value) const {
+            GL_CAPTURE_DATA(Uniform, &value.x, sizeof(value),
+                            CaptureFormat::Uniform2fv, location);
             glUniform2fv(location, 1, &value.x);
         }
 
         void setVec3(const glm::vec3 & value) const {
+            GL_CAPTURE_DATA(Uniform, &value.x, sizeof(value),
+                            CaptureFormat::Uniform3fv, location);
             glUniform3fv(location, 1, &value.x);
         }
 
         void setVec4(const glm::vec4 & value) const {
+            GL_CAPTURE_DATA(Uniform, &value.x, sizeof(value),
+                            CaptureFormat::Uniform4fv, location);
             glUniform4fv(location, 1, &value.x);
         }
 
         void setMat2(const glm::mat2 & value) const {
+            GL_CAPTURE_DATA(Uniform, &value[0][0], sizeof(value),
+                            CaptureFormat::UniformMatrix2fv, location);
             glUniformMatrix2fv(location, 1, GL_FALSE, &value[0][0]);
         }
 
         void setMat3(const glm::mat3 & value) const {
+            GL_CAPTURE_DATA(Uniform, &value[0][0], sizeof(value),
+                            CaptureFormat::UniformMatrix3fv, location);
             glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]);
         }
 
         void setMat4(const glm::mat4 & value) const {
+            GL_CAPTURE_DATA(Uniform, &value[0][0], sizeof(value),
+                            CaptureFormat::UniformMatrix4fv, location);
             glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
         }
     };
@@ -85,6 +108,35 @@ public:
         glDeleteShader(vShader);
         glDeleteShader(fShader);
 
+        if (!linkSuccess(program)) {
+            throw LinkException(program);
+        }
+
+#ifdef GL_CAPTURE_ENABLED
+        if (GLCapture::active())
+            GLCapture::get().createProgram(program, vertexSource,
+                                           fragmentSource);
+#endif
+    }
+
+    /**
+     * Create a compute program, run with dispatch(). Needs OpenGL 4.3.
+     *
+     * Compute programs are not captured, gl_replay has no dispatches to
+     * replay them with.
+     */
+    explicit Shader(const char * computeSource) {
+        GLuint cShader = compileShader(GL_COMPUTE_SHADER, computeSource);
+
+        program = glCreateProgram();
+
+        glAttachShader(program, cShader);
+
+        glLinkProgram(program);
+
+        glDetachShader(program, cShader);
+        glDeleteShader(cShader);
+
         if (!linkSuccess(program)) {
             throw LinkException(program);
         }
@@ -104,8 +156,10 @@ public:
     Shader & operator=(const Shader &) = delete;
 
     ~Shader() {
-        if (program)
+        if (program) {
+            GL_CAPTURE(DeleteProgram, program);
             glDeleteProgram(program);
+        }
     }
 
     GLuint getProgram() const {
@@ -113,15 +167,27 @@ public:
     }
 
     void bind() const {
+        GL_STATS_BIND(ProgramBinding, program);
+        GL_CAPTURE(UseProgram, program);
         glUseProgram(program);
     }
 
     void unbind() const {
+        GL_STATS_BIND(ProgramBinding, 0);
+        GL_CAPTURE(UseProgram, 0);
         glUseProgram(0);
     }
 
+    /// Run the compute program, which must be bound, over groups of work
+    /// groups.
+    void dispatch(GLuint x, GLuint y = 1, GLuint z = 1) const {
+        glDispatchCompute(x, y, z);
+    }
+
     Uniform uniform(const char * name) const {
         GLuint location = glGetUniformLocation(program, name);
+        GL_CAPTURE_DATA(UniformLocation, name, std::strlen(name) + 1, program,
+                        location);
         return Uniform(location);
     }
 
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "JobSystem.hpp"
+#include "Profiler.hpp"
+#include "Transform.hpp"
+#include "World.hpp"
+
+/**
+ * Runs systems over the chunks of a World, in parallel where the
+ * components they access allow.
+ *
+ * A system names the components it reads, as const types, and writes, and
+ * runs on each chunk of the entities with all of them. Two systems
+ * conflict if one writes a component the other reads or writes. Each
+ * system goes in the phase after the last system added before it that it
+ * conflicts with, so systems that touch the same data run in the order
+ * they were added. run() runs the chunks of all systems of a phase as one
+ * parallelFor, then the next phase.
+ *
+ * A const Transform still counts as written: toMatrix() fills the cached
+ * matrix, so two systems calling it on the same entities would race.
+ */
+class SystemScheduler {
+    struct System {
+        std::string name;
+        ComponentMask required;
+        ComponentMask reads;
+        ComponentMask writes;
+        std::function<void(World::Archetype &, size_t)> run;
+        size_t phase;
+    };
+
+    struct Work {
+        const System * system;
+        World::Archetype * archetype;
+        size_t chunk;
+    };
+
+    std::vector<System> systems;
+    std::vector<std::vector<size_t>> phases;
+    std::vector<Work> work;
+
+public:
+    /**
+     * Add a system that calls function(count, Components * ...) with the
+     * arrays of each chunk, like World::eachChunk.
+     */
+    template <typename... Components, typename Function>
+    void add(const std::string & name, Function function) {
+        System system;
+        system.name = name;
+        system.required = World::mask<Components...>();
+        system.reads = (ComponentMask(0) | ...
+                        | (std::is_const<Components>::value
+                               ? World::mask<Components>()
+                               : 0));
+        system.reads &= ~cached();
+        system.writes = system.required & ~system.reads;
+        system.run = [function](World::Archetype & archetype, size_t chunk) {
+            function(archetype.getChunkSize(chunk),
+                     archetype.template getColumn<Components>(chunk)...);
+        };
+
+        system.phase = 0;
+        for (auto & other : systems) {
+            if (conflicts(other, system))
+                system.phase = std::max(system.phase, other.phase + 1);
+        }
+        if (phases.size() <= system.phase)
+            phases.resize(system.phase + 1);
+        phases[system.phase].push_back(systems.size());
+        systems.push_back(std::move(system));
+    }
+
+    size_t size() const {
+        return systems.size();
+    }
+
+    const std::string & getName(size_t system) const {
+        return systems[system].name;
+    }
+
+    /// The phase of a system, by the order systems were added.
+    size_t getPhase(size_t system) const {
+        return systems[system].phase;
+    }
+
+    size_t getPhaseCount() const {
+        return phases.size();
+    }
+
+    /// Run each phase on the workers of jobs.
+    void run(World & world, JobSystem & jobs) {
+        PROFILE_ZONE("SystemScheduler::run");
+        for (auto & phase : phases) {
+            collect(world, phase);
+            jobs.parallelFor(0, work.size(),
+                             [this](size_t first, size_t last) {
+                                 for (size_t i = first; i < last; i++)
+                                     work[i].system->run(*work[i].archetype,
+                                                         work[i].chunk);
+                             },
+                             1);
+        }
+    }
+
+    /// Run the systems in order on the calling thread.
+    void run(World & world) {
+        PROFILE_ZONE("SystemScheduler::run");
+        for (auto & phase : phases) {
+            collect(world, phase);
+            for (auto & item : work)
+                item.system->run(*item.archetype, item.chunk);
+        }
+    }
+
+private:
+    /// The components with a cache their const methods write.
+    static ComponentMask cached() {
+        return World::mask<Transform>();
+    }
+
+    static bool conflicts(const System & a, const System & b) {
+        return (a.writes & (b.reads | b.writes)) || (a.reads & b.writes);
+    }
+
+    /// The chunks each system of phase runs on.
+    void collect(World & world, const std::vector<size_t> & phase) {
+        work.clear();
+        for (size_t index : phase) {
+            const System & system = systems[index];
+            for (auto & archetype : world.getArchetypes()) {
+                if (!archetype->matches(system.required))
+                    continue;
+                for (size_t c = 0; c < archetype->getChunkCount(); c++)
+                    work.push_back({&system, archetype.get(), c});
+            }
+        }
+    }
+};
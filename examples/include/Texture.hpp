@@ -6,8 +6,15 @@
 // REMEMBER TO DEVINE STB_IMAGE_IMPLEMENTATION in main.cpp
 #include <stb_image.h>
 
+#include <algorithm>
 #include <glm/glm.hpp>
+#include <memory>
 #include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Capture.hpp"
+#include "GLStats.hpp"
 
 class Texture {
 public:
@@ -15,6 +22,34 @@ public:
         Gray = GL_RED,
         RGB = GL_RGB,
         RGBA = GL_RGBA,
+
+        // Sized internal formats for render targets
+        RGBA8 = GL_RGBA8,
+        RGBA16F = GL_RGBA16F,
+        RGBA32F = GL_RGBA32F,
+        R11G11B10F = GL_R11F_G11F_B10F,
+        RGB10A2 = GL_RGB10_A2,
+        SRGB8A8 = GL_SRGB8_ALPHA8,
+        Depth24 = GL_DEPTH_COMPONENT24,
+        Depth32F = GL_DEPTH_COMPONENT32F,
+        Depth24Stencil8 = GL_DEPTH24_STENCIL8,
+
+        // Pixel data formats of depth textures
+        Depth = GL_DEPTH_COMPONENT,
+        DepthStencil = GL_DEPTH_STENCIL,
+
+        // Block compressed, internal format only. Load with loadCompressed.
+        BC1 = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+        BC1SRGB = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT,
+        BC2 = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,
+        BC2SRGB = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT,
+        BC3 = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+        BC3SRGB = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT,
+        BC4 = GL_COMPRESSED_RED_RGTC1,
+        BC5 = GL_COMPRESSED_RG_RGTC2,
+        BC6H = GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT,
+        BC7 = GL_COMPRESSED_RGBA_BPTC_UNORM,
+        BC7SRGB = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,
     };
 
     /// Mag filter only accepts Nearest or Linear.
@@ -51,6 +86,10 @@ private:
     Wrap wrap;
     bool mipmaps;
 
+    GLsizei layers;
+    GLuint64 handle;
+    bool resident;
+
 public:
     /**
      * Create a texture from an image.
@@ -85,9 +124,13 @@ public:
           minFilter(minFilter),
           magFilter(magFilter),
           wrap(wrap),
-          mipmaps(mipmaps) {
+          mipmaps(mipmaps),
+          layers(0),
+          handle(0),
+          resident(false) {
 
         glGenTextures(1, &textureId);
+        GL_CAPTURE(GenTexture, textureId);
         loadFrom(data, size, nrComponents);
     }
 
@@ -128,12 +171,78 @@ public:
           minFilter(minFilter),
           magFilter(magFilter),
           wrap(wrap),
-          mipmaps(mipmaps) {
+          mipmaps(mipmaps),
+          layers(0),
+          handle(0),
+          resident(false) {
 
         glGenTextures(1, &textureId);
+        GL_CAPTURE(GenTexture, textureId);
         resize(size);
     }
 
+    /**
+     * Create an empty GL_TEXTURE_2D_ARRAY with size.z layers. Fill each
+     * layer with loadLayer.
+     *
+     * @param size the layer size in pixels and the number of layers
+     * @param internal the internal format like GL_RGBA8, GL_RGBA, etc.
+     * @param format the format of pixel data
+     * @param type the data type of pixel data
+     * @param magFilter the magnification filter (default GL_NEAREST)
+     * @param minFilter the minification filter (default GL_NEAREST)
+     * @param wrap the wrap mode when drawing
+     * @param mipmaps should mipmaps be generated
+     */
+    Texture(const glm::uvec3 & size,
+            Format internal = RGBA,
+            Format format = RGBA,
+            GLenum type = GL_UNSIGNED_BYTE,
+            Filter magFilter = Linear,
+            Filter minFilter = LinearMmLinear,
+            Wrap wrap = Repeat,
+            bool mipmaps = true)
+        : textureId(0),
+          size(size.x, size.y),
+          internal(internal),
+          format(format),
+          type(type),
+          samples(0),
+          target(GL_TEXTURE_2D_ARRAY),
+          minFilter(minFilter),
+          magFilter(magFilter),
+          wrap(wrap),
+          mipmaps(mipmaps),
+          layers(size.z),
+          handle(0),
+          resident(false) {
+
+        glGenTextures(1, &textureId);
+        GL_CAPTURE(GenTexture, textureId);
+        resize(this->size);
+    }
+
+    /**
+     * Create an empty texture to render into, with the pixel format and type
+     * picked to match the internal format. The texture is clamped and has
+     * no mipmaps.
+     *
+     * @param size the image size in pixels
+     * @param internal the internal format, usually a sized format like
+     *                 RGBA16F or Depth24Stencil8
+     * @param samples the number of samples to use, 0 to disable
+     *                multisampling
+     * @param filter the min and mag filter
+     */
+    static Texture renderTarget(const glm::uvec2 & size,
+                                Format internal,
+                                GLsizei samples = 0,
+                                Filter filter = Linear) {
+        return Texture(size, internal, pixelFormat(internal),
+                       pixelType(internal), samples, filter, filter, Clamp,
+                       false);
+    }
+
     Texture(Texture && other)
         : textureId(other.textureId),
           size(other.size),
@@ -145,8 +254,13 @@ public:
           magFilter(other.magFilter),
           minFilter(other.minFilter),
           wrap(other.wrap),
-          mipmaps(other.mipmaps) {
+          mipmaps(other.mipmaps),
+          layers(other.layers),
+          handle(other.handle),
+          resident(other.resident) {
         other.textureId = 0;
+        other.handle = 0;
+        other.resident = false;
     }
 
     Texture & operator=(Texture && other) {
@@ -162,6 +276,11 @@ public:
         minFilter = other.minFilter;
         wrap = other.wrap;
         mipmaps = other.mipmaps;
+        layers = other.layers;
+        handle = other.handle;
+        resident = other.resident;
+        other.handle = 0;
+        other.resident = false;
         return *this;
     }
 
@@ -169,14 +288,22 @@ public:
     Texture & operator=(const Texture &) = delete;
 
     ~Texture() {
-        if (textureId)
+        if (resident)
+            glMakeTextureHandleNonResidentARB(handle);
+        if (textureId) {
+            GL_CAPTURE(DeleteTexture, textureId);
             glDeleteTextures(1, &textureId);
+        }
     }
 
     GLuint getTextureId() const {
         return textureId;
     }
 
+    Format getInternal() const {
+        return internal;
+    }
+
     GLsizei getSamples() const {
         return samples;
     }
@@ -189,11 +316,58 @@ public:
         return size;
     }
 
+    /// Number of layers of a GL_TEXTURE_2D_ARRAY, 0 for other targets.
+    GLsizei getLayers() const {
+        return layers;
+    }
+
+    /// Check for GL_ARB_bindless_texture, required by getHandle.
+    static bool bindlessSupported() {
+        return GLEW_ARB_bindless_texture;
+    }
+
+    /**
+     * Get the bindless handle of this texture, creating it on first use.
+     * After this call the texture parameters and storage can no longer be
+     * changed.
+     */
+    GLuint64 getHandle() {
+        if (!handle)
+            handle = glGetTextureHandleARB(textureId);
+        return handle;
+    }
+
+    /**
+     * Make the bindless handle resident so shaders can sample through it
+     * without this texture being bound.
+     */
+    void makeResident() {
+        if (!resident) {
+            glMakeTextureHandleResidentARB(getHandle());
+            resident = true;
+        }
+    }
+
+    void makeNonResident() {
+        if (resident) {
+            glMakeTextureHandleNonResidentARB(handle);
+            resident = false;
+        }
+    }
+
+    bool isResident() const {
+        return resident;
+    }
+
     void bind() const {
+        GL_STATS_BIND(TextureBinding, textureId);
+        GL_CAPTURE(BindTexture, target, textureId);
         glBindTexture(target, textureId);
     }
 
     void unbind() const {
+        GL_STATS_BIND(TextureBinding, 0);
+        GL_CAPTURE(BindTexture, target, 0);
         glBindTexture(target, 0);
     }
 
@@ -229,41 +403,477 @@ public:
         samples = 0;
         target = GL_TEXTURE_2D;
 
+        GL_STATS_UPLOAD(TextureUpload, size.x * size.y * nrComponents);
+        GL_CAPTURE_DATA(TexImage2D, data,
+                        GLCapture::get().imageBytes(size.x, size.y, 1, format,
+                                                    type),
+                        target, 0, internal, size.x, size.y, 0, format, type);
         glTexImage2D(target, 0, internal, size.x, size.y, 0, format, type, data);
 
+        GL_CAPTURE(TexParameteri, target, GL_TEXTURE_MAG_FILTER, magFilter);
         glTexParameteri(target, GL_TEXTURE_MAG_FILTER, magFilter);
+        GL_CAPTURE(TexParameteri, target, GL_TEXTURE_MIN_FILTER, minFilter);
         glTexParameteri(target, GL_TEXTURE_MIN_FILTER, minFilter);
 
+        GL_CAPTURE(TexParameteri, target, GL_TEXTURE_WRAP_S, wrap);
         glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+        GL_CAPTURE(TexParameteri, target, GL_TEXTURE_WRAP_T, wrap);
         glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
 
-        if (mipmaps)
+        if (mipmaps) {
+            GL_CAPTURE(GenerateMipmap, target);
             glGenerateMipmap(target);
+        }
+        unbind();
+    }
+
+    /**
+     * Update a region of the texture from an image. The texture must
+     * already be allocated and the pixel data must not exceed its bounds.
+     * Mipmaps are not updated, call generateMipmaps once all regions are
+     * loaded.
+     *
+     * Throw TextureLoadException if nrComponents is unsupported. Only 1, 3
+     * and 4 are supported.
+     *
+     * @param data the pixel data
+     * @param offset the position of the region in pixels
+     * @param size the region dimensions in pixels
+     * @param nrComponents the number of components for each pixel
+     * @param rowLength the row length of data in pixels, 0 if tightly
+     *                  packed
+     *
+     * @throws TextureLoadException for unsupported nrComponents
+     */
+    void loadSubImage(const unsigned char * data,
+                      const glm::uvec2 & offset,
+                      const glm::uvec2 & size,
+                      size_t nrComponents,
+                      GLint rowLength = 0) {
+        Format dataFormat;
+        if (nrComponents == 1)
+            dataFormat = Gray;
+        else if (nrComponents == 3)
+            dataFormat = RGB;
+        else if (nrComponents == 4)
+            dataFormat = RGBA;
+        else
+            throw TextureLoadException("Unsupported number of components");
+
+        bind();
+        GL_CAPTURE(PixelStorei, GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        GL_CAPTURE(PixelStorei, GL_UNPACK_ROW_LENGTH, rowLength);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+        GL_STATS_UPLOAD(TextureUpload, size.x * size.y * nrComponents);
+        GL_CAPTURE_DATA(TexSubImage2D, data,
+                        GLCapture::get().imageBytes(size.x, size.y, 1,
+                                                    dataFormat,
+                                                    GL_UNSIGNED_BYTE),
+                        target, 0, offset.x, offset.y, size.x, size.y,
+                        dataFormat, GL_UNSIGNED_BYTE);
+        glTexSubImage2D(target, 0, offset.x, offset.y, size.x, size.y,
+                        dataFormat, GL_UNSIGNED_BYTE, data);
+        GL_CAPTURE(PixelStorei, GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        GL_CAPTURE(PixelStorei, GL_UNPACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
         unbind();
     }
 
     void resize(const glm::uvec2 & size) {
+        if (isCompressed(internal))
+            throw TextureLoadException("Compressed textures can't be resized");
+
         this->size = size;
         if (size.x > 0 && size.y > 0) {
             bind();
             if (samples > 0) {
+                GL_CAPTURE(TexImage2DMultisample, target, samples, internal,
+                           size.x, size.y, GL_TRUE);
                 glTexImage2DMultisample(target, samples, internal, size.x,
                                         size.y, GL_TRUE);
             }
             else {
-                glTexImage2D(target, 0, internal, size.x, size.y, 0, format,
-                             type, NULL);
+                if (target == GL_TEXTURE_2D_ARRAY) {
+                    GL_CAPTURE(TexImage3D, target, 0, internal, size.x, size.y,
+                               layers, 0, format, type);
+                    glTexImage3D(target, 0, internal, size.x, size.y, layers,
+                                 0, format, type, NULL);
+                }
+                else {
+                    GL_CAPTURE(TexImage2D, target, 0, internal, size.x, size.y,
+                               0, format, type);
+                    glTexImage2D(target, 0, internal, size.x, size.y, 0,
+                                 format, type, NULL);
+                }
+
+                GL_CAPTURE(TexParameteri, target, GL_TEXTURE_MAG_FILTER,
+                           magFilter);
+                glTexParameteri(target, GL_TEXTURE_MAG_FILTER, magFilter);
+                GL_CAPTURE(TexParameteri, target, GL_TEXTURE_MIN_FILTER,
+                           minFilter);
+                glTexParameteri(target, GL_TEXTURE_MIN_FILTER, minFilter);
+
+                GL_CAPTURE(TexParameteri, target, GL_TEXTURE_WRAP_S, wrap);
+                glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+                GL_CAPTURE(TexParameteri, target, GL_TEXTURE_WRAP_T, wrap);
+                glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+            }
+            unbind();
+        }
+    }
 
+    /**
+     * Replace the storage with immutable storage of a new size. The texture
+     * object is recreated, so the id changes and a FrameBuffer must attach
+     * it again. Unsized formats can't have immutable storage and fall back
+     * to resize, and so does a driver without texture storage, which for a
+     * multisampled texture came later than for the others.
+     *
+     * @param size the new image size in pixels
+     */
+    void reallocate(const glm::uvec2 & size) {
+        bool storage =
+            samples > 0
+                ? GLEW_VERSION_4_3 || GLEW_ARB_texture_storage_multisample
+                : GLEW_VERSION_4_3 || GLEW_ARB_texture_storage;
+        if (!isSized(internal) || target == GL_TEXTURE_2D_ARRAY || !storage) {
+            resize(size);
+            return;
+        }
+
+        makeNonResident();
+        handle = 0;
+        if (textureId) {
+            GL_CAPTURE(DeleteTexture, textureId);
+            glDeleteTextures(1, &textureId);
+        }
+        glGenTextures(1, &textureId);
+        GL_CAPTURE(GenTexture, textureId);
+
+        this->size = size;
+        if (size.x > 0 && size.y > 0) {
+            bind();
+            if (samples > 0) {
+                GL_CAPTURE(TexStorage2DMultisample, target, samples, internal,
+                           size.x, size.y, GL_TRUE);
+                glTexStorage2DMultisample(target, samples, internal, size.x,
+                                          size.y, GL_TRUE);
+            }
+            else {
+                GLsizei levels = 1;
+                if (mipmaps) {
+                    while ((std::max(size.x, size.y) >> levels) > 0)
+                        levels++;
+                }
+                GL_CAPTURE(TexStorage2D, target, levels, internal, size.x,
+                           size.y);
+                glTexStorage2D(target, levels, internal, size.x, size.y);
+
+                GL_CAPTURE(TexParameteri, target, GL_TEXTURE_MAG_FILTER,
+                           magFilter);
                 glTexParameteri(target, GL_TEXTURE_MAG_FILTER, magFilter);
+                GL_CAPTURE(TexParameteri, target, GL_TEXTURE_MIN_FILTER,
+                           minFilter);
                 glTexParameteri(target, GL_TEXTURE_MIN_FILTER, minFilter);
 
+                GL_CAPTURE(TexParameteri, target, GL_TEXTURE_WRAP_S, wrap);
                 glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+                GL_CAPTURE(TexParameteri, target, GL_TEXTURE_WRAP_T, wrap);
                 glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
             }
             unbind();
         }
     }
 
+    /**
+     * Load block compressed image data, one entry per mip level starting at
+     * the full size image. Mipmaps come from the data and are never
+     * generated.
+     *
+     * @param format the compressed format of the data
+     * @param size the full size image dimensions in pixels
+     * @param levels the data of each mip level
+     *
+     * @throws TextureLoadException if format is not a compressed format or
+     * is not supported by the driver
+     */
+    void loadCompressed(Format format,
+                        const glm::uvec2 & size,
+                        const std::vector<std::vector<unsigned char>> & levels) {
+        if (!isCompressed(format))
+            throw TextureLoadException("Format is not compressed");
+        if (!isSupported(format))
+            throw TextureLoadException("Compressed format not supported");
+        if (levels.empty())
+            throw TextureLoadException("No image data");
+
+        bind();
+
+        this->size = size;
+        internal = format;
+        this->format = format;
+        type = GL_UNSIGNED_BYTE;
+        samples = 0;
+        target = GL_TEXTURE_2D;
+
+        glm::uvec2 levelSize = size;
+        for (size_t i = 0; i < levels.size(); i++) {
+            GL_STATS_UPLOAD(TextureUpload, levels[i].size());
+            GL_CAPTURE_DATA(CompressedTexImage2D, levels[i].data(),
+                            levels[i].size(), target, i, format, levelSize.x,
+                            levelSize.y, 0, levels[i].size());
+            glCompressedTexImage2D(target, i, format, levelSize.x, levelSize.y,
+                                   0, levels[i].size(), levels[i].data());
+            levelSize = glm::max(levelSize / 2u, glm::uvec2(1));
+        }
+
+        GL_CAPTURE(TexParameteri, target, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+        GL_CAPTURE(TexParameteri, target, GL_TEXTURE_MAX_LEVEL,
+                   levels.size() - 1);
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels.size() - 1);
+
+        GL_CAPTURE(TexParameteri, target, GL_TEXTURE_MAG_FILTER, magFilter);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, magFilter);
+        GL_CAPTURE(TexParameteri, target, GL_TEXTURE_MIN_FILTER, minFilter);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, minFilter);
+
+        GL_CAPTURE(TexParameteri, target, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+        GL_CAPTURE(TexParameteri, target, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+        unbind();
+    }
+
+    static bool isCompressed(Format format) {
+        switch (format) {
+            case BC1:
+            case BC1SRGB:
+            case BC2:
+            case BC2SRGB:
+            case BC3:
+            case BC3SRGB:
+            case BC4:
+            case BC5:
+            case BC6H:
+            case BC7:
+            case BC7SRGB:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /// Check for a sized internal format, as required by immutable storage.
+    static bool isSized(Format format) {
+        switch (format) {
+            case Gray:
+            case RGB:
+            case RGBA:
+            case Depth:
+            case DepthStencil:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    /// Bytes per 4x4 block of a compressed format.
+    static size_t blockBytes(Format format) {
+        if (format == BC1 || format == BC1SRGB || format == BC4)
+            return 8;
+        return 16;
+    }
+
+    /// Pixel data format to use with an internal format.
+    static Format pixelFormat(Format internal) {
+        switch (internal) {
+            case Gray:
+                return Gray;
+            case RGB:
+            case R11G11B10F:
+                return RGB;
+            case Depth:
+            case Depth24:
+            case Depth32F:
+                return Depth;
+            case DepthStencil:
+            case Depth24Stencil8:
+                return DepthStencil;
+            default:
+                return RGBA;
+        }
+    }
+
+    /// Pixel data type to use with an internal format.
+    static GLenum pixelType(Format internal) {
+        switch (internal) {
+            case RGBA16F:
+            case RGBA32F:
+            case R11G11B10F:
+            case Depth32F:
+                return GL_FLOAT;
+            case Depth:
+            case Depth24:
+                return GL_UNSIGNED_INT;
+            case DepthStencil:
+            case Depth24Stencil8:
+                return GL_UNSIGNED_INT_24_8;
+            default:
+                return GL_UNSIGNED_BYTE;
+        }
+    }
+
+    /**
+     * Video memory used by an image in an internal format. Unsized formats
+     * assume 8 bits per channel, the driver may pick otherwise.
+     */
+    static size_t storageBytes(Format internal,
+                               const glm::uvec2 & size,
+                               GLsizei samples = 0) {
+        if (isCompressed(internal))
+            return ((size.x + 3) / 4) * ((size.y + 3) / 4)
+                   * blockBytes(internal);
+
+        size_t pixelBytes;
+        switch (internal) {
+            case Gray:
+                pixelBytes = 1;
+                break;
+            case RGB:
+                pixelBytes = 3;
+                break;
+            case RGBA16F:
+                pixelBytes = 8;
+                break;
+            case RGBA32F:
+                pixelBytes = 16;
+                break;
+            default:
+                pixelBytes = 4;
+                break;
+        }
+        return size_t(size.x) * size.y * pixelBytes * std::max(samples, 1);
+    }
+
+    /**
+     * Check if a format can be attached to a FrameBuffer and rendered to.
+     * Uses GL_ARB_internalformat_query2 when available, otherwise assumes
+     * every uncompressed format is renderable.
+     *
+     * @param internal the internal format
+     * @param target GL_TEXTURE_2D, GL_TEXTURE_2D_MULTISAMPLE or
+     *               GL_RENDERBUFFER
+     */
+    static bool isRenderable(Format internal, GLenum target = GL_TEXTURE_2D) {
+        if (isCompressed(internal))
+            return false;
+        if (!GLEW_VERSION_4_3 && !GLEW_ARB_internalformat_query2)
+            return true;
+
+        GLint supported = GL_FALSE;
+        glGetInternalformativ(target, internal, GL_INTERNALFORMAT_SUPPORTED, 1,
+                              &supported);
+        if (supported != GL_TRUE)
+            return false;
+
+        GLint renderable = GL_NONE;
+        glGetInternalformativ(target, internal, GL_FRAMEBUFFER_RENDERABLE, 1,
+                              &renderable);
+        return renderable == GL_FULL_SUPPORT;
+    }
+
+    /**
+     * Check if the driver can sample a format. Uncompressed formats are
+     * always supported, BC1-BC3 need GL_EXT_texture_compression_s3tc, BC4
+     * and BC5 need OpenGL 3.0 and BC6H and BC7 need OpenGL 4.2.
+     */
+    static bool isSupported(Format format) {
+        switch (format) {
+            case BC1:
+            case BC2:
+            case BC3:
+                return GLEW_EXT_texture_compression_s3tc;
+            case BC1SRGB:
+            case BC2SRGB:
+            case BC3SRGB:
+                return GLEW_EXT_texture_compression_s3tc
+                       && GLEW_EXT_texture_sRGB;
+            case BC4:
+            case BC5:
+                return GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc;
+            case BC6H:
+            case BC7:
+            case BC7SRGB:
+                return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+            default:
+                return true;
+        }
+    }
+
+    /**
+     * Load one layer of a GL_TEXTURE_2D_ARRAY from an image. The image must
+     * match the layer size. Mipmaps are not updated, call generateMipmaps
+     * once all layers are loaded.
+     *
+     * Throw TextureLoadException if nrComponents is unsupported. Only 1, 3
+     * and 4 are supported.
+     *
+     * @param layer the layer index
+     * @param data the pixel data
+     * @param size the image dimensions in pixels
+     * @param nrComponents the number of components for each pixel
+     *
+     * @throws TextureLoadException for unsupported nrComponents, a
+     * mismatched size or a layer out of range
+     */
+    void loadLayer(GLsizei layer,
+                   const unsigned char * data,
+                   const glm::uvec2 & size,
+                   size_t nrComponents) {
+        Format dataFormat;
+        if (nrComponents == 1)
+            dataFormat = Gray;
+        else if (nrComponents == 3)
+            dataFormat = RGB;
+        else if (nrComponents == 4)
+            dataFormat = RGBA;
+        else
+            throw TextureLoadException("Unsupported number of components");
+
+        if (target != GL_TEXTURE_2D_ARRAY || layer < 0 || layer >= layers)
+            throw TextureLoadException("Layer out of range");
+        if (size != this->size)
+            throw TextureLoadException("Layer size does not match");
+
+        bind();
+        GL_CAPTURE(PixelStorei, GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        GL_STATS_UPLOAD(TextureUpload, size.x * size.y * nrComponents);
+        GL_CAPTURE_DATA(TexSubImage3D, data,
+                        GLCapture::get().imageBytes(size.x, size.y, 1,
+                                                    dataFormat,
+                                                    GL_UNSIGNED_BYTE),
+                        target, 0, 0, 0, layer, size.x, size.y, 1, dataFormat,
+                        GL_UNSIGNED_BYTE);
+        glTexSubImage3D(target, 0, 0, 0, layer, size.x, size.y, 1,
+                        dataFormat, GL_UNSIGNED_BYTE, data);
+        GL_CAPTURE(PixelStorei, GL_UNPACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        unbind();
+    }
+
+    void generateMipmaps() {
+        if (mipmaps && samples == 0) {
+            bind();
+            GL_CAPTURE(GenerateMipmap, target);
+            glGenerateMipmap(target);
+            unbind();
+        }
+    }
+
     /**
      * Load the texture from a file, setting the size from the image.
      *
@@ -277,10 +887,45 @@ public:
      */
     static Texture fromPath(const std::string & path) {
         int x, y, n;
-        auto * data = stbi_load(path.c_str(), &x, &y, &n, 0);
+        std::unique_ptr<unsigned char, void (*)(void *)> data(
+            stbi_load(path.c_str(), &x, &y, &n, 0), stbi_image_free);
         if (!data)
             throw TextureLoadException("Failed to load image from file");
-        return Texture(data, glm::uvec2(x, y), n);
+        return Texture(data.get(), glm::uvec2(x, y), n);
+    }
+
+    /**
+     * Load a GL_TEXTURE_2D_ARRAY with one layer per file. All images must
+     * have the same dimensions, they are converted to RGBA.
+     *
+     * @param paths the path to each layer image
+     *
+     * @throws TextureLoadException if an image fails to load or the sizes
+     * do not match
+     */
+    static Texture arrayFromPaths(const std::vector<std::string> & paths) {
+        if (paths.empty())
+            throw TextureLoadException("No layers to load");
+
+        std::vector<std::unique_ptr<unsigned char, void (*)(void *)>> images;
+        glm::uvec2 layerSize(0);
+        for (auto & path : paths) {
+            int x, y, n;
+            images.emplace_back(stbi_load(path.c_str(), &x, &y, &n, 4),
+                                stbi_image_free);
+            if (!images.back())
+                throw TextureLoadException("Failed to load image from file");
+            if (images.size() == 1)
+                layerSize = glm::uvec2(x, y);
+            else if (layerSize != glm::uvec2(x, y))
+                throw TextureLoadException("Layer size does not match");
+        }
+
+        Texture texture(glm::uvec3(layerSize, paths.size()));
+        for (size_t i = 0; i < images.size(); i++)
+            texture.loadLayer(i, images[i].get(), layerSize, 4);
+        texture.generateMipmaps();
+        return texture;
     }
 
     class TextureLoadException : public std::runtime_error {
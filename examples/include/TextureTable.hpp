@@ -0,0 +1,134 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "Buffer.hpp"
+#include "Texture.hpp"
+
+/**
+ * A list of textures that shaders select by index, so draws sharing a
+ * TextureTable need no texture binds in between.
+ *
+ * With GL_ARB_bindless_texture each texture is made resident and its
+ * handle is stored in a shader storage buffer, declared in GLSL as
+ *
+ *     #extension GL_ARB_bindless_texture : require
+ *     layout(std430, binding = 0) readonly buffer Textures {
+ *         sampler2D textures[];
+ *     };
+ *
+ * Without it each texture is bound to its own texture unit and the shader
+ * declares `layout(binding = 0) uniform sampler2D textures[N]` instead,
+ * which limits the table to GL_MAX_TEXTURE_IMAGE_UNITS entries. In both
+ * cases the index must be dynamically uniform, like gl_DrawID or a flat
+ * per-draw value.
+ */
+class TextureTable {
+    std::vector<Texture *> textures;
+    Buffer buffer;
+    bool bindless;
+    bool changed;
+    // GL_MAX_TEXTURE_IMAGE_UNITS, 0 in bindless mode
+    std::size_t maxUnits;
+
+public:
+    TextureTable(bool bindless = Texture::bindlessSupported())
+        : buffer(GL_SHADER_STORAGE_BUFFER),
+          bindless(bindless),
+          changed(false),
+          maxUnits(0) {
+        if (!bindless) {
+            GLint units = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+            maxUnits = units;
+        }
+    }
+
+    TextureTable(TextureTable && other) = default;
+    TextureTable & operator=(TextureTable && other) = default;
+
+    TextureTable(const TextureTable &) = delete;
+    TextureTable & operator=(const TextureTable &) = delete;
+
+    bool isBindless() const {
+        return bindless;
+    }
+
+    std::size_t size() const {
+        return textures.size();
+    }
+
+    /**
+     * Add a texture to the table. The texture must outlive the table. In
+     * bindless mode it is made resident, and stays resident after clear()
+     * as other tables may hold it too.
+     *
+     * @return the index shaders use to select the texture
+     *
+     * @throws std::runtime_error if the table has more entries than texture
+     * units when not using bindless textures
+     */
+    GLuint add(Texture * texture) {
+        if (!bindless) {
+            if (textures.size() >= maxUnits)
+                throw std::runtime_error("Too many textures without bindless");
+        }
+        else {
+            texture->makeResident();
+        }
+
+        textures.push_back(texture);
+        changed = true;
+        return textures.size() - 1;
+    }
+
+    /**
+     * Remove every texture. Their residency is left to their owner, call
+     * Texture::makeNonResident once no table uses a texture.
+     */
+    void clear() {
+        textures.clear();
+        changed = true;
+    }
+
+    /**
+     * Make the table visible to shaders. In bindless mode this uploads
+     * changed handles and binds the storage buffer, otherwise it binds each
+     * texture to texture unit binding + index.
+     *
+     * @param binding the storage buffer binding or the first texture unit
+     *
+     * @throws std::runtime_error if the textures from unit binding on go
+     * past the last texture unit
+     */
+    void bind(GLuint binding = 0) {
+        if (bindless) {
+            if (changed) {
+                std::vector<GLuint64> handles;
+                handles.reserve(textures.size());
+                for (auto * texture : textures)
+                    handles.push_back(texture->getHandle());
+                buffer.bufferData(handles.size() * sizeof(GLuint64),
+                                  handles.data(), GL_DYNAMIC_DRAW);
+                changed = false;
+            }
+            buffer.bindBase(binding);
+        }
+        else {
+            if (binding + textures.size() > maxUnits)
+                throw std::runtime_error("Texture units past the last one");
+            for (std::size_t i = 0; i < textures.size(); i++) {
+                GL_CAPTURE(ActiveTexture, GL_TEXTURE0 + binding + i);
+                glActiveTexture(GL_TEXTURE0 + binding + i);
+                textures[i]->bind();
+            }
+            GL_CAPTURE(ActiveTexture, GL_TEXTURE0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+    }
+};
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Timed events in the Chrome trace event format, to open in
+ * chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Times are microseconds on the steady clock, see now(). Each thread id is
+ * a track in the viewer and can be given a name.
+ *
+ * Not thread safe. Give each profiler its own trace, GpuProfiler adds to
+ * it on the render thread and CpuProfiler on its collector, and merge()
+ * them once the profilers are done with them.
+ */
+class ChromeTrace {
+public:
+    struct Event {
+        std::string name;
+        std::string category;
+        double start;
+        double duration;
+        int thread;
+    };
+
+private:
+    std::vector<Event> events;
+    std::map<int, std::string> threads;
+
+public:
+    /// Microseconds since the steady clock epoch.
+    static double now() {
+        auto time = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration<double, std::micro>(time).count();
+    }
+
+    void add(const std::string & name,
+             const std::string & category,
+             double start,
+             double duration,
+             int thread = 0) {
+        events.push_back({name, category, start, duration, thread});
+    }
+
+    void setThreadName(int thread, const std::string & name) {
+        threads[thread] = name;
+    }
+
+    /// Add the events and thread names of other.
+    void merge(const ChromeTrace & other) {
+        events.insert(events.end(), other.events.begin(), other.events.end());
+        for (auto & thread : other.threads)
+            threads[thread.first] = thread.second;
+    }
+
+    const std::vector<Event> & getEvents() const {
+        return events;
+    }
+
+    size_t size() const {
+        return events.size();
+    }
+
+    void clear() {
+        events.clear();
+    }
+
+    /// Write all events as a JSON object.
+    void write(std::ostream & out) const {
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+        bool first = true;
+        for (auto & thread : threads) {
+            out << (first ? "\n" : ",\n");
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                << thread.first << ",\"args\":{\"name\":";
+            writeString(out, thread.second);
+            out << "}}";
+            first = false;
+        }
+
+        char number[64];
+        for (auto & event : events) {
+            out << (first ? "\n" : ",\n");
+            out << "{\"name\":";
+            writeString(out, event.name);
+            out << ",\"cat\":";
+            writeString(out, event.category);
+            snprintf(number, sizeof(number), "%.3f", event.start);
+            out << ",\"ph\":\"X\",\"ts\":" << number;
+            snprintf(number, sizeof(number), "%.3f", event.duration);
+            out << ",\"dur\":" << number << ",\"pid\":1,\"tid\":" << event.thread
+                << "}";
+            first = false;
+        }
+
+        out << "\n]}\n";
+    }
+
+private:
+    static void writeString(std::ostream & out, const std::string & value) {
+        out << '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out << escaped;
+            }
+            else {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+};
+
+/// The last samples of a measurement, with their average and percentiles.
+class RollingStats {
+    std::vector<double> samples;
+    size_t capacity;
+    size_t next;
+
+public:
+    RollingStats(size_t capacity = 128) : capacity(capacity), next(0) {
+        samples.reserve(capacity);
+    }
+
+    void add(double value) {
+        if (samples.size() < capacity)
+            samples.push_back(value);
+        else
+            samples[next] = value;
+        next = (next + 1) % capacity;
+    }
+
+    size_t count() const {
+        return samples.size();
+    }
+
+    double last() const {
+        if (samples.empty())
+            return 0;
+        return samples[(next + capacity - 1) % capacity];
+    }
+
+    double average() const {
+        if (samples.empty())
+            return 0;
+        double sum = 0;
+        for (double sample : samples)
+            sum += sample;
+        return sum / samples.size();
+    }
+
+    /// @param p the percentile from 0 to 100
+    double percentile(double p) const {
+        if (samples.empty())
+            return 0;
+        std::vector<double> sorted = samples;
+        size_t index = std::min(size_t(p / 100.0 * sorted.size()),
+                                sorted.size() - 1);
+        std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+        return sorted[index];
+    }
+
+    void clear() {
+        samples.clear();
+        next = 0;
+    }
+};
+
+/**
+ * Counts of samples in fixed width buckets, for percentiles over any number
+ * of samples in constant memory. Samples past the last bucket are counted
+ * in it.
+ */
+class Histogram {
+    std::vector<uint64_t> counts;
+    double bucketWidth;
+    uint64_t total;
+    double sum;
+    double maximum;
+
+public:
+    Histogram(double bucketWidth = 0.25, size_t buckets = 400)
+        : counts(buckets), bucketWidth(bucketWidth), total(0), sum(0),
+          maximum(0) {}
+
+    void add(double value) {
+        size_t bucket = value > 0 ? size_t(value / bucketWidth) : 0;
+        counts[std::min(bucket, counts.size() - 1)]++;
+        total++;
+        sum += value;
+        maximum = std::max(maximum, value);
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    double average() const {
+        return total ? sum / total : 0;
+    }
+
+    double max() const {
+        return maximum;
+    }
+
+    /**
+     * The upper edge of the bucket holding the percentile.
+     *
+     * @param p the percentile from 0 to 100
+     */
+    double percentile(double p) const {
+        if (total == 0)
+            return 0;
+        uint64_t rank = uint64_t(p / 100.0 * (total - 1));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen > rank)
+                return std::min((i + 1) * bucketWidth, maximum);
+        }
+        return maximum;
+    }
+
+    const std::vector<uint64_t> & getBuckets() const {
+        return counts;
+    }
+
+    double getBucketWidth() const {
+        return bucketWidth;
+    }
+
+    void clear() {
+        std::fill(counts.begin(), counts.end(), 0);
+        total = 0;
+        sum = 0;
+        maximum = 0;
+    }
+};
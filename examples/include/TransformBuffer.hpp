@@ -0,0 +1,546 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define TRANSFORM_BUFFER_SSE
+#endif
+#if defined(__AVX2__)
+#define TRANSFORM_BUFFER_AVX2
+#endif
+
+#include "Profiler.hpp"
+#include "Transform.hpp"
+
+/**
+ * Position, rotation and scale of many objects, stored as one array per
+ * component with a dirty bit each, composed to matrices in batches.
+ *
+ * The matrices equal Transform::toMatrix() (translate * rotate * scale) up
+ * to rounding. update() composes the dirty ones 8 (AVX2) or 4 (SSE) at a
+ * time, whichever the compiler targets, and the rest one at a time. Build
+ * with -DENABLE_AVX2=ON for the AVX2 kernel.
+ */
+class TransformBuffer {
+public:
+    /// A composition kernel, see supported().
+    enum Kernel {
+        Scalar,
+        SSE,
+        AVX2,
+    };
+
+private:
+    std::vector<float> px, py, pz;
+    std::vector<float> qx, qy, qz, qw;
+    std::vector<float> sx, sy, sz;
+    std::vector<uint64_t> dirty;
+    std::vector<glm::mat4> matrices;
+
+public:
+    TransformBuffer() {}
+
+    TransformBuffer(TransformBuffer && other) = default;
+    TransformBuffer & operator=(TransformBuffer && other) = default;
+
+    TransformBuffer(const TransformBuffer &) = delete;
+    TransformBuffer & operator=(const TransformBuffer &) = delete;
+
+    /// If this build has the kernel.
+    static bool supported(Kernel kernel) {
+        switch (kernel) {
+            case Scalar:
+                return true;
+#ifdef TRANSFORM_BUFFER_SSE
+            case SSE:
+                return true;
+#endif
+#ifdef TRANSFORM_BUFFER_AVX2
+            case AVX2:
+                return true;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    /// The widest supported kernel.
+    static Kernel bestKernel() {
+        return supported(AVX2) ? AVX2 : supported(SSE) ? SSE : Scalar;
+    }
+
+    /**
+     * Add a transform, it starts dirty.
+     *
+     * @return the index of the transform
+     */
+    size_t add(const glm::vec3 & position = glm::vec3(0),
+               const glm::quat & rotation = glm::quat(glm::vec3(0)),
+               const glm::vec3 & scale = glm::vec3(1)) {
+        size_t i = size();
+        px.push_back(position.x);
+        py.push_back(position.y);
+        pz.push_back(position.z);
+        qx.push_back(rotation.x);
+        qy.push_back(rotation.y);
+        qz.push_back(rotation.z);
+        qw.push_back(rotation.w);
+        sx.push_back(scale.x);
+        sy.push_back(scale.y);
+        sz.push_back(scale.z);
+        matrices.emplace_back(1);
+        if (i % 64 == 0)
+            dirty.push_back(0);
+        markDirty(i);
+        return i;
+    }
+
+    size_t add(const Transform & transform) {
+        return add(transform.getPosition(), transform.getRotation(),
+                   transform.getScale());
+    }
+
+    void reserve(size_t count) {
+        for (auto * v : {&px, &py, &pz, &qx, &qy, &qz, &qw, &sx, &sy, &sz})
+            v->reserve(count);
+        dirty.reserve((count + 63) / 64);
+        matrices.reserve(count);
+    }
+
+    void clear() {
+        for (auto * v : {&px, &py, &pz, &qx, &qy, &qz, &qw, &sx, &sy, &sz})
+            v->clear();
+        dirty.clear();
+        matrices.clear();
+    }
+
+    size_t size() const {
+        return px.size();
+    }
+
+    /// A copy of transform i as a Transform.
+    Transform get(size_t i) const {
+        return Transform(getPosition(i), getRotation(i), getScale(i));
+    }
+
+    glm::vec3 getPosition(size_t i) const {
+        return glm::vec3(px[i], py[i], pz[i]);
+    }
+
+    void setPosition(size_t i, const glm::vec3 & position) {
+        px[i] = position.x;
+        py[i] = position.y;
+        pz[i] = position.z;
+        markDirty(i);
+    }
+
+    void move(size_t i, const glm::vec3 & delta) {
+        setPosition(i, getPosition(i) + delta);
+    }
+
+    glm::quat getRotation(size_t i) const {
+        return glm::quat(qw[i], qx[i], qy[i], qz[i]);
+    }
+
+    void setRotation(size_t i, const glm::quat & rotation) {
+        qx[i] = rotation.x;
+        qy[i] = rotation.y;
+        qz[i] = rotation.z;
+        qw[i] = rotation.w;
+        markDirty(i);
+    }
+
+    void rotate(size_t i, const glm::quat & delta) {
+        setRotation(i, delta * getRotation(i));
+    }
+
+    void rotateEuler(size_t i, const glm::vec3 & delta) {
+        rotate(i, glm::quat(delta));
+    }
+
+    glm::vec3 getScale(size_t i) const {
+        return glm::vec3(sx[i], sy[i], sz[i]);
+    }
+
+    void setScale(size_t i, const glm::vec3 & scale) {
+        sx[i] = scale.x;
+        sy[i] = scale.y;
+        sz[i] = scale.z;
+        markDirty(i);
+    }
+
+    void scale(size_t i, const glm::vec3 & scale) {
+        setScale(i, getScale(i) * scale);
+    }
+
+    bool isDirty(size_t i) const {
+        return (dirty[i / 64] >> (i % 64)) & 1;
+    }
+
+    void markDirty(size_t i) {
+        dirty[i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    void markAllDirty() {
+        for (size_t w = 0; w < dirty.size(); w++)
+            dirty[w] = wordMask(w);
+    }
+
+    /**
+     * Compose the matrices of the dirty transforms and clear their bits.
+     *
+     * @return the number of matrices composed
+     */
+    size_t update(Kernel kernel = bestKernel()) {
+        PROFILE_ZONE("TransformBuffer::update");
+        size_t composed = 0;
+        forEachDirtyRun([&](size_t first, size_t end) {
+            composeMat4(first, end - first, &matrices[first], kernel);
+            composed += end - first;
+        });
+        clearDirty();
+        return composed;
+    }
+
+    /// Call fn(first, end) for each run of dirty transforms, first to end,
+    /// in order.
+    template <typename F>
+    void forEachDirtyRun(F && fn) const {
+        size_t i = 0;
+        while (i < size()) {
+            uint64_t word = dirty[i / 64] >> (i % 64);
+            if (word == 0) {
+                i += 64 - i % 64;
+                continue;
+            }
+            i += countTrailingZeros(word);
+
+            // Extend the run of dirty bits across words
+            size_t end = i;
+            while (end < size()) {
+                uint64_t rest = ~dirty[end / 64] >> (end % 64);
+                if (rest == 0) {
+                    end += 64 - end % 64;
+                    continue;
+                }
+                end += countTrailingZeros(rest);
+                break;
+            }
+            if (end > size())
+                end = size();
+
+            fn(i, end);
+            i = end;
+        }
+    }
+
+    /// Clear the dirty bits without composing, for a caller that composes
+    /// the runs of forEachDirtyRun() itself.
+    void clearDirty() {
+        std::fill(dirty.begin(), dirty.end(), 0);
+    }
+
+    /// The matrix of transform i as of the last update().
+    const glm::mat4 & getMatrix(size_t i) const {
+        return matrices[i];
+    }
+
+    /// All matrices as of the last update(), to upload as instance data.
+    const std::vector<glm::mat4> & getMatrices() const {
+        return matrices;
+    }
+
+    /**
+     * Compose the matrices of transforms first to first + count into out,
+     * whether dirty or not, without changing the dirty bits.
+     */
+    void composeMat4(size_t first,
+                     size_t count,
+                     glm::mat4 * out,
+                     Kernel kernel = bestKernel()) const {
+        compose<false>(first, count, &out[0][0][0], kernel);
+    }
+
+    /**
+     * Like composeMat4(), but write the top three rows of each matrix, the
+     * bottom is always 0, 0, 0, 1. Column r of the mat3x4 is row r of the
+     * matrix, which is 48 instead of 64 bytes to upload and transforms with
+     * `vec3 world = vec4(position, 1.0) * model;` in GLSL.
+     */
+    void composeMat3x4(size_t first,
+                       size_t count,
+                       glm::mat3x4 * out,
+                       Kernel kernel = bestKernel()) const {
+        compose<true>(first, count, &out[0][0][0], kernel);
+    }
+
+    /**
+     * Copy the rotation, position and scale of transforms first to first +
+     * count into out, 10 floats each: the quaternion x, y, z, w, then the
+     * position and the scale. 40 bytes to upload, decoded in the shader.
+     */
+    void packQuatPosScale(size_t first, size_t count, float * out) const {
+        for (size_t i = first; i < first + count; i++, out += 10) {
+            out[0] = qx[i];
+            out[1] = qy[i];
+            out[2] = qz[i];
+            out[3] = qw[i];
+            out[4] = px[i];
+            out[5] = py[i];
+            out[6] = pz[i];
+            out[7] = sx[i];
+            out[8] = sy[i];
+            out[9] = sz[i];
+        }
+    }
+
+private:
+    uint64_t wordMask(size_t w) const {
+        size_t bits = size() - w * 64;
+        return bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+    }
+
+    static unsigned countTrailingZeros(uint64_t word) {
+#if defined(__GNUC__)
+        return __builtin_ctzll(word);
+#else
+        unsigned n = 0;
+        for (; !(word & 1); word >>= 1)
+            n++;
+        return n;
+#endif
+    }
+
+    struct ScalarLanes {
+        using Vector = float;
+
+        static Vector load(const float * p) {
+            return *p;
+        }
+
+        static Vector set(float value) {
+            return value;
+        }
+
+        static Vector add(Vector a, Vector b) {
+            return a + b;
+        }
+
+        static Vector sub(Vector a, Vector b) {
+            return a - b;
+        }
+
+        static Vector mul(Vector a, Vector b) {
+            return a * b;
+        }
+
+        static void store4(Vector a,
+                           Vector b,
+                           Vector c,
+                           Vector d,
+                           float * out,
+                           size_t) {
+            out[0] = a;
+            out[1] = b;
+            out[2] = c;
+            out[3] = d;
+        }
+
+        static void store8(const Vector * v, float * out, size_t) {
+            for (size_t j = 0; j < 8; j++)
+                out[j] = v[j];
+        }
+    };
+
+#ifdef TRANSFORM_BUFFER_SSE
+    struct SSELanes {
+        using Vector = __m128;
+
+        static Vector load(const float * p) {
+            return _mm_loadu_ps(p);
+        }
+
+        static Vector set(float value) {
+            return _mm_set1_ps(value);
+        }
+
+        static Vector add(Vector a, Vector b) {
+            return _mm_add_ps(a, b);
+        }
+
+        static Vector sub(Vector a, Vector b) {
+            return _mm_sub_ps(a, b);
+        }
+
+        static Vector mul(Vector a, Vector b) {
+            return _mm_mul_ps(a, b);
+        }
+
+        /// Write a, b, c, d of lane k to out + k * stride.
+        static void store4(Vector a,
+                           Vector b,
+                           Vector c,
+                           Vector d,
+                           float * out,
+                           size_t stride) {
+            _MM_TRANSPOSE4_PS(a, b, c, d);
+            _mm_storeu_ps(out, a);
+            _mm_storeu_ps(out + stride, b);
+            _mm_storeu_ps(out + 2 * stride, c);
+            _mm_storeu_ps(out + 3 * stride, d);
+        }
+
+        /// Write v[0] to v[7] of lane k to out + k * stride.
+        static void store8(const Vector * v, float * out, size_t stride) {
+            store4(v[0], v[1], v[2], v[3], out, stride);
+            store4(v[4], v[5], v[6], v[7], out + 4, stride);
+        }
+    };
+#endif
+
+#ifdef TRANSFORM_BUFFER_AVX2
+    struct AVX2Lanes {
+        using Vector = __m256;
+
+        static Vector load(const float * p) {
+            return _mm256_loadu_ps(p);
+        }
+
+        static Vector set(float value) {
+            return _mm256_set1_ps(value);
+        }
+
+        static Vector add(Vector a, Vector b) {
+            return _mm256_add_ps(a, b);
+        }
+
+        static Vector sub(Vector a, Vector b) {
+            return _mm256_sub_ps(a, b);
+        }
+
+        static Vector mul(Vector a, Vector b) {
+            return _mm256_mul_ps(a, b);
+        }
+
+        static void store4(Vector a,
+                           Vector b,
+                           Vector c,
+                           Vector d,
+                           float * out,
+                           size_t stride) {
+            SSELanes::store4(
+                _mm256_castps256_ps128(a), _mm256_castps256_ps128(b),
+                _mm256_castps256_ps128(c), _mm256_castps256_ps128(d), out,
+                stride);
+            SSELanes::store4(
+                _mm256_extractf128_ps(a, 1), _mm256_extractf128_ps(b, 1),
+                _mm256_extractf128_ps(c, 1), _mm256_extractf128_ps(d, 1),
+                out + 4 * stride, stride);
+        }
+
+        static void store8(const Vector * v, float * out, size_t stride) {
+            // 8x8 transpose, pairs, then quads within each 128 bit half,
+            // then the halves
+            __m256 t[8], u[8];
+            for (size_t j = 0; j < 8; j += 2) {
+                t[j] = _mm256_unpacklo_ps(v[j], v[j + 1]);
+                t[j + 1] = _mm256_unpackhi_ps(v[j], v[j + 1]);
+            }
+            for (size_t j = 0; j < 8; j += 4) {
+                u[j] = _mm256_shuffle_ps(t[j], t[j + 2],
+                                         _MM_SHUFFLE(1, 0, 1, 0));
+                u[j + 1] = _mm256_shuffle_ps(t[j], t[j + 2],
+                                             _MM_SHUFFLE(3, 2, 3, 2));
+                u[j + 2] = _mm256_shuffle_ps(t[j + 1], t[j + 3],
+                                             _MM_SHUFFLE(1, 0, 1, 0));
+                u[j + 3] = _mm256_shuffle_ps(t[j + 1], t[j + 3],
+                                             _MM_SHUFFLE(3, 2, 3, 2));
+            }
+            for (size_t k = 0; k < 4; k++) {
+                _mm256_storeu_ps(out + k * stride,
+                                 _mm256_permute2f128_ps(u[k], u[k + 4], 0x20));
+                _mm256_storeu_ps(out + (k + 4) * stride,
+                                 _mm256_permute2f128_ps(u[k], u[k + 4], 0x31));
+            }
+        }
+    };
+#endif
+
+    template <bool affine>
+    void compose(size_t first, size_t count, float * out, Kernel kernel) const {
+        const size_t stride = affine ? 12 : 16;
+        size_t i = first, end = first + count;
+#ifdef TRANSFORM_BUFFER_AVX2
+        if (kernel >= AVX2) {
+            for (; i + 8 <= end; i += 8)
+                composeLanes<AVX2Lanes, affine>(i, out + (i - first) * stride);
+        }
+#endif
+#ifdef TRANSFORM_BUFFER_SSE
+        if (kernel >= SSE) {
+            for (; i + 4 <= end; i += 4)
+                composeLanes<SSELanes, affine>(i, out + (i - first) * stride);
+        }
+#endif
+        for (; i < end; i++)
+            composeLanes<ScalarLanes, affine>(i, out + (i - first) * stride);
+    }
+
+    /**
+     * Compose the transforms from i, one per lane, in the order of
+     * operations of glm::toMat4 and the products in Transform::toMatrix().
+     */
+    template <typename L, bool affine>
+    void composeLanes(size_t i, float * out) const {
+        using V = typename L::Vector;
+        const V one = L::set(1), two = L::set(2);
+
+        V x = L::load(&qx[i]), y = L::load(&qy[i]), z = L::load(&qz[i]),
+          w = L::load(&qw[i]);
+        V xx = L::mul(x, x), yy = L::mul(y, y), zz = L::mul(z, z);
+        V xz = L::mul(x, z), xy = L::mul(x, y), yz = L::mul(y, z);
+        V wx = L::mul(w, x), wy = L::mul(w, y), wz = L::mul(w, z);
+
+        V scaleX = L::load(&sx[i]), scaleY = L::load(&sy[i]),
+          scaleZ = L::load(&sz[i]);
+
+        // m[column][row] of the top three rows
+        V m[4][3] = {
+            {L::mul(L::sub(one, L::mul(two, L::add(yy, zz))), scaleX),
+             L::mul(L::mul(two, L::add(xy, wz)), scaleX),
+             L::mul(L::mul(two, L::sub(xz, wy)), scaleX)},
+            {L::mul(L::mul(two, L::sub(xy, wz)), scaleY),
+             L::mul(L::sub(one, L::mul(two, L::add(xx, zz))), scaleY),
+             L::mul(L::mul(two, L::add(yz, wx)), scaleY)},
+            {L::mul(L::mul(two, L::add(xz, wy)), scaleZ),
+             L::mul(L::mul(two, L::sub(yz, wx)), scaleZ),
+             L::mul(L::sub(one, L::mul(two, L::add(xx, yy))), scaleZ)},
+            {L::load(&px[i]), L::load(&py[i]), L::load(&pz[i])},
+        };
+
+        if (affine) {
+            const V rows[8] = {m[0][0], m[1][0], m[2][0], m[3][0],
+                               m[0][1], m[1][1], m[2][1], m[3][1]};
+            L::store8(rows, out, 12);
+            L::store4(m[0][2], m[1][2], m[2][2], m[3][2], out + 8, 12);
+        }
+        else {
+            const V zero = L::set(0);
+            const V columns[2][8] = {
+                {m[0][0], m[0][1], m[0][2], zero,  //
+                 m[1][0], m[1][1], m[1][2], zero}, //
+                {m[2][0], m[2][1], m[2][2], zero,  //
+                 m[3][0], m[3][1], m[3][2], one},  //
+            };
+            L::store8(columns[0], out, 16);
+            L::store8(columns[1], out + 8, 16);
+        }
+    }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <SFML/Graphics.hpp>
+#include <glm/glm.hpp>
+
+#include "FrameBuffer.hpp"
+
+/**
+ * An SFML window with the interface of HeadlessSurface, drawing into
+ * FrameBuffer::getDefault(). Escape or closing the window closes it.
+ */
+class WindowSurface {
+    sf::RenderWindow & window;
+    glm::uvec2 size;
+
+public:
+    /// @param window an open window with a current context
+    WindowSurface(sf::RenderWindow & window)
+        : window(window), size(window.getSize().x, window.getSize().y) {
+        FrameBuffer::getDefault().resize(size.x, size.y);
+    }
+
+    const glm::uvec2 & getSize() const {
+        return size;
+    }
+
+    FrameBuffer & getFrameBuffer() {
+        return FrameBuffer::getDefault();
+    }
+
+    bool isOpen() const {
+        return window.isOpen();
+    }
+
+    void pollEvents() {
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            switch (event.type) {
+                case sf::Event::KeyPressed:
+                    if (event.key.code == sf::Keyboard::Escape)
+                        window.close();
+                    break;
+                case sf::Event::Resized:
+                    size = glm::uvec2(event.size.width, event.size.height);
+                    window.setView(sf::View(
+                        sf::FloatRect(0, 0, event.size.width, event.size.height)));
+                    FrameBuffer::getDefault().resize(size.x, size.y);
+                    break;
+                case sf::Event::Closed:
+                    window.close();
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    void display() {
+        window.display();
+    }
+};
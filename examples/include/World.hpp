@@ -0,0 +1,484 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// A set of component types, one bit per World::componentId.
+using ComponentMask = uint64_t;
+
+/**
+ * Entities with any set of components, stored by archetype: the entities
+ * with the same set of component types share an archetype, which keeps
+ * each component type in its own array, so a query walks the components
+ * it asks for contiguously and skips the others.
+ *
+ * An archetype's entities fill fixed size chunks, each holding one array
+ * per component type for the entities in it. Chunks don't move once
+ * allocated and are the unit of parallel work of a SystemScheduler.
+ * Removing an entity moves the archetype's last entity into its row, so
+ * rows stay packed. Adding or removing a component moves the entity to
+ * another archetype.
+ *
+ * Components can be any movable type, up to 64 types in a program.
+ * Entities are handles that stay valid until destroyed. Component
+ * references and chunk pointers are only valid until the next change to
+ * the set of entities or their component types, so queries must not make
+ * structural changes.
+ */
+class World {
+public:
+    using Entity = uint32_t;
+
+    /// Not an entity.
+    static constexpr Entity none = ~Entity(0);
+
+    /// Bytes of a chunk, its rows are as many entities as fit.
+    static constexpr size_t chunkBytes = 16 * 1024;
+
+    /// Size and alignment of a component type, and how to move and destroy
+    /// one without knowing the type.
+    struct ComponentInfo {
+        size_t size;
+        size_t align;
+        /// Move construct at to from from, then destroy from
+        void (*moveTo)(void * to, void * from);
+        void (*destroy)(void * component);
+    };
+
+    /// The id of component type T, its bit in a ComponentMask.
+    template <typename T>
+    static size_t componentId() {
+        using Type = std::remove_cv_t<T>;
+        // One id for T and const T
+        if (!std::is_same<T, Type>::value)
+            return componentId<Type>();
+        static const size_t id = registerComponent({
+            sizeof(Type),
+            alignof(Type),
+            [](void * to, void * from) {
+                new (to) Type(std::move(*static_cast<Type *>(from)));
+                static_cast<Type *>(from)->~Type();
+            },
+            [](void * component) { static_cast<Type *>(component)->~Type(); },
+        });
+        return id;
+    }
+
+    template <typename... Components>
+    static ComponentMask mask() {
+        return (ComponentMask(0) | ... | (ComponentMask(1)
+                                          << componentId<Components>()));
+    }
+
+    /// The entities with one set of component types.
+    class Archetype {
+        struct alignas(64) Chunk {
+            unsigned char data[chunkBytes];
+        };
+
+        ComponentMask componentMask;
+        std::vector<size_t> ids;
+        // By component id, the column of the component or -1
+        std::array<int8_t, 64> columns;
+        std::vector<size_t> offsets;
+        size_t capacity;
+        size_t count;
+        std::vector<std::unique_ptr<Chunk>> chunks;
+
+        friend class World;
+
+    public:
+        explicit Archetype(ComponentMask componentMask)
+            : componentMask(componentMask), count(0) {
+            columns.fill(-1);
+            size_t rowBytes = sizeof(Entity), padding = 0;
+            for (size_t id = 0; id < 64; id++) {
+                if (!(componentMask >> id & 1))
+                    continue;
+                columns[id] = int8_t(ids.size());
+                ids.push_back(id);
+                rowBytes += info(id).size;
+                padding += info(id).align;
+            }
+            capacity = (chunkBytes - padding) / rowBytes;
+            if (capacity == 0)
+                throw std::length_error("Components don't fit in a chunk");
+
+            // Entities first, then each column aligned
+            size_t offset = capacity * sizeof(Entity);
+            for (size_t id : ids) {
+                size_t align = info(id).align;
+                offset = (offset + align - 1) / align * align;
+                offsets.push_back(offset);
+                offset += capacity * info(id).size;
+            }
+        }
+
+        Archetype(const Archetype &) = delete;
+        Archetype & operator=(const Archetype &) = delete;
+
+        ~Archetype() {
+            for (size_t row = 0; row < count; row++)
+                destroyRow(row);
+        }
+
+        ComponentMask getMask() const {
+            return componentMask;
+        }
+
+        /// If the entities of the archetype have all components of mask.
+        bool matches(ComponentMask required) const {
+            return (componentMask & required) == required;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        /// Entities per chunk.
+        size_t getChunkCapacity() const {
+            return capacity;
+        }
+
+        size_t getChunkCount() const {
+            return (count + capacity - 1) / capacity;
+        }
+
+        /// Entities in chunk, all chunks but the last are full.
+        size_t getChunkSize(size_t chunk) const {
+            return std::min(capacity, count - chunk * capacity);
+        }
+
+        const Entity * getEntities(size_t chunk) const {
+            return reinterpret_cast<const Entity *>(chunks[chunk]->data);
+        }
+
+        /// The components T of the entities in chunk, nullptr if the
+        /// archetype doesn't have T.
+        template <typename T>
+        T * getColumn(size_t chunk) const {
+            int column = columns[componentId<T>()];
+            if (column < 0)
+                return nullptr;
+            return reinterpret_cast<T *>(chunks[chunk]->data
+                                         + offsets[column]);
+        }
+
+    private:
+        void * component(size_t column, size_t row) const {
+            return chunks[row / capacity]->data + offsets[column]
+                   + row % capacity * info(ids[column]).size;
+        }
+
+        Entity & entity(size_t row) const {
+            return reinterpret_cast<Entity *>(
+                chunks[row / capacity]->data)[row % capacity];
+        }
+
+        /// Add a row for entity, the components are left unconstructed.
+        size_t pushRow(Entity entity) {
+            if (count == chunks.size() * capacity)
+                chunks.emplace_back(new Chunk);
+            this->entity(count) = entity;
+            return count++;
+        }
+
+        void destroyRow(size_t row) {
+            for (size_t column = 0; column < ids.size(); column++)
+                info(ids[column]).destroy(component(column, row));
+        }
+
+        /**
+         * Remove a row whose components were moved out or destroyed, by
+         * moving the last row into it.
+         *
+         * @return the entity moved into row, or none
+         */
+        Entity popRow(size_t row) {
+            size_t last = --count;
+            Entity moved = none;
+            if (row != last) {
+                for (size_t column = 0; column < ids.size(); column++)
+                    info(ids[column])
+                        .moveTo(component(column, row),
+                                component(column, last));
+                moved = entity(row) = entity(last);
+            }
+            // Keep one empty chunk, so an entity moving back and forth at
+            // a chunk boundary doesn't allocate each time
+            if (count + 2 * capacity <= chunks.size() * capacity)
+                chunks.pop_back();
+            return moved;
+        }
+    };
+
+private:
+    struct Location {
+        uint32_t archetype;
+        uint32_t row;
+    };
+
+    std::vector<std::unique_ptr<Archetype>> archetypes;
+    std::unordered_map<ComponentMask, uint32_t> archetypeIndex;
+
+    // By entity
+    std::vector<Location> locations;
+    std::vector<Entity> freeEntities;
+    size_t entityCount;
+
+public:
+    World() : entityCount(0) {
+        archetypeOf(0);
+    }
+
+    World(World && other) = default;
+    World & operator=(World && other) = default;
+
+    World(const World &) = delete;
+    World & operator=(const World &) = delete;
+
+    /// Live entities.
+    size_t size() const {
+        return entityCount;
+    }
+
+    bool contains(Entity entity) const {
+        return entity < locations.size()
+               && locations[entity].archetype != none;
+    }
+
+    /// Create an entity with components.
+    template <typename... Components>
+    Entity create(Components... components) {
+        std::array<size_t, sizeof...(Components)> ids = {
+            componentId<Components>()...};
+        ComponentMask componentMask = 0;
+        for (size_t id : ids) {
+            if (componentMask >> id & 1)
+                throw std::invalid_argument("A component type given twice");
+            componentMask |= ComponentMask(1) << id;
+        }
+
+        Entity entity;
+        if (!freeEntities.empty()) {
+            entity = freeEntities.back();
+            freeEntities.pop_back();
+        }
+        else {
+            entity = Entity(locations.size());
+            locations.push_back({none, 0});
+        }
+
+        uint32_t index = archetypeOf(componentMask);
+        Archetype & archetype = *archetypes[index];
+        size_t row = archetype.pushRow(entity);
+        (construct(archetype, row, std::move(components)), ...);
+
+        locations[entity] = {index, uint32_t(row)};
+        entityCount++;
+        return entity;
+    }
+
+    /**
+     * Destroy an entity and its components.
+     *
+     * @throws std::out_of_range if entity isn't an entity
+     */
+    void destroy(Entity entity) {
+        Location location = locationOf(entity);
+        Archetype & archetype = *archetypes[location.archetype];
+        archetype.destroyRow(location.row);
+        removeRow(archetype, location.row);
+
+        locations[entity].archetype = none;
+        freeEntities.push_back(entity);
+        entityCount--;
+    }
+
+    template <typename T>
+    bool has(Entity entity) const {
+        Location location = locationOf(entity);
+        return archetypes[location.archetype]->columns[componentId<T>()] >= 0;
+    }
+
+    /**
+     * The component T of entity.
+     *
+     * @throws std::out_of_range if entity isn't an entity or doesn't have T
+     */
+    template <typename T>
+    T & get(Entity entity) {
+        Location location = locationOf(entity);
+        Archetype & archetype = *archetypes[location.archetype];
+        int column = archetype.columns[componentId<T>()];
+        if (column < 0)
+            throw std::out_of_range("The entity doesn't have the component");
+        return *static_cast<T *>(archetype.component(column, location.row));
+    }
+
+    template <typename T>
+    const T & get(Entity entity) const {
+        return const_cast<World *>(this)->get<T>(entity);
+    }
+
+    /**
+     * Add component to entity, moving it to the archetype with T, or
+     * replace the one it has.
+     *
+     * @throws std::out_of_range if entity isn't an entity
+     */
+    template <typename T>
+    T & add(Entity entity, T component) {
+        if (has<T>(entity))
+            return get<T>(entity) = std::move(component);
+
+        size_t id = componentId<T>();
+        Location location = move(entity, ComponentMask(1) << id);
+        Archetype & archetype = *archetypes[location.archetype];
+        return *new (archetype.component(archetype.columns[id], location.row))
+            T(std::move(component));
+    }
+
+    /**
+     * Remove the component T of entity, if it has one.
+     *
+     * @throws std::out_of_range if entity isn't an entity
+     */
+    template <typename T>
+    void remove(Entity entity) {
+        if (has<T>(entity))
+            move(entity, ComponentMask(1) << componentId<T>());
+    }
+
+    /**
+     * Call function(count, Components * ...) for each chunk of the
+     * entities with all of Components, with the arrays of their
+     * components. A const component type gives a const array.
+     */
+    template <typename... Components, typename Function>
+    void eachChunk(Function && function) {
+        ComponentMask required = mask<Components...>();
+        for (auto & archetype : archetypes) {
+            if (!archetype->matches(required))
+                continue;
+            for (size_t c = 0; c < archetype->getChunkCount(); c++)
+                function(archetype->getChunkSize(c),
+                         archetype->template getColumn<Components>(c)...);
+        }
+    }
+
+    /// Call function(Components & ...) for each entity with all of them.
+    template <typename... Components, typename Function>
+    void each(Function && function) {
+        eachChunk<Components...>([&](size_t count, Components *... columns) {
+            for (size_t i = 0; i < count; i++)
+                function(columns[i]...);
+        });
+    }
+
+    /// The entities with all of Components.
+    template <typename... Components>
+    size_t count() const {
+        ComponentMask required = mask<Components...>();
+        size_t total = 0;
+        for (auto & archetype : archetypes) {
+            if (archetype->matches(required))
+                total += archetype->size();
+        }
+        return total;
+    }
+
+    /// Archetypes in creation order, the first has no components.
+    const std::vector<std::unique_ptr<Archetype>> & getArchetypes() const {
+        return archetypes;
+    }
+
+private:
+    // A fixed array, so registering a type doesn't move the infos other
+    // threads read
+    static std::array<ComponentInfo, 64> & components() {
+        static std::array<ComponentInfo, 64> infos;
+        return infos;
+    }
+
+    static size_t registerComponent(const ComponentInfo & componentInfo) {
+        static std::mutex mutex;
+        static size_t count = 0;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count == components().size())
+            throw std::length_error("More than 64 component types");
+        components()[count] = componentInfo;
+        return count++;
+    }
+
+    static const ComponentInfo & info(size_t id) {
+        return components()[id];
+    }
+
+    template <typename T>
+    static void construct(Archetype & archetype, size_t row, T && component) {
+        int column = archetype.columns[componentId<T>()];
+        new (archetype.component(column, row)) T(std::move(component));
+    }
+
+    Location locationOf(Entity entity) const {
+        if (!contains(entity))
+            throw std::out_of_range("Not an entity of the world");
+        return locations[entity];
+    }
+
+    uint32_t archetypeOf(ComponentMask componentMask) {
+        auto found = archetypeIndex.find(componentMask);
+        if (found != archetypeIndex.end())
+            return found->second;
+        archetypes.emplace_back(new Archetype(componentMask));
+        uint32_t index = uint32_t(archetypes.size() - 1);
+        archetypeIndex.emplace(componentMask, index);
+        return index;
+    }
+
+    void removeRow(Archetype & archetype, size_t row) {
+        Entity moved = archetype.popRow(row);
+        if (moved != none)
+            locations[moved].row = uint32_t(row);
+    }
+
+    /**
+     * Move entity to the archetype with the components of toggle toggled,
+     * moving the components both have and destroying the ones it loses.
+     * Added components are left unconstructed.
+     */
+    Location move(Entity entity, ComponentMask toggle) {
+        Location from = locationOf(entity);
+        Location to;
+        to.archetype =
+            archetypeOf(archetypes[from.archetype]->componentMask ^ toggle);
+        // archetypeOf may have grown the vector, look the archetypes up
+        // after it
+        Archetype & source = *archetypes[from.archetype];
+        Archetype & target = *archetypes[to.archetype];
+        to.row = uint32_t(target.pushRow(entity));
+
+        for (size_t column = 0; column < source.ids.size(); column++) {
+            size_t id = source.ids[column];
+            void * component = source.component(column, from.row);
+            if (target.columns[id] >= 0)
+                info(id).moveTo(target.component(target.columns[id], to.row),
+                                component);
+            else
+                info(id).destroy(component);
+        }
+        removeRow(source, from.row);
+        locations[entity] = to;
+        return to;
+    }
+};
@@ -0,0 +1,156 @@
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Atlas.hpp>
+
+namespace {
+
+struct Rect {
+    glm::uvec2 pos;
+    glm::uvec2 size;
+
+    bool overlaps(const Rect & other) const {
+        return pos.x < other.pos.x + other.size.x
+               && other.pos.x < pos.x + size.x
+               && pos.y < other.pos.y + other.size.y
+               && other.pos.y < pos.y + size.y;
+    }
+};
+
+/// Insert rectangles of random sizes until one doesn't fit.
+std::vector<Rect> packRandom(AtlasPacker & packer, unsigned seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<unsigned> side(1, 40);
+    std::vector<Rect> rects;
+    while (true) {
+        Rect rect {glm::uvec2(0), glm::uvec2(side(random), side(random))};
+        if (!packer.insert(rect.size, rect.pos))
+            return rects;
+        rects.push_back(rect);
+    }
+}
+
+/// A size.x by size.y image with n components, each byte set to value.
+std::vector<unsigned char> solidImage(const glm::uvec2 & size,
+                                      size_t n,
+                                      unsigned char value) {
+    return std::vector<unsigned char>(size.x * size.y * n, value);
+}
+
+} // namespace
+
+TEST(AtlasPacker, FirstAtOrigin) {
+    AtlasPacker packer(glm::uvec2(64, 32));
+    glm::uvec2 pos(1);
+    ASSERT_TRUE(packer.insert(glm::uvec2(10, 20), pos));
+    EXPECT_EQ(pos, glm::uvec2(0, 0));
+    // Lowest spot next, beside the first rather than on top of it
+    ASSERT_TRUE(packer.insert(glm::uvec2(10, 5), pos));
+    EXPECT_EQ(pos, glm::uvec2(10, 0));
+}
+
+TEST(AtlasPacker, ExactFitThenFull) {
+    AtlasPacker packer(glm::uvec2(32, 32));
+    glm::uvec2 pos;
+    for (int i = 0; i < 4; i++)
+        ASSERT_TRUE(packer.insert(glm::uvec2(16, 16), pos));
+    EXPECT_FALSE(packer.insert(glm::uvec2(1, 1), pos));
+    EXPECT_FALSE(AtlasPacker(glm::uvec2(8, 8)).insert(glm::uvec2(9, 1), pos));
+
+    packer.clear();
+    ASSERT_TRUE(packer.insert(glm::uvec2(32, 32), pos));
+    EXPECT_EQ(pos, glm::uvec2(0, 0));
+}
+
+/// Random rectangles stay inside the atlas, don't overlap and fill most of
+/// it before one doesn't fit.
+TEST(AtlasPacker, RandomNoOverlap) {
+    for (unsigned seed = 1; seed <= 5; seed++) {
+        SCOPED_TRACE("seed " + std::to_string(seed));
+        AtlasPacker packer(glm::uvec2(256, 200));
+        std::vector<Rect> rects = packRandom(packer, seed);
+        size_t area = 0;
+        for (size_t i = 0; i < rects.size(); i++) {
+            ASSERT_LE(rects[i].pos.x + rects[i].size.x, 256u);
+            ASSERT_LE(rects[i].pos.y + rects[i].size.y, 200u);
+            for (size_t j = 0; j < i; j++)
+                ASSERT_FALSE(rects[i].overlaps(rects[j]))
+                    << "rects " << j << " and " << i;
+            area += rects[i].size.x * rects[i].size.y;
+        }
+        EXPECT_GT(area, 256u * 200 / 2);
+    }
+}
+
+/// Regions are aligned, padded apart and their UVs cover the image.
+TEST(TextureAtlas, InsertRegions) {
+    TextureAtlas atlas(glm::uvec2(128, 64), 2, 4);
+    auto gray = solidImage(glm::uvec2(10, 7), 1, 50);
+    auto rgb = solidImage(glm::uvec2(5, 9), 3, 100);
+    auto rgba = solidImage(glm::uvec2(20, 20), 4, 150);
+    atlas.insert("gray", gray.data(), glm::uvec2(10, 7), 1);
+    atlas.insert("rgb", rgb.data(), glm::uvec2(5, 9), 3);
+    atlas.insert("rgba", rgba.data(), glm::uvec2(20, 20), 4);
+    atlas.generateMipmaps();
+
+    std::vector<Rect> padded;
+    for (auto & entry : atlas.getRegions()) {
+        const TextureAtlas::Region & region = entry.second;
+        SCOPED_TRACE(entry.first);
+        EXPECT_EQ((region.pos.x - 2) % 4, 0u);
+        EXPECT_EQ((region.pos.y - 2) % 4, 0u);
+        EXPECT_EQ(region.uvMin, glm::vec2(region.pos) / glm::vec2(128, 64));
+        EXPECT_EQ(region.uvMax,
+                  glm::vec2(region.pos + region.size) / glm::vec2(128, 64));
+        EXPECT_EQ(region.remap(glm::vec2(0)), region.uvMin);
+        EXPECT_EQ(region.remap(glm::vec2(1)), region.uvMax);
+        padded.push_back({region.pos - 2u, region.size + 4u});
+    }
+    EXPECT_EQ(atlas.get("rgb").size, glm::uvec2(5, 9));
+    for (size_t i = 0; i < padded.size(); i++) {
+        for (size_t j = 0; j < i; j++)
+            EXPECT_FALSE(padded[i].overlaps(padded[j]));
+    }
+
+    float uvs[] = {0, 0, 0.5f, 1};
+    atlas.remapUVs("gray", uvs, 2);
+    const TextureAtlas::Region & region = atlas.get("gray");
+    EXPECT_EQ(glm::vec2(uvs[0], uvs[1]), region.uvMin);
+    EXPECT_EQ(glm::vec2(uvs[2], uvs[3]), region.remap(glm::vec2(0.5f, 1)));
+}
+
+TEST(TextureAtlas, Errors) {
+    TextureAtlas atlas(glm::uvec2(32, 32), 2, 4, false);
+    auto image = solidImage(glm::uvec2(20, 20), 4, 0);
+    atlas.insert("a", image.data(), glm::uvec2(20, 20), 4);
+    EXPECT_THROW(atlas.insert("a", image.data(), glm::uvec2(1, 1), 4),
+                 TextureAtlas::AtlasException);
+    EXPECT_THROW(atlas.insert("b", image.data(), glm::uvec2(20, 20), 4),
+                 TextureAtlas::AtlasException);
+    EXPECT_THROW(atlas.insert("c", image.data(), glm::uvec2(0, 4), 4),
+                 TextureAtlas::AtlasException);
+    EXPECT_THROW(atlas.insert("d", image.data(), glm::uvec2(1, 1), 2),
+                 Texture::TextureLoadException);
+    EXPECT_THROW(atlas.get("b"), TextureAtlas::AtlasException);
+    EXPECT_TRUE(atlas.contains("a"));
+    EXPECT_FALSE(atlas.contains("b"));
+}
+
+/// build packs the tallest image first, at the origin.
+TEST(TextureAtlas, BuildTallestFirst) {
+    auto small = solidImage(glm::uvec2(16, 16), 4, 0);
+    auto tall = solidImage(glm::uvec2(16, 32), 4, 0);
+    std::vector<TextureAtlas::Image> images = {
+        {"small0", small.data(), glm::uvec2(16, 16), 4},
+        {"tall", tall.data(), glm::uvec2(16, 32), 4},
+        {"small1", small.data(), glm::uvec2(16, 16), 4},
+    };
+    TextureAtlas atlas = TextureAtlas::build(images, glm::uvec2(32, 32), 0, 1);
+    EXPECT_EQ(atlas.get("tall").pos, glm::uvec2(0, 0));
+    EXPECT_EQ(atlas.getRegions().size(), 3u);
+}
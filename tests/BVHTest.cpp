@@ -0,0 +1,174 @@
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include <BVH.hpp>
+#include <Bounds.hpp>
+#include <Frustum.hpp>
+#include <JobSystem.hpp>
+
+namespace {
+
+/// count boxes of 0.5 to 4 units a side scattered over a 200 unit cube.
+std::vector<AABB> randomBoxes(size_t count) {
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> position(-100, 100), extent(0.25f, 2);
+    std::vector<AABB> boxes;
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 extents(extent(random), extent(random), extent(random));
+        boxes.emplace_back(center - extents, center + extents);
+    }
+    return boxes;
+}
+
+/// A 60 degree camera at the origin looking along direction, seeing about
+/// a tenth of randomBoxes().
+Frustum cameraFrustum(const glm::vec3 & direction) {
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9,
+                                            0.1f, 150.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0), direction, glm::vec3(0, 1, 0));
+    return Frustum::fromMatrix(projection * view);
+}
+
+std::vector<uint32_t> sorted(std::vector<uint32_t> objects) {
+    std::sort(objects.begin(), objects.end());
+    return objects;
+}
+
+/**
+ * 20 random frustum, box and ray queries of bvh against testing each of
+ * the objects below count that it contains.
+ */
+void expectQueriesMatch(const BVH & bvh,
+                        uint32_t count,
+                        std::mt19937 & random) {
+    std::uniform_real_distribution<float> unit(-1, 1);
+    for (int q = 0; q < 20; q++) {
+        SCOPED_TRACE("query " + std::to_string(q));
+        glm::vec3 point(unit(random), unit(random), unit(random));
+        glm::vec3 direction(unit(random), unit(random), unit(random));
+        point *= 100.0f;
+        Frustum frustum = cameraFrustum(direction);
+        AABB box(point - glm::vec3(8), point + glm::vec3(8));
+
+        std::vector<uint32_t> inFrustum, inBox, expectedFrustum, expectedBox;
+        BVH::Hit expectedHit;
+        glm::vec3 inverse(1 / direction.x, 1 / direction.y, 1 / direction.z);
+        for (uint32_t object = 0; object < count; object++) {
+            if (!bvh.contains(object))
+                continue;
+            const AABB & bounds = bvh.getBounds(object);
+            if (frustum.intersects(bounds))
+                expectedFrustum.push_back(object);
+            if (bounds.overlaps(box))
+                expectedBox.push_back(object);
+            float distance;
+            if (BVH::intersect(bounds, point, inverse, expectedHit.distance,
+                               distance)) {
+                expectedHit.object = object;
+                expectedHit.distance = distance;
+            }
+        }
+        bvh.query(frustum, [&](uint32_t o) { inFrustum.push_back(o); });
+        bvh.query(box, [&](uint32_t o) { inBox.push_back(o); });
+        BVH::Hit hit;
+        bvh.raycast(point, direction, hit);
+
+        EXPECT_EQ(sorted(inFrustum), expectedFrustum);
+        EXPECT_EQ(sorted(inBox), expectedBox);
+        EXPECT_EQ(hit.distance, expectedHit.distance);
+    }
+}
+
+} // namespace
+
+/**
+ * Queries after a build, after moves, removes and inserts and a refit,
+ * and after a rebuild on a worker.
+ */
+TEST(BVH, QueriesMatchTestingEachObject) {
+    std::vector<AABB> boxes = randomBoxes(5000);
+    BVH bvh;
+    for (auto & box : boxes)
+        bvh.insert(box);
+    bvh.rebuild();
+    // The ids so far, removed ones are reused first
+    uint32_t objects = uint32_t(boxes.size());
+
+    std::mt19937 random(13);
+    std::uniform_real_distribution<float> unit(-1, 1);
+    {
+        SCOPED_TRACE("after a build");
+        expectQueriesMatch(bvh, objects, random);
+    }
+
+    for (uint32_t object = 0; object < boxes.size(); object += 3) {
+        glm::vec3 move(unit(random), unit(random), unit(random));
+        move *= 10.0f;
+        bvh.update(object, AABB(boxes[object].min + move,
+                                boxes[object].max + move));
+    }
+    for (uint32_t object = 1; object < boxes.size(); object += 7)
+        bvh.remove(object);
+    for (auto & box : randomBoxes(1000))
+        objects = std::max(objects, bvh.insert(box) + 1);
+    bvh.refit();
+    EXPECT_NE(bvh.getPendingCount(), 0u);
+    {
+        SCOPED_TRACE("after a refit");
+        expectQueriesMatch(bvh, objects, random);
+    }
+
+    JobSystem jobs(4);
+    bvh.startRebuild(jobs);
+    bvh.finishRebuild(true);
+    EXPECT_EQ(bvh.getPendingCount(), 0u);
+    {
+        SCOPED_TRACE("after a rebuild");
+        expectQueriesMatch(bvh, objects, random);
+    }
+}
+
+/// Removed objects and the ones reusing their ids, before any refit.
+TEST(BVH, RemoveAndReuseWithoutRefit) {
+    std::vector<AABB> boxes = randomBoxes(5000);
+    BVH bvh;
+    for (auto & box : boxes)
+        bvh.insert(box);
+    bvh.rebuild();
+    uint32_t objects = uint32_t(boxes.size());
+    std::mt19937 random(17);
+
+    for (uint32_t object = 1; object < boxes.size(); object += 7)
+        bvh.remove(object);
+    {
+        SCOPED_TRACE("after removes");
+        expectQueriesMatch(bvh, objects, random);
+    }
+
+    // Fewer than were removed, each takes over a removed object's leaf at
+    // another place
+    size_t removed = objects - bvh.size();
+    for (auto & box : randomBoxes(removed / 2)) {
+        glm::vec3 move(50, -30, 20);
+        ASSERT_LT(bvh.insert(AABB(box.min + move, box.max + move)), objects);
+    }
+    EXPECT_EQ(bvh.getPendingCount(), 0u);
+    {
+        SCOPED_TRACE("after inserts");
+        expectQueriesMatch(bvh, objects, random);
+    }
+
+    bvh.refit();
+    {
+        SCOPED_TRACE("after a refit");
+        expectQueriesMatch(bvh, objects, random);
+    }
+}
@@ -0,0 +1,119 @@
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Bounds.hpp>
+#include <BoundsBuffer.hpp>
+#include <Frustum.hpp>
+#include <JobSystem.hpp>
+#include <RenderQueue.hpp>
+#include <Transform.hpp>
+#include <World.hpp>
+
+namespace {
+
+/// count boxes of 0.5 to 4 units a side scattered over a 200 unit cube.
+std::vector<AABB> randomBoxes(size_t count) {
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> position(-100, 100), extent(0.25f, 2);
+    std::vector<AABB> boxes;
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 extents(extent(random), extent(random), extent(random));
+        boxes.emplace_back(center - extents, center + extents);
+    }
+    return boxes;
+}
+
+/// The boxes, every other one as its bounding sphere.
+BoundsBuffer boundsOf(const std::vector<AABB> & boxes) {
+    BoundsBuffer buffer;
+    buffer.reserve(boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++) {
+        if (i % 2)
+            buffer.add(Sphere::fromAABB(boxes[i]));
+        else
+            buffer.add(boxes[i]);
+    }
+    return buffer;
+}
+
+/// A 60 degree camera at the origin looking along direction, seeing about
+/// a tenth of randomBoxes().
+Frustum cameraFrustum(const glm::vec3 & direction) {
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9,
+                                            0.1f, 150.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0), direction, glm::vec3(0, 1, 0));
+    return Frustum::fromMatrix(projection * view);
+}
+
+} // namespace
+
+/**
+ * Each kernel and the parallel cull against Frustum::intersects, for boxes
+ * and spheres and an empty box.
+ */
+TEST(BoundsBuffer, CullMatchesFrustum) {
+    std::vector<AABB> boxes = randomBoxes(3 * BoundsBuffer::blockSize + 13);
+    boxes[4] = AABB();
+    BoundsBuffer buffer = boundsOf(boxes);
+    JobSystem jobs(4);
+
+    const glm::vec3 directions[] = {
+        {0, 0, -1}, {1, 0.2f, 0}, {-0.3f, -0.5f, 0.8f}};
+    for (auto & direction : directions) {
+        Frustum frustum = cameraFrustum(direction);
+        std::vector<uint32_t> expected;
+        for (size_t i = 0; i < boxes.size(); i++) {
+            bool inside = i % 2 ? frustum.intersects(Sphere::fromAABB(boxes[i]))
+                                : frustum.intersects(boxes[i]);
+            if (inside)
+                expected.push_back(uint32_t(i));
+        }
+        ASSERT_FALSE(expected.empty()) << "the frustum sees nothing";
+
+        std::vector<uint32_t> visible;
+        for (int k = BoundsBuffer::Scalar; k <= BoundsBuffer::AVX2; k++) {
+            auto kernel = BoundsBuffer::Kernel(k);
+            if (!BoundsBuffer::supported(kernel))
+                continue;
+            SCOPED_TRACE("kernel " + std::to_string(k));
+            BoundsBuffer::Stats stats = buffer.cull(frustum, visible, kernel);
+            EXPECT_EQ(visible, expected);
+            EXPECT_EQ(stats.visible, expected.size());
+            EXPECT_EQ(stats.culled(), boxes.size() - expected.size());
+        }
+        BoundsBuffer::Stats stats = buffer.cull(frustum, visible, jobs);
+        EXPECT_EQ(visible, expected) << "parallel cull";
+        EXPECT_EQ(stats.visible, expected.size()) << "parallel cull";
+    }
+}
+
+/// RenderQueue drops the entities whose Bounds are outside its frustum.
+TEST(BoundsBuffer, RenderQueueCullsOutside) {
+    // Unit boxes along x from 0 to 999, half of them right of the frustum
+    World world;
+    for (size_t i = 0; i < 1000; i++) {
+        Transform transform(glm::vec3(float(i), 0, 0), glm::quat(),
+                            glm::vec3(1));
+        Bounds bounds(AABB(glm::vec3(-0.5f), glm::vec3(0.5f)));
+        bounds.update(transform.toMatrix());
+        world.create(transform, Mesh(), Material(), bounds);
+    }
+    Frustum frustum = Frustum::fromMatrix(glm::ortho(0.0f, 500.0f, -1.0f,
+                                                     1.0f, -1.0f, 1.0f));
+    JobSystem jobs(4);
+    RenderQueue queue;
+    queue.collect(world, jobs, &frustum);
+    queue.sort();
+    EXPECT_EQ(queue.getCulledCount(), 499u);
+    EXPECT_EQ(queue.getMatrices().size(), 501u);
+    for (auto & matrix : queue.getMatrices())
+        EXPECT_LE(matrix[3].x, 500);
+}
@@ -0,0 +1,83 @@
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <CaptureFormat.hpp>
+
+namespace {
+
+/**
+ * Write frames payloads of 3000 bytes, each frame the same shared one and
+ * one that changes, then read the capture back and check each BufferData
+ * record gets the bytes it was given.
+ */
+void roundTrip(std::iostream & stream) {
+    const int frames = 20;
+    std::vector<unsigned char> shared(3000, 7);
+    std::vector<std::vector<unsigned char>> changing;
+    CaptureWriter writer(stream, 640, 480);
+    for (int frame = 0; frame < frames; frame++) {
+        changing.emplace_back(3000, 0);
+        changing.back()[frame * 100] = 1;
+        uint32_t a = writer.payload(shared.data(), shared.size());
+        uint32_t b = writer.payload(changing.back().data(), 3000);
+        writer.record(CaptureFormat::BufferData, {3000}, {a});
+        writer.record(CaptureFormat::BufferData, {3000}, {b});
+        writer.record(CaptureFormat::EndFrame, {});
+    }
+    EXPECT_EQ(writer.getPayloadBytes(), 3000u * (frames + 1));
+    EXPECT_EQ(writer.getDedupedBytes(), 3000u * (frames - 1));
+
+    stream.seekg(0);
+    CaptureReader reader(stream);
+    EXPECT_EQ(reader.getWidth(), 640u);
+    EXPECT_EQ(reader.getHeight(), 480u);
+    CaptureFormat::Record record;
+    for (int frame = 0; frame < frames; frame++) {
+        for (auto * expected : {&shared, &changing[frame]}) {
+            ASSERT_TRUE(reader.next(record));
+            ASSERT_EQ(record.op, CaptureFormat::BufferData);
+            ASSERT_EQ(record.payloads.size(), 1u);
+            const unsigned char * data = reader.getPayload(record.payloads[0]);
+            ASSERT_EQ(std::vector<unsigned char>(data, data + 3000),
+                      *expected)
+                << "frame " << frame;
+        }
+        ASSERT_TRUE(reader.next(record));
+        ASSERT_EQ(record.op, CaptureFormat::EndFrame);
+    }
+    EXPECT_FALSE(reader.next(record));
+}
+
+} // namespace
+
+TEST(CaptureFormat, RoundTripInMemory) {
+    std::stringstream stream(std::ios::in | std::ios::out | std::ios::binary);
+    roundTrip(stream);
+}
+
+/// A file stream switches between writing and reading back payloads.
+TEST(CaptureFormat, RoundTripInFile) {
+    std::string path = testing::TempDir() + "capture_format_test.glcap";
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::trunc
+                                    | std::ios::binary);
+        ASSERT_TRUE(file);
+        roundTrip(file);
+    }
+    std::remove(path.c_str());
+}
+
+TEST(CaptureFormat, NullPayload) {
+    std::stringstream stream;
+    CaptureWriter writer(stream, 1, 1);
+    EXPECT_EQ(writer.payload(nullptr, 16), 0u);
+}
+
+TEST(CaptureFormat, RejectsOtherFiles) {
+    std::stringstream stream("not a capture at all");
+    EXPECT_THROW(CaptureReader reader(stream), std::runtime_error);
+}
@@ -0,0 +1,359 @@
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include <CompressedTexture.hpp>
+#include <Texture.hpp>
+
+namespace {
+
+using Bytes = std::vector<unsigned char>;
+
+void write32(Bytes & data, size_t offset, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        data[offset + i] = (value >> (i * 8)) & 0xFF;
+}
+
+void write64(Bytes & data, size_t offset, uint64_t value) {
+    write32(data, offset, uint32_t(value));
+    write32(data, offset + 4, uint32_t(value >> 32));
+}
+
+/// The RGBA pixel at index i of decoded pixels.
+glm::uvec4 pixel(const Bytes & pixels, size_t i) {
+    return glm::uvec4(pixels[i * 4], pixels[i * 4 + 1], pixels[i * 4 + 2],
+                      pixels[i * 4 + 3]);
+}
+
+Bytes decodeBlock(Texture::Format format, const Bytes & block) {
+    return BlockDecoder::decode(format, glm::uvec2(4), block.data());
+}
+
+/**
+ * A DDS header for a width by height image with mips levels, followed by
+ * payload bytes counting up from 0. A DX10 fourCC adds its extension
+ * header with dxgiFormat and arraySize.
+ */
+Bytes ddsFile(const char * fourCC,
+              glm::uvec2 size,
+              uint32_t mips,
+              size_t payload,
+              uint32_t dxgiFormat = 0,
+              uint32_t arraySize = 1) {
+    bool dx10 = std::string(fourCC) == "DX10";
+    Bytes data(dx10 ? 148 : 128, 0);
+    std::memcpy(data.data(), "DDS ", 4);
+    write32(data, 4, 124);
+    write32(data, 12, size.y);
+    write32(data, 16, size.x);
+    write32(data, 28, mips);
+    std::memcpy(&data[84], fourCC, 4);
+    if (dx10) {
+        write32(data, 128, dxgiFormat);
+        write32(data, 132, 3); // Texture 2D
+        write32(data, 140, arraySize);
+    }
+    for (size_t i = 0; i < payload; i++)
+        data.push_back(i & 0xFF);
+    return data;
+}
+
+/**
+ * A KTX2 file of a width by height image of vkFormat, with a level index
+ * entry for each of levels and their bytes after it, counting up from 0.
+ */
+Bytes ktx2File(uint32_t vkFormat,
+               glm::uvec2 size,
+               const std::vector<size_t> & levels) {
+    static const unsigned char magic[12] = {
+        0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A,
+    };
+    Bytes data(80 + levels.size() * 24, 0);
+    std::memcpy(data.data(), magic, 12);
+    write32(data, 12, vkFormat);
+    write32(data, 16, 1);
+    write32(data, 20, size.x);
+    write32(data, 24, size.y);
+    write32(data, 36, 1); // Faces
+    write32(data, 40, levels.size());
+    for (size_t l = 0; l < levels.size(); l++) {
+        write64(data, 80 + l * 24, data.size());
+        write64(data, 80 + l * 24 + 8, levels[l]);
+        write64(data, 80 + l * 24 + 16, levels[l]);
+        size_t start = data.size();
+        for (size_t i = 0; i < levels[l]; i++)
+            data.push_back((start + i) & 0xFF);
+    }
+    return data;
+}
+
+} // namespace
+
+/// Red and blue endpoints with the two colors between, c0 > c1.
+TEST(BlockDecoder, BC1FourColors) {
+    Bytes block = {0x00, 0xF8, 0x1F, 0x00, 0xE4, 0x00, 0x00, 0x00};
+    Bytes pixels = decodeBlock(Texture::BC1, block);
+    EXPECT_EQ(pixel(pixels, 0), glm::uvec4(255, 0, 0, 255));
+    EXPECT_EQ(pixel(pixels, 1), glm::uvec4(0, 0, 255, 255));
+    EXPECT_EQ(pixel(pixels, 2), glm::uvec4(170, 0, 85, 255));
+    EXPECT_EQ(pixel(pixels, 3), glm::uvec4(85, 0, 170, 255));
+    for (size_t i = 4; i < 16; i++)
+        EXPECT_EQ(pixel(pixels, i), glm::uvec4(255, 0, 0, 255));
+}
+
+/// c0 <= c1 gives the midpoint and transparent black.
+TEST(BlockDecoder, BC1ThreeColors) {
+    Bytes block = {0x1F, 0x00, 0x00, 0xF8, 0xE4, 0x00, 0x00, 0x00};
+    Bytes pixels = decodeBlock(Texture::BC1SRGB, block);
+    EXPECT_EQ(pixel(pixels, 0), glm::uvec4(0, 0, 255, 255));
+    EXPECT_EQ(pixel(pixels, 1), glm::uvec4(255, 0, 0, 255));
+    EXPECT_EQ(pixel(pixels, 2), glm::uvec4(127, 0, 127, 255));
+    EXPECT_EQ(pixel(pixels, 3), glm::uvec4(0, 0, 0, 0));
+}
+
+/// Explicit 4 bit alpha, and always four colors whatever the endpoints.
+TEST(BlockDecoder, BC2) {
+    Bytes block = {0xF0, 0x18, 0, 0, 0, 0, 0, 0, //
+                   0x00, 0x00, 0xFF, 0xFF, 0x02, 0x00, 0x00, 0x00};
+    Bytes pixels = decodeBlock(Texture::BC2, block);
+    EXPECT_EQ(pixel(pixels, 0), glm::uvec4(85, 85, 85, 0));
+    EXPECT_EQ(pixel(pixels, 1), glm::uvec4(0, 0, 0, 255));
+    EXPECT_EQ(pixel(pixels, 2).w, 136u);
+    EXPECT_EQ(pixel(pixels, 3).w, 17u);
+    EXPECT_EQ(pixel(pixels, 15).w, 0u);
+}
+
+/// Interpolated alpha, 8 values when a0 > a1 and 6 plus 0 and 255 when not.
+TEST(BlockDecoder, BC3) {
+    Bytes block = {255, 0, 0x3A, 0, 0, 0, 0, 0, //
+                   0xE0, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    Bytes pixels = decodeBlock(Texture::BC3, block);
+    EXPECT_EQ(pixel(pixels, 0), glm::uvec4(0, 255, 0, 218));
+    EXPECT_EQ(pixel(pixels, 1).w, 36u);
+    EXPECT_EQ(pixel(pixels, 2).w, 255u);
+
+    // Indices 2, 6 and 7
+    block[0] = 0;
+    block[1] = 255;
+    block[2] = 0xF2;
+    block[3] = 0x01;
+    pixels = decodeBlock(Texture::BC3SRGB, block);
+    EXPECT_EQ(pixel(pixels, 0).w, 51u);
+    EXPECT_EQ(pixel(pixels, 1).w, 0u);
+    EXPECT_EQ(pixel(pixels, 2).w, 255u);
+    EXPECT_EQ(pixel(pixels, 3).w, 0u);
+}
+
+TEST(BlockDecoder, BC4) {
+    Bytes block = {200, 100, 0x02, 0, 0, 0, 0, 0};
+    Bytes pixels = decodeBlock(Texture::BC4, block);
+    EXPECT_EQ(pixel(pixels, 0), glm::uvec4(185, 0, 0, 255));
+    for (size_t i = 1; i < 16; i++)
+        EXPECT_EQ(pixel(pixels, i), glm::uvec4(200, 0, 0, 255));
+}
+
+/// Two BC4 blocks, red then green.
+TEST(BlockDecoder, BC5) {
+    Bytes block = {200, 100, 0x02, 0, 0, 0, 0, 0, //
+                   10, 20, 0x37, 0, 0, 0, 0, 0};
+    Bytes pixels = decodeBlock(Texture::BC5, block);
+    EXPECT_EQ(pixel(pixels, 0), glm::uvec4(185, 255, 0, 255));
+    EXPECT_EQ(pixel(pixels, 1), glm::uvec4(200, 0, 0, 255));
+    EXPECT_EQ(pixel(pixels, 2), glm::uvec4(200, 10, 0, 255));
+}
+
+/// An image that ends inside its blocks keeps only the pixels inside it.
+TEST(BlockDecoder, PartialBlocks) {
+    Bytes blocks = {0x00, 0xF8, 0x00, 0x00, 0, 0, 0, 0, //
+                    0x1F, 0x00, 0x00, 0x00, 0, 0, 0, 0};
+    Bytes pixels =
+        BlockDecoder::decode(Texture::BC1, glm::uvec2(5, 3), blocks.data());
+    ASSERT_EQ(pixels.size(), 5u * 3 * 4);
+    for (size_t y = 0; y < 3; y++) {
+        for (size_t x = 0; x < 5; x++) {
+            glm::uvec4 expected = x < 4 ? glm::uvec4(255, 0, 0, 255)
+                                        : glm::uvec4(0, 0, 255, 255);
+            EXPECT_EQ(pixel(pixels, y * 5 + x), expected);
+        }
+    }
+}
+
+TEST(BlockDecoder, NoBPTCDecoder) {
+    Bytes block(16, 0);
+    EXPECT_THROW(decodeBlock(Texture::BC6H, block),
+                 Texture::TextureLoadException);
+    EXPECT_THROW(decodeBlock(Texture::BC7, block),
+                 Texture::TextureLoadException);
+}
+
+/// Each mip level takes its size of bytes in order, at least one block.
+TEST(CompressedImage, DDSLevels) {
+    Bytes file = ddsFile("DXT5", glm::uvec2(16, 8), 5, 128 + 32 + 16 + 16 + 16);
+    CompressedImage image = CompressedImage::fromDDS(file);
+    EXPECT_EQ(image.format, Texture::BC3);
+    EXPECT_EQ(image.size, glm::uvec2(16, 8));
+    ASSERT_EQ(image.levels.size(), 5u);
+    std::vector<size_t> sizes = {128, 32, 16, 16, 16};
+    size_t offset = 0;
+    for (size_t l = 0; l < sizes.size(); l++) {
+        ASSERT_EQ(image.levels[l].size(), sizes[l]);
+        EXPECT_EQ(image.levels[l][0], offset & 0xFF);
+        offset += sizes[l];
+    }
+
+    // No mip count is one level
+    image = CompressedImage::fromDDS(ddsFile("DXT1", glm::uvec2(4), 0, 8));
+    EXPECT_EQ(image.format, Texture::BC1);
+    EXPECT_EQ(image.levels.size(), 1u);
+
+    image = CompressedImage::fromDDS(
+        ddsFile("DX10", glm::uvec2(4), 1, 16, 99));
+    EXPECT_EQ(image.format, Texture::BC7SRGB);
+    ASSERT_EQ(image.levels.size(), 1u);
+    EXPECT_EQ(image.levels[0].size(), 16u);
+}
+
+TEST(CompressedImage, DDSFourCCs) {
+    std::vector<std::pair<const char *, Texture::Format>> formats = {
+        {"DXT1", Texture::BC1}, {"DXT3", Texture::BC2},
+        {"DXT5", Texture::BC3}, {"ATI1", Texture::BC4},
+        {"BC4U", Texture::BC4}, {"ATI2", Texture::BC5},
+        {"BC5U", Texture::BC5},
+    };
+    for (auto & format : formats) {
+        Bytes file = ddsFile(format.first, glm::uvec2(4), 1, 16);
+        EXPECT_EQ(CompressedImage::fromDDS(file).format, format.second)
+            << format.first;
+    }
+}
+
+TEST(CompressedImage, DDSErrors) {
+    Bytes file = ddsFile("DXT1", glm::uvec2(8), 2, 32 + 8);
+    // Truncated in the last level, the header, or the DX10 header
+    file.pop_back();
+    EXPECT_THROW(CompressedImage::fromDDS(file), Texture::TextureLoadException);
+    file.resize(100);
+    EXPECT_THROW(CompressedImage::fromDDS(file), Texture::TextureLoadException);
+    file = ddsFile("DX10", glm::uvec2(4), 1, 0, 71);
+    file.resize(140);
+    EXPECT_THROW(CompressedImage::fromDDS(file), Texture::TextureLoadException);
+
+    // A huge size can't wrap the level size past the check
+    file = ddsFile("DXT1", glm::uvec2(0xFFFFFFFF), 1, 64);
+    EXPECT_THROW(CompressedImage::fromDDS(file), Texture::TextureLoadException);
+
+    file = ddsFile("ABCD", glm::uvec2(4), 1, 16);
+    EXPECT_THROW(CompressedImage::fromDDS(file), Texture::TextureLoadException);
+    file = ddsFile("DX10", glm::uvec2(4), 1, 16, 2);
+    EXPECT_THROW(CompressedImage::fromDDS(file), Texture::TextureLoadException);
+    file = ddsFile("DX10", glm::uvec2(4), 1, 16, 71, 2);
+    EXPECT_THROW(CompressedImage::fromDDS(file), Texture::TextureLoadException);
+    file = ddsFile("DXT1", glm::uvec2(4), 1, 8);
+    file[0] = 'X';
+    EXPECT_THROW(CompressedImage::fromDDS(file), Texture::TextureLoadException);
+}
+
+TEST(CompressedImage, KTX2Levels) {
+    Bytes file = ktx2File(133, glm::uvec2(8), {32, 8, 8, 8});
+    CompressedImage image = CompressedImage::fromKTX2(file);
+    EXPECT_EQ(image.format, Texture::BC1);
+    EXPECT_EQ(image.size, glm::uvec2(8));
+    ASSERT_EQ(image.levels.size(), 4u);
+    size_t offset = 80 + 4 * 24;
+    for (auto & level : image.levels) {
+        EXPECT_EQ(level[0], offset & 0xFF);
+        offset += level.size();
+    }
+    EXPECT_EQ(image.levels[0].size(), 32u);
+    EXPECT_EQ(image.levels[3].size(), 8u);
+
+    image = CompressedImage::fromKTX2(ktx2File(146, glm::uvec2(4), {16}));
+    EXPECT_EQ(image.format, Texture::BC7SRGB);
+}
+
+TEST(CompressedImage, KTX2Errors) {
+    auto fails = [](const Bytes & file) {
+        EXPECT_THROW(CompressedImage::fromKTX2(file),
+                     Texture::TextureLoadException);
+    };
+    Bytes valid = ktx2File(133, glm::uvec2(8), {32, 8});
+
+    Bytes file = valid;
+    file.resize(79);
+    fails(file);
+    // A level index past the end, also with a count that wraps in 32 bits
+    file = valid;
+    write32(file, 40, 8);
+    fails(file);
+    write32(file, 40, 0xFFFFFFFF);
+    fails(file);
+    // A level past the end, one whose end wraps, and one too small
+    file = valid;
+    file.pop_back();
+    fails(file);
+    file = valid;
+    write64(file, 88, 0xFFFFFFFFFFFFFFF0);
+    fails(file);
+    file = valid;
+    write64(file, 88, 16);
+    fails(file);
+
+    file = valid;
+    write32(file, 36, 6);
+    fails(file);
+    file = valid;
+    write32(file, 32, 2);
+    fails(file);
+    file = valid;
+    write32(file, 44, 1);
+    fails(file);
+    file = valid;
+    write32(file, 12, 37);
+    fails(file);
+    file = valid;
+    file[1] = 0;
+    fails(file);
+}
+
+/// fromPath picks the container from the magic.
+TEST(CompressedImage, FromPath) {
+    std::string path = testing::TempDir() + "compressed_texture_test.bin";
+    auto load = [&](const Bytes & data) {
+        std::ofstream(path, std::ios::binary)
+            .write(reinterpret_cast<const char *>(data.data()), data.size());
+        return CompressedImage::fromPath(path);
+    };
+    EXPECT_EQ(load(ktx2File(139, glm::uvec2(4), {8})).format, Texture::BC4);
+    EXPECT_EQ(load(ddsFile("ATI2", glm::uvec2(4), 1, 16)).format,
+              Texture::BC5);
+    EXPECT_THROW(load(Bytes(200, 7)), Texture::TextureLoadException);
+    std::remove(path.c_str());
+    EXPECT_THROW(CompressedImage::fromPath(path),
+                 Texture::TextureLoadException);
+}
+
+/**
+ * Without S3TC, NullGL has no extensions, the decoded pixels keep the
+ * sRGB formats in an sRGB texture.
+ */
+TEST(CompressedImage, DecodedFallback) {
+    ASSERT_FALSE(Texture::isSupported(Texture::BC1));
+    CompressedImage image;
+    image.size = glm::uvec2(4);
+    image.levels.push_back(Bytes(8, 0));
+    image.format = Texture::BC1;
+    EXPECT_EQ(image.toTexture().getInternal(), Texture::RGBA);
+    image.format = Texture::BC1SRGB;
+    EXPECT_EQ(image.toTexture().getInternal(), Texture::SRGB8A8);
+    image.levels[0].resize(16);
+    image.format = Texture::BC3SRGB;
+    EXPECT_EQ(image.toTexture().getInternal(), Texture::SRGB8A8);
+    image.format = Texture::BC7;
+    EXPECT_THROW(image.toTexture(), Texture::TextureLoadException);
+}
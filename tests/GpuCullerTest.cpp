@@ -0,0 +1,137 @@
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <gtest/gtest.h>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#define STB_IMAGE_IMPLEMENTATION
+#include <Bounds.hpp>
+#include <Frustum.hpp>
+#include <GpuCuller.hpp>
+#include <HeadlessSurface.hpp>
+#include <stb_image.h>
+
+namespace {
+
+/// A 4.3 context, or nullptr where there is none or no compute shaders.
+std::unique_ptr<HeadlessSurface> computeSurface() {
+    std::unique_ptr<HeadlessSurface> surface;
+    try {
+        surface.reset(new HeadlessSurface(glm::uvec2(64), 4, 3));
+    }
+    catch (const std::runtime_error &) {
+        return nullptr;
+    }
+    if (!GpuCuller::supported())
+        return nullptr;
+    return surface;
+}
+
+/// The box grown or shrunk by margin on each side.
+AABB grown(const AABB & box, float margin) {
+    return AABB(box.min - glm::vec3(margin), box.max + glm::vec3(margin));
+}
+
+/**
+ * The commands of culler after a cull with viewProjection against a CPU
+ * Frustum test of each instance. Instances within a rounding error of a
+ * plane may go either way.
+ */
+void expectCommandsMatchFrustum(GpuCuller & culler,
+                                const std::vector<GpuCuller::Mesh> & meshes,
+                                const std::vector<uint32_t> & instanceMeshes,
+                                const glm::mat4 & viewProjection) {
+    culler.cull(viewProjection);
+    std::vector<DrawElementsIndirectCommand> commands = culler.readCommands();
+    ASSERT_EQ(commands.size(), meshes.size());
+
+    Frustum frustum = Frustum::fromMatrix(viewProjection);
+    std::vector<size_t> expected(meshes.size(), 0), unsure(meshes.size(), 0);
+    size_t total = 0;
+    for (uint32_t i = 0; i < instanceMeshes.size(); i++) {
+        uint32_t mesh = instanceMeshes[i];
+        AABB box = meshes[mesh].bounds.transformed(culler.get(i));
+        bool inside = frustum.intersects(box);
+        expected[mesh] += inside;
+        total += inside;
+        if (frustum.intersects(grown(box, 1e-3f))
+            != frustum.intersects(grown(box, -1e-3f)))
+            unsure[mesh]++;
+    }
+    ASSERT_GT(total, 0u) << "the frustum sees nothing";
+    ASSERT_LT(total, instanceMeshes.size()) << "the frustum sees everything";
+
+    size_t visible = 0;
+    for (size_t m = 0; m < meshes.size(); m++) {
+        EXPECT_EQ(commands[m].count, meshes[m].count) << "mesh " << m;
+        EXPECT_EQ(commands[m].firstIndex, meshes[m].firstIndex) << "mesh " << m;
+        EXPECT_EQ(commands[m].baseVertex, meshes[m].baseVertex) << "mesh " << m;
+        EXPECT_NEAR(double(commands[m].instanceCount), double(expected[m]),
+                    double(unsure[m]))
+            << "mesh " << m;
+        visible += commands[m].instanceCount;
+    }
+    EXPECT_EQ(culler.readVisibleCount(), visible);
+}
+
+} // namespace
+
+/**
+ * The instances of each mesh that cull() keeps against a CPU frustum test,
+ * after adding them and after moving some. Skipped without a GL 4.3
+ * context.
+ */
+TEST(GpuCuller, CommandsMatchFrustum) {
+    std::unique_ptr<HeadlessSurface> surface = computeSurface();
+    if (!surface)
+        GTEST_SKIP() << "no context with compute shaders";
+
+    std::vector<GpuCuller::Mesh> meshes = {
+        {36, 0, 0, AABB(glm::vec3(-0.5f), glm::vec3(0.5f))},
+        {18, 36, 8, AABB(glm::vec3(-1, 0, -1), glm::vec3(1, 2, 1))},
+        {6, 54, 13, AABB(glm::vec3(-3, -0.1f, -3), glm::vec3(3, 0.1f, 3))},
+    };
+    GpuCuller culler;
+    for (auto & mesh : meshes)
+        culler.addMesh(mesh);
+
+    // More than a work group, scattered around the camera
+    std::mt19937 random(23);
+    std::uniform_real_distribution<float> position(-60, 60), angle(-3, 3);
+    std::vector<uint32_t> instanceMeshes;
+    auto randomMatrix = [&]() {
+        glm::mat4 model = glm::translate(
+            glm::mat4(1),
+            glm::vec3(position(random), position(random) / 4,
+                      position(random)));
+        return glm::rotate(model, angle(random), glm::vec3(0, 1, 0));
+    };
+    for (size_t i = 0; i < 1000; i++) {
+        uint32_t mesh = uint32_t(random() % meshes.size());
+        culler.add(mesh, randomMatrix());
+        instanceMeshes.push_back(mesh);
+    }
+
+    glm::mat4 projection =
+        glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 50.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 5, 0), glm::vec3(0, 0, -20),
+                                 glm::vec3(0, 1, 0));
+    {
+        SCOPED_TRACE("after adding");
+        expectCommandsMatchFrustum(culler, meshes, instanceMeshes,
+                                   projection * view);
+    }
+
+    for (uint32_t i = 0; i < culler.size(); i += 5)
+        culler.set(i, randomMatrix());
+    view = glm::lookAt(glm::vec3(0, 5, 0), glm::vec3(20, 0, 5),
+                       glm::vec3(0, 1, 0));
+    {
+        SCOPED_TRACE("after moving");
+        expectCommandsMatchFrustum(culler, meshes, instanceMeshes,
+                                   projection * view);
+    }
+}
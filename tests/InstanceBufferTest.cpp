@@ -0,0 +1,109 @@
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <InstanceBuffer.hpp>
+#include <Transform.hpp>
+#include <TransformBuffer.hpp>
+
+namespace {
+
+/// count random transforms, the same ones each call.
+std::vector<Transform> randomTransforms(size_t count) {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-100, 100),
+        angle(-3.14f, 3.14f), scale(0.1f, 10);
+    std::vector<Transform> transforms;
+    for (size_t i = 0; i < count; i++)
+        transforms.emplace_back(
+            glm::vec3(position(random), position(random), position(random)),
+            glm::quat(glm::vec3(angle(random), angle(random), angle(random))),
+            glm::vec3(scale(random), scale(random), scale(random)));
+    return transforms;
+}
+
+/// Where the vertex shader of InstanceBuffer::shaderSource() moves
+/// position to, given the packed floats of its instance.
+glm::vec3 decodeInstance(InstanceBuffer::Packing packing,
+                         const float * in,
+                         const glm::vec3 & position) {
+    glm::vec4 p(position, 1);
+    if (packing == InstanceBuffer::Mat4) {
+        glm::mat4 model;
+        for (int c = 0; c < 4; c++)
+            model[c] = glm::vec4(in[c * 4], in[c * 4 + 1], in[c * 4 + 2],
+                                 in[c * 4 + 3]);
+        return glm::vec3(model * p);
+    }
+    if (packing == InstanceBuffer::Mat3x4) {
+        glm::vec3 out;
+        for (int r = 0; r < 3; r++)
+            out[r] = glm::dot(p, glm::vec4(in[r * 4], in[r * 4 + 1],
+                                           in[r * 4 + 2], in[r * 4 + 3]));
+        return out;
+    }
+    glm::vec3 u(in[0], in[1], in[2]);
+    glm::vec3 v = position * glm::vec3(in[7], in[8], in[9]);
+    v += 2.0f * glm::cross(u, glm::cross(u, v) + in[3] * v);
+    return v + glm::vec3(in[4], in[5], in[6]);
+}
+
+} // namespace
+
+/**
+ * Each packing, decoded like its shader does, against Transform::toMatrix
+ * after a full and a sparse update, and the sparse one packs only what
+ * changed.
+ */
+TEST(InstanceBuffer, PackingsMatchToMatrix) {
+    std::vector<Transform> transforms = randomTransforms(203);
+    const glm::vec3 corner(0.5f, -0.25f, 1);
+    for (int p = InstanceBuffer::Mat4; p <= InstanceBuffer::QuatPosScale;
+         p++) {
+        auto packing = InstanceBuffer::Packing(p);
+        SCOPED_TRACE("packing " + std::to_string(p));
+        size_t n = InstanceBuffer::stride(packing) / sizeof(float);
+        std::vector<Transform> expected = transforms;
+        TransformBuffer buffer;
+        for (auto & transform : expected)
+            buffer.add(transform);
+        InstanceBuffer instances(packing, 4);
+        InstanceBuffer::Stats full = instances.update(buffer);
+
+        // Change every seventh transform and a run in the middle
+        size_t changed = 0;
+        for (size_t i = 0; i < expected.size(); i++) {
+            if (i % 7 != 0 && (i < 100 || i >= 140))
+                continue;
+            expected[i].move(glm::vec3(1, 2, 3));
+            expected[i].rotate(glm::quat(glm::vec3(0.1f, 0.2f, 0.3f)));
+            buffer.move(i, glm::vec3(1, 2, 3));
+            buffer.rotate(i, glm::quat(glm::vec3(0.1f, 0.2f, 0.3f)));
+            changed++;
+        }
+        InstanceBuffer::Stats sparse = instances.update(buffer);
+        InstanceBuffer::Stats none = instances.update(buffer);
+
+        EXPECT_EQ(full.instances, expected.size());
+        EXPECT_EQ(full.ranges, 1u);
+        EXPECT_EQ(sparse.instances, changed);
+        EXPECT_EQ(none.ranges, 0u);
+        ASSERT_EQ(instances.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); i++) {
+            glm::vec3 want = glm::vec3(expected[i].toMatrix()
+                                       * glm::vec4(corner, 1));
+            glm::vec3 got =
+                decodeInstance(packing, &instances.getData()[i * n], corner);
+            for (int c = 0; c < 3; c++)
+                ASSERT_NEAR(got[c], want[c],
+                            1e-4f * std::max(1.0f, std::abs(want[c])))
+                    << "instance " << i;
+        }
+    }
+}
@@ -0,0 +1,137 @@
+#include <atomic>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include <JobSystem.hpp>
+
+namespace {
+
+/// parallelFor over count indices, each hit once.
+void expectEachIndexOnce(JobSystem & jobs, size_t count, size_t grain = 0) {
+    std::vector<std::atomic<int>> hits(count);
+    jobs.parallelFor(0, count, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+            hits[i]++;
+    }, grain);
+    for (size_t i = 0; i < count; i++)
+        ASSERT_EQ(hits[i], 1) << "index " << i;
+}
+
+/// A runOnMain job run by wait(), on the main thread of jobs.
+void expectMainJobRuns(JobSystem & jobs) {
+    bool onMain = false;
+    JobCounter counter;
+    jobs.runOnMain([&] { onMain = jobs.isMain(); }, &counter);
+    jobs.wait(counter);
+    EXPECT_TRUE(onMain);
+}
+
+} // namespace
+
+class JobSystemThreads : public testing::TestWithParam<size_t> {};
+
+INSTANTIATE_TEST_SUITE_P(JobSystem, JobSystemThreads, testing::Values(1, 2, 4));
+
+TEST_P(JobSystemThreads, ParallelForCoversEachIndexOnce) {
+    JobSystem jobs(GetParam());
+    for (size_t grain : {0, 1, 64, 100000}) {
+        SCOPED_TRACE("grain " + std::to_string(grain));
+        expectEachIndexOnce(jobs, 10007, grain);
+    }
+}
+
+TEST_P(JobSystemThreads, NestedParallelFor) {
+    JobSystem jobs(GetParam());
+    std::atomic<int> sum(0);
+    jobs.parallelFor(0, 16, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+            jobs.parallelFor(0, 100, [&](size_t first, size_t last) {
+                sum += int(last - first);
+            });
+    }, 1);
+    EXPECT_EQ(sum, 1600);
+}
+
+/// 100 jobs, one after them, one after that, one on the main thread.
+TEST_P(JobSystemThreads, DependenciesAndMainJobs) {
+    JobSystem jobs(GetParam());
+    std::vector<int> stage(100, 0);
+    std::atomic<bool> ordered(true);
+    bool onMain = false;
+    JobCounter first, second, third;
+    for (size_t i = 0; i < stage.size(); i++)
+        jobs.run([&, i] { stage[i] = 1; }, &first);
+    jobs.run([&] {
+        for (auto & done : stage) {
+            if (done != 1)
+                ordered = false;
+            done = 2;
+        }
+    }, &second, &first);
+    jobs.run([&] {
+        for (auto & done : stage) {
+            if (done != 2)
+                ordered = false;
+        }
+        jobs.runOnMain([&] { onMain = jobs.isMain(); }, &third);
+    }, &third, &second);
+    jobs.wait(third);
+    EXPECT_TRUE(ordered) << "a job started before its dependency";
+    EXPECT_TRUE(onMain) << "a main job ran off the main thread";
+}
+
+TEST_P(JobSystemThreads, ParallelForFromAnotherThread) {
+    JobSystem jobs(GetParam());
+    // Without other workers nothing runs the jobs of an outside thread
+    if (jobs.getThreadCount() == 1)
+        GTEST_SKIP();
+    std::thread outside([&] { expectEachIndexOnce(jobs, 10007); });
+    outside.join();
+}
+
+/// Two systems created on one thread, each keeps it as its main thread.
+TEST(JobSystem, TwoSystemsOnOneThread) {
+    JobSystem first(1);
+    {
+        JobSystem second(2);
+        ASSERT_TRUE(first.isMain());
+        ASSERT_TRUE(second.isMain());
+        expectEachIndexOnce(second, 1000);
+        expectMainJobRuns(second);
+    }
+    // A system with one thread only makes progress on its main thread
+    ASSERT_TRUE(first.isMain());
+    expectEachIndexOnce(first, 1000);
+    expectMainJobRuns(first);
+
+    // Destroyed in the order they were made too
+    auto third = std::make_unique<JobSystem>(1);
+    JobSystem fourth(1);
+    third.reset();
+    ASSERT_TRUE(fourth.isMain());
+    expectEachIndexOnce(fourth, 1000);
+}
+
+/// A system made and destroyed inside the jobs of another.
+TEST(JobSystem, SystemInsideAJob) {
+    JobSystem outer(4);
+    std::atomic<int> sum(0), workers(0);
+    outer.parallelFor(0, 8, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            {
+                JobSystem inner(2);
+                inner.parallelFor(0, 100, [&](size_t first, size_t last) {
+                    sum += int(last - first);
+                });
+                expectMainJobRuns(inner);
+            }
+            workers += outer.isWorker();
+        }
+    }, 1);
+    EXPECT_EQ(sum, 800);
+    EXPECT_EQ(workers, 8);
+    ASSERT_TRUE(outer.isMain());
+    expectEachIndexOnce(outer, 1000);
+    expectMainJobRuns(outer);
+}
@@ -0,0 +1,262 @@
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Bounds.hpp>
+#include <MeshLod.hpp>
+#include <RenderQueue.hpp>
+#include <Transform.hpp>
+#include <World.hpp>
+
+namespace {
+
+/// The vertices, texture coordinates and triangles of a mesh to simplify.
+struct LodMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<float> texCoords;
+    std::vector<GLuint> indices;
+};
+
+/**
+ * A unit sphere of rows by 2 * rows quads with bumps, wound outwards. The
+ * first column of vertices repeats at the end with u = 1, a texture seam,
+ * and so does the vertex at each pole for each column.
+ */
+LodMesh bumpySphere(int rows) {
+    const float pi = 3.14159265f;
+    int columns = 2 * rows;
+    LodMesh mesh;
+    for (int r = 0; r <= rows; r++) {
+        for (int c = 0; c <= columns; c++) {
+            float theta = pi * r / rows, phi = 2 * pi * (c % columns) / columns;
+            float radius =
+                1 + 0.1f * std::sin(5 * theta) * std::sin(4 * phi);
+            glm::vec3 position(radius * std::sin(theta) * std::cos(phi),
+                               radius * std::cos(theta),
+                               radius * std::sin(theta) * std::sin(phi));
+            if (r == 0 || r == rows)
+                position = glm::vec3(0, r == 0 ? 1 : -1, 0);
+            mesh.positions.push_back(position);
+            mesh.texCoords.push_back(float(c) / columns);
+            mesh.texCoords.push_back(float(r) / rows);
+        }
+    }
+    auto vertex = [&](int r, int c) { return GLuint(r * (columns + 1) + c); };
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            if (r > 0)
+                mesh.indices.insert(mesh.indices.end(),
+                                    {vertex(r, c), vertex(r, c + 1),
+                                     vertex(r + 1, c + 1)});
+            if (r + 1 < rows)
+                mesh.indices.insert(mesh.indices.end(),
+                                    {vertex(r, c), vertex(r + 1, c + 1),
+                                     vertex(r + 1, c)});
+        }
+    }
+    return mesh;
+}
+
+/// A square of rows by rows quads with bumps, over x and z from -1 to 1,
+/// facing up and open at its border.
+LodMesh bumpyGrid(int rows) {
+    LodMesh mesh;
+    for (int r = 0; r <= rows; r++) {
+        for (int c = 0; c <= rows; c++) {
+            float x = -1 + 2.0f * c / rows, z = -1 + 2.0f * r / rows;
+            mesh.positions.emplace_back(
+                x, 0.1f * std::sin(3 * x) * std::sin(2 * z), z);
+            mesh.texCoords.push_back(float(c) / rows);
+            mesh.texCoords.push_back(float(r) / rows);
+        }
+    }
+    auto vertex = [&](int r, int c) { return GLuint(r * (rows + 1) + c); };
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < rows; c++)
+            mesh.indices.insert(mesh.indices.end(),
+                                {vertex(r, c), vertex(r + 1, c + 1),
+                                 vertex(r, c + 1), vertex(r, c),
+                                 vertex(r + 1, c), vertex(r + 1, c + 1)});
+    }
+    return mesh;
+}
+
+/// The number of triangles of indices first to first + count with each
+/// edge, by the positions of its ends and in the order they wind.
+std::map<std::vector<float>, int> positionEdges(
+    const LodMesh & mesh, const std::vector<GLuint> & indices, size_t first,
+    size_t count) {
+    std::map<std::vector<float>, int> edges;
+    for (size_t i = first; i < first + count; i++) {
+        glm::vec3 a = mesh.positions[indices[i]];
+        glm::vec3 b = mesh.positions[indices[i - i % 3 + (i + 1) % 3]];
+        edges[{a.x, a.y, a.z, b.x, b.y, b.z}]++;
+    }
+    return edges;
+}
+
+/// The LOD chain of a bumpy sphere with a texture seam.
+struct SphereChain {
+    LodMesh sphere = bumpySphere(24);
+    std::vector<GLuint> indices = sphere.indices;
+    LodChain chain;
+
+    SphereChain() {
+        MeshSimplifier simplifier(sphere.positions, sphere.texCoords, 2);
+        chain = simplifier.buildChain(indices, 0, indices.size());
+    }
+
+    /// The volume the triangles of level enclose.
+    double volume(const LodLevel & level) const {
+        double sum = 0;
+        for (GLint i = level.first; i < level.first + level.count; i += 3) {
+            glm::dvec3 a = sphere.positions[indices[i]];
+            glm::dvec3 b = sphere.positions[indices[i + 1]];
+            glm::dvec3 c = sphere.positions[indices[i + 2]];
+            sum += glm::dot(a, glm::cross(b, c));
+        }
+        return sum / 6;
+    }
+};
+
+} // namespace
+
+/**
+ * Every level stays closed, keeps its volume and seam and has fewer
+ * triangles and more error than the last.
+ */
+TEST(MeshLod, SphereLevels) {
+    SphereChain lod;
+    const LodChain & chain = lod.chain;
+    ASSERT_GE(chain.levels.size(), 3u);
+    double fullVolume = lod.volume(chain.levels[0]);
+    for (size_t l = 1; l < chain.levels.size(); l++) {
+        SCOPED_TRACE("level " + std::to_string(l));
+        const LodLevel & level = chain.levels[l];
+        const LodLevel & last = chain.levels[l - 1];
+        EXPECT_GT(level.count, 0);
+        EXPECT_EQ(level.count % 3, 0);
+        EXPECT_LT(level.count, last.count);
+        EXPECT_GT(level.error, last.error);
+        ASSERT_LE(level.first + level.count, GLint(lod.indices.size()));
+        EXPECT_NEAR(lod.volume(level), fullVolume, 0.1 * fullVolume);
+        // Closed, each edge once each way
+        auto edges = positionEdges(lod.sphere, lod.indices, level.first,
+                                   level.count);
+        for (auto & edge : edges) {
+            auto & e = edge.first;
+            auto back = edges.find({e[3], e[4], e[5], e[0], e[1], e[2]});
+            ASSERT_EQ(edge.second, 1);
+            ASSERT_NE(back, edges.end());
+            ASSERT_EQ(back->second, 1);
+        }
+        // No triangle across the seam from u = 1 back to 0
+        for (GLint i = level.first; i < level.first + level.count; i += 3) {
+            float u[3];
+            for (int c = 0; c < 3; c++)
+                u[c] = lod.sphere.texCoords[lod.indices[i + c] * 2];
+            ASSERT_LT(std::max({u[0], u[1], u[2]})
+                          - std::min({u[0], u[1], u[2]}),
+                      0.5f);
+        }
+    }
+}
+
+/// The outline of an open square stays, 8 units around.
+TEST(MeshLod, GridKeepsBorder) {
+    LodMesh grid = bumpyGrid(32);
+    MeshSimplifier simplifier(grid.positions, grid.texCoords, 2);
+    float error = 0;
+    std::vector<GLuint> simple = simplifier.simplify(
+        grid.indices.data(), grid.indices.size(), grid.indices.size() / 4,
+        0.01f, &error);
+    auto edges = positionEdges(grid, simple, 0, simple.size());
+    float outline = 0;
+    for (auto & edge : edges) {
+        auto & e = edge.first;
+        if (!edges.count({e[3], e[4], e[5], e[0], e[1], e[2]}))
+            outline += glm::length(glm::vec2(e[3] - e[0], e[5] - e[2]));
+    }
+    EXPECT_LE(simple.size(), grid.indices.size() / 2);
+    EXPECT_LE(error, 0.01f);
+    EXPECT_NEAR(outline, 8, 1e-4f);
+}
+
+/**
+ * LodChain::select walks each level from far to near, without switching
+ * back and forth near the threshold.
+ */
+TEST(MeshLod, SelectHysteresis) {
+    SphereChain lod;
+    const LodChain & chain = lod.chain;
+    LodView view = LodView::perspective(glm::vec3(0), glm::radians(60.0f),
+                                        1080, 1, 0.25f);
+    size_t level = chain.levels.size() - 1;
+    for (float distance = 1000; distance > 1; distance *= 0.99f) {
+        SCOPED_TRACE("distance " + std::to_string(distance));
+        float pixels = view.pixelsPerUnit / distance;
+        size_t next = chain.select(pixels, level, view.threshold,
+                                   view.hysteresis);
+        // Wiggling 5% either way changes the level once at most
+        size_t wiggle = next, changes = 0;
+        for (int i = 0; i < 6; i++) {
+            size_t last = wiggle;
+            wiggle = chain.select(i % 2 ? pixels * 1.05f : pixels / 1.05f,
+                                  wiggle, 1, 0.25f);
+            changes += wiggle != last;
+        }
+        ASSERT_LE(next, level);
+        if (next > 0)
+            ASSERT_LE(chain.levels[next].error * pixels, 1.25f);
+        ASSERT_LE(changes, 1u);
+        level = next;
+    }
+    EXPECT_EQ(level, 0u);
+}
+
+/// Spheres along -z, each RenderQueue batch at the level they select.
+TEST(MeshLod, QueueBatchesByLevel) {
+    SphereChain lod;
+    const LodChain & chain = lod.chain;
+    LodView view = LodView::perspective(glm::vec3(0), glm::radians(60.0f),
+                                        1080, 1, 0.25f);
+    Mesh full;
+    full.count = chain.levels[0].count;
+    World world;
+    for (int i = 0; i < 200; i++) {
+        Transform transform(glm::vec3(0, 0, -2.0f - i), glm::quat(),
+                            glm::vec3(0.5f));
+        Bounds bounds(AABB(glm::vec3(-1.1f), glm::vec3(1.1f)));
+        bounds.update(transform.toMatrix());
+        world.create(transform, full, Material(), bounds,
+                     Lod {&chain});
+    }
+    RenderQueue queue;
+    queue.collect(world, nullptr, nullptr, &view);
+    queue.sort();
+    std::vector<size_t> batched(chain.levels.size(), 0);
+    for (auto & batch : queue.getBatches()) {
+        for (size_t i = batch.first; i < batch.first + batch.count; i++) {
+            AABB box = AABB(glm::vec3(-1.1f), glm::vec3(1.1f))
+                           .transformed(queue.getMatrices()[i]);
+            size_t expected = chain.select(view.pixelsPerUnitOf(box, 0.5f),
+                                           0, 1, 0.25f);
+            const LodLevel & level = chain.levels[expected];
+            ASSERT_EQ(batch.mesh.first, level.first)
+                << "sphere at z " << queue.getMatrices()[i][3].z;
+            ASSERT_EQ(batch.mesh.count, level.count)
+                << "sphere at z " << queue.getMatrices()[i][3].z;
+            batched[expected]++;
+        }
+    }
+    size_t levels = chain.levels.size()
+                    - std::count(batched.begin(), batched.end(), 0);
+    EXPECT_EQ(queue.getBatches().size(), levels);
+    EXPECT_GE(levels, 2u);
+}
@@ -0,0 +1,310 @@
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Bounds.hpp>
+#include <Frustum.hpp>
+#include <JobSystem.hpp>
+#include <OcclusionBuffer.hpp>
+#include <RenderQueue.hpp>
+#include <Transform.hpp>
+#include <World.hpp>
+
+namespace {
+
+/// A camera at the origin looking along -z, with the 2:1 aspect of the
+/// default OcclusionBuffer.
+glm::mat4 occlusionCamera() {
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f,
+                                            150.0f);
+    return projection
+           * glm::lookAt(glm::vec3(0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
+}
+
+/// Models of count unit box occluders, 1 to 6 units a side and turned
+/// about y, in front of occlusionCamera() and some past its sides.
+std::vector<glm::mat4> randomOccluders(size_t count) {
+    std::mt19937 random(17);
+    std::uniform_real_distribution<float> x(-40, 40), y(-15, 15), z(-60, -5);
+    std::uniform_real_distribution<float> size(1, 6), angle(0, 3.14f);
+    std::vector<glm::mat4> models;
+    for (size_t i = 0; i < count; i++) {
+        Transform transform(glm::vec3(x(random), y(random), z(random)),
+                            glm::quat(glm::vec3(0, angle(random), 0)),
+                            glm::vec3(size(random), size(random),
+                                      size(random)));
+        models.push_back(transform.toMatrix());
+    }
+    return models;
+}
+
+/// count boxes of 0.5 to 4 units a side scattered over a 200 unit cube.
+std::vector<AABB> randomBoxes(size_t count) {
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> position(-100, 100), extent(0.25f, 2);
+    std::vector<AABB> boxes;
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 extents(extent(random), extent(random), extent(random));
+        boxes.emplace_back(center - extents, center + extents);
+    }
+    return boxes;
+}
+
+/// 200 random box occluders in front of occlusionCamera(), rendered.
+struct Occluders {
+    Occluder box = Occluder::fromBox(AABB(glm::vec3(-0.5f), glm::vec3(0.5f)));
+    std::vector<glm::mat4> models = randomOccluders(200);
+    glm::mat4 camera = occlusionCamera();
+    OcclusionBuffer buffer;
+
+    Occluders() {
+        buffer.begin(camera);
+        for (auto & model : models)
+            buffer.add(box, model);
+        buffer.render(OcclusionBuffer::Scalar);
+    }
+};
+
+} // namespace
+
+/**
+ * The scalar render against sampling each front face in double precision,
+ * and every kernel and the parallel render against the scalar one.
+ */
+TEST(OcclusionBuffer, DepthMatchesSampledFaces) {
+    Occluders occluders;
+    const Occluder & box = occluders.box;
+    OcclusionBuffer & buffer = occluders.buffer;
+    std::vector<float> expected = buffer.getDepth();
+    int width = buffer.getWidth(), height = buffer.getHeight();
+
+    // Sample the front faces in double precision at 5 by 5 points over
+    // each pixel, the nearest that might cover each point. A pixel must be
+    // covered at all of its points and at least as far as all of them, and
+    // covered where a face surely covers all of it, the edges in pixels.
+    const int samples = 4;
+    int sampleWidth = width * samples + 1;
+    std::vector<double> nearest(size_t(sampleWidth) * (height * samples + 1),
+                                2);
+    std::vector<bool> whole(expected.size());
+    for (auto & model : occluders.models) {
+        glm::mat4 matrix = occluders.camera * model;
+        for (size_t i = 0; i < box.indices.size(); i += 3) {
+            glm::dvec3 v[3];
+            for (int k = 0; k < 3; k++) {
+                glm::vec4 clip =
+                    matrix * glm::vec4(box.vertices[box.indices[i + k]], 1);
+                v[k] = glm::dvec3((clip.x / clip.w * 0.5 + 0.5) * width,
+                                  (clip.y / clip.w * 0.5 + 0.5) * height,
+                                  clip.z / clip.w * 0.5 + 0.5);
+            }
+            double area = (v[1].x - v[0].x) * (v[2].y - v[0].y)
+                          - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+            // Boxes are closed, their backs are not drawn
+            if (area <= 0)
+                continue;
+            // The barycentric weights of the opposite vertices times the
+            // area, and the distance to the nearest edge
+            auto sample = [&](double px, double py, double & z) {
+                double weights[3], distance = 1e9;
+                for (int e = 0; e < 3; e++) {
+                    const glm::dvec3 & a = v[e], & b = v[(e + 1) % 3];
+                    double edge = (b.x - a.x) * (py - a.y)
+                                  - (b.y - a.y) * (px - a.x);
+                    weights[(e + 2) % 3] = edge;
+                    double length = std::hypot(b.x - a.x, b.y - a.y);
+                    distance = std::min(distance, edge / length);
+                }
+                z = (weights[0] * v[0].z + weights[1] * v[1].z
+                     + weights[2] * v[2].z)
+                    / area;
+                return distance;
+            };
+            int x0 = std::max(0, int(std::floor(std::min({v[0].x, v[1].x,
+                                                           v[2].x}))));
+            int y0 = std::max(0, int(std::floor(std::min({v[0].y, v[1].y,
+                                                           v[2].y}))));
+            int x1 = std::min(width - 1,
+                              int(std::max({v[0].x, v[1].x, v[2].x})));
+            int y1 = std::min(height - 1,
+                              int(std::max({v[0].y, v[1].y, v[2].y})));
+            for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) {
+                    bool inside = true;
+                    for (int s = 0; s < (samples + 1) * (samples + 1); s++) {
+                        int sx = x * samples + s % (samples + 1);
+                        int sy = y * samples + s / (samples + 1);
+                        double z, distance = sample(double(sx) / samples,
+                                                    double(sy) / samples, z);
+                        inside = inside && distance > 1e-3;
+                        if (distance < -1e-3)
+                            continue;
+                        double & point = nearest[size_t(sy) * sampleWidth + sx];
+                        point = std::min(point, z);
+                    }
+                    if (inside)
+                        whole[size_t(y) * width + x] = true;
+                }
+            }
+        }
+    }
+    size_t covered = 0;
+    for (size_t pixel = 0; pixel < expected.size(); pixel++) {
+        int x = int(pixel % width), y = int(pixel / width);
+        double farthest = 0;
+        for (int s = 0; s < (samples + 1) * (samples + 1); s++)
+            farthest = std::max(
+                farthest, nearest[size_t(y * samples + s / (samples + 1))
+                                      * sampleWidth
+                                  + x * samples + s % (samples + 1)]);
+        if (expected[pixel] < 1)
+            ASSERT_GE(expected[pixel], farthest - 1e-5)
+                << "pixel " << pixel << " is nearer than the faces over it";
+        if (whole[pixel])
+            ASSERT_LT(expected[pixel], 1)
+                << "pixel " << pixel << " is under a face but empty";
+        covered += expected[pixel] < 1;
+    }
+    ASSERT_GT(covered, 0u);
+    ASSERT_LT(covered, expected.size());
+
+    for (int k = OcclusionBuffer::Scalar; k <= OcclusionBuffer::AVX2; k++) {
+        auto kernel = OcclusionBuffer::Kernel(k);
+        if (!OcclusionBuffer::supported(kernel))
+            continue;
+        buffer.render(kernel);
+        EXPECT_EQ(buffer.getDepth(), expected) << "kernel " << k;
+    }
+    JobSystem jobs(4);
+    buffer.render(jobs);
+    EXPECT_EQ(buffer.getDepth(), expected) << "parallel render";
+}
+
+/**
+ * Blocks hold the farthest of their pixels, and occluded() reads the same
+ * as testing every pixel.
+ */
+TEST(OcclusionBuffer, OccludedMatchesEveryPixel) {
+    Occluders occluders;
+    const OcclusionBuffer & buffer = occluders.buffer;
+    const std::vector<float> & depth = buffer.getDepth();
+    int width = buffer.getWidth(), height = buffer.getHeight();
+
+    int blocksX = width / OcclusionBuffer::blockSize;
+    for (size_t b = 0; b < buffer.getBlockDepth().size(); b++) {
+        float farthest = 0;
+        int bx = int(b % blocksX), by = int(b / blocksX);
+        for (int y = 0; y < OcclusionBuffer::blockSize; y++)
+            for (int x = 0; x < OcclusionBuffer::blockSize; x++)
+                farthest = std::max(farthest,
+                                    depth[size_t(by * 8 + y) * width + bx * 8
+                                          + x]);
+        ASSERT_EQ(buffer.getBlockDepth()[b], farthest) << "block " << b;
+    }
+
+    size_t occluded = 0, tested = 0;
+    for (auto & object : randomBoxes(20000)) {
+        bool hidden = true, inside = false;
+        float x0 = 1e9f, y0 = 1e9f, x1 = -1e9f, y1 = -1e9f, nearest = 1;
+        for (int corner = 0; corner < 8 && hidden; corner++) {
+            glm::vec4 clip =
+                occluders.camera
+                * glm::vec4(corner & 1 ? object.max.x : object.min.x,
+                            corner & 2 ? object.max.y : object.min.y,
+                            corner & 4 ? object.max.z : object.min.z, 1);
+            hidden = clip.w > 0;
+            float w = 1 / clip.w;
+            float x = (clip.x * w * 0.5f + 0.5f) * width;
+            float y = (clip.y * w * 0.5f + 0.5f) * height;
+            x0 = std::min(x0, x);
+            y0 = std::min(y0, y);
+            x1 = std::max(x1, x);
+            y1 = std::max(y1, y);
+            nearest = std::min(nearest, clip.z * w * 0.5f + 0.5f);
+        }
+        for (int y = 0; y < height && hidden; y++) {
+            for (int x = 0; x < width && hidden; x++) {
+                // Pixels the box touches
+                if (x + 1 <= x0 || x > x1 || y + 1 <= y0 || y > y1)
+                    continue;
+                inside = true;
+                hidden = depth[size_t(y) * width + x]
+                         < nearest - OcclusionBuffer::depthBias;
+            }
+        }
+        hidden = hidden && inside;
+        ASSERT_EQ(buffer.occluded(object), hidden)
+            << "box at " << object.center().x << ", " << object.center().y
+            << ", " << object.center().z;
+        occluded += hidden;
+        tested += inside;
+    }
+    EXPECT_GT(occluded, 0u);
+    EXPECT_LT(occluded, tested);
+}
+
+/**
+ * Inside a room of 20 units the near plane and guard band clip the walls,
+ * which hide everything outside and nothing inside.
+ */
+TEST(OcclusionBuffer, ClipsInsideARoom) {
+    glm::mat4 camera = occlusionCamera();
+    AABB walls(glm::vec3(-10), glm::vec3(10));
+    Occluder room = Occluder::fromBox(walls);
+    room.closed = false;
+    OcclusionBuffer buffer;
+    buffer.begin(camera);
+    buffer.add(room);
+    JobSystem jobs(4);
+    buffer.render(jobs);
+    for (float depth : buffer.getDepth())
+        ASSERT_LT(depth, 1) << "the room has a hole";
+
+    for (auto object : randomBoxes(2000)) {
+        // At least 3 pixels wide, with the centre on screen
+        object = AABB(object.min - glm::vec3(2), object.max + glm::vec3(2));
+        glm::vec4 centre = camera * glm::vec4(object.center(), 1);
+        bool onScreen = std::abs(centre.x) < 0.9f * centre.w
+                        && std::abs(centre.y) < 0.9f * centre.w;
+        bool outside = !walls.overlaps(object);
+        if (!outside)
+            EXPECT_FALSE(buffer.occluded(object)) << "a box inside is hidden";
+        else if (object.max.z < -11 && onScreen)
+            EXPECT_TRUE(buffer.occluded(object)) << "a box behind is shown";
+    }
+}
+
+/// A wall 5 units ahead hides the 100 boxes behind it, not 100 in front.
+TEST(OcclusionBuffer, RenderQueueCullsOccluded) {
+    glm::mat4 camera = occlusionCamera();
+    World world;
+    for (size_t i = 0; i < 200; i++) {
+        glm::vec3 position(float(i % 10) * 0.2f - 1,
+                           float(i / 10 % 10) * 0.2f - 1, i < 100 ? -10 : -2);
+        Transform transform(position, glm::quat(), glm::vec3(0.1f));
+        Bounds bounds(AABB(glm::vec3(-0.5f), glm::vec3(0.5f)));
+        bounds.update(transform.toMatrix());
+        world.create(transform, Mesh(), Material(), bounds);
+    }
+    OcclusionBuffer buffer;
+    buffer.begin(camera);
+    buffer.add(Occluder::fromBox(AABB(glm::vec3(-20, -20, -5.5f),
+                                      glm::vec3(20, 20, -5))));
+    JobSystem jobs(4);
+    buffer.render(jobs);
+    Frustum frustum = Frustum::fromMatrix(camera);
+    RenderQueue queue;
+    queue.collect(world, jobs, &frustum, &buffer);
+    queue.sort();
+    EXPECT_EQ(queue.getCulledCount(), 100u);
+    for (auto & matrix : queue.getMatrices())
+        EXPECT_GT(matrix[3].z, -5);
+}
@@ -0,0 +1,107 @@
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <Buffer.hpp>
+#include <JobSystem.hpp>
+#include <RenderQueue.hpp>
+#include <Shader.hpp>
+#include <Transform.hpp>
+#include <World.hpp>
+
+namespace {
+
+const char * emptyShader = R"(
+#version 330 core
+void main() {}
+)";
+
+/// Meshes and materials of null GL objects, each with its own array or
+/// shader so they sort apart.
+struct RenderAssets {
+    std::vector<Shader> shaders;
+    std::vector<BufferArray> arrays;
+    std::vector<Mesh> meshes;
+    std::vector<Material> materials;
+
+    RenderAssets(size_t shaderCount, size_t meshCount) {
+        for (size_t i = 0; i < shaderCount; i++)
+            shaders.emplace_back(emptyShader, emptyShader);
+        for (size_t i = 0; i < meshCount; i++)
+            arrays.emplace_back(std::vector<std::vector<Attribute>> {{}, {}});
+        for (auto & shader : shaders)
+            materials.push_back({&shader, {}});
+        for (auto & array : arrays)
+            meshes.push_back({&array, 36, GL_UNSIGNED_INT, GL_TRIANGLES, 0, 1});
+    }
+};
+
+} // namespace
+
+/**
+ * Each draw of an entity batched with the entity's mesh and material,
+ * once, sorted by shader.
+ */
+TEST(RenderQueue, BatchesEachDrawWithItsState) {
+    RenderAssets assets(3, 2);
+    std::mt19937 random(5);
+    World world;
+    std::vector<std::pair<size_t, size_t>> states;
+    for (size_t i = 0; i < 1000; i++) {
+        size_t mesh = random() % 2, material = random() % 3;
+        states.emplace_back(mesh, material);
+        // The x position identifies the entity
+        world.create(Transform(glm::vec3(float(i), 0, 0), glm::quat(),
+                               glm::vec3(1)),
+                     assets.meshes[mesh], assets.materials[material]);
+    }
+
+    JobSystem jobs(4);
+    RenderQueue queue;
+    queue.collect(world, jobs);
+    queue.sort();
+
+    std::vector<int> seen(states.size(), 0);
+    GLuint program = 0;
+    for (auto & batch : queue.getBatches()) {
+        ASSERT_GE(batch.material.shader->getProgram(), program)
+            << "batches not sorted by shader";
+        program = batch.material.shader->getProgram();
+        for (size_t i = batch.first; i < batch.first + batch.count; i++) {
+            size_t entity = size_t(queue.getMatrices()[i][3].x);
+            ASSERT_LT(entity, states.size());
+            auto & state = states[entity];
+            EXPECT_TRUE(assets.meshes[state.first] == batch.mesh)
+                << "entity " << entity;
+            EXPECT_TRUE(assets.materials[state.second] == batch.material)
+                << "entity " << entity;
+            seen[entity]++;
+        }
+    }
+    EXPECT_EQ(queue.getBatches().size(), 6u);
+    EXPECT_EQ(std::count(seen.begin(), seen.end(), 1), int(seen.size()));
+}
+
+/// Meshes of one array whose first indices are the same in their low bits
+/// still batch apart.
+TEST(RenderQueue, KeyKeepsFullIds) {
+    RenderAssets assets(1, 1);
+    Mesh low = assets.meshes[0], high = low;
+    high.first = low.first + 0x10000;
+    World world;
+    for (size_t i = 0; i < 100; i++)
+        world.create(Transform(), i % 2 ? high : low, assets.materials[0]);
+
+    RenderQueue queue;
+    queue.collect(world);
+    queue.sort();
+    ASSERT_EQ(queue.getBatches().size(), 2u);
+    EXPECT_TRUE(queue.getBatches()[0].mesh == low);
+    EXPECT_TRUE(queue.getBatches()[1].mesh == high);
+    EXPECT_EQ(queue.getBatches()[0].count, 50u);
+}
@@ -0,0 +1,89 @@
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <SceneGraph.hpp>
+#include <Transform.hpp>
+
+namespace {
+
+/// count random transforms of unit scale, so the world matrices stay in
+/// range many levels down.
+std::vector<Transform> randomTransforms(size_t count) {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-100, 100),
+        angle(-3.14f, 3.14f);
+    std::vector<Transform> transforms;
+    for (size_t i = 0; i < count; i++)
+        transforms.emplace_back(
+            glm::vec3(position(random), position(random), position(random)),
+            glm::quat(glm::vec3(angle(random), angle(random), angle(random))),
+            glm::vec3(1));
+    return transforms;
+}
+
+} // namespace
+
+/**
+ * World matrices against composing the local transforms up the parents,
+ * after random adds, edits, reparents and removes.
+ */
+TEST(SceneGraph, WorldMatchesParentChain) {
+    std::mt19937 random(2);
+    std::vector<Transform> transforms = randomTransforms(400);
+    SceneGraph graph;
+    std::vector<SceneGraph::Node> nodes;
+    auto randomNode = [&]() { return nodes[random() % nodes.size()]; };
+
+    for (size_t round = 0; round < 4; round++) {
+        for (size_t i = 0; i < 100; i++) {
+            SceneGraph::Node parent =
+                nodes.empty() || random() % 8 == 0 ? SceneGraph::none
+                                                   : randomNode();
+            nodes.push_back(graph.add(parent, transforms[nodes.size()]));
+        }
+        graph.update();
+
+        for (size_t i = 0; i < 50; i++) {
+            SceneGraph::Node node = randomNode(), parent = randomNode();
+            if (graph.isAncestor(node, parent))
+                EXPECT_THROW(graph.setParent(node, parent),
+                             std::invalid_argument);
+            else
+                graph.setParent(node, parent);
+            graph.editLocal(randomNode()).move(glm::vec3(0.5f));
+        }
+
+        graph.remove(randomNode());
+        nodes.erase(std::remove_if(nodes.begin(), nodes.end(),
+                                   [&](SceneGraph::Node node) {
+                                       return !graph.contains(node);
+                                   }),
+                    nodes.end());
+        graph.update();
+
+        for (auto node : nodes) {
+            glm::mat4 expected = graph.getLocal(node).toMatrix();
+            for (auto parent = graph.getParent(node);
+                 parent != SceneGraph::none; parent = graph.getParent(parent))
+                expected = graph.getLocal(parent).toMatrix() * expected;
+
+            // The products associate the other way, allow for rounding
+            const glm::mat4 & world = graph.getWorld(node);
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 4; r++) {
+                    float value = expected[c][r];
+                    ASSERT_NEAR(world[c][r], value,
+                                1e-4f * std::max(1.0f, std::abs(value)))
+                        << "node " << node << " in round " << round;
+                }
+            }
+        }
+    }
+}
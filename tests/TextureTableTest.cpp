@@ -0,0 +1,51 @@
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include <Texture.hpp>
+#include <TextureTable.hpp>
+
+namespace {
+
+/// count empty 4x4 textures.
+std::vector<Texture> emptyTextures(size_t count) {
+    std::vector<Texture> textures;
+    for (size_t i = 0; i < count; i++)
+        textures.emplace_back(glm::uvec2(4), Texture::RGBA8, Texture::RGBA,
+                              GL_UNSIGNED_BYTE);
+    return textures;
+}
+
+} // namespace
+
+TEST(TextureTable, BindlessIndices) {
+    auto textures = emptyTextures(3);
+    TextureTable table(true);
+    ASSERT_TRUE(table.isBindless());
+    for (GLuint i = 0; i < textures.size(); i++) {
+        EXPECT_EQ(table.add(&textures[i]), i);
+        EXPECT_TRUE(textures[i].isResident());
+    }
+    EXPECT_EQ(table.size(), 3u);
+    EXPECT_NO_THROW(table.bind(2));
+
+    table.clear();
+    EXPECT_EQ(table.size(), 0u);
+    EXPECT_EQ(table.add(&textures[2]), 0u);
+}
+
+/// Clearing one table leaves the textures another one holds resident.
+TEST(TextureTable, ClearKeepsShared) {
+    auto textures = emptyTextures(2);
+    TextureTable a(true), b(true);
+    a.add(&textures[0]);
+    a.add(&textures[1]);
+    b.add(&textures[1]);
+    a.clear();
+    EXPECT_TRUE(textures[0].isResident());
+    EXPECT_TRUE(textures[1].isResident());
+    textures[0].makeNonResident();
+    EXPECT_FALSE(textures[0].isResident());
+}
@@ -0,0 +1,74 @@
+#include <GL/glew.h>
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Transform.hpp>
+#include <TransformBuffer.hpp>
+
+namespace {
+
+/// count random transforms, the same ones each call.
+std::vector<Transform> randomTransforms(size_t count) {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-100, 100),
+        angle(-3.14f, 3.14f), scale(0.1f, 10);
+    std::vector<Transform> transforms;
+    for (size_t i = 0; i < count; i++)
+        transforms.emplace_back(
+            glm::vec3(position(random), position(random), position(random)),
+            glm::quat(glm::vec3(angle(random), angle(random), angle(random))),
+            glm::vec3(scale(random), scale(random), scale(random)));
+    return transforms;
+}
+
+} // namespace
+
+/**
+ * Every kernel against Transform::toMatrix, for a count that isn't a
+ * multiple of the lane widths and a sparse dirty set.
+ */
+TEST(TransformBuffer, KernelsMatchToMatrix) {
+    std::vector<Transform> transforms = randomTransforms(203);
+    for (int k = TransformBuffer::Scalar; k <= TransformBuffer::AVX2; k++) {
+        auto kernel = TransformBuffer::Kernel(k);
+        if (!TransformBuffer::supported(kernel))
+            continue;
+        SCOPED_TRACE("kernel " + std::to_string(k));
+
+        std::vector<Transform> expected = transforms;
+        TransformBuffer buffer;
+        for (auto & transform : expected)
+            buffer.add(transform);
+        buffer.update(kernel);
+
+        // Change every third transform after the first update
+        for (size_t i = 0; i < expected.size(); i += 3) {
+            expected[i].move(glm::vec3(1, 2, 3));
+            buffer.move(i, glm::vec3(1, 2, 3));
+        }
+        EXPECT_EQ(buffer.update(kernel), (expected.size() + 2) / 3);
+
+        std::vector<glm::mat3x4> affine(expected.size());
+        buffer.composeMat3x4(0, affine.size(), affine.data(), kernel);
+        for (size_t i = 0; i < expected.size(); i++) {
+            glm::mat4 matrix = expected[i].toMatrix();
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 4; r++) {
+                    float value = matrix[c][r];
+                    float tolerance = 1e-5f * std::max(1.0f, std::abs(value));
+                    ASSERT_NEAR(buffer.getMatrix(i)[c][r], value, tolerance)
+                        << "matrix " << i;
+                    if (r < 3)
+                        ASSERT_NEAR(affine[i][r][c], value, tolerance)
+                            << "mat3x4 " << i;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,180 @@
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Bounds.hpp>
+#include <JobSystem.hpp>
+#include <SystemScheduler.hpp>
+#include <Transform.hpp>
+#include <World.hpp>
+
+namespace {
+
+/// A component the examples don't have, for the ECS checks.
+struct Velocity {
+    glm::vec3 value;
+};
+
+/// count entities at random positions with a velocity and bounds, the same
+/// ones each call.
+World movingWorld(size_t count) {
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> position(-100, 100);
+    World world;
+    Bounds bounds(AABB(glm::vec3(-1), glm::vec3(1)));
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 at(position(random), position(random), position(random));
+        world.create(Transform(at, glm::quat(), glm::vec3(1)),
+                     Velocity {glm::vec3(0.01f)}, bounds);
+    }
+    return world;
+}
+
+} // namespace
+
+/**
+ * World against a map of what each entity should have, after random
+ * creates, destroys and component adds and removes.
+ */
+TEST(World, MatchesMapAfterRandomEdits) {
+    struct Expected {
+        glm::vec3 position;
+        bool velocity;
+        std::string name;
+    };
+
+    std::mt19937 random(4);
+    World world;
+    std::map<World::Entity, Expected> expected;
+    auto randomEntity = [&]() {
+        auto it = expected.begin();
+        std::advance(it, random() % expected.size());
+        return it->first;
+    };
+
+    for (size_t round = 0; round < 20; round++) {
+        for (size_t i = 0; i < 200; i++) {
+            glm::vec3 position(float(round), float(i), 0);
+            Transform transform(position, glm::quat(), glm::vec3(1));
+            std::string name(20, char('a' + i % 26));
+            World::Entity entity;
+            if (i % 3 == 0)
+                entity = world.create(transform, Velocity {glm::vec3(1)});
+            else if (i % 3 == 1)
+                entity = world.create(transform);
+            else
+                entity = world.create(name, transform);
+            expected[entity] = {position, i % 3 == 0, i % 3 == 2 ? name : ""};
+        }
+
+        for (size_t i = 0; i < 150; i++) {
+            World::Entity entity = randomEntity();
+            Expected & e = expected[entity];
+            switch (random() % 5) {
+                case 0:
+                    world.destroy(entity);
+                    expected.erase(entity);
+                    break;
+                case 1:
+                    world.add(entity, Velocity {glm::vec3(1)});
+                    e.velocity = true;
+                    break;
+                case 2:
+                    world.remove<Velocity>(entity);
+                    e.velocity = false;
+                    break;
+                case 3:
+                    e.name = std::string(30, 'z');
+                    world.add(entity, e.name);
+                    break;
+                case 4:
+                    world.remove<std::string>(entity);
+                    e.name.clear();
+                    break;
+            }
+        }
+
+        size_t withVelocity = 0;
+        for (auto & pair : expected) {
+            World::Entity entity = pair.first;
+            const Expected & e = pair.second;
+            withVelocity += e.velocity;
+            ASSERT_TRUE(world.contains(entity)) << "entity " << entity;
+            EXPECT_EQ(world.get<Transform>(entity).getPosition(), e.position);
+            EXPECT_EQ(world.has<Velocity>(entity), e.velocity);
+            ASSERT_EQ(world.has<std::string>(entity), !e.name.empty());
+            if (!e.name.empty())
+                EXPECT_EQ(world.get<std::string>(entity), e.name);
+        }
+        size_t visited = 0;
+        world.each<const Transform, const Velocity>(
+            [&](const Transform &, const Velocity &) { visited++; });
+        EXPECT_EQ(world.size(), expected.size());
+        EXPECT_EQ(world.count<Transform>(), expected.size());
+        EXPECT_EQ((world.count<Transform, Velocity>()), withVelocity);
+        EXPECT_EQ(visited, withVelocity);
+    }
+}
+
+/// Systems that don't conflict share a phase, in parallel like in order.
+TEST(SystemScheduler, ParallelMatchesInOrder) {
+    World serial = movingWorld(5000);
+    World parallel = movingWorld(5000);
+    SystemScheduler systems;
+    systems.add<Transform, const Velocity>(
+        "move", [](size_t count, Transform * transforms,
+                   const Velocity * velocities) {
+            for (size_t i = 0; i < count; i++)
+                transforms[i].move(velocities[i].value);
+        });
+    systems.add<const Velocity, Bounds>(
+        "grow", [](size_t count, const Velocity * velocities, Bounds * bounds) {
+            for (size_t i = 0; i < count; i++)
+                bounds[i].local.max += velocities[i].value;
+        });
+    // Bounds reads what move writes, so it has to run after it
+    systems.add<const Transform, Bounds>(
+        "bounds",
+        [](size_t count, const Transform * transforms, Bounds * bounds) {
+            for (size_t i = 0; i < count; i++)
+                bounds[i].update(transforms[i].toMatrix());
+        });
+    ASSERT_EQ(systems.getPhaseCount(), 2u);
+    EXPECT_EQ(systems.getPhase(0), 0u);
+    EXPECT_EQ(systems.getPhase(1), 0u);
+    EXPECT_EQ(systems.getPhase(2), 1u);
+
+    JobSystem jobs(4);
+    systems.run(serial);
+    systems.run(parallel, jobs);
+    std::vector<Bounds> expected;
+    serial.each<const Bounds>(
+        [&](const Bounds & bounds) { expected.push_back(bounds); });
+    size_t i = 0;
+    parallel.each<const Bounds>([&](const Bounds & bounds) {
+        ASSERT_LT(i, expected.size());
+        EXPECT_EQ(bounds.world.min, expected[i].world.min) << "entity " << i;
+        EXPECT_EQ(bounds.world.max, expected[i].world.max) << "entity " << i;
+        i++;
+    });
+    EXPECT_EQ(i, expected.size());
+}
+
+/// toMatrix() writes the cached matrix, so two const readers can't share.
+TEST(SystemScheduler, ConstTransformIsWritten) {
+    SystemScheduler systems;
+    systems.add<const Transform, Bounds>(
+        "bounds", [](size_t, const Transform *, Bounds *) {});
+    systems.add<const Transform, const Velocity>(
+        "read", [](size_t, const Transform *, const Velocity *) {});
+    systems.add<const Velocity>("velocity", [](size_t, const Velocity *) {});
+    EXPECT_EQ(systems.getPhase(0), 0u);
+    EXPECT_EQ(systems.getPhase(1), 1u);
+    EXPECT_EQ(systems.getPhase(2), 0u);
+}
@@ -0,0 +1,13 @@
+#include <GL/glew.h>
+
+#include <gtest/gtest.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include <NullGL.hpp>
+#include <stb_image.h>
+
+int main(int argc, char ** argv) {
+    // The wrappers run without a context, their GL calls do nothing
+    NullGL::load();
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
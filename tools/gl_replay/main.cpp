@@ -0,0 +1,655 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#define GL_GLEXT_PROTOTYPES 1
+#include <GL/gl.h>
+// glext.h after gl.h, clang-format don't sort
+#include <GL/glext.h>
+
+#include <CaptureFormat.hpp>
+#include <HeadlessContext.hpp>
+
+static const char * usage = R"(usage: gl_replay CAPTURE [options]
+
+Replay a capture written with GL_CAPTURE in a headless context and time
+each frame.
+
+  --frames A:B    time frames A up to B, earlier frames only create
+                  resources, B may be left out to run to the end
+  --repeat N      replay the timed frames N times (default 1)
+  --warmup N      replay them N times untimed first (default 1), so
+                  shader compilation doesn't count
+  --csv FILE      write the time of each frame as CSV
+  --json FILE     write the times and a summary as JSON
+  --image FILE    write the last frame as a binary PPM image
+)";
+
+/**
+ * Executes capture records, mapping the object names and uniform locations
+ * of the capture to its own.
+ */
+class Replayer {
+    const CaptureReader & reader;
+    unordered_map<uint64_t, GLuint> buffers;
+    unordered_map<uint64_t, GLuint> arrays;
+    unordered_map<uint64_t, GLuint> programs;
+    unordered_map<uint64_t, GLuint> textures;
+    unordered_map<uint64_t, GLuint> framebuffers;
+    unordered_map<uint64_t, GLuint> renderbuffers;
+    // Captured program and location to replay location
+    map<pair<uint64_t, uint64_t>, GLint> locations;
+    uint64_t program;
+
+    // Stands in for the default frame buffer of the captured window
+    GLuint frameBuffer;
+    GLuint colorBuffer;
+    GLuint depthBuffer;
+    GLsizei width, height;
+
+public:
+    /// Draws, clears and blits are skipped while false.
+    bool drawing;
+
+    Replayer(const CaptureReader & reader)
+        : reader(reader),
+          program(0),
+          width(reader.getWidth()),
+          height(reader.getHeight()),
+          drawing(true) {
+        glGenRenderbuffers(1, &colorBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width,
+                              height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &frameBuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                  GL_RENDERBUFFER, colorBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                                  GL_RENDERBUFFER, depthBuffer);
+        glViewport(0, 0, width, height);
+    }
+
+    Replayer(const Replayer &) = delete;
+    Replayer & operator=(const Replayer &) = delete;
+
+    void execute(const CaptureFormat::Record & record) {
+        auto & a = record.args;
+        auto data = [&](size_t i = 0) -> const void * {
+            return i < record.payloads.size()
+                       ? reader.getPayload(record.payloads[i])
+                       : nullptr;
+        };
+        auto i32 = [&](size_t i) { return GLint(int32_t(uint32_t(a[i]))); };
+        auto u32 = [&](size_t i) { return GLuint(a[i]); };
+        auto f32 = [&](size_t i) { return CaptureFormat::bitsFloat(a[i]); };
+        auto offset = [&](size_t i) {
+            return reinterpret_cast<const void *>(uintptr_t(a[i]));
+        };
+
+        switch (record.op) {
+            case CaptureFormat::GenBuffer:
+                glGenBuffers(1, &create(buffers, a[0], glDeleteBuffers));
+                break;
+            case CaptureFormat::DeleteBuffer:
+                destroy(buffers, a[0], glDeleteBuffers);
+                break;
+            case CaptureFormat::BindBuffer:
+                glBindBuffer(u32(0), find(buffers, a[1]));
+                break;
+            case CaptureFormat::BindBufferBase:
+                glBindBufferBase(u32(0), u32(1), find(buffers, a[2]));
+                break;
+            case CaptureFormat::BufferData:
+                glBufferData(u32(0), a[1], data(), u32(2));
+                break;
+            case CaptureFormat::BufferSubData:
+                glBufferSubData(u32(0), a[1], a[2], data());
+                break;
+
+            case CaptureFormat::GenVertexArray:
+                glGenVertexArrays(1,
+                                  &create(arrays, a[0], glDeleteVertexArrays));
+                break;
+            case CaptureFormat::DeleteVertexArray:
+                destroy(arrays, a[0], glDeleteVertexArrays);
+                break;
+            case CaptureFormat::BindVertexArray:
+                glBindVertexArray(find(arrays, a[0]));
+                break;
+            case CaptureFormat::VertexAttribPointer:
+                glVertexAttribPointer(u32(0), i32(1), u32(2), GLboolean(a[3]),
+                                      i32(4), offset(5));
+                break;
+            case CaptureFormat::VertexAttribDivisor:
+                glVertexAttribDivisor(u32(0), u32(1));
+                break;
+            case CaptureFormat::EnableVertexAttribArray:
+                glEnableVertexAttribArray(u32(0));
+                break;
+            case CaptureFormat::DisableVertexAttribArray:
+                glDisableVertexAttribArray(u32(0));
+                break;
+
+            case CaptureFormat::DrawArrays:
+                if (drawing)
+                    glDrawArrays(u32(0), i32(1), i32(2));
+                break;
+            case CaptureFormat::DrawArraysInstanced:
+                if (drawing)
+                    glDrawArraysInstanced(u32(0), i32(1), i32(2), i32(3));
+                break;
+            case CaptureFormat::DrawElements:
+                if (drawing)
+                    glDrawElements(u32(0), i32(1), u32(2), offset(3));
+                break;
+            case CaptureFormat::DrawElementsInstanced:
+                if (drawing)
+                    glDrawElementsInstanced(u32(0), i32(1), u32(2), offset(3),
+                                            i32(4));
+                break;
+
+            case CaptureFormat::CreateProgram:
+                createProgram(a[0], static_cast<const char *>(data(0)),
+                              static_cast<const char *>(data(1)));
+                break;
+            case CaptureFormat::DeleteProgram:
+                destroy(programs, a[0], [](GLsizei, const GLuint * id) {
+                    glDeleteProgram(*id);
+                });
+                break;
+            case CaptureFormat::UseProgram:
+                program = a[0];
+                glUseProgram(find(programs, a[0]));
+                break;
+            case CaptureFormat::UniformLocation:
+                locations[{a[0], a[1]}] = glGetUniformLocation(
+                    find(programs, a[0]), static_cast<const char *>(data()));
+                break;
+            case CaptureFormat::Uniform:
+                uniform(record);
+                break;
+
+            case CaptureFormat::GenTexture:
+                glGenTextures(1, &create(textures, a[0], glDeleteTextures));
+                break;
+            case CaptureFormat::DeleteTexture:
+                destroy(textures, a[0], glDeleteTextures);
+                break;
+            case CaptureFormat::BindTexture:
+                glBindTexture(u32(0), find(textures, a[1]));
+                break;
+            case CaptureFormat::ActiveTexture:
+                glActiveTexture(u32(0));
+                break;
+            case CaptureFormat::TexImage2D:
+                glTexImage2D(u32(0), i32(1), i32(2), i32(3), i32(4), i32(5),
+                             u32(6), u32(7), data());
+                break;
+            case CaptureFormat::TexSubImage2D:
+                glTexSubImage2D(u32(0), i32(1), i32(2), i32(3), i32(4), i32(5),
+                                u32(6), u32(7), data());
+                break;
+            case CaptureFormat::TexImage3D:
+                glTexImage3D(u32(0), i32(1), i32(2), i32(3), i32(4), i32(5),
+                             i32(6), u32(7), u32(8), data());
+                break;
+            case CaptureFormat::TexSubImage3D:
+                glTexSubImage3D(u32(0), i32(1), i32(2), i32(3), i32(4), i32(5),
+                                i32(6), i32(7), u32(8), u32(9), data());
+                break;
+            case CaptureFormat::CompressedTexImage2D:
+                glCompressedTexImage2D(u32(0), i32(1), u32(2), i32(3), i32(4),
+                                       i32(5), i32(6), data());
+                break;
+            case CaptureFormat::TexImage2DMultisample:
+                glTexImage2DMultisample(u32(0), i32(1), u32(2), i32(3), i32(4),
+                                        GLboolean(a[5]));
+                break;
+            case CaptureFormat::TexStorage2D:
+                glTexStorage2D(u32(0), i32(1), u32(2), i32(3), i32(4));
+                break;
+            case CaptureFormat::TexStorage2DMultisample:
+                glTexStorage2DMultisample(u32(0), i32(1), u32(2), i32(3),
+                                          i32(4), GLboolean(a[5]));
+                break;
+            case CaptureFormat::TexParameteri:
+                glTexParameteri(u32(0), u32(1), i32(2));
+                break;
+            case CaptureFormat::GenerateMipmap:
+                glGenerateMipmap(u32(0));
+                break;
+            case CaptureFormat::PixelStorei:
+                glPixelStorei(u32(0), i32(1));
+                break;
+
+            case CaptureFormat::GenFramebuffer:
+                glGenFramebuffers(1, &create(framebuffers, a[0],
+                                             glDeleteFramebuffers));
+                break;
+            case CaptureFormat::DeleteFramebuffer:
+                destroy(framebuffers, a[0], glDeleteFramebuffers);
+                break;
+            case CaptureFormat::BindFramebuffer:
+                glBindFramebuffer(u32(0), a[1] ? find(framebuffers, a[1])
+                                               : frameBuffer);
+                break;
+            case CaptureFormat::FramebufferTexture2D:
+                glFramebufferTexture2D(u32(0), u32(1), u32(2),
+                                       find(textures, a[3]), i32(4));
+                break;
+            case CaptureFormat::FramebufferRenderbuffer:
+                glFramebufferRenderbuffer(u32(0), u32(1), u32(2),
+                                          find(renderbuffers, a[3]));
+                break;
+            case CaptureFormat::GenRenderbuffer:
+                glGenRenderbuffers(1, &create(renderbuffers, a[0],
+                                              glDeleteRenderbuffers));
+                break;
+            case CaptureFormat::DeleteRenderbuffer:
+                destroy(renderbuffers, a[0], glDeleteRenderbuffers);
+                break;
+            case CaptureFormat::BindRenderbuffer:
+                glBindRenderbuffer(u32(0), find(renderbuffers, a[1]));
+                break;
+            case CaptureFormat::RenderbufferStorage:
+                glRenderbufferStorage(u32(0), u32(1), i32(2), i32(3));
+                break;
+            case CaptureFormat::RenderbufferStorageMultisample:
+                glRenderbufferStorageMultisample(u32(0), i32(1), u32(2),
+                                                 i32(3), i32(4));
+                break;
+            case CaptureFormat::BlitFramebuffer:
+                if (drawing)
+                    glBlitFramebuffer(i32(0), i32(1), i32(2), i32(3), i32(4),
+                                      i32(5), i32(6), i32(7), u32(8), u32(9));
+                break;
+            case CaptureFormat::Viewport:
+                glViewport(i32(0), i32(1), i32(2), i32(3));
+                break;
+
+            case CaptureFormat::Clear:
+                if (drawing)
+                    glClear(u32(0));
+                break;
+            case CaptureFormat::ClearColor:
+                glClearColor(f32(0), f32(1), f32(2), f32(3));
+                break;
+            case CaptureFormat::Enable:
+                glEnable(u32(0));
+                break;
+            case CaptureFormat::Disable:
+                glDisable(u32(0));
+                break;
+            case CaptureFormat::BlendFunc:
+                glBlendFunc(u32(0), u32(1));
+                break;
+            case CaptureFormat::DepthFunc:
+                glDepthFunc(u32(0));
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    /// Read the color of the default frame buffer, bottom row first.
+    vector<unsigned char> readPixels() const {
+        vector<unsigned char> pixels(size_t(width) * height * 3);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, frameBuffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE,
+                     pixels.data());
+        return pixels;
+    }
+
+    GLsizei getWidth() const {
+        return width;
+    }
+
+    GLsizei getHeight() const {
+        return height;
+    }
+
+private:
+    using DeleteFunction = void (*)(GLsizei, const GLuint *);
+
+    /// Slot for a new object, deleting one left from an earlier repeat.
+    static GLuint & create(unordered_map<uint64_t, GLuint> & names,
+                           uint64_t id,
+                           DeleteFunction remove) {
+        auto it = names.find(id);
+        if (it != names.end())
+            remove(1, &it->second);
+        return names[id];
+    }
+
+    static void destroy(unordered_map<uint64_t, GLuint> & names,
+                        uint64_t id,
+                        DeleteFunction remove) {
+        auto it = names.find(id);
+        if (it == names.end())
+            return;
+        remove(1, &it->second);
+        names.erase(it);
+    }
+
+    static GLuint find(const unordered_map<uint64_t, GLuint> & names,
+                       uint64_t id) {
+        auto it = names.find(id);
+        return it == names.end() ? 0 : it->second;
+    }
+
+    void createProgram(uint64_t id,
+                       const char * vertexSource,
+                       const char * fragmentSource) {
+        if (!vertexSource || !fragmentSource)
+            throw runtime_error("Program without sources in capture");
+
+        GLuint program = glCreateProgram();
+        GLuint shaders[] = {compile(GL_VERTEX_SHADER, vertexSource),
+                            compile(GL_FRAGMENT_SHADER, fragmentSource)};
+        for (GLuint shader : shaders)
+            glAttachShader(program, shader);
+        glLinkProgram(program);
+        for (GLuint shader : shaders) {
+            glDetachShader(program, shader);
+            glDeleteShader(shader);
+        }
+
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+            throw runtime_error("Failed to link captured program "
+                                + to_string(id));
+
+        create(programs, id, [](GLsizei, const GLuint * old) {
+            glDeleteProgram(*old);
+        }) = program;
+    }
+
+    static GLuint compile(GLenum type, const char * source) {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        GLint success = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+            throw runtime_error("Failed to compile captured shader");
+        return shader;
+    }
+
+    void uniform(const CaptureFormat::Record & record) {
+        auto & a = record.args;
+        auto it = locations.find({program, a[1]});
+        // Locations queried before the capture started are kept as they are
+        GLint location = it != locations.end() ? it->second
+                                               : GLint(int32_t(uint32_t(a[1])));
+        auto values = [&]() {
+            if (record.payloads.empty())
+                throw runtime_error("Uniform without values in capture");
+            return reinterpret_cast<const GLfloat *>(
+                reader.getPayload(record.payloads[0]));
+        };
+
+        switch (a[0]) {
+            case CaptureFormat::Uniform1i:
+                glUniform1i(location, GLint(int32_t(uint32_t(a[2]))));
+                break;
+            case CaptureFormat::Uniform1ui:
+                glUniform1ui(location, GLuint(a[2]));
+                break;
+            case CaptureFormat::Uniform1f:
+                glUniform1f(location, CaptureFormat::bitsFloat(a[2]));
+                break;
+            case CaptureFormat::Uniform1d:
+                glUniform1d(location,
+                            *reinterpret_cast<const GLdouble *>(values()));
+                break;
+            case CaptureFormat::Uniform2fv:
+                glUniform2fv(location, 1, values());
+                break;
+            case CaptureFormat::Uniform3fv:
+                glUniform3fv(location, 1, values());
+                break;
+            case CaptureFormat::Uniform4fv:
+                glUniform4fv(location, 1, values());
+                break;
+            case CaptureFormat::UniformMatrix2fv:
+                glUniformMatrix2fv(location, 1, GL_FALSE, values());
+                break;
+            case CaptureFormat::UniformMatrix3fv:
+                glUniformMatrix3fv(location, 1, GL_FALSE, values());
+                break;
+            case CaptureFormat::UniformMatrix4fv:
+                glUniformMatrix4fv(location, 1, GL_FALSE, values());
+                break;
+        }
+    }
+};
+
+struct FrameTime {
+    size_t repeat;
+    size_t frame;
+    double cpu;
+    double gpu;
+};
+
+struct Summary {
+    double mean;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+};
+
+static Summary summarize(vector<double> values) {
+    if (values.empty())
+        return {0, 0, 0, 0, 0};
+    sort(values.begin(), values.end());
+    auto percentile = [&](double p) {
+        size_t i = size_t(p / 100 * (values.size() - 1) + 0.5);
+        return values[i];
+    };
+    double sum = 0;
+    for (double v : values)
+        sum += v;
+    return {sum / values.size(), percentile(50), percentile(95),
+            percentile(99), values.back()};
+}
+
+static void writeSummary(ostream & out, const Summary & s) {
+    out << "{\"mean\": " << s.mean << ", \"p50\": " << s.p50
+        << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99
+        << ", \"max\": " << s.max << "}";
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2 || argv[1][0] == '-') {
+        cerr << usage;
+        return 1;
+    }
+
+    string capturePath = argv[1];
+    size_t first = 0;
+    size_t last = SIZE_MAX;
+    size_t repeat = 1;
+    size_t warmup = 1;
+    string csvPath, jsonPath, imagePath;
+
+    for (int i = 2; i < argc; i++) {
+        string option = argv[i];
+        if (i + 1 >= argc) {
+            cerr << "Missing value for " << option << endl << usage;
+            return 1;
+        }
+        string value = argv[++i];
+        if (option == "--frames") {
+            size_t colon = value.find(':');
+            first = strtoull(value.c_str(), nullptr, 10);
+            if (colon != string::npos && colon + 1 < value.size())
+                last = strtoull(value.c_str() + colon + 1, nullptr, 10);
+            else if (colon == string::npos)
+                last = first + 1;
+        }
+        else if (option == "--repeat")
+            repeat = max<size_t>(1, strtoull(value.c_str(), nullptr, 10));
+        else if (option == "--warmup")
+            warmup = strtoull(value.c_str(), nullptr, 10);
+        else if (option == "--csv")
+            csvPath = value;
+        else if (option == "--json")
+            jsonPath = value;
+        else if (option == "--image")
+            imagePath = value;
+        else {
+            cerr << "Unknown option " << option << endl << usage;
+            return 1;
+        }
+    }
+
+    try {
+        ifstream file(capturePath, ios::binary);
+        if (!file)
+            throw runtime_error("Failed to open " + capturePath);
+        CaptureReader reader(file);
+
+        HeadlessContext context;
+        cout << "Replaying " << capturePath << " (" << reader.getWidth() << "x"
+             << reader.getHeight() << ") on " << glGetString(GL_RENDERER)
+             << endl;
+
+        Replayer replayer(reader);
+
+        // Run up to the first timed frame without drawing, keep the records
+        // of the timed frames
+        vector<vector<CaptureFormat::Record>> frames;
+        CaptureFormat::Record record;
+        size_t frame = 0;
+        replayer.drawing = false;
+        while (frame < last && reader.next(record)) {
+            if (frame < first) {
+                replayer.execute(record);
+                if (record.op == CaptureFormat::EndFrame)
+                    frame++;
+                continue;
+            }
+            if (frames.size() <= frame - first)
+                frames.emplace_back();
+            frames.back().push_back(record);
+            if (record.op == CaptureFormat::EndFrame)
+                frame++;
+        }
+        // Drop a partial frame at the end of the capture
+        if (!frames.empty()
+            && (frames.back().empty()
+                || frames.back().back().op != CaptureFormat::EndFrame))
+            frames.pop_back();
+        if (frames.empty())
+            throw runtime_error("No frames to replay from frame "
+                                + to_string(first));
+        glFinish();
+
+        GLuint query;
+        glGenQueries(1, &query);
+        vector<FrameTime> times;
+        replayer.drawing = true;
+        for (size_t r = 0; r < warmup + repeat; r++) {
+            for (size_t f = 0; f < frames.size(); f++) {
+                auto start = chrono::steady_clock::now();
+                glBeginQuery(GL_TIME_ELAPSED, query);
+                for (auto & record : frames[f])
+                    replayer.execute(record);
+                glEndQuery(GL_TIME_ELAPSED);
+                auto end = chrono::steady_clock::now();
+
+                // Waiting for each frame keeps frames from overlapping
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+                if (r < warmup)
+                    continue;
+                times.push_back(
+                    {r - warmup, first + f,
+                     chrono::duration<double, milli>(end - start).count(),
+                     elapsed / 1.0e6});
+            }
+        }
+        glDeleteQueries(1, &query);
+
+        GLenum error = glGetError();
+        if (error != GL_NO_ERROR)
+            cerr << "GL error 0x" << hex << error << dec << " during replay"
+                 << endl;
+
+        vector<double> cpu, gpu;
+        for (auto & time : times) {
+            cpu.push_back(time.cpu);
+            gpu.push_back(time.gpu);
+        }
+        Summary cpuSummary = summarize(cpu);
+        Summary gpuSummary = summarize(gpu);
+
+        cout << fixed << setprecision(3) << "frames " << first << "-"
+             << first + frames.size() - 1 << " x" << repeat << endl;
+        cout << "cpu ms: mean " << cpuSummary.mean << ", p50 " << cpuSummary.p50
+             << ", p95 " << cpuSummary.p95 << ", p99 " << cpuSummary.p99
+             << endl;
+        cout << "gpu ms: mean " << gpuSummary.mean << ", p50 " << gpuSummary.p50
+             << ", p95 " << gpuSummary.p95 << ", p99 " << gpuSummary.p99
+             << endl;
+
+        if (!csvPath.empty()) {
+            ofstream csv(csvPath);
+            csv << "repeat,frame,cpu_ms,gpu_ms\n" << fixed << setprecision(4);
+            for (auto & time : times)
+                csv << time.repeat << "," << time.frame << "," << time.cpu
+                    << "," << time.gpu << "\n";
+        }
+
+        if (!jsonPath.empty()) {
+            ofstream json(jsonPath);
+            json << fixed << setprecision(4) << "{\"capture\": \"" << capturePath
+                 << "\", \"repeat\": " << repeat << ", \"cpu_ms\": ";
+            writeSummary(json, cpuSummary);
+            json << ", \"gpu_ms\": ";
+            writeSummary(json, gpuSummary);
+            json << ", \"frames\": [";
+            for (size_t i = 0; i < times.size(); i++)
+                json << (i ? ", " : "") << "{\"frame\": " << times[i].frame
+                     << ", \"cpu_ms\": " << times[i].cpu
+                     << ", \"gpu_ms\": " << times[i].gpu << "}";
+            json << "]}\n";
+        }
+
+        if (!imagePath.empty()) {
+            vector<unsigned char> pixels = replayer.readPixels();
+            ofstream image(imagePath, ios::binary);
+            int w = replayer.getWidth();
+            int h = replayer.getHeight();
+            image << "P6\n" << w << " " << h << "\n255\n";
+            for (int y = h - 1; y >= 0; y--)
+                image.write(reinterpret_cast<const char *>(&pixels[y * w * 3]),
+                            w * 3);
+        }
+    }
+    catch (const exception & e) {
+        cerr << "gl_replay: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
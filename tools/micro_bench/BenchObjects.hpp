@@ -0,0 +1,199 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <Bounds.hpp>
+#include <BoundsBuffer.hpp>
+#include <Buffer.hpp>
+#include <Frustum.hpp>
+#include <MeshLod.hpp>
+#include <RenderQueue.hpp>
+#include <Shader.hpp>
+#include <Transform.hpp>
+#include <World.hpp>
+
+/**
+ * The objects micro_bench times, the same ones each call, so each run and
+ * baseline.csv time the same work.
+ */
+
+/// count random transforms, the same ones each call.
+static std::vector<Transform> randomTransforms(size_t count) {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-100, 100),
+        angle(-3.14f, 3.14f), scale(0.1f, 10);
+    std::vector<Transform> transforms;
+    for (size_t i = 0; i < count; i++)
+        transforms.emplace_back(
+            glm::vec3(position(random), position(random), position(random)),
+            glm::quat(glm::vec3(angle(random), angle(random), angle(random))),
+            glm::vec3(scale(random), scale(random), scale(random)));
+    return transforms;
+}
+
+static const char * vertexSource = R"(
+#version 330 core
+void main() {}
+)";
+
+static const char * fragmentSource = R"(
+#version 330 core
+void main() {}
+)";
+
+/// A component the examples don't have, for the ECS checks.
+struct Velocity {
+    glm::vec3 value;
+};
+
+/**
+ * count entities with a transform, velocity, mesh, material and bounds,
+ * the meshes and materials picked at random from the given ones.
+ */
+static World randomWorld(size_t count,
+                         const std::vector<Mesh> & meshes,
+                         const std::vector<Material> & materials) {
+    std::mt19937 random(3);
+    World world;
+    AABB box(glm::vec3(-1), glm::vec3(1));
+    for (auto & transform : randomTransforms(count))
+        world.create(transform, Velocity {glm::vec3(0.01f)},
+                     meshes[random() % meshes.size()],
+                     materials[random() % materials.size()], Bounds(box));
+    return world;
+}
+
+/// Meshes and materials of null GL objects for the render queue.
+struct RenderAssets {
+    std::vector<Shader> shaders;
+    std::vector<BufferArray> arrays;
+    std::vector<Mesh> meshes;
+    std::vector<Material> materials;
+
+    RenderAssets(size_t shaderCount, size_t meshCount, bool instanced) {
+        for (size_t i = 0; i < shaderCount; i++)
+            shaders.emplace_back(vertexSource, fragmentSource);
+        for (size_t i = 0; i < meshCount; i++)
+            arrays.emplace_back(std::vector<std::vector<Attribute>> {{}, {}});
+        for (auto & shader : shaders)
+            materials.push_back({&shader, {}});
+        for (auto & array : arrays)
+            meshes.push_back(
+                {&array, 36, GL_UNSIGNED_INT, GL_TRIANGLES, 0,
+                 instanced ? 1 : -1});
+    }
+};
+
+/// count boxes of 0.5 to 4 units a side scattered over a 200 unit cube.
+static std::vector<AABB> randomBoxes(size_t count) {
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> position(-100, 100), extent(0.25f, 2);
+    std::vector<AABB> boxes;
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 center(position(random), position(random), position(random));
+        glm::vec3 extents(extent(random), extent(random), extent(random));
+        boxes.emplace_back(center - extents, center + extents);
+    }
+    return boxes;
+}
+
+/// The boxes, every other one as its bounding sphere.
+static BoundsBuffer boundsOf(const std::vector<AABB> & boxes) {
+    BoundsBuffer buffer;
+    buffer.reserve(boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++) {
+        if (i % 2)
+            buffer.add(Sphere::fromAABB(boxes[i]));
+        else
+            buffer.add(boxes[i]);
+    }
+    return buffer;
+}
+
+/// A 60 degree camera at the origin looking along direction, seeing about
+/// a tenth of randomBoxes().
+static Frustum cameraFrustum(const glm::vec3 & direction) {
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9,
+                                            0.1f, 150.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0), direction, glm::vec3(0, 1, 0));
+    return Frustum::fromMatrix(projection * view);
+}
+
+/// A camera at the origin looking along -z, with the 2:1 aspect of the
+/// default OcclusionBuffer.
+static glm::mat4 occlusionCamera() {
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 2.0f, 0.1f,
+                                            150.0f);
+    return projection
+           * glm::lookAt(glm::vec3(0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0));
+}
+
+/// Models of count unit box occluders, 1 to 6 units a side and turned
+/// about y, in front of occlusionCamera() and some past its sides.
+static std::vector<glm::mat4> randomOccluders(size_t count) {
+    std::mt19937 random(17);
+    std::uniform_real_distribution<float> x(-40, 40), y(-15, 15), z(-60, -5);
+    std::uniform_real_distribution<float> size(1, 6), angle(0, 3.14f);
+    std::vector<glm::mat4> models;
+    for (size_t i = 0; i < count; i++) {
+        Transform transform(glm::vec3(x(random), y(random), z(random)),
+                            glm::quat(glm::vec3(0, angle(random), 0)),
+                            glm::vec3(size(random), size(random),
+                                      size(random)));
+        models.push_back(transform.toMatrix());
+    }
+    return models;
+}
+
+/// The vertices, texture coordinates and triangles of a mesh to simplify.
+struct LodMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<float> texCoords;
+    std::vector<GLuint> indices;
+};
+
+/**
+ * A unit sphere of rows by 2 * rows quads with bumps, wound outwards. The
+ * first column of vertices repeats at the end with u = 1, a texture seam,
+ * and so does the vertex at each pole for each column.
+ */
+static LodMesh bumpySphere(int rows) {
+    const float pi = 3.14159265f;
+    int columns = 2 * rows;
+    LodMesh mesh;
+    for (int r = 0; r <= rows; r++) {
+        for (int c = 0; c <= columns; c++) {
+            float theta = pi * r / rows, phi = 2 * pi * (c % columns) / columns;
+            float radius =
+                1 + 0.1f * std::sin(5 * theta) * std::sin(4 * phi);
+            glm::vec3 position(radius * std::sin(theta) * std::cos(phi),
+                               radius * std::cos(theta),
+                               radius * std::sin(theta) * std::sin(phi));
+            if (r == 0 || r == rows)
+                position = glm::vec3(0, r == 0 ? 1 : -1, 0);
+            mesh.positions.push_back(position);
+            mesh.texCoords.push_back(float(c) / columns);
+            mesh.texCoords.push_back(float(r) / rows);
+        }
+    }
+    auto vertex = [&](int r, int c) { return GLuint(r * (columns + 1) + c); };
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            if (r > 0)
+                mesh.indices.insert(mesh.indices.end(),
+                                    {vertex(r, c), vertex(r, c + 1),
+                                     vertex(r + 1, c + 1)});
+            if (r + 1 < rows)
+                mesh.indices.insert(mesh.indices.end(),
+                                    {vertex(r, c), vertex(r + 1, c + 1),
+                                     vertex(r + 1, c)});
+        }
+    }
+    return mesh;
+}
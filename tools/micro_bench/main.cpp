@@ -0,0 +1,810 @@
+#include <atomic>
+#include <cmath>
+#include <ostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+
+#include <benchmark/benchmark.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include <BVH.hpp>
+#include <Bounds.hpp>
+#include <BoundsBuffer.hpp>
+#include <Buffer.hpp>
+#include <Frustum.hpp>
+#include <InstanceBuffer.hpp>
+#include <JobSystem.hpp>
+#include <MeshLod.hpp>
+#include <NullGL.hpp>
+#include <OcclusionBuffer.hpp>
+#include <RenderQueue.hpp>
+#include <SceneGraph.hpp>
+#include <Shader.hpp>
+#include <SystemScheduler.hpp>
+#include <Texture.hpp>
+#include <Transform.hpp>
+#include <TransformBuffer.hpp>
+#include <World.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "BenchObjects.hpp"
+
+static const char * resources = "../../../examples/res";
+
+static void transformToMatrix(benchmark::State & state) {
+    Transform transform(glm::vec3(1, 2, 3), glm::quat(glm::vec3(0.1f)),
+                        glm::vec3(2));
+    const glm::quat delta(glm::vec3(0.01f, 0.02f, 0.03f));
+    for (auto _ : state) {
+        // Rotating marks the matrix changed, so every call recomputes it
+        transform.rotate(delta);
+        benchmark::DoNotOptimize(transform.toMatrix());
+    }
+}
+BENCHMARK(transformToMatrix);
+
+static void transformToMatrixCached(benchmark::State & state) {
+    Transform transform(glm::vec3(1, 2, 3), glm::quat(glm::vec3(0.1f)),
+                        glm::vec3(2));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(transform.toMatrix());
+}
+BENCHMARK(transformToMatrixCached);
+
+static void transformFromMatrix(benchmark::State & state) {
+    glm::mat4 matrix = Transform(glm::vec3(1, 2, 3),
+                                 glm::quat(glm::vec3(0.1f, 0.2f, 0.3f)),
+                                 glm::vec3(2))
+                           .toMatrix();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(matrix);
+        Transform transform(matrix);
+        benchmark::DoNotOptimize(transform);
+    }
+}
+BENCHMARK(transformFromMatrix);
+
+/// Compose range(0) matrices, every transform changed.
+static void transformToMatrixMany(benchmark::State & state) {
+    vector<Transform> transforms = randomTransforms(state.range(0));
+    vector<glm::mat4> matrices(transforms.size());
+    for (auto _ : state) {
+        for (size_t i = 0; i < transforms.size(); i++) {
+            transforms[i].setScale(transforms[i].getScale());
+            matrices[i] = transforms[i].toMatrix();
+        }
+        benchmark::DoNotOptimize(matrices.data());
+    }
+    state.SetItemsProcessed(state.iterations() * transforms.size());
+}
+BENCHMARK(transformToMatrixMany)->Arg(1000)->Arg(100000);
+
+static void transformBufferArgs(benchmark::internal::Benchmark * benchmark) {
+    benchmark->ArgNames({"count", "kernel"});
+    for (int kernel = TransformBuffer::Scalar; kernel <= TransformBuffer::AVX2;
+         kernel++) {
+        if (!TransformBuffer::supported(TransformBuffer::Kernel(kernel)))
+            continue;
+        benchmark->Args({1000, kernel});
+        benchmark->Args({100000, kernel});
+    }
+}
+
+/// Compose range(0) matrices with kernel range(1), every transform dirty.
+static void transformBufferUpdate(benchmark::State & state) {
+    TransformBuffer buffer;
+    for (auto & transform : randomTransforms(state.range(0)))
+        buffer.add(transform);
+    auto kernel = TransformBuffer::Kernel(state.range(1));
+    for (auto _ : state) {
+        buffer.markAllDirty();
+        buffer.update(kernel);
+        benchmark::DoNotOptimize(buffer.getMatrices().data());
+    }
+    state.SetItemsProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(transformBufferUpdate)->Apply(transformBufferArgs);
+
+/// Compose range(0) mat3x4s with kernel range(1).
+static void transformBufferMat3x4(benchmark::State & state) {
+    TransformBuffer buffer;
+    for (auto & transform : randomTransforms(state.range(0)))
+        buffer.add(transform);
+    vector<glm::mat3x4> matrices(buffer.size());
+    auto kernel = TransformBuffer::Kernel(state.range(1));
+    for (auto _ : state) {
+        buffer.composeMat3x4(0, buffer.size(), matrices.data(), kernel);
+        benchmark::DoNotOptimize(matrices.data());
+    }
+    state.SetItemsProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(transformBufferMat3x4)->Apply(transformBufferArgs);
+
+/**
+ * Move range(1) percent of range(0) instances, picked at random, and
+ * update an InstanceBuffer of packing range(2). The uploads go to the
+ * stubs, so this times packing and finding the ranges.
+ */
+static void instanceBufferUpdate(benchmark::State & state) {
+    TransformBuffer transforms;
+    for (auto & transform : randomTransforms(state.range(0)))
+        transforms.add(transform);
+    InstanceBuffer instances(InstanceBuffer::Packing(state.range(2)));
+    instances.update(transforms);
+
+    vector<size_t> changed;
+    mt19937 random(12);
+    bernoulli_distribution pick(state.range(1) / 100.0);
+    for (size_t i = 0; i < transforms.size(); i++) {
+        if (pick(random))
+            changed.push_back(i);
+    }
+    InstanceBuffer::Stats stats;
+    float step = 1;
+    for (auto _ : state) {
+        for (size_t i : changed)
+            transforms.move(i, glm::vec3(step, 0, 0));
+        stats = instances.update(transforms);
+        step = -step;
+    }
+    state.SetItemsProcessed(state.iterations() * changed.size());
+    state.counters["ranges"] = double(stats.ranges);
+    state.counters["MB"] = stats.bytes / 1e6;
+}
+BENCHMARK(instanceBufferUpdate)
+    ->ArgNames({"count", "percent", "packing"})
+    ->ArgsProduct({{10000, 100000, 1000000},
+                   {1, 10, 100},
+                   {InstanceBuffer::Mat4, InstanceBuffer::Mat3x4,
+                    InstanceBuffer::QuatPosScale}})
+    ->Unit(benchmark::kMicrosecond);
+
+enum HierarchyShape {
+    Deep,
+    Wide,
+    Tree,
+};
+
+/// count nodes in a chain, under one root or in a tree of 4 children each.
+static SceneGraph hierarchy(HierarchyShape shape, size_t count) {
+    vector<Transform> transforms = randomTransforms(count);
+    vector<SceneGraph::Node> nodes;
+    SceneGraph graph;
+    graph.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        SceneGraph::Node parent = SceneGraph::none;
+        if (i > 0)
+            parent = shape == Deep ? nodes[i - 1]
+                     : shape == Wide ? nodes[0]
+                                     : nodes[(i - 1) / 4];
+        nodes.push_back(graph.add(parent, transforms[i]));
+    }
+    graph.update();
+    return graph;
+}
+
+static void hierarchyArgs(benchmark::internal::Benchmark * benchmark) {
+    benchmark->ArgNames({"shape", "dirty"});
+    for (int shape : {Deep, Wide, Tree}) {
+        // No node, the root, 1% of nodes
+        for (int dirty = 0; dirty < 3; dirty++)
+            benchmark->Args({shape, dirty});
+    }
+}
+
+/// Update 10^5 nodes of shape range(0), with range(1) dirty.
+static void sceneGraphUpdate(benchmark::State & state) {
+    SceneGraph graph = hierarchy(HierarchyShape(state.range(0)), 100000);
+    const glm::quat delta(glm::vec3(0.01f));
+    mt19937 random(1);
+    for (auto _ : state) {
+        if (state.range(1) == 1)
+            graph.editLocal(graph.getNode(0)).rotate(delta);
+        else if (state.range(1) == 2) {
+            for (size_t i = 0; i < graph.size() / 100; i++)
+                graph.editLocal(graph.getNode(random() % graph.size()))
+                    .rotate(delta);
+        }
+        benchmark::DoNotOptimize(graph.update());
+    }
+    state.SetItemsProcessed(state.iterations() * graph.size());
+}
+BENCHMARK(sceneGraphUpdate)->Apply(hierarchyArgs);
+
+/**
+ * Move the first of 10 trees of 10^4 nodes under the last node, past every
+ * other node, then make it a root again.
+ */
+static void sceneGraphReparent(benchmark::State & state) {
+    SceneGraph graph;
+    graph.reserve(100000);
+    for (size_t tree = 0; tree < 10; tree++) {
+        vector<SceneGraph::Node> nodes;
+        for (size_t i = 0; i < 10000; i++)
+            nodes.push_back(graph.add(i > 0 ? nodes[(i - 1) / 4]
+                                            : SceneGraph::none));
+    }
+    graph.update();
+
+    for (auto _ : state) {
+        SceneGraph::Node first = graph.getNode(0);
+        graph.setParent(first, graph.getNode(graph.size() - 1));
+        graph.setParent(first, SceneGraph::none);
+    }
+}
+BENCHMARK(sceneGraphReparent);
+
+/// Thread counts from 1 doubling up to the hardware threads, and those.
+static void threadArgs(benchmark::internal::Benchmark * benchmark) {
+    benchmark->ArgName("threads");
+    int hardware = max(1u, thread::hardware_concurrency());
+    for (int threads = 1; threads < hardware; threads *= 2)
+        benchmark->Arg(threads);
+    benchmark->Arg(hardware);
+}
+
+/// Compose 10^6 mat3x4s with a parallelFor on range(0) threads.
+static void jobSystemParallelFor(benchmark::State & state) {
+    TransformBuffer buffer;
+    for (auto & transform : randomTransforms(1000000))
+        buffer.add(transform);
+    vector<glm::mat3x4> matrices(buffer.size());
+    JobSystem jobs(state.range(0));
+    for (auto _ : state) {
+        jobs.parallelFor(0, buffer.size(), [&](size_t first, size_t last) {
+            buffer.composeMat3x4(first, last - first, matrices.data() + first);
+        });
+        benchmark::DoNotOptimize(matrices.data());
+    }
+    state.SetItemsProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(jobSystemParallelFor)->Apply(threadArgs)->UseRealTime();
+
+/// Run and wait for 10^4 empty jobs on range(0) threads.
+static void jobSystemEmptyJobs(benchmark::State & state) {
+    JobSystem jobs(state.range(0));
+    for (auto _ : state) {
+        JobCounter counter;
+        for (size_t i = 0; i < 10000; i++)
+            jobs.run([] {}, &counter);
+        jobs.wait(counter);
+    }
+    state.SetItemsProcessed(state.iterations() * 10000);
+}
+BENCHMARK(jobSystemEmptyJobs)->Apply(threadArgs)->UseRealTime();
+
+/// The components of an entity of the ECS benchmarks, as one struct.
+struct GameObject {
+    Transform transform;
+    Velocity velocity;
+    Mesh mesh;
+    Material material;
+    Bounds bounds;
+};
+
+/// Move 10^5 entities by their velocity, a query on 2 of 5 components.
+static void worldEachMove(benchmark::State & state) {
+    World world = randomWorld(100000, {Mesh()}, {Material()});
+    for (auto _ : state) {
+        world.each<Transform, const Velocity>(
+            [](Transform & transform, const Velocity & velocity) {
+                transform.move(velocity.value);
+            });
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * world.size());
+}
+BENCHMARK(worldEachMove);
+
+/// worldEachMove over an array of structs with all 5 components.
+static void gameObjectsMove(benchmark::State & state) {
+    vector<GameObject> objects;
+    for (auto & transform : randomTransforms(100000))
+        objects.push_back({transform, {glm::vec3(0.01f)}, {}, {}, {}});
+    for (auto _ : state) {
+        for (auto & object : objects)
+            object.transform.move(object.velocity.value);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * objects.size());
+}
+BENCHMARK(gameObjectsMove);
+
+/**
+ * Move 10^5 entities and update their world bounds, as two systems in
+ * two phases on range(0) threads.
+ */
+static void systemSchedulerRun(benchmark::State & state) {
+    World world = randomWorld(100000, {Mesh()}, {Material()});
+    SystemScheduler systems;
+    systems.add<Transform, const Velocity>(
+        "move", [](size_t count, Transform * transforms,
+                   const Velocity * velocities) {
+            for (size_t i = 0; i < count; i++)
+                transforms[i].move(velocities[i].value);
+        });
+    systems.add<const Transform, Bounds>(
+        "bounds",
+        [](size_t count, const Transform * transforms, Bounds * bounds) {
+            for (size_t i = 0; i < count; i++)
+                bounds[i].update(transforms[i].toMatrix());
+        });
+    JobSystem jobs(state.range(0));
+    for (auto _ : state)
+        systems.run(world, jobs);
+    state.SetItemsProcessed(state.iterations() * world.size());
+}
+BENCHMARK(systemSchedulerRun)->Apply(threadArgs)->UseRealTime();
+
+/// Collect and sort the draws of 10^5 entities of 8 shaders and 4 meshes.
+static void renderQueueBuild(benchmark::State & state) {
+    RenderAssets assets(8, 4, true);
+    World world = randomWorld(100000, assets.meshes, assets.materials);
+    RenderQueue queue;
+    for (auto _ : state) {
+        queue.clear();
+        queue.collect(world);
+        queue.sort();
+        benchmark::DoNotOptimize(queue.getBatches().data());
+    }
+    state.SetItemsProcessed(state.iterations() * world.size());
+}
+BENCHMARK(renderQueueBuild)->Unit(benchmark::kMillisecond);
+
+/// Submit the 32 batches of 10^5 entities, instanced if range(0).
+static void renderQueueSubmit(benchmark::State & state) {
+    RenderAssets assets(8, 4, state.range(0));
+    World world = randomWorld(100000, assets.meshes, assets.materials);
+    RenderQueue queue;
+    queue.collect(world);
+    queue.sort();
+    for (auto _ : state)
+        queue.submit();
+    state.SetItemsProcessed(state.iterations() * world.size());
+}
+BENCHMARK(renderQueueSubmit)
+    ->ArgName("instanced")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+static void boundsBufferArgs(benchmark::internal::Benchmark * benchmark) {
+    benchmark->ArgNames({"count", "kernel"});
+    for (int kernel = BoundsBuffer::Scalar; kernel <= BoundsBuffer::AVX2;
+         kernel++) {
+        if (!BoundsBuffer::supported(BoundsBuffer::Kernel(kernel)))
+            continue;
+        for (int count : {10000, 100000, 1000000})
+            benchmark->Args({count, kernel});
+    }
+}
+
+/// Cull range(0) objects with kernel range(1).
+static void boundsBufferCull(benchmark::State & state) {
+    BoundsBuffer buffer = boundsOf(randomBoxes(state.range(0)));
+    Frustum frustum = cameraFrustum(glm::vec3(0, 0, -1));
+    auto kernel = BoundsBuffer::Kernel(state.range(1));
+    vector<uint32_t> visible;
+    BoundsBuffer::Stats stats;
+    for (auto _ : state) {
+        stats = buffer.cull(frustum, visible, kernel);
+        benchmark::DoNotOptimize(visible.data());
+    }
+    state.counters["visible"] = double(stats.visible);
+    state.SetItemsProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(boundsBufferCull)->Apply(boundsBufferArgs);
+
+/// Cull 10^6 objects on range(0) threads.
+static void boundsBufferCullParallel(benchmark::State & state) {
+    BoundsBuffer buffer = boundsOf(randomBoxes(1000000));
+    Frustum frustum = cameraFrustum(glm::vec3(0, 0, -1));
+    JobSystem jobs(state.range(0));
+    vector<uint32_t> visible;
+    for (auto _ : state) {
+        buffer.cull(frustum, visible, jobs);
+        benchmark::DoNotOptimize(visible.data());
+    }
+    state.SetItemsProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(boundsBufferCullParallel)->Apply(threadArgs)->UseRealTime();
+
+/// Frustum::intersects over an array of range(0) boxes, for comparison.
+static void frustumIntersects(benchmark::State & state) {
+    vector<AABB> boxes = randomBoxes(state.range(0));
+    Frustum frustum = cameraFrustum(glm::vec3(0, 0, -1));
+    vector<uint32_t> visible;
+    for (auto _ : state) {
+        visible.clear();
+        for (size_t i = 0; i < boxes.size(); i++) {
+            if (frustum.intersects(boxes[i]))
+                visible.push_back(uint32_t(i));
+        }
+        benchmark::DoNotOptimize(visible.data());
+    }
+    state.SetItemsProcessed(state.iterations() * boxes.size());
+}
+BENCHMARK(frustumIntersects)->Arg(10000)->Arg(100000)->Arg(1000000);
+
+static void bvhArgs(benchmark::internal::Benchmark * benchmark) {
+    benchmark->ArgName("count");
+    for (int count : {10000, 100000, 1000000})
+        benchmark->Arg(count);
+}
+
+static BVH bvhOf(const vector<AABB> & boxes) {
+    BVH bvh;
+    for (auto & box : boxes)
+        bvh.insert(box);
+    bvh.rebuild();
+    return bvh;
+}
+
+/// Build a BVH of range(0) objects.
+static void bvhBuild(benchmark::State & state) {
+    vector<AABB> boxes = randomBoxes(state.range(0));
+    BVH bvh;
+    for (auto & box : boxes)
+        bvh.insert(box);
+    for (auto _ : state) {
+        bvh.rebuild();
+        benchmark::DoNotOptimize(bvh.getNodes().data());
+    }
+    state.SetItemsProcessed(state.iterations() * boxes.size());
+}
+BENCHMARK(bvhBuild)->Apply(bvhArgs)->Unit(benchmark::kMillisecond);
+
+/// Move range(1) percent of range(0) objects by up to a unit and refit.
+static void bvhRefit(benchmark::State & state) {
+    vector<AABB> boxes = randomBoxes(state.range(0));
+    BVH bvh = bvhOf(boxes);
+    vector<AABB> moved = boxes;
+    mt19937 random(11);
+    uniform_real_distribution<float> offset(-1, 1);
+    for (auto & box : moved) {
+        glm::vec3 move(offset(random), offset(random), offset(random));
+        box = AABB(box.min + move, box.max + move);
+    }
+    size_t step = 100 / state.range(1);
+    bool back = false;
+    for (auto _ : state) {
+        auto & to = back ? boxes : moved;
+        for (size_t i = 0; i < boxes.size(); i += step)
+            bvh.update(uint32_t(i), to[i]);
+        bvh.refit();
+        back = !back;
+    }
+    state.SetItemsProcessed(state.iterations() * (boxes.size() / step));
+}
+BENCHMARK(bvhRefit)
+    ->ArgNames({"count", "percent"})
+    ->ArgsProduct({{10000, 100000, 1000000}, {1, 10, 100}})
+    ->Unit(benchmark::kMicrosecond);
+
+/// The objects of range(0) in the view of cameraFrustum().
+static void bvhQueryFrustum(benchmark::State & state) {
+    BVH bvh = bvhOf(randomBoxes(state.range(0)));
+    Frustum frustum = cameraFrustum(glm::vec3(0, 0, -1));
+    vector<uint32_t> visible;
+    for (auto _ : state) {
+        visible.clear();
+        bvh.query(frustum, [&](uint32_t object) { visible.push_back(object); });
+        benchmark::DoNotOptimize(visible.data());
+    }
+    state.counters["visible"] = double(visible.size());
+    state.SetItemsProcessed(state.iterations() * bvh.size());
+}
+BENCHMARK(bvhQueryFrustum)->Apply(bvhArgs)->Unit(benchmark::kMicrosecond);
+
+/// 1000 queries of 10 unit boxes among range(0) objects.
+static void bvhQueryBox(benchmark::State & state) {
+    BVH bvh = bvhOf(randomBoxes(state.range(0)));
+    vector<AABB> queries = randomBoxes(1000);
+    for (auto & box : queries)
+        box = AABB(box.center() - glm::vec3(5), box.center() + glm::vec3(5));
+    size_t found = 0;
+    for (auto _ : state) {
+        found = 0;
+        for (auto & box : queries)
+            bvh.query(box, [&](uint32_t) { found++; });
+        benchmark::DoNotOptimize(found);
+    }
+    state.counters["found"] = double(found) / queries.size();
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+BENCHMARK(bvhQueryBox)->Apply(bvhArgs)->Unit(benchmark::kMicrosecond);
+
+/// 1000 rays from random points in random directions among range(0)
+/// objects.
+static void bvhRaycast(benchmark::State & state) {
+    BVH bvh = bvhOf(randomBoxes(state.range(0)));
+    vector<AABB> origins = randomBoxes(1000);
+    vector<AABB> directions = randomBoxes(1000);
+    size_t hits = 0;
+    for (auto _ : state) {
+        hits = 0;
+        for (size_t i = 0; i < origins.size(); i++) {
+            BVH::Hit hit;
+            hits += bvh.raycast(origins[i].center(), directions[i].center(),
+                                hit);
+        }
+        benchmark::DoNotOptimize(hits);
+    }
+    state.SetItemsProcessed(state.iterations() * origins.size());
+}
+BENCHMARK(bvhRaycast)->Apply(bvhArgs)->Unit(benchmark::kMicrosecond);
+
+static void occlusionArgs(benchmark::internal::Benchmark * benchmark) {
+    benchmark->ArgNames({"occluders", "kernel"});
+    for (int kernel = OcclusionBuffer::Scalar; kernel <= OcclusionBuffer::AVX2;
+         kernel++) {
+        if (!OcclusionBuffer::supported(OcclusionBuffer::Kernel(kernel)))
+            continue;
+        for (int count : {100, 1000})
+            benchmark->Args({count, kernel});
+    }
+}
+
+/// Add range(0) box occluders, transforming, clipping and binning them.
+static void occlusionBufferAdd(benchmark::State & state) {
+    Occluder box = Occluder::fromBox(AABB(glm::vec3(-0.5f), glm::vec3(0.5f)));
+    vector<glm::mat4> models = randomOccluders(state.range(0));
+    OcclusionBuffer buffer;
+    for (auto _ : state) {
+        buffer.begin(occlusionCamera());
+        for (auto & model : models)
+            buffer.add(box, model);
+        benchmark::DoNotOptimize(buffer.getPolygonCount());
+    }
+    state.counters["polygons"] = double(buffer.getPolygonCount());
+    state.SetItemsProcessed(state.iterations() * models.size());
+}
+BENCHMARK(occlusionBufferAdd)->Arg(100)->Arg(1000);
+
+/// Rasterize range(0) box occluders at 256x128 with kernel range(1).
+static void occlusionBufferRender(benchmark::State & state) {
+    Occluder box = Occluder::fromBox(AABB(glm::vec3(-0.5f), glm::vec3(0.5f)));
+    OcclusionBuffer buffer;
+    buffer.begin(occlusionCamera());
+    for (auto & model : randomOccluders(state.range(0)))
+        buffer.add(box, model);
+    auto kernel = OcclusionBuffer::Kernel(state.range(1));
+    for (auto _ : state) {
+        buffer.render(kernel);
+        benchmark::DoNotOptimize(buffer.getDepth().data());
+    }
+    state.SetItemsProcessed(state.iterations() * buffer.getPolygonCount());
+}
+BENCHMARK(occlusionBufferRender)
+    ->Apply(occlusionArgs)
+    ->Unit(benchmark::kMicrosecond);
+
+/// Rasterize 1000 box occluders on range(0) threads, a bin per job.
+static void occlusionBufferRenderParallel(benchmark::State & state) {
+    Occluder box = Occluder::fromBox(AABB(glm::vec3(-0.5f), glm::vec3(0.5f)));
+    OcclusionBuffer buffer;
+    buffer.begin(occlusionCamera());
+    for (auto & model : randomOccluders(1000))
+        buffer.add(box, model);
+    JobSystem jobs(state.range(0));
+    for (auto _ : state) {
+        buffer.render(jobs);
+        benchmark::DoNotOptimize(buffer.getDepth().data());
+    }
+    state.SetItemsProcessed(state.iterations() * buffer.getPolygonCount());
+}
+BENCHMARK(occlusionBufferRenderParallel)
+    ->Apply(threadArgs)
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+
+/// Test range(0) boxes against 1000 box occluders.
+static void occlusionBufferOccluded(benchmark::State & state) {
+    Occluder box = Occluder::fromBox(AABB(glm::vec3(-0.5f), glm::vec3(0.5f)));
+    OcclusionBuffer buffer;
+    buffer.begin(occlusionCamera());
+    for (auto & model : randomOccluders(1000))
+        buffer.add(box, model);
+    buffer.render();
+    vector<AABB> boxes = randomBoxes(state.range(0));
+    size_t occluded = 0;
+    for (auto _ : state) {
+        occluded = 0;
+        for (auto & object : boxes)
+            occluded += buffer.occluded(object);
+        benchmark::DoNotOptimize(occluded);
+    }
+    state.counters["occluded"] = double(occluded);
+    state.SetItemsProcessed(state.iterations() * boxes.size());
+}
+BENCHMARK(occlusionBufferOccluded)->Arg(10000)->Arg(100000)->Arg(1000000);
+
+/// Build the LOD chain of a bumpy sphere of about range(0) triangles.
+static void meshSimplifierBuildChain(benchmark::State & state) {
+    LodMesh mesh = bumpySphere(int(sqrt(state.range(0) / 4.0)));
+    MeshSimplifier simplifier(mesh.positions, mesh.texCoords, 2);
+    LodChain chain;
+    for (auto _ : state) {
+        vector<GLuint> indices = mesh.indices;
+        chain = simplifier.buildChain(indices, 0, indices.size());
+        benchmark::DoNotOptimize(indices.data());
+    }
+    state.counters["levels"] = double(chain.levels.size());
+    state.SetItemsProcessed(state.iterations() * mesh.indices.size() / 3);
+}
+BENCHMARK(meshSimplifierBuildChain)
+    ->Arg(10000)
+    ->Arg(100000)
+    ->Unit(benchmark::kMillisecond);
+
+/**
+ * Collect and sort 10^5 entities with a Lod of a bumpy sphere's chain at
+ * range(0) pixels of error, 0 for the full meshes, seen from the middle of
+ * them. Counts the triangles drawn and the percent saved.
+ */
+static void renderQueueLod(benchmark::State & state) {
+    LodMesh mesh = bumpySphere(50);
+    MeshSimplifier simplifier(mesh.positions, mesh.texCoords, 2);
+    LodChain chain = simplifier.buildChain(mesh.indices, 0,
+                                           mesh.indices.size());
+    RenderAssets assets(1, 1, true);
+    Mesh full = assets.meshes[0];
+    full.count = GLsizei(mesh.indices.size());
+    World world;
+    for (auto & transform : randomTransforms(100000)) {
+        Bounds bounds(AABB(glm::vec3(-1.1f), glm::vec3(1.1f)));
+        bounds.update(transform.toMatrix());
+        world.create(transform, full, assets.materials[0], bounds,
+                     Lod {&chain});
+    }
+    LodView view = LodView::perspective(glm::vec3(0), glm::radians(60.0f),
+                                        1080, float(state.range(0)));
+    RenderQueue queue;
+    for (auto _ : state) {
+        queue.clear();
+        queue.collect(world, nullptr, nullptr,
+                      state.range(0) > 0 ? &view : nullptr);
+        queue.sort();
+        benchmark::DoNotOptimize(queue.getBatches().data());
+    }
+    double triangles = 0;
+    for (auto & batch : queue.getBatches())
+        triangles += double(batch.mesh.count / 3) * batch.count;
+    double fullTriangles = double(world.size()) * (full.count / 3);
+    state.counters["triangles"] = triangles;
+    state.counters["saved%"] = 100 * (1 - triangles / fullTriangles);
+    state.SetItemsProcessed(state.iterations() * world.size());
+}
+BENCHMARK(renderQueueLod)
+    ->ArgName("pixels")
+    ->Arg(0)
+    ->Arg(1)
+    ->Arg(4)
+    ->Unit(benchmark::kMillisecond);
+
+static void quadSetPos(benchmark::State & state) {
+    Quad quad;
+    float x = 0;
+    for (auto _ : state) {
+        quad.setPos(x, -x);
+        x += 0.001f;
+    }
+}
+BENCHMARK(quadSetPos);
+
+/// Construct and destroy an array with range(0) vertex buffers.
+static void bufferArrayLifetime(benchmark::State & state) {
+    vector<vector<Attribute>> attributes(
+        state.range(0),
+        {Attribute {0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0}});
+    for (auto _ : state) {
+        BufferArray array(attributes);
+        benchmark::DoNotOptimize(array.getArrayId());
+    }
+}
+BENCHMARK(bufferArrayLifetime)->Arg(1)->Arg(4)->Arg(16);
+
+/// Enable range(0) attributes, as AttributedBuffer::bufferData does.
+static void attributeEnable(benchmark::State & state) {
+    vector<Attribute> attributes;
+    for (GLuint i = 0; i < state.range(0); i++)
+        attributes.push_back(Attribute {i, 4, GL_FLOAT, GL_FALSE,
+                                        GLsizei(state.range(0) * 16),
+                                        reinterpret_cast<void *>(i * 16)});
+    for (auto _ : state) {
+        for (auto & a : attributes)
+            a.enable();
+    }
+    state.SetItemsProcessed(state.iterations() * attributes.size());
+}
+BENCHMARK(attributeEnable)->Arg(1)->Arg(4)->Arg(16);
+
+static void uniformLookup(benchmark::State & state) {
+    Shader shader(vertexSource, fragmentSource);
+    const char * names[] = {"model", "view", "projection", "tex"};
+    for (auto _ : state) {
+        for (auto name : names)
+            benchmark::DoNotOptimize(shader.uniform(name).getLocation());
+    }
+    state.SetItemsProcessed(state.iterations() * 4);
+}
+BENCHMARK(uniformLookup);
+
+static void uniformLookupSetMat4(benchmark::State & state) {
+    Shader shader(vertexSource, fragmentSource);
+    glm::mat4 matrix(1);
+    for (auto _ : state)
+        shader.uniform("model").setMat4(matrix);
+}
+BENCHMARK(uniformLookupSetMat4);
+
+static void textureFromPath(benchmark::State & state) {
+    string path = string(resources) + "/uv.png";
+    for (auto _ : state) {
+        try {
+            Texture texture = Texture::fromPath(path);
+            benchmark::DoNotOptimize(texture.getTextureId());
+        }
+        catch (const exception &) {
+            state.SkipWithError(("Can't load " + path).c_str());
+            break;
+        }
+    }
+}
+BENCHMARK(textureFromPath)->Unit(benchmark::kMillisecond);
+
+/**
+ * Writes the median CPU time of each benchmark to --benchmark_out, rounded to
+ * three significant digits, one line each and without the machine context, so
+ * a stored baseline only changes where a time does. Needs repetitions, runs
+ * that fail have no median and are left out.
+ */
+class BaselineReporter : public benchmark::BenchmarkReporter {
+public:
+    bool ReportContext(const Context &) override {
+        GetOutputStream() << "benchmark,cpu_time,unit\n";
+        return true;
+    }
+
+    void ReportRuns(const vector<Run> & runs) override {
+        for (auto & run : runs) {
+            if (run.run_type != Run::RT_Aggregate
+                || run.aggregate_name != "median")
+                continue;
+            GetOutputStream() << run.run_name.str() << ","
+                              << round3(run.GetAdjustedCPUTime()) << ","
+                              << benchmark::GetTimeUnitString(run.time_unit)
+                              << "\n";
+        }
+    }
+
+private:
+    static double round3(double value) {
+        if (value <= 0)
+            return value;
+        double scale = pow(10.0, 2 - floor(log10(value)));
+        return round(value * scale) / scale;
+    }
+};
+
+int main(int argc, char ** argv) {
+    NullGL::load();
+
+    // Google Benchmark refuses a file reporter without a file
+    bool out = false;
+    for (int i = 1; i < argc; i++)
+        out = out || string(argv[i]).rfind("--benchmark_out=", 0) == 0;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    BaselineReporter baseline;
+    benchmark::RunSpecifiedBenchmarks(nullptr, out ? &baseline : nullptr);
+    benchmark::Shutdown();
+    return 0;
+}
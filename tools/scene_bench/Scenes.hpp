@@ -0,0 +1,1067 @@
+#pragma once
+
+#include <GL/glew.h>
+// gl.h after glew.h, clang-format don't sort
+#include <GL/gl.h>
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Bounds.hpp>
+#include <Buffer.hpp>
+#include <FrameBuffer.hpp>
+#include <GpuCuller.hpp>
+#include <InstanceBuffer.hpp>
+#include <JobSystem.hpp>
+#include <MeshLod.hpp>
+#include <OcclusionBuffer.hpp>
+#include <RenderGraph.hpp>
+#include <RenderQueue.hpp>
+#include <RenderTargetPool.hpp>
+#include <Shader.hpp>
+#include <SystemScheduler.hpp>
+#include <Texture.hpp>
+#include <Transform.hpp>
+#include <TransformBuffer.hpp>
+#include <World.hpp>
+
+/**
+ * The scenes of the examples without their windows. Each draws one frame
+ * into the frame buffer that stands in for the window.
+ */
+struct SceneParams {
+    /// Objects of the transform, ecs, gpu_cull, occlusion, instancing and
+    /// lod scenes, instances of the instanced scene, 0 for the count the
+    /// example uses
+    int instances;
+    /// Directory of the example resources
+    std::string resources;
+    /// Fraction of the instancing scene's objects that move each frame
+    float changed = 0.1f;
+    /// The most error on screen of the lod scene's levels of detail, in
+    /// pixels, 0 to draw every sphere in full
+    float lodError = 1;
+};
+
+static const char * textureVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+out vec2 FragTex;
+void main() {
+    gl_Position = vec4(aPos, 1.0);
+    FragTex = aTex;
+})";
+
+static const char * textureFragmentShaderSource = R"(
+#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+void main() {
+    FragColor = texture(gTexture, FragTex);
+})";
+
+/// The triangle of the examples with texture coordinates.
+static BufferArray createTriangle(float size = 0.5f) {
+    const float vertices[] = {
+        -size, -size, 0.0f, // Bottom Left
+        size,  -size, 0.0f, // Bottom Right
+        0.0f,  size,  0.0f // Top Center
+    };
+
+    const float texCoords[] = {
+        -0.5f, -0.5f, // Bottom Left
+        0.5f,  -0.5f, // Bottom Right
+        0.0f,  0.5f, // Top Center
+    };
+
+    const unsigned int indices[] = {
+        0, 1, 2, // First Triangle
+    };
+
+    Attribute a0 {0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0};
+    Attribute a1 {1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0};
+
+    BufferArray array(std::vector<std::vector<Attribute>> {{a0}, {a1}});
+    array.bind();
+    array.bufferData(0, sizeof(vertices), vertices);
+    array.bufferData(1, sizeof(texCoords), texCoords);
+    array.bufferElements(sizeof(indices), indices);
+    array.unbind();
+    return array;
+}
+
+/**
+ * The attributes of a model matrix per instance, at location to location
+ * + 3 of one buffer, a mat4 takes 4 locations.
+ */
+static std::vector<Attribute> instanceMatrixAttributes(GLuint location) {
+    std::vector<Attribute> model;
+    for (GLuint i = 0; i < 4; i++)
+        model.push_back({location + i, 4, GL_FLOAT, GL_FALSE,
+                         sizeof(glm::mat4),
+                         reinterpret_cast<void *>(i * sizeof(glm::vec4)), 1});
+    return model;
+}
+
+/**
+ * A color and depth texture to draw a scene into with depth testing, then
+ * blit to the target, resized to it as it changes.
+ */
+struct OffscreenTarget {
+    Texture color;
+    Texture depth;
+    FrameBuffer fbo;
+
+    /// @param depthFilter of the depth texture, Nearest to read it texel by
+    /// texel
+    explicit OffscreenTarget(Texture::Filter depthFilter = Texture::Linear)
+        : color(Texture::renderTarget({1, 1}, Texture::RGBA8)),
+          depth(Texture::renderTarget({1, 1}, Texture::Depth32F, 0,
+                                      depthFilter)),
+          fbo(1, 1) {
+        fbo.attach(&color, GL_COLOR_ATTACHMENT0);
+        fbo.attach(&depth, GL_DEPTH_ATTACHMENT);
+    }
+
+    OffscreenTarget(const OffscreenTarget &) = delete;
+    OffscreenTarget & operator=(const OffscreenTarget &) = delete;
+
+    /// Bind the frame buffer at the size of target.
+    void bind(const FrameBuffer & target) {
+        if (fbo.getWidth() != target.getWidth()
+            || fbo.getHeight() != target.getHeight())
+            fbo.resize(target.getWidth(), target.getHeight());
+        fbo.bind();
+        fbo.viewport();
+    }
+
+    void blitTo(FrameBuffer & target) const {
+        target.bind();
+        target.viewport();
+        target.blit(fbo);
+    }
+};
+
+/// 01_hello_triangle
+class TriangleScene {
+    Shader shader;
+    BufferArray array;
+
+public:
+    TriangleScene(const SceneParams &)
+        : shader(vertexShaderSource, fragmentShaderSource),
+          array(createTriangle()) {}
+
+    void draw(FrameBuffer & target, float) {
+        target.bind();
+        target.viewport();
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        shader.bind();
+        array.drawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
+    }
+
+private:
+    static constexpr const char * vertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+void main() {
+    gl_Position = vec4(aPos, 1.0);
+})";
+
+    static constexpr const char * fragmentShaderSource = R"(
+#version 330 core
+out vec4 FragColor;
+void main() {
+    FragColor = vec4(1.0, 1.0, 1.0, 1.0);
+})";
+};
+
+/// 04_texture
+class TextureScene {
+    Shader shader;
+    Texture texture;
+    BufferArray array;
+
+public:
+    TextureScene(const SceneParams & params)
+        : shader(textureVertexShaderSource, textureFragmentShaderSource),
+          texture(Texture::fromPath(params.resources + "/uv.png")),
+          array(createTriangle()) {}
+
+    void draw(FrameBuffer & target, float) {
+        target.bind();
+        target.viewport();
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        shader.bind();
+        texture.bind();
+        array.drawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
+    }
+};
+
+/// 07_post_process, the scene into a transient target then a screen pass
+class PostProcessScene {
+    Shader shader;
+    Shader screenShader;
+    Shader::Uniform time;
+    Texture texture;
+    BufferArray array;
+    Quad quad;
+    RenderTargetPool pool;
+    RenderGraph graph;
+
+public:
+    PostProcessScene(const SceneParams & params)
+        : shader(textureVertexShaderSource, textureFragmentShaderSource),
+          screenShader(screenVertexShaderSource, screenFragmentShaderSource),
+          time(screenShader.uniform("t")),
+          texture(Texture::fromPath(params.resources + "/uv.png")),
+          array(createTriangle()) {}
+
+    void draw(FrameBuffer & target, float t) {
+        pool.beginFrame();
+        glm::uvec2 size(target.getWidth(), target.getHeight());
+
+        graph.clear();
+        RenderGraph::Handle screen = graph.importFrameBuffer("screen", &target);
+        RenderGraph::Handle sceneColor;
+
+        graph.addPass(
+            "scene",
+            [&](RenderGraph::Builder & builder) {
+                sceneColor = builder.create("sceneColor",
+                                            {size, Texture::R11G11B10F});
+                builder.create("sceneDepth",
+                               {size, Texture::Depth24Stencil8, 0, true},
+                               GL_DEPTH_STENCIL_ATTACHMENT);
+            },
+            [&](RenderGraph::Context &) {
+                glClear(GL_COLOR_BUFFER_BIT);
+
+                shader.bind();
+                texture.bind();
+                array.drawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
+            });
+
+        graph.addPass(
+            "post",
+            [&](RenderGraph::Builder & builder) {
+                builder.read(sceneColor);
+                builder.write(screen);
+            },
+            [&](RenderGraph::Context & context) {
+                glClear(GL_COLOR_BUFFER_BIT);
+
+                screenShader.bind();
+                time.setValue(t);
+                context.getTexture(sceneColor).bind();
+                quad.draw();
+            });
+
+        graph.execute(pool);
+    }
+
+private:
+    static constexpr const char * screenVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+out vec2 FragPos;
+out vec2 FragTex;
+void main() {
+    gl_Position = vec4(aPos, 1.0);
+    FragPos = aPos.xy;
+    FragTex = aTex;
+})";
+
+    static constexpr const char * screenFragmentShaderSource = R"(
+#version 330 core
+in vec2 FragPos;
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+uniform float t;
+void main() {
+    vec2 d = vec2(sin(t + FragPos.x * 3) * 0.1, sin(t + FragPos.y * 3) * 0.1);
+    vec2 texCoord = FragTex + vec2(d.x, 0.0);
+    vec4 c = texture(gTexture, texCoord);
+    float v = c.r * 0.2126 + c.g * 0.7152 + c.b * 0.0722;
+    FragColor = vec4(vec3(v), c.a);
+})";
+};
+
+/// 08_blit, the scene into a frame buffer blitted to the target
+class BlitScene {
+    Shader shader;
+    Texture texture;
+    BufferArray array;
+    FrameBuffer fbo;
+    RenderBuffer depth;
+    RenderBuffer color;
+
+public:
+    BlitScene(const SceneParams & params)
+        : shader(textureVertexShaderSource, textureFragmentShaderSource),
+          texture(Texture::fromPath(params.resources + "/uv.png")),
+          array(createTriangle()),
+          fbo(1, 1),
+          depth(1, 1, GL_DEPTH24_STENCIL8),
+          color(1, 1, GL_RGB8) {
+        fbo.attach(&depth, GL_DEPTH_STENCIL_ATTACHMENT);
+        fbo.attach(&color, GL_COLOR_ATTACHMENT0);
+    }
+
+    void draw(FrameBuffer & target, float) {
+        if (fbo.getWidth() != target.getWidth()
+            || fbo.getHeight() != target.getHeight())
+            fbo.resize(target.getWidth(), target.getHeight());
+
+        fbo.bind();
+        fbo.viewport();
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        shader.bind();
+        texture.bind();
+        array.drawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
+
+        target.bind();
+        target.viewport();
+        glClear(GL_COLOR_BUFFER_BIT);
+        target.blit(fbo);
+    }
+};
+
+/// 09_transform, one draw and matrix upload per object
+class TransformScene {
+    Shader shader;
+    Shader::Uniform mvp;
+    Texture texture;
+    BufferArray array;
+    std::vector<Transform> models;
+
+public:
+    TransformScene(const SceneParams & params)
+        : shader(vertexShaderSource, textureFragmentShaderSource),
+          mvp(shader.uniform("mvp")),
+          texture(Texture::fromPath(params.resources + "/uv.png")),
+          array(createTriangle()) {
+        int count = params.instances > 0 ? params.instances : 1;
+        int columns = std::ceil(std::sqrt(float(count)));
+        float cell = 2.0f / columns;
+        for (int i = 0; i < count; i++) {
+            Transform model;
+            model.setPosition({-1 + cell * (i % columns + 0.5f),
+                               -1 + cell * (i / columns + 0.5f), 0});
+            model.setScale(glm::vec3(cell));
+            models.push_back(model);
+        }
+    }
+
+    void draw(FrameBuffer & target, float) {
+        target.bind();
+        target.viewport();
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        shader.bind();
+        texture.bind();
+        for (auto & model : models) {
+            model.rotateEuler({0, 0, 0.01});
+            mvp.setMat4(model.toMatrix());
+            array.drawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
+        }
+    }
+
+private:
+    static constexpr const char * vertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+uniform mat4 mvp;
+out vec2 FragTex;
+void main() {
+    gl_Position = mvp * vec4(aPos, 1.0);
+    FragTex = aTex;
+})";
+};
+
+/// 10_instanced, one draw of a grid of instances
+class InstancedScene {
+    Shader shader;
+    Texture texture;
+    BufferArray array;
+    int count;
+
+public:
+    InstancedScene(const SceneParams & params)
+        : shader(vertexShaderSource, textureFragmentShaderSource),
+          texture(Texture::fromPath(params.resources + "/uv.png")),
+          array(std::vector<std::vector<Attribute>> {
+              {Attribute {0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0}},
+              {Attribute {1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0}},
+              {Attribute {2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0, 1}},
+          }),
+          count(params.instances > 0 ? params.instances : 100) {
+        int columns = std::ceil(std::sqrt(float(count)));
+        float cell = 2.0f / columns;
+        float size = cell / 4;
+
+        const float vertices[] = {
+            -size, -size, 0.0f, // Bottom Left
+            size,  -size, 0.0f, // Bottom Right
+            0.0f,  size,  0.0f // Top Center
+        };
+
+        const float texCoords[] = {
+            -0.5f, -0.5f, // Bottom Left
+            0.5f,  -0.5f, // Bottom Right
+            0.0f,  0.5f, // Top Center
+        };
+
+        const unsigned int indices[] = {
+            0, 1, 2, // First Triangle
+        };
+
+        std::vector<glm::vec2> translations;
+        for (int i = 0; i < count; i++)
+            translations.emplace_back(-1 + cell * (i % columns + 0.5f),
+                                      -1 + cell * (i / columns + 0.5f));
+
+        array.bind();
+        array.bufferData(0, sizeof(vertices), vertices);
+        array.bufferData(1, sizeof(texCoords), texCoords);
+        array.bufferData(2, translations.size() * sizeof(glm::vec2),
+                         translations.data());
+        array.bufferElements(sizeof(indices), indices);
+        array.unbind();
+    }
+
+    void draw(FrameBuffer & target, float) {
+        target.bind();
+        target.viewport();
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        shader.bind();
+        texture.bind();
+        array.drawElementsInstanced(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0,
+                                    count);
+    }
+
+private:
+    static constexpr const char * vertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+layout (location = 2) in vec2 aOffset;
+out vec2 FragTex;
+void main() {
+    gl_Position = vec4(aPos.xy + aOffset, aPos.z, 1.0);
+    FragTex = aTex;
+})";
+};
+
+/**
+ * The transform scene as World entities, spun by a system on all cores and
+ * drawn by a RenderQueue, in one instanced batch per material.
+ */
+class EcsScene {
+    struct Spin {
+        glm::quat delta;
+    };
+
+    Shader shader;
+    Shader tintedShader;
+    Texture texture;
+    BufferArray array;
+    World world;
+    SystemScheduler systems;
+    JobSystem jobs;
+    RenderQueue queue;
+
+public:
+    EcsScene(const SceneParams & params)
+        : shader(vertexShaderSource, textureFragmentShaderSource),
+          tintedShader(vertexShaderSource, tintedFragmentShaderSource),
+          texture(Texture::fromPath(params.resources + "/uv.png")),
+          array(createTriangle()) {
+        array.addBuffer(instanceMatrixAttributes(2));
+
+        Mesh mesh {&array, 3};
+        mesh.instanceBuffer = 2;
+        Material materials[] = {{&shader, {&texture}},
+                                {&tintedShader, {&texture}}};
+        AABB box(glm::vec3(-0.5f, -0.5f, 0), glm::vec3(0.5f, 0.5f, 0));
+
+        int count = params.instances > 0 ? params.instances : 10000;
+        int columns = std::ceil(std::sqrt(float(count)));
+        float cell = 2.0f / columns;
+        for (int i = 0; i < count; i++) {
+            Transform model;
+            model.setPosition({-1 + cell * (i % columns + 0.5f),
+                               -1 + cell * (i / columns + 0.5f), 0});
+            model.setScale(glm::vec3(cell));
+            world.create(model, Spin {glm::quat(glm::vec3(0, 0, 0.01f))},
+                         mesh, materials[i % 2], Bounds(box));
+        }
+
+        systems.add<Transform, const Spin>(
+            "spin",
+            [](size_t count, Transform * transforms, const Spin * spins) {
+                for (size_t i = 0; i < count; i++)
+                    transforms[i].rotate(spins[i].delta);
+            });
+        systems.add<const Transform, Bounds>(
+            "bounds",
+            [](size_t count, const Transform * transforms, Bounds * bounds) {
+                for (size_t i = 0; i < count; i++)
+                    bounds[i].update(transforms[i].toMatrix());
+            });
+    }
+
+    void draw(FrameBuffer & target, float) {
+        systems.run(world, jobs);
+        queue.clear();
+        queue.collect(world, jobs);
+        queue.sort();
+
+        target.bind();
+        target.viewport();
+        glClear(GL_COLOR_BUFFER_BIT);
+        queue.submit();
+    }
+
+private:
+    static constexpr const char * vertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+layout (location = 2) in mat4 aModel;
+out vec2 FragTex;
+void main() {
+    gl_Position = aModel * vec4(aPos, 1.0);
+    FragTex = aTex;
+})";
+
+    static constexpr const char * tintedFragmentShaderSource = R"(
+#version 330 core
+in vec2 FragTex;
+out vec4 FragColor;
+uniform sampler2D gTexture;
+void main() {
+    FragColor = texture(gTexture, FragTex) * vec4(1.0, 0.6, 0.6, 1.0);
+})";
+};
+
+/// Index counts of the shapes of bufferShapes(), the pyramid's indices
+/// follow the cube's.
+struct Shapes {
+    GLuint cubeCount;
+    GLuint pyramidCount;
+};
+
+/**
+ * Buffer a cube of 24 vertices, one quad per face, then a pyramid of 5,
+ * both a unit across around the origin, into buffers 0 (positions) and 1
+ * (texture coordinates) and the elements of array.
+ */
+static Shapes bufferShapes(BufferArray & array) {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> texCoords;
+    std::vector<unsigned int> indices;
+    for (int axis = 0; axis < 3; axis++) {
+        for (float side : {-0.5f, 0.5f}) {
+            GLuint first = vertices.size();
+            for (int corner = 0; corner < 4; corner++) {
+                float u = corner == 1 || corner == 2;
+                float v = corner >= 2;
+                glm::vec2 uv(u, v);
+                glm::vec3 vertex;
+                vertex[axis] = side;
+                vertex[(axis + 1) % 3] = uv.x - 0.5f;
+                vertex[(axis + 2) % 3] = uv.y - 0.5f;
+                vertices.push_back(vertex);
+                texCoords.push_back(uv);
+            }
+            for (GLuint index : {0, 1, 2, 0, 2, 3})
+                indices.push_back(first + index);
+        }
+    }
+    GLuint cubeCount = indices.size();
+    GLuint pyramidVertex = vertices.size();
+    const glm::vec3 pyramid[] = {
+        {-0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, 0.5f},
+        {-0.5f, -0.5f, 0.5f},  {0.0f, 0.5f, 0.0f},
+    };
+    for (auto & vertex : pyramid) {
+        vertices.push_back(vertex);
+        texCoords.emplace_back(vertex.x + 0.5f, vertex.z + 0.5f);
+    }
+    for (GLuint index : {0, 1, 2, 0, 2, 3, 0, 1, 4, 1, 2, 4, 2, 3, 4, 3, 0, 4})
+        indices.push_back(pyramidVertex + index);
+
+    array.bind();
+    array.bufferData(0, vertices.size() * sizeof(glm::vec3), vertices.data());
+    array.bufferData(1, texCoords.size() * sizeof(glm::vec2),
+                     texCoords.data());
+    array.bufferElements(indices.size() * sizeof(unsigned int),
+                         indices.data());
+    array.unbind();
+    return {cubeCount, GLuint(indices.size()) - cubeCount};
+}
+
+/// The walls of the ring scenes, cubes scaled to 5 by 4 by half a unit, 8
+/// around the origin with gaps between them.
+static std::vector<glm::mat4> ringWalls() {
+    std::vector<glm::mat4> walls;
+    for (int i = 0; i < 8; i++) {
+        float angle = glm::radians(45.0f * i);
+        glm::mat4 model = glm::rotate(glm::mat4(1), angle, {0, 1, 0});
+        model = glm::translate(model, {0, 1.5f, -8});
+        walls.push_back(glm::scale(model, {5, 4, 0.5f}));
+    }
+    return walls;
+}
+
+/// count objects of the ring scenes on a grid outside the walls, cubes at
+/// odd indices and pyramids at even ones.
+static std::vector<glm::mat4> ringField(int count) {
+    // A grid with room for the cells inside the walls, left empty
+    std::vector<glm::mat4> field;
+    int columns = std::ceil(std::sqrt(float(count + 100)));
+    for (int cell = 0, i = 0; i < count; cell++) {
+        glm::vec3 position(2.0f * (cell % columns) - columns,
+                           0,
+                           2.0f * (cell / columns) - columns);
+        if (glm::length(position) < 10)
+            continue;
+        glm::mat4 model = glm::translate(glm::mat4(1), position);
+        model = glm::rotate(model, float(i), {0, 1, 0});
+        field.push_back(glm::scale(model, glm::vec3(0.5f + (i % 5) * 0.2f)));
+        i++;
+    }
+    return field;
+}
+
+/// The view-projection matrix of the ring scenes at time t, turning slowly
+/// inside the walls.
+static glm::mat4 ringCamera(float aspect, float t) {
+    glm::mat4 projection =
+        glm::perspective(glm::radians(60.0f), aspect, 0.1f, 500.0f);
+    glm::vec3 direction(std::sin(t * 0.3f), 0, -std::cos(t * 0.3f));
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 1.5f, 0),
+                                 glm::vec3(0, 1.5f, 0) + direction,
+                                 glm::vec3(0, 1, 0));
+    return projection * view;
+}
+
+static const char * ringVertexShaderSource = R"(
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+layout (location = 2) in mat4 aModel;
+uniform mat4 viewProjection;
+out vec2 FragTex;
+void main() {
+    gl_Position = viewProjection * aModel * vec4(aPos, 1.0);
+    FragTex = aTex;
+})";
+
+/**
+ * A field of cubes and pyramids around a ring of walls, seen from inside the
+ * ring, culled on the GPU against the frustum and the depth of the last
+ * frame and drawn with one indirect multi draw. Needs OpenGL 4.3.
+ */
+class GpuCullScene {
+    Shader shader;
+    Shader::Uniform viewProjection;
+    Texture texture;
+    BufferArray array;
+    GpuCuller culler;
+    OffscreenTarget offscreen;
+
+public:
+    GpuCullScene(const SceneParams & params)
+        : shader(ringVertexShaderSource, textureFragmentShaderSource),
+          viewProjection(shader.uniform("viewProjection")),
+          texture(Texture::fromPath(params.resources + "/uv.png")),
+          array(std::vector<std::vector<Attribute>> {
+              {Attribute {0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0}},
+              {Attribute {1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0}},
+          }),
+          offscreen(Texture::Nearest) {
+        Shapes shapes = bufferShapes(array);
+        culler.attach(array, 2);
+
+        AABB box(glm::vec3(-0.5f), glm::vec3(0.5f));
+        uint32_t cube = culler.addMesh({shapes.cubeCount, 0, 0, box});
+        uint32_t pyramid = culler.addMesh(
+            {shapes.pyramidCount, shapes.cubeCount, 0, box});
+
+        // The walls hide most of the field
+        for (auto & model : ringWalls())
+            culler.add(cube, model);
+        std::vector<glm::mat4> field =
+            ringField(params.instances > 0 ? params.instances : 20000);
+        for (size_t i = 0; i < field.size(); i++)
+            culler.add(i % 2 ? cube : pyramid, field[i]);
+    }
+
+    void draw(FrameBuffer & target, float t) {
+        glm::mat4 matrix = ringCamera(
+            float(target.getWidth()) / target.getHeight(), t);
+        culler.cull(matrix);
+
+        offscreen.bind(target);
+        glEnable(GL_DEPTH_TEST);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shader.bind();
+        viewProjection.setMat4(matrix);
+        texture.bind();
+        culler.draw(array);
+        glDisable(GL_DEPTH_TEST);
+
+        // The depth of this frame hides objects in the next one
+        culler.buildHiZ(offscreen.depth, matrix);
+
+        offscreen.blitTo(target);
+    }
+};
+
+/**
+ * The ring of walls and field of gpu_cull culled on the CPU: each frame the
+ * walls are drawn into an OcclusionBuffer on a JobSystem and RenderQueue
+ * drops the objects outside the frustum or behind the walls before drawing
+ * them instanced.
+ */
+class OcclusionScene {
+    Shader shader;
+    Shader::Uniform viewProjection;
+    Texture texture;
+    BufferArray array;
+    World world;
+    JobSystem jobs;
+    RenderQueue queue;
+    Occluder wall;
+    std::vector<glm::mat4> walls;
+    OcclusionBuffer occlusion;
+    OffscreenTarget offscreen;
+
+public:
+    OcclusionScene(const SceneParams & params)
+        : shader(ringVertexShaderSource, textureFragmentShaderSource),
+          viewProjection(shader.uniform("viewProjection")),
+          texture(Texture::fromPath(params.resources + "/uv.png")),
+          array(std::vector<std::vector<Attribute>> {
+              {Attribute {0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0}},
+              {Attribute {1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0}},
+          }),
+          wall(Occluder::fromBox(AABB(glm::vec3(-0.5f), glm::vec3(0.5f)))),
+          walls(ringWalls()),
+          // 16:9 like the default size, others stretch its pixels
+          occlusion(256, 144) {
+        Shapes shapes = bufferShapes(array);
+        array.addBuffer(instanceMatrixAttributes(2));
+
+        Mesh cube {&array, GLsizei(shapes.cubeCount)};
+        cube.instanceBuffer = 2;
+        Mesh pyramid = cube;
+        pyramid.count = shapes.pyramidCount;
+        pyramid.first = shapes.cubeCount;
+        Material material {&shader, {&texture}};
+        AABB box(glm::vec3(-0.5f), glm::vec3(0.5f));
+        auto create = [&](const Mesh & mesh, const glm::mat4 & model) {
+            Bounds bounds(box);
+            bounds.update(model);
+            world.create(Transform(model), mesh, material, bounds);
+        };
+
+        for (auto & model : walls)
+            create(cube, model);
+        std::vector<glm::mat4> field =
+            ringField(params.instances > 0 ? params.instances : 20000);
+        for (size_t i = 0; i < field.size(); i++)
+            create(i % 2 ? cube : pyramid, field[i]);
+    }
+
+    void draw(FrameBuffer & target, float t) {
+        glm::mat4 matrix = ringCamera(
+            float(target.getWidth()) / target.getHeight(), t);
+        occlusion.begin(matrix);
+        for (auto & model : walls)
+            occlusion.add(wall, model);
+        occlusion.render(jobs);
+
+        Frustum frustum = Frustum::fromMatrix(matrix);
+        queue.clear();
+        queue.collect(world, jobs, &frustum, &occlusion);
+        queue.sort();
+
+        offscreen.bind(target);
+        glEnable(GL_DEPTH_TEST);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shader.bind();
+        viewProjection.setMat4(matrix);
+        queue.submit();
+        glDisable(GL_DEPTH_TEST);
+
+        offscreen.blitTo(target);
+    }
+};
+
+/**
+ * A grid of cubes with a full transform each, drawn with one instanced
+ * draw. Each frame a window of the changed fraction of them, walking along
+ * the grid, spins, and an InstanceBuffer uploads only their mat3x4s.
+ */
+class InstancingScene {
+    Shader shader;
+    Shader::Uniform viewProjection;
+    Texture texture;
+    BufferArray array;
+    TransformBuffer transforms;
+    InstanceBuffer instances;
+    GLuint cubeCount;
+    size_t changed;
+    size_t first = 0;
+    int columns;
+    OffscreenTarget offscreen;
+
+public:
+    InstancingScene(const SceneParams & params)
+        : shader(vertexShaderSource().c_str(), textureFragmentShaderSource),
+          viewProjection(shader.uniform("viewProjection")),
+          texture(Texture::fromPath(params.resources + "/uv.png")),
+          array(std::vector<std::vector<Attribute>> {
+              {Attribute {0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0}},
+              {Attribute {1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0}},
+          }),
+          instances(InstanceBuffer::Mat3x4) {
+        cubeCount = bufferShapes(array).cubeCount;
+        instances.attach(array, 2);
+
+        int count = params.instances > 0 ? params.instances : 100000;
+        columns = std::ceil(std::sqrt(float(count)));
+        for (int i = 0; i < count; i++) {
+            glm::vec3 position(2.0f * (i % columns) - columns, 0,
+                               2.0f * (i / columns) - columns);
+            transforms.add(position,
+                           glm::quat(glm::vec3(0, float(i), 0)),
+                           glm::vec3(0.5f + (i % 5) * 0.2f));
+        }
+        changed = std::min(size_t(count),
+                           size_t(std::max(0.0f, params.changed) * count));
+        instances.update(transforms);
+    }
+
+    void draw(FrameBuffer & target, float) {
+        const glm::quat spin(glm::vec3(0, 0.05f, 0));
+        for (size_t i = 0; i < changed; i++)
+            transforms.rotate((first + i) % transforms.size(), spin);
+        first = (first + changed) % transforms.size();
+        instances.update(transforms);
+
+        float aspect = float(target.getWidth()) / target.getHeight();
+        glm::mat4 projection = glm::perspective(glm::radians(60.0f), aspect,
+                                                0.1f, 4.0f * columns);
+        glm::mat4 view = glm::lookAt(glm::vec3(0, columns, columns * 1.2f),
+                                     glm::vec3(0), glm::vec3(0, 1, 0));
+
+        offscreen.bind(target);
+        glEnable(GL_DEPTH_TEST);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shader.bind();
+        viewProjection.setMat4(projection * view);
+        texture.bind();
+        array.drawElementsInstanced(GL_TRIANGLES, cubeCount, GL_UNSIGNED_INT,
+                                    0, transforms.size());
+        glDisable(GL_DEPTH_TEST);
+
+        offscreen.blitTo(target);
+    }
+
+private:
+    static std::string vertexShaderSource() {
+        return "#version 330 core\n"
+               + InstanceBuffer::shaderSource(InstanceBuffer::Mat3x4, 2)
+               + R"(layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTex;
+uniform mat4 viewProjection;
+out vec2 FragTex;
+void main() {
+    gl_Position = viewProjection * vec4(instanceTransform(aPos), 1.0);
+    FragTex = aTex;
+})";
+    }
+};
+
+/**
+ * Buffer a unit sphere of rows by 2 * rows quads with bumps, then the
+ * levels of detail MeshSimplifier makes of it, into buffers 0 (positions)
+ * and 1 (texture coordinates) and the elements of array.
+ */
+static LodChain bufferLodSphere(BufferArray & array, int rows) {
+    const float pi = 3.14159265f;
+    int columns = 2 * rows;
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec2> texCoords;
+    std::vector<GLuint> indices;
+    // The first column repeats at the end with u = 1, and the poles once
+    // per column, for the texture
+    for (int r = 0; r <= rows; r++) {
+        for (int c = 0; c <= columns; c++) {
+            float theta = pi * r / rows;
+            float phi = 2 * pi * (c % columns) / columns;
+            float radius = 1 + 0.1f * std::sin(5 * theta) * std::sin(4 * phi);
+            glm::vec3 vertex(radius * std::sin(theta) * std::cos(phi),
+                             radius * std::cos(theta),
+                             radius * std::sin(theta) * std::sin(phi));
+            if (r == 0 || r == rows)
+                vertex = glm::vec3(0, r == 0 ? 1 : -1, 0);
+            vertices.push_back(vertex);
+            texCoords.emplace_back(float(c) / columns, float(r) / rows);
+        }
+    }
+    auto vertex = [&](int r, int c) { return GLuint(r * (columns + 1) + c); };
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            if (r > 0)
+                indices.insert(indices.end(), {vertex(r, c), vertex(r, c + 1),
+                                               vertex(r + 1, c + 1)});
+            if (r + 1 < rows)
+                indices.insert(indices.end(),
+                               {vertex(r, c), vertex(r + 1, c + 1),
+                                vertex(r + 1, c)});
+        }
+    }
+
+    MeshSimplifier simplifier(
+        vertices, {&texCoords[0].x, &texCoords[0].x + texCoords.size() * 2},
+        2);
+    LodChain chain = simplifier.buildChain(indices, 0, indices.size());
+
+    array.bind();
+    array.bufferData(0, vertices.size() * sizeof(glm::vec3), vertices.data());
+    array.bufferData(1, texCoords.size() * sizeof(glm::vec2),
+                     texCoords.data());
+    array.bufferElements(indices.size() * sizeof(GLuint), indices.data());
+    array.unbind();
+    return chain;
+}
+
+/**
+ * A field of bumpy spheres the camera flies low over, each drawn at the
+ * coarsest level of detail whose error stays under the lodError pixels
+ * on screen. RenderQueue picks the levels as it collects the spheres
+ * inside the frustum and draws the ones at the same level instanced.
+ */
+class LodScene {
+    Shader shader;
+    Shader::Uniform viewProjection;
+    Texture texture;
+    BufferArray array;
+    LodChain chain;
+    World world;
+    JobSystem jobs;
+    RenderQueue queue;
+    float lodError;
+    int columns;
+    size_t frames = 0;
+    size_t triangles = 0;
+    size_t fullTriangles = 0;
+    OffscreenTarget offscreen;
+
+public:
+    LodScene(const SceneParams & params)
+        : shader(ringVertexShaderSource, textureFragmentShaderSource),
+          viewProjection(shader.uniform("viewProjection")),
+          texture(Texture::fromPath(params.resources + "/uv.png")),
+          array(std::vector<std::vector<Attribute>> {
+              {Attribute {0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0}},
+              {Attribute {1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0}},
+          }),
+          chain(bufferLodSphere(array, 32)),
+          lodError(params.lodError) {
+        array.addBuffer(instanceMatrixAttributes(2));
+
+        Mesh mesh {&array, chain.levels[0].count};
+        mesh.instanceBuffer = 2;
+        Material material {&shader, {&texture}};
+        // The bumps reach 1.1 out
+        AABB box(glm::vec3(-1.1f), glm::vec3(1.1f));
+
+        int count = params.instances > 0 ? params.instances : 4096;
+        columns = std::ceil(std::sqrt(float(count)));
+        for (int i = 0; i < count; i++) {
+            glm::vec3 position(3.0f * (i % columns) - 1.5f * columns, 0,
+                               3.0f * (i / columns) - 1.5f * columns);
+            glm::mat4 matrix = glm::translate(glm::mat4(1), position);
+            matrix = glm::rotate(matrix, float(i), {0, 1, 0});
+            matrix = glm::scale(matrix, glm::vec3(0.5f + (i % 5) * 0.2f));
+            Bounds bounds(box);
+            bounds.update(matrix);
+            world.create(Transform(matrix), mesh, material, bounds,
+                         Lod {&chain});
+        }
+    }
+
+    /// The mean triangles drawn per frame since the last resetTriangles(),
+    /// and how many the same spheres have in full.
+    std::pair<size_t, size_t> getTriangles() const {
+        if (frames == 0)
+            return {0, 0};
+        return {triangles / frames, fullTriangles / frames};
+    }
+
+    /// Count from the next frame, after the warmup ones.
+    void resetTriangles() {
+        frames = 0;
+        triangles = 0;
+        fullTriangles = 0;
+    }
+
+    void draw(FrameBuffer & target, float t) {
+        // Down the middle of the field from one end, looking ahead
+        const float fovy = glm::radians(60.0f);
+        float half = 1.5f * columns;
+        glm::vec3 eye(0.75f, 2.5f, half - std::fmod(t * 4, 2 * half));
+        glm::mat4 projection =
+            glm::perspective(fovy, float(target.getWidth())
+                                       / target.getHeight(),
+                             0.1f, 4.0f * half);
+        glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0, -0.3f, -1),
+                                     glm::vec3(0, 1, 0));
+        glm::mat4 matrix = projection * view;
+
+        Frustum frustum = Frustum::fromMatrix(matrix);
+        LodView lod = LodView::perspective(eye, fovy,
+                                           float(target.getHeight()),
+                                           lodError);
+        queue.clear();
+        queue.collect(world, jobs, &frustum, nullptr,
+                      lodError > 0 ? &lod : nullptr);
+        queue.sort();
+
+        frames++;
+        for (auto & batch : queue.getBatches()) {
+            triangles += size_t(batch.mesh.count / 3) * batch.count;
+            fullTriangles += size_t(chain.levels[0].count / 3) * batch.count;
+        }
+
+        offscreen.bind(target);
+        glEnable(GL_DEPTH_TEST);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shader.bind();
+        viewProjection.setMat4(matrix);
+        queue.submit();
+        glDisable(GL_DEPTH_TEST);
+
+        offscreen.blitTo(target);
+    }
+};
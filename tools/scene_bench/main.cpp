@@ -0,0 +1,355 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include <GL/glew.h>
+
+#include <SFML/Graphics.hpp>
+#define STB_IMAGE_IMPLEMENTATION
+#include <HeadlessSurface.hpp>
+#include <Query.hpp>
+#include <Trace.hpp>
+#include <WindowSurface.hpp>
+#include <glm/glm.hpp>
+
+#include "Scenes.hpp"
+
+static const char * usage = R"(usage: scene_bench [options]
+
+Run the example scenes for a fixed number of frames, uncapped, and report
+CPU and GPU frame times.
+
+  --scenes A,B    scenes to run (default all): triangle, texture,
+                  post_process, blit, transform, instanced, ecs,
+                  gpu_cull (skipped below OpenGL 4.3), occlusion,
+                  instancing, lod
+  --frames N      timed frames per scene (default 500)
+  --warmup N      untimed frames before them (default 20)
+  --size WxH      frame buffer size (default 1280x720)
+  --instances N   objects of transform, ecs, gpu_cull, occlusion,
+                  instancing and lod, instances of instanced
+  --changed F     fraction of the instancing objects moving each frame
+                  (default 0.1)
+  --lod-error P   most error of the lod levels on screen in pixels, 0 to
+                  draw the spheres in full (default 1)
+  --window        draw in a window instead of offscreen
+  --json FILE     write the results as JSON
+  --res DIR       example resources (default ../../../examples/res)
+)";
+
+static const char * sceneNames[] = {
+    "triangle", "texture", "post_process", "blit", "transform", "instanced",
+    "ecs", "gpu_cull", "occlusion", "instancing", "lod",
+};
+
+struct BenchOptions {
+    vector<string> scenes;
+    size_t frames = 500;
+    size_t warmup = 20;
+    glm::uvec2 size = {1280, 720};
+    bool window = false;
+    string json;
+    SceneParams params = {0, "../../../examples/res"};
+};
+
+struct SceneResult {
+    string name;
+    size_t frames;
+    RollingStats cpu;
+    RollingStats gpu;
+    /// Mean triangles drawn per frame and at full detail, for the scenes
+    /// with levels of detail, else 0
+    size_t triangles = 0;
+    size_t fullTriangles = 0;
+};
+
+/// The triangles of a scene with getTriangles(), see SceneResult.
+template <typename Scene>
+static auto trianglesOf(const Scene & scene, int)
+    -> decltype(scene.getTriangles()) {
+    return scene.getTriangles();
+}
+
+template <typename Scene>
+static pair<size_t, size_t> trianglesOf(const Scene &, long) {
+    return {0, 0};
+}
+
+/// Leave the warmup frames out of trianglesOf() for the scenes that count.
+template <typename Scene>
+static auto resetTrianglesOf(Scene & scene, int)
+    -> decltype(scene.resetTriangles()) {
+    scene.resetTriangles();
+}
+
+template <typename Scene>
+static void resetTrianglesOf(Scene &, long) {}
+
+/**
+ * Run a scene, timing the CPU side of each frame with the steady clock and
+ * the GPU side with a ring of timer queries read a few frames later.
+ */
+template <typename Scene, typename Surface>
+static SceneResult run(const string & name,
+                       Surface & surface,
+                       const BenchOptions & options) {
+    const size_t latency = 4;
+
+    Scene scene(options.params);
+    vector<Query> queries;
+    for (size_t i = 0; i < latency; i++)
+        queries.emplace_back(GL_TIME_ELAPSED);
+
+    SceneResult result {name, 0, RollingStats(options.frames),
+                        RollingStats(options.frames)};
+    auto retire = [&](size_t frame) {
+        double ms = queries[frame % latency].getResult() / 1.0e6;
+        if (frame >= options.warmup)
+            result.gpu.add(ms);
+    };
+
+    size_t frame = 0;
+    for (; frame < options.warmup + options.frames && surface.isOpen();
+         frame++) {
+        if (frame == options.warmup)
+            resetTrianglesOf(scene, 0);
+        auto start = chrono::steady_clock::now();
+        surface.pollEvents();
+
+        queries[frame % latency].begin();
+        // A fixed time step, so each run draws the same frames
+        scene.draw(surface.getFrameBuffer(), frame / 60.0f);
+        queries[frame % latency].end();
+        surface.display();
+
+        if (frame + 1 >= latency)
+            retire(frame + 1 - latency);
+
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now()
+                                                    - start)
+                        .count();
+        if (frame >= options.warmup)
+            result.cpu.add(ms);
+    }
+    for (size_t i = frame < latency ? 0 : frame + 1 - latency; i < frame; i++)
+        retire(i);
+
+    result.frames = result.cpu.count();
+    pair<size_t, size_t> triangles = trianglesOf(scene, 0);
+    result.triangles = triangles.first;
+    result.fullTriangles = triangles.second;
+    return result;
+}
+
+template <typename Surface>
+static SceneResult run(const string & name,
+                       Surface & surface,
+                       const BenchOptions & options) {
+    if (name == "triangle")
+        return run<TriangleScene>(name, surface, options);
+    if (name == "texture")
+        return run<TextureScene>(name, surface, options);
+    if (name == "post_process")
+        return run<PostProcessScene>(name, surface, options);
+    if (name == "blit")
+        return run<BlitScene>(name, surface, options);
+    if (name == "transform")
+        return run<TransformScene>(name, surface, options);
+    if (name == "instanced")
+        return run<InstancedScene>(name, surface, options);
+    if (name == "ecs")
+        return run<EcsScene>(name, surface, options);
+    if (name == "gpu_cull")
+        return run<GpuCullScene>(name, surface, options);
+    if (name == "occlusion")
+        return run<OcclusionScene>(name, surface, options);
+    if (name == "instancing")
+        return run<InstancingScene>(name, surface, options);
+    if (name == "lod")
+        return run<LodScene>(name, surface, options);
+    throw runtime_error("Unknown scene " + name);
+}
+
+template <typename Surface>
+static vector<SceneResult> runAll(Surface & surface,
+                                  const BenchOptions & options) {
+    cout << "Running on " << glGetString(GL_RENDERER) << ", "
+         << surface.getSize().x << "x" << surface.getSize().y << endl;
+    cout << left << setw(14) << "scene" << right << setw(8) << "frames"
+         << setw(10) << "cpu avg" << setw(8) << "p95" << setw(8) << "p99"
+         << setw(10) << "gpu avg" << setw(8) << "p95" << setw(8) << "p99"
+         << endl;
+
+    vector<SceneResult> results;
+    for (auto & name : options.scenes) {
+        if (name == "gpu_cull" && !GpuCuller::supported()) {
+            cout << left << setw(14) << name << "skipped, needs OpenGL 4.3"
+                 << endl;
+            continue;
+        }
+        results.push_back(run(name, surface, options));
+        SceneResult & r = results.back();
+        cout << left << setw(14) << r.name << right << setw(8) << r.frames
+             << fixed << setprecision(3) << setw(10) << r.cpu.average()
+             << setw(8) << r.cpu.percentile(95) << setw(8)
+             << r.cpu.percentile(99) << setw(10) << r.gpu.average()
+             << setw(8) << r.gpu.percentile(95) << setw(8)
+             << r.gpu.percentile(99) << endl;
+        if (r.fullTriangles > 0)
+            cout << "  " << r.triangles << " of " << r.fullTriangles
+                 << " triangles per frame, " << setprecision(1)
+                 << 100.0 * (1 - double(r.triangles) / r.fullTriangles)
+                 << "% saved" << endl;
+    }
+    return results;
+}
+
+static void writeStats(ostream & out, const RollingStats & stats) {
+    out << "{\"mean\": " << stats.average()
+        << ", \"p50\": " << stats.percentile(50)
+        << ", \"p95\": " << stats.percentile(95)
+        << ", \"p99\": " << stats.percentile(99) << "}";
+}
+
+static void writeJson(ostream & out,
+                      const vector<SceneResult> & results,
+                      const BenchOptions & options,
+                      const char * renderer) {
+    out << fixed << setprecision(4) << "{\n  \"renderer\": \"" << renderer
+        << "\",\n  \"width\": " << options.size.x
+        << ",\n  \"height\": " << options.size.y
+        << ",\n  \"instances\": " << options.params.instances
+        << ",\n  \"changed\": " << options.params.changed
+        << ",\n  \"lod_error\": " << options.params.lodError
+        << ",\n  \"scenes\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        auto & r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"frames\": " << r.frames
+            << ", \"cpu_ms\": ";
+        writeStats(out, r.cpu);
+        out << ", \"gpu_ms\": ";
+        writeStats(out, r.gpu);
+        if (r.fullTriangles > 0)
+            out << ", \"triangles\": " << r.triangles
+                << ", \"full_triangles\": " << r.fullTriangles;
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char ** argv) {
+    BenchOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        string option = argv[i];
+        if (option == "--window") {
+            options.window = true;
+            continue;
+        }
+        if (option == "--help" || i + 1 >= argc) {
+            cerr << usage;
+            return option == "--help" ? 0 : 1;
+        }
+
+        string value = argv[++i];
+        if (option == "--scenes") {
+            stringstream list(value);
+            string name;
+            while (getline(list, name, ','))
+                options.scenes.push_back(name);
+        }
+        else if (option == "--frames")
+            options.frames = strtoull(value.c_str(), nullptr, 10);
+        else if (option == "--warmup")
+            options.warmup = strtoull(value.c_str(), nullptr, 10);
+        else if (option == "--size") {
+            unsigned width = 0, height = 0;
+            if (sscanf(value.c_str(), "%ux%u", &width, &height) != 2
+                || width == 0 || height == 0) {
+                cerr << "Invalid size " << value << endl;
+                return 1;
+            }
+            options.size = {width, height};
+        }
+        else if (option == "--instances")
+            options.params.instances = atoi(value.c_str());
+        else if (option == "--changed")
+            options.params.changed = atof(value.c_str());
+        else if (option == "--lod-error")
+            options.params.lodError = atof(value.c_str());
+        else if (option == "--json")
+            options.json = value;
+        else if (option == "--res")
+            options.params.resources = value;
+        else {
+            cerr << "Unknown option " << option << endl << usage;
+            return 1;
+        }
+    }
+
+    if (options.scenes.empty())
+        options.scenes.assign(begin(sceneNames), end(sceneNames));
+    if (options.frames == 0) {
+        cerr << "No frames to run" << endl;
+        return 1;
+    }
+
+    try {
+        vector<SceneResult> results;
+        string renderer;
+        if (options.window) {
+            const sf::ContextSettings settings(24, 1, 0, 3, 3);
+            sf::RenderWindow window(sf::VideoMode(options.size.x,
+                                                  options.size.y),
+                                    "Scene Bench",
+                                    sf::Style::Default,
+                                    settings);
+            window.setVerticalSyncEnabled(false);
+            window.setFramerateLimit(0);
+            window.setActive();
+
+            GLenum err = glewInit();
+            if (err != GLEW_OK) {
+                cerr << "glewInit failed: " << glewGetErrorString(err);
+                return 1;
+            }
+
+            WindowSurface surface(window);
+            results = runAll(surface, options);
+            renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+        }
+        else {
+            // 4.3 for gpu_cull, the other scenes run on 3.3
+            unique_ptr<HeadlessSurface> surface;
+            try {
+                surface = make_unique<HeadlessSurface>(options.size, 4, 3);
+            }
+            catch (const runtime_error &) {
+                surface = make_unique<HeadlessSurface>(options.size);
+            }
+            results = runAll(*surface, options);
+            renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+        }
+
+        if (!options.json.empty()) {
+            ofstream out(options.json);
+            writeJson(out, results, options, renderer.c_str());
+            cout << "Wrote " << options.json << endl;
+        }
+    }
+    catch (const exception & e) {
+        cerr << "scene_bench: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}